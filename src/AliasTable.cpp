@@ -0,0 +1,88 @@
+#include "AliasTable.hpp"
+
+#include <cstddef>
+
+//=======================================================================
+//function : Build
+//purpose  :
+//=======================================================================
+bool AliasTable::Build (const std::vector<float>& theWeights)
+{
+  Clear();
+
+  double aTotal = 0.0;
+  for (size_t anIdx = 0; anIdx < theWeights.size(); ++anIdx)
+  {
+    aTotal += theWeights[anIdx] > 0.f ? theWeights[anIdx] : 0.f;
+  }
+
+  if (aTotal <= 0.0)
+  {
+    return false;
+  }
+
+  const int aSize = static_cast<int> (theWeights.size());
+
+  myTotal = static_cast<float> (aTotal);
+  myCells.resize (aSize);
+
+  // Scaled probabilities (mean is 1) split into under- and overfull cells
+  std::vector<double> aScaled (aSize);
+  std::vector<int>    aSmall;
+  std::vector<int>    aLarge;
+
+  for (int anIdx = 0; anIdx < aSize; ++anIdx)
+  {
+    const double aWeight = theWeights[anIdx] > 0.f ? theWeights[anIdx] : 0.f;
+
+    myCells[anIdx].Prob      = static_cast<float> (aWeight / aTotal);
+    myCells[anIdx].Threshold = 1.f;
+    myCells[anIdx].Alias     = anIdx;
+
+    aScaled[anIdx] = aWeight / aTotal * aSize;
+    (aScaled[anIdx] < 1.0 ? aSmall : aLarge).push_back (anIdx);
+  }
+
+  while (!aSmall.empty() && !aLarge.empty())
+  {
+    const int aLess = aSmall.back();
+    aSmall.pop_back();
+
+    const int aMore = aLarge.back();
+    aLarge.pop_back();
+
+    myCells[aLess].Threshold = static_cast<float> (aScaled[aLess]);
+    myCells[aLess].Alias     = aMore;
+
+    aScaled[aMore] -= 1.0 - aScaled[aLess];
+    (aScaled[aMore] < 1.0 ? aSmall : aLarge).push_back (aMore);
+  }
+
+  // Remaining cells are full up to rounding, except empty ones left without a partner
+  int aMaxIdx = 0;
+  for (int anIdx = 1; anIdx < aSize; ++anIdx)
+  {
+    aMaxIdx = myCells[anIdx].Prob > myCells[aMaxIdx].Prob ? anIdx : aMaxIdx;
+  }
+
+  for (size_t anIdx = 0; anIdx < aSmall.size(); ++anIdx)
+  {
+    if (myCells[aSmall[anIdx]].Prob <= 0.f)
+    {
+      myCells[aSmall[anIdx]].Threshold = 0.f;
+      myCells[aSmall[anIdx]].Alias     = aMaxIdx;
+    }
+  }
+
+  return true;
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void AliasTable::Clear()
+{
+  myCells.clear();
+  myTotal = 0.f;
+}
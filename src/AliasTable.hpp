@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+//! Walker's alias table for constant time sampling of discrete distribution.
+class AliasTable
+{
+public:
+
+  //! Creates empty table.
+  AliasTable() : myTotal (0.f) {}
+
+  //! Builds table for the given non-negative weights.
+  //! Returns false if all weights are zero (table remains empty).
+  bool Build (const std::vector<float>& theWeights);
+
+  //! Releases table.
+  void Clear();
+
+  //! Returns true if table is empty.
+  bool IsEmpty() const { return myCells.empty(); }
+
+  //! Returns number of entries.
+  int Size() const { return static_cast<int> (myCells.size()); }
+
+  //! Returns sum of weights.
+  float Total() const { return myTotal; }
+
+  //! Returns size of the table in bytes.
+  size_t MemorySize() const { return myCells.size() * sizeof (Cell); }
+
+  //! Samples entry by random number in [0, 1), returns its index and probability.
+  int Sample (float theU, float& theProb) const
+  {
+    const float aScaled = theU * static_cast<float> (myCells.size());
+
+    int anIdx = static_cast<int> (aScaled);
+    anIdx = anIdx < Size() ? anIdx : Size() - 1;
+
+    const Cell& aCell = myCells[anIdx];
+    if (aScaled - static_cast<float> (anIdx) >= aCell.Threshold)
+    {
+      anIdx = aCell.Alias;
+    }
+
+    theProb = myCells[anIdx].Prob;
+    return anIdx;
+  }
+
+  //! Same as above, additionally returns theU remapped to [0, 1) within the chosen
+  //! entry, so that the number can be reused for sampling inside the entry.
+  int Sample (float theU, float& theProb, float& theRemapped) const
+  {
+    const float aScaled = theU * static_cast<float> (myCells.size());
+
+    int anIdx = static_cast<int> (aScaled);
+    anIdx = anIdx < Size() ? anIdx : Size() - 1;
+
+    const Cell& aCell = myCells[anIdx];
+    const float aFrac = aScaled - static_cast<float> (anIdx);
+    if (aFrac >= aCell.Threshold)
+    {
+      anIdx = aCell.Alias;
+      theRemapped = (aFrac - aCell.Threshold) / (1.f - aCell.Threshold);
+    }
+    else
+    {
+      theRemapped = aFrac / aCell.Threshold;
+    }
+
+    theRemapped = theRemapped < 0.99999994f ? theRemapped : 0.99999994f;
+    theProb = myCells[anIdx].Prob;
+    return anIdx;
+  }
+
+  //! Returns probability of sampling the entry.
+  float Prob (int theIdx) const { return myCells[theIdx].Prob; }
+
+private:
+
+  //! Cell of the table.
+  struct Cell
+  {
+    float Threshold; //!< probability of keeping the cell (otherwise alias is returned)
+    float Prob;      //!< normalized probability of the entry
+    int   Alias;     //!< alternative entry
+  };
+
+  std::vector<Cell> myCells;
+  float             myTotal;
+
+};
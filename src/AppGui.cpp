@@ -1,5 +1,9 @@
 #include "AppGui.hpp"
 
+#include "HugePages.hpp"
+#include "Numa.hpp"
+#include "Renderer.hpp"
+
 #include <algorithm>
 
 #include "tinyfiledialogs.h"
@@ -9,10 +13,6 @@
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include <imgui_internal.h>
 
-#define TINYOBJLOADER_USE_DOUBLE
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
-
 #define SETTINGS_FILE "viewer_settings.ini"
 
 #define WAVE_MIN 380
@@ -28,6 +28,7 @@
 //purpose  :
 //=======================================================================
 AppGui::AppGui()
+: myRenderer (NULL)
 {
   char aPath[256];
   std::sprintf (aPath, "%s\\%s", getenv ("USERPROFILE"), SETTINGS_FILE);
@@ -84,9 +85,7 @@ bool Splitter (const ImVec2& size_arg)
 //=======================================================================
 static bool LayerItemGetter (void* theData, int theItem, const char** theName)
 {
-  static char aName[256];
-  sprintf_s (aName, 256, "Layer %d", theItem);
-  *theName = aName;
+  *theName = Framebuffer::LayerName (theItem);
 
   return true;
 };
@@ -179,9 +178,425 @@ void AppGui::Draw (int theScreenWidth, int theScreenHeight)
 
     // ---------------- User panels ---------------------
 
-    if (CollapsingHeader("Test", true))
+    if (myRenderer == NULL)
+    {
+      ImGui::End();
+      return;
+    }
+
+    if (CollapsingHeader ("Scene", true))
     {
-        ImGui::Button("Test button");
+      if (ImGui::Button ("Open OBJ..."))
+      {
+        const std::string aFileName = OpenFileDialog ("scene", "*.obj\0");
+        if (!aFileName.empty())
+        {
+          myRenderer->LoadScene (aFileName);
+        }
+      }
+
+      const Scene& aScene = myRenderer->CurrentScene();
+      ImGui::Text ("Triangles: %d", static_cast<int> (aScene.Triangles.size()));
+      if (aScene.NbShapes() > 0)
+      {
+        ImGui::Text ("Shapes:    %d spheres, %d discs, %d curves, %d patches", static_cast<int> (aScene.Spheres.size()),
+                                                                            static_cast<int> (aScene.Discs.size()),
+                                                                            static_cast<int> (aScene.Curves.size()),
+                                                                            static_cast<int> (aScene.Patches.size()));
+        ImGui::Text ("Shape BVH: %d nodes, %.1f MB", static_cast<int> (aScene.ShapeHierarchy().Nodes().size()),
+                                                    aScene.ShapeHierarchy().MemorySize() / (1024.0 * 1024.0));
+      }
+      ImGui::Text ("Materials: %d", static_cast<int> (aScene.Materials.size()));
+      ImGui::Text ("Emitters:  %d", static_cast<int> (aScene.Emitters().size()));
+      ImGui::Text ("Light BVH: %d nodes", static_cast<int> (aScene.LightHierarchy().Nodes().size()));
+      ImGui::Text ("BVH:       %d nodes, %d references", static_cast<int> (aScene.Hierarchy().Nodes().size()),
+                                                         static_cast<int> (aScene.Hierarchy().Indices().size()));
+      ImGui::Text ("BVH size:  %.1f MB", aScene.Hierarchy().MemorySize() / (1024.0 * 1024.0));
+      if (aScene.IsWideBvh())
+      {
+        ImGui::Text ("Wide BVH:  %d nodes, %.1f MB", static_cast<int> (aScene.WideHierarchy().Nodes().size()),
+                                                    aScene.WideHierarchy().MemorySize() / (1024.0 * 1024.0));
+      }
+      if (!aScene.PagedHierarchy().IsEmpty())
+      {
+        const PagedBvh&   aPaged = aScene.PagedHierarchy();
+        const PagingStats aStats = aPaged.Stats();
+        ImGui::Text ("Paged BVH: %d blocks, %d nodes, file %.1f MB", aStats.NbBlocks, aPaged.NbNodes(), aPaged.FileSize() / (1024.0 * 1024.0));
+        ImGui::Text ("Pages:     %d blocks touched (%.1f MB), %.1f MB resident, %d hints", aStats.NbTouched, aStats.TouchedBytes / (1024.0 * 1024.0),
+                                                                                     aStats.ResidentBytes / (1024.0 * 1024.0), static_cast<int> (aStats.NbPrefetched));
+      }
+      if (NumaTopology::Get().NbNodes() > 1)
+      {
+        ImGui::Text ("NUMA:      %d nodes, %d CPUs, %d replicas (%.1f MB)", NumaTopology::Get().NbNodes(), NumaTopology::Get().NbCpus(),
+                                                                          aScene.NbReplicas(), aScene.ReplicaSize() / (1024.0 * 1024.0));
+      }
+      if (myRenderer->IsHugePages())
+      {
+        const std::vector<HugePageRegion> aRegions = HugePages::Regions();
+
+        size_t aBytes = 0;
+        size_t aHugeBytes = 0;
+        for (size_t aRegionIdx = 0; aRegionIdx < aRegions.size(); ++aRegionIdx)
+        {
+          aBytes     += aRegions[aRegionIdx].Bytes;
+          aHugeBytes += aRegions[aRegionIdx].HugeBytes;
+        }
+        ImGui::Text ("Huge pages: %d regions, %.1f of %.1f MB backed", static_cast<int> (aRegions.size()),
+                                                                     aHugeBytes / (1024.0 * 1024.0), aBytes / (1024.0 * 1024.0));
+      }
+      if (aScene.HasMotion())
+      {
+        ImGui::Text ("Motion:    %d keys, %d nodes, %.1f MB", aScene.NbMotionKeys(), aScene.MotionHierarchy().NbNodes(),
+                                                             aScene.MotionHierarchy().MemorySize() / (1024.0 * 1024.0));
+      }
+
+      int aBvhMode = myRenderer->BvhBuildMode();
+      if (ImGui::Combo ("BVH build", &aBvhMode, [](void*, int theItem, const char** theName)
+                                                {
+                                                  *theName = Scene::BvhBuildName (theItem);
+                                                  return true;
+                                                }, NULL, BvhBuild_NB))
+      {
+        myRenderer->SetBvhBuildMode (static_cast<BvhBuild> (aBvhMode));
+      }
+
+      if (myRenderer->BvhBuildMode() == BvhBuild_Spatial)
+      {
+        float aGrowth = myRenderer->MaxReferenceGrowth();
+        if (ImGui::InputFloat ("Reference growth", &aGrowth, 0.25f, 1.f, 2, ImGuiInputTextFlags_EnterReturnsTrue))
+        {
+          myRenderer->SetMaxReferenceGrowth (aGrowth);
+        }
+      }
+
+      bool isOptimized = myRenderer->IsBvhOptimized();
+      if (ImGui::Checkbox ("Optimize BVH", &isOptimized))
+      {
+        myRenderer->SetBvhOptimization (isOptimized);
+      }
+
+      ImGui::SameLine();
+
+      bool isCaching = myRenderer->IsUsingBvhCache();
+      if (ImGui::Checkbox ("Cache BVH", &isCaching))
+      {
+        myRenderer->SetBvhCache (isCaching);
+      }
+
+      bool isWide = myRenderer->IsWideBvh();
+      if (ImGui::Checkbox ("8-wide compressed BVH", &isWide))
+      {
+        myRenderer->SetWideBvh (isWide);
+      }
+
+      if (!aScene.HasMotion())
+      {
+        bool isPaging = myRenderer->IsPaging();
+        if (ImGui::Checkbox ("Out-of-core BVH", &isPaging))
+        {
+          myRenderer->SetPaging (isPaging);
+        }
+
+        if (myRenderer->IsPaging())
+        {
+          ImGui::SameLine();
+
+          bool isPrefetching = myRenderer->IsPrefetching();
+          if (ImGui::Checkbox ("Prefetch", &isPrefetching))
+          {
+            myRenderer->SetPrefetch (isPrefetching);
+          }
+        }
+      }
+
+      if (NumaTopology::Get().NbNodes() > 1)
+      {
+        bool isPinning = myRenderer->IsNumaPinning();
+        if (ImGui::Checkbox ("Pin threads to NUMA nodes", &isPinning))
+        {
+          myRenderer->SetNumaPinning (isPinning);
+        }
+
+        ImGui::SameLine();
+
+        bool isReplicating = myRenderer->IsReplicating();
+        if (ImGui::Checkbox ("Replicate BVH", &isReplicating))
+        {
+          myRenderer->SetReplication (isReplicating);
+        }
+      }
+
+      bool isHugePages = myRenderer->IsHugePages();
+      if (ImGui::Checkbox ("Huge pages", &isHugePages))
+      {
+        myRenderer->SetHugePages (isHugePages);
+      }
+
+      if (aScene.HasMotion())
+      {
+        bool isInterpolated = myRenderer->IsMotionInterpolated();
+        if (ImGui::Checkbox ("Interpolated motion bounds", &isInterpolated))
+        {
+          myRenderer->SetMotionInterpolation (isInterpolated);
+        }
+      }
+
+      if (!aScene.Patches.empty())
+      {
+        int aLevel = myRenderer->TessellationLevel();
+        if (ImGui::SliderInt ("Tessellation level", &aLevel, 0, 8))
+        {
+          myRenderer->SetTessellationLevel (aLevel);
+        }
+
+        const TessellationCache& aCache = aScene.Tessellation();
+
+        int aBudget = static_cast<int> (aCache.Budget() >> 20);
+        if (ImGui::InputInt ("Cache budget (MB)", &aBudget, 16, 128, ImGuiInputTextFlags_EnterReturnsTrue))
+        {
+          myRenderer->ChangeScene().ChangeTessellation().SetBudget (static_cast<size_t> (std::max (aBudget, 1)) << 20);
+        }
+
+        ImGui::Text ("Tess cache: %d / %d patches, %.1f MB", aCache.NbResident(), static_cast<int> (aScene.Patches.size()),
+                                                            aCache.MemoryUsed() / (1024.0 * 1024.0));
+        ImGui::Text ("Hit rate:  %.2f%% (%llu misses, %llu evicted)", 100.0 * aCache.HitRate(),
+                     static_cast<unsigned long long> (aCache.NbMisses()), static_cast<unsigned long long> (aCache.NbEvictions()));
+        ImGui::Text ("Tess time: %.1f ms (all threads)", aCache.TessellationTime());
+      }
+
+      int aLightMode = myRenderer->LightSamplingMode();
+      if (ImGui::Combo ("Light sampling", &aLightMode, [](void*, int theItem, const char** theName)
+                                                       {
+                                                         *theName = Scene::LightSamplingName (theItem);
+                                                         return true;
+                                                       }, NULL, LightSampling_NB))
+      {
+        myRenderer->SetLightSamplingMode (static_cast<LightSampling> (aLightMode));
+      }
+
+      if (ImGui::Button ("Open HDR..."))
+      {
+        const std::string aFileName = OpenFileDialog ("environment", "*.hdr\0*.pfm\0");
+        if (!aFileName.empty())
+        {
+          myRenderer->LoadEnvironment (aFileName);
+        }
+      }
+
+      const Environment& anEnv = aScene.EnvironmentLight();
+      if (!anEnv.IsEmpty())
+      {
+        ImGui::SameLine();
+        if (ImGui::Button ("Remove"))
+        {
+          myRenderer->ClearEnvironment();
+        }
+        else
+        {
+          ImGui::Text ("Environment: %dx%d", anEnv.SizeX(), anEnv.SizeY());
+
+          float anIntensity = myRenderer->EnvironmentIntensity();
+          if (ImGui::SliderFloat ("Intensity", &anIntensity, 0.f, 10.f, "%.2f", 2.f))
+          {
+            myRenderer->SetEnvironmentIntensity (anIntensity);
+          }
+        }
+      }
+    }
+
+    if (CollapsingHeader ("Rendering", true))
+    {
+      int aMode = myRenderer->Mode();
+      if (ImGui::Combo ("Integrator", &aMode, [](void*, int theItem, const char** theName)
+                                              {
+                                                *theName = Renderer::ModeName (theItem);
+                                                return true;
+                                              }, NULL, IntegratorMode_NB))
+      {
+        myRenderer->SetMode (static_cast<IntegratorMode> (aMode));
+      }
+
+      if (myRenderer->Mode() == IntegratorMode_Wavefront)
+      {
+        int anIsa = myRenderer->BsdfIsa();
+        if (ImGui::Combo ("BSDF kernels", &anIsa, [](void*, int theItem, const char** theName)
+                                                  {
+                                                    *theName = BsdfBatch::IsaName (theItem);
+                                                    return true;
+                                                  }, NULL, BsdfBatch::SupportedIsa() + 1))
+        {
+          myRenderer->SetBsdfIsa (static_cast<SimdIsa> (anIsa));
+        }
+
+        if (!myRenderer->CurrentScene().HasMotion())
+        {
+          bool isReordering = myRenderer->IsRayReordering();
+          if (ImGui::Checkbox ("Reorder rays by BVH subtree", &isReordering))
+          {
+            myRenderer->SetRayReordering (isReordering);
+          }
+        }
+      }
+
+      int aSampler = myRenderer->Sampler();
+      if (ImGui::Combo ("Sampler", &aSampler, [](void*, int theItem, const char** theName)
+                                              {
+                                                *theName = PathSampler::TypeName (theItem);
+                                                return true;
+                                              }, NULL, SamplerType_NB))
+      {
+        myRenderer->SetSampler (static_cast<SamplerType> (aSampler));
+      }
+
+      int aMaxDepth = myRenderer->MaxDepth();
+      if (ImGui::SliderInt ("Max depth", &aMaxDepth, 1, 32))
+      {
+        myRenderer->SetMaxDepth (aMaxDepth);
+      }
+
+      bool isBatching = myRenderer->IsBatchingShadows();
+      if (ImGui::Checkbox ("Batch shadow rays", &isBatching))
+      {
+        myRenderer->SetShadowBatching (isBatching);
+      }
+
+      float aScale = myRenderer->ResolutionScale();
+      if (ImGui::SliderFloat ("Resolution", &aScale, 0.1f, 1.f))
+      {
+        myRenderer->SetResolutionScale (aScale);
+      }
+
+      float anExposure = myRenderer->Exposure();
+      if (ImGui::SliderFloat ("Exposure", &anExposure, 0.01f, 16.f, "%.2f", 2.f))
+      {
+        myRenderer->SetExposure (anExposure);
+      }
+
+      float aTargetError = myRenderer->TargetError();
+      if (ImGui::SliderFloat ("Target error", &aTargetError, 0.f, 0.1f, aTargetError > 0.f ? "%.4f" : "off", 2.f))
+      {
+        myRenderer->SetTargetError (aTargetError);
+      }
+
+      int aMinSamples = myRenderer->MinSamples();
+      if (ImGui::SliderInt ("Min samples", &aMinSamples, 2, 64))
+      {
+        myRenderer->SetMinSamples (aMinSamples);
+      }
+
+      int aMaxSamples = myRenderer->MaxSamples();
+      if (ImGui::SliderInt ("Max samples", &aMaxSamples, 0, 4096, aMaxSamples > 0 ? "%.0f" : "unlimited"))
+      {
+        myRenderer->SetMaxSamples (aMaxSamples);
+      }
+
+      const Framebuffer& aFramebuffer = myRenderer->Accumulator();
+      ImGui::Text ("Threads:   %d", myRenderer->Pool().NbThreads());
+      ImGui::Text ("Size:      %d x %d", aFramebuffer.SizeX(), aFramebuffer.SizeY());
+      ImGui::Text ("Samples:   %d (%.1f average)", aFramebuffer.NbPasses(), aFramebuffer.AverageSamples());
+      ImGui::Text ("Tiles:     %d / %d active%s", static_cast<int> (aFramebuffer.ActiveTiles().size()), aFramebuffer.NbTiles(),
+                   myRenderer->IsConverged() ? " (converged)" : "");
+      ImGui::Text ("Pass time: %.1f ms", myRenderer->LastPassTime());
+      ImGui::Text ("Total:     %.1f s", myRenderer->AccumulatedTime() * 1.0e-3);
+      ImGui::Text ("Rays:      %.2f Mrays/s", myRenderer->LastPassRays() / (std::max (myRenderer->LastPassTime(), 1.0e-3) * 1.0e3));
+    }
+
+    if (CollapsingHeader ("Memory", false))
+    {
+      const MemoryStats& aMemory = myRenderer->Memory();
+      for (int aTagIdx = 0; aTagIdx < MemoryTag_NB; ++aTagIdx)
+      {
+        const MemoryTag aTag = static_cast<MemoryTag> (aTagIdx);
+        ImGui::Text ("%-13s %8.1f MB (peak %.1f MB)%s", MemoryStats::TagName (aTag), aMemory.Current (aTag) / (1024.0 * 1024.0),
+                     aMemory.Peak (aTag) / (1024.0 * 1024.0), aMemory.IsOverBudget (aTag) ? " over budget" : "");
+      }
+      ImGui::Text ("%-13s %8.1f MB (peak %.1f MB)", "total", aMemory.TotalCurrent() / (1024.0 * 1024.0), aMemory.TotalPeak() / (1024.0 * 1024.0));
+      ImGui::Text ("%-13s %8.1f MB (peak %.1f MB)", "process", MemoryStats::ProcessResident() / (1024.0 * 1024.0),
+                                                              MemoryStats::ProcessPeak() / (1024.0 * 1024.0));
+
+      // Caches are trimmed to the budget after each pass (0 - unlimited)
+      int aCacheBudget = static_cast<int> (aMemory.Budget (MemoryTag_Caches) >> 20);
+      if (ImGui::InputInt ("Caches budget (MB)", &aCacheBudget, 16, 128, ImGuiInputTextFlags_EnterReturnsTrue))
+      {
+        myRenderer->ChangeMemory().SetBudget (MemoryTag_Caches, static_cast<size_t> (std::max (aCacheBudget, 0)) << 20);
+        myRenderer->UpdateMemory();
+      }
+
+      if (ImGui::Button ("Reset peaks"))
+      {
+        myRenderer->ChangeMemory().ResetPeaks();
+      }
+    }
+
+    if (CollapsingHeader ("Path guiding", false))
+    {
+      bool isGuiding = myRenderer->IsGuiding();
+      if (ImGui::Checkbox ("Enabled", &isGuiding))
+      {
+        myRenderer->SetGuiding (isGuiding);
+      }
+
+      const PathGuide& aGuide = myRenderer->Guide();
+
+      float aBsdfFraction = aGuide.Params().BsdfFraction;
+      if (ImGui::SliderFloat ("BSDF fraction", &aBsdfFraction, 0.f, 1.f))
+      {
+        myRenderer->SetGuideBsdfFraction (aBsdfFraction);
+      }
+
+      if (myRenderer->IsGuiding())
+      {
+        ImGui::Text ("Iteration: %d / %d%s", aGuide.Iteration(), aGuide.Params().NbIterations, aGuide.IsLearning() ? " (learning)" : "");
+        ImGui::Text ("Leaves:    %d", aGuide.NbLeaves());
+        ImGui::Text ("Nodes:     %d", aGuide.NbDirectionalNodes());
+      }
+    }
+
+    if (CollapsingHeader ("Denoiser", true))
+    {
+      int anInterval = myRenderer->DenoiseInterval();
+      if (ImGui::SliderInt ("Every N samples", &anInterval, 0, 64, anInterval > 0 ? "%.0f" : "off"))
+      {
+        myRenderer->SetDenoiseInterval (anInterval);
+        myRenderer->InvalidateDenoised();
+      }
+
+      Denoiser& aDenoiser = myRenderer->ImageDenoiser();
+      DenoiserParams& aParams = aDenoiser.ChangeParams();
+
+      bool isChanged = false;
+      isChanged |= ImGui::SliderInt   ("Iterations",   &aParams.NbIterations, 1, 8);
+      isChanged |= ImGui::SliderFloat ("Sigma color",  &aParams.SigmaColor,  0.01f, 4.f, "%.3f", 2.f);
+      isChanged |= ImGui::SliderFloat ("Sigma normal", &aParams.SigmaNormal, 0.01f, 1.f, "%.3f", 2.f);
+      isChanged |= ImGui::SliderFloat ("Sigma depth",  &aParams.SigmaDepth,  0.01f, 1.f, "%.3f", 2.f);
+      isChanged |= ImGui::SliderFloat ("Sigma albedo", &aParams.SigmaAlbedo, 0.01f, 1.f, "%.3f", 2.f);
+
+      int anIsa = aDenoiser.Isa();
+      if (ImGui::Combo ("Kernels", &anIsa, [](void*, int theItem, const char** theName)
+                                           {
+                                             *theName = BsdfBatch::IsaName (theItem);
+                                             return true;
+                                           }, NULL, BsdfBatch::SupportedIsa() + 1))
+      {
+        aDenoiser.SetIsa (static_cast<SimdIsa> (anIsa));
+        isChanged = true;
+      }
+
+      if (isChanged)
+      {
+        myRenderer->InvalidateDenoised();
+      }
+
+      ImGui::Text ("Time:      %.1f ms", aDenoiser.LastTime());
+    }
+
+    if (CollapsingHeader ("Layers", true))
+    {
+      int aLayer = myRenderer->DisplayLayer();
+      if (ImGui::ListBox ("##Layers", &aLayer, LayerItemGetter, NULL, Layer_NB))
+      {
+        myRenderer->SetDisplayLayer (static_cast<FramebufferLayer> (aLayer));
+      }
     }
 
     ImGui::End();
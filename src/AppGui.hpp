@@ -4,6 +4,8 @@
 
 #include "Settings.hpp"
 
+class Renderer;
+
 //! Application GUI wrapper
 class AppGui
 {
@@ -21,8 +23,13 @@ public:
 
   void HandleFileDrop (const char* thePath);
 
+  //! Sets renderer controlled by the panel.
+  void SetRenderer (Renderer* theRenderer) { myRenderer = theRenderer; }
+
 private:
 
   std::unique_ptr<Settings> mySettings;
 
+  Renderer* myRenderer;
+
 };
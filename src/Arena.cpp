@@ -0,0 +1,200 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+  //! Number of counted heap allocations.
+  std::atomic<uint64_t> THE_NB_ALLOCATIONS (0);
+
+  //! Depth of AllocationCounter::Ignore scopes of the calling thread.
+  thread_local int THE_IGNORE_DEPTH = 0;
+}
+
+#ifdef RAYLAB_COUNT_ALLOCATIONS
+
+//=======================================================================
+//function : operator new
+//purpose  : Counts allocations
+//=======================================================================
+void* operator new (size_t theBytes)
+{
+  if (THE_IGNORE_DEPTH == 0)
+  {
+    THE_NB_ALLOCATIONS.fetch_add (1, std::memory_order_relaxed);
+  }
+
+  void* aPtr = std::malloc (theBytes != 0 ? theBytes : 1);
+  if (aPtr == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return aPtr;
+}
+
+//=======================================================================
+//function : operator new[]
+//purpose  :
+//=======================================================================
+void* operator new[] (size_t theBytes)
+{
+  return operator new (theBytes);
+}
+
+//=======================================================================
+//function : operator delete
+//purpose  :
+//=======================================================================
+void operator delete (void* thePtr) noexcept
+{
+  std::free (thePtr);
+}
+
+//=======================================================================
+//function : operator delete[]
+//purpose  :
+//=======================================================================
+void operator delete[] (void* thePtr) noexcept
+{
+  std::free (thePtr);
+}
+
+//=======================================================================
+//function : operator delete
+//purpose  :
+//=======================================================================
+void operator delete (void* thePtr, size_t) noexcept
+{
+  std::free (thePtr);
+}
+
+//=======================================================================
+//function : operator delete[]
+//purpose  :
+//=======================================================================
+void operator delete[] (void* thePtr, size_t) noexcept
+{
+  std::free (thePtr);
+}
+
+#endif
+
+//=======================================================================
+//function : Arena
+//purpose  :
+//=======================================================================
+Arena::Arena (size_t theBlockSize)
+: myCurrent (nullptr),
+  myEnd (nullptr),
+  myBlockSize (theBlockSize),
+  myUsed (0),
+  myCapacity (0)
+{
+  //
+}
+
+//=======================================================================
+//function : addBlock
+//purpose  :
+//=======================================================================
+void Arena::addBlock (size_t theBytes)
+{
+  const size_t aSize = std::max (theBytes, myBlockSize);
+
+  myBlocks.push_back (std::unique_ptr<char[]> (new char[aSize]));
+  myBlockSizes.push_back (aSize);
+
+  myCurrent   = myBlocks.back().get();
+  myEnd       = myCurrent + aSize;
+  myCapacity += aSize;
+
+  // Blocks grow geometrically, so that the last one soon fits the whole pass
+  myBlockSize = std::max (myBlockSize, aSize) * 2;
+}
+
+//=======================================================================
+//function : Reset
+//purpose  :
+//=======================================================================
+void Arena::Reset()
+{
+  myUsed = 0;
+  if (myBlocks.empty())
+  {
+    return;
+  }
+
+  // Blocks grow geometrically, so the last one is kept as the largest; releasing
+  // the others doesn't allocate, unlike merging them into the new block
+  if (myBlocks.size() > 1)
+  {
+    myBlocks.erase (myBlocks.begin(), myBlocks.end() - 1);
+    myBlockSizes.erase (myBlockSizes.begin(), myBlockSizes.end() - 1);
+    myCapacity = myBlockSizes.front();
+  }
+
+  myCurrent = myBlocks.front().get();
+  myEnd     = myCurrent + myBlockSizes.front();
+}
+
+//=======================================================================
+//function : Reserve
+//purpose  :
+//=======================================================================
+void Arena::Reserve (size_t theBytes)
+{
+  Reset();
+  if (myBlocks.empty() ? theBytes == 0 : myBlockSizes.front() >= theBytes)
+  {
+    return;
+  }
+
+  // Block is replaced rather than added, so that the arena stays single block
+  myBlocks.clear();
+  myBlockSizes.clear();
+  myCapacity = 0;
+  addBlock (theBytes);
+}
+
+//=======================================================================
+//function : IsAvailable
+//purpose  :
+//=======================================================================
+bool AllocationCounter::IsAvailable()
+{
+#ifdef RAYLAB_COUNT_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+//=======================================================================
+//function : Count
+//purpose  :
+//=======================================================================
+uint64_t AllocationCounter::Count()
+{
+  return THE_NB_ALLOCATIONS;
+}
+
+//=======================================================================
+//function : Ignore
+//purpose  :
+//=======================================================================
+AllocationCounter::Ignore::Ignore()
+{
+  ++THE_IGNORE_DEPTH;
+}
+
+//=======================================================================
+//function : ~Ignore
+//purpose  :
+//=======================================================================
+AllocationCounter::Ignore::~Ignore()
+{
+  --THE_IGNORE_DEPTH;
+}
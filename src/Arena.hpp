@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Heap allocations are counted in debug builds (or when requested explicitly)
+#if defined(_DEBUG) && !defined(RAYLAB_COUNT_ALLOCATIONS)
+  #define RAYLAB_COUNT_ALLOCATIONS
+#endif
+
+//! Bump allocator for transient data of one thread (ray batches, path state, shading scratch).
+//! Memory is taken from blocks allocated on demand and released all at once by Reset(),
+//! which keeps the largest block, so that after the first passes the arena serves
+//! the same requests without touching the heap. Destructors of elements are not called.
+class Arena
+{
+public:
+
+  //! Default size of the first block.
+  static const size_t DefaultBlockSize = 64 * 1024;
+
+  //! Creates empty arena (the first block is allocated on demand).
+  explicit Arena (size_t theBlockSize = DefaultBlockSize);
+
+  //! Returns memory of theBytes aligned to theAlign (power of two up to 64).
+  void* Allocate (size_t theBytes, size_t theAlign = 16)
+  {
+    uintptr_t aStart = (reinterpret_cast<uintptr_t> (myCurrent) + theAlign - 1) & ~static_cast<uintptr_t> (theAlign - 1);
+    if (myCurrent == nullptr || aStart + theBytes > reinterpret_cast<uintptr_t> (myEnd))
+    {
+      addBlock (theBytes + theAlign);
+      aStart = (reinterpret_cast<uintptr_t> (myCurrent) + theAlign - 1) & ~static_cast<uintptr_t> (theAlign - 1);
+    }
+
+    myCurrent = reinterpret_cast<char*> (aStart + theBytes);
+    myUsed   += theBytes;
+    return reinterpret_cast<void*> (aStart);
+  }
+
+  //! Returns array of theCount elements left unwritten (elements must be written before use).
+  template<class T>
+  T* Allocate (size_t theCount)
+  {
+    static_assert (std::is_trivially_copyable<T>::value, "arena elements are neither constructed nor destroyed");
+    return static_cast<T*> (Allocate (theCount * sizeof (T), alignof (T) > 16 ? alignof (T) : 16));
+  }
+
+  //! Returns bytes taken by Allocate<T> (theCount) in the worst case of alignment.
+  template<class T>
+  static size_t Footprint (size_t theCount)
+  {
+    return theCount * sizeof (T) + (alignof (T) > 16 ? alignof (T) : 16);
+  }
+
+  //! Releases all allocations. Only the largest (the last) block is kept.
+  void Reset();
+
+  //! Releases all allocations and makes the kept block hold at least theBytes, so that
+  //! scratch up to this size never touches the heap (called between passes, as Reset()).
+  void Reserve (size_t theBytes);
+
+  //! Returns bytes allocated since the last reset.
+  size_t Used() const { return myUsed; }
+
+  //! Returns bytes of all blocks.
+  size_t Capacity() const { return myCapacity; }
+
+private:
+
+  //! Opens new block fitting at least theBytes.
+  void addBlock (size_t theBytes);
+
+  //! Position in the current block to rewind to.
+  struct Mark
+  {
+    size_t Block;
+    char*  Current;
+    size_t Used;
+  };
+
+  friend class ArenaScope;
+
+private:
+
+  std::vector<std::unique_ptr<char[]> > myBlocks;
+  std::vector<size_t>                   myBlockSizes;
+
+  char*  myCurrent;   //!< first free byte of the last block
+  char*  myEnd;       //!< end of the last block
+  size_t myBlockSize; //!< size of the next block
+  size_t myUsed;
+  size_t myCapacity;
+
+};
+
+//! Releases allocations made in the scope (e.g. scratch of one tile) on destruction.
+//! Blocks added in the scope are kept until Arena::Reset().
+class ArenaScope
+{
+public:
+
+  //! Remembers the current position of theArena.
+  explicit ArenaScope (Arena& theArena)
+  : myArena (theArena)
+  {
+    myMark.Block   = theArena.myBlocks.size();
+    myMark.Current = theArena.myCurrent;
+    myMark.Used    = theArena.myUsed;
+  }
+
+  //! Rewinds the arena (only within the same block).
+  ~ArenaScope()
+  {
+    if (myArena.myBlocks.size() == myMark.Block)
+    {
+      myArena.myCurrent = myMark.Current;
+    }
+    myArena.myUsed = myMark.Used;
+  }
+
+private:
+
+  ArenaScope (const ArenaScope&);
+  ArenaScope& operator= (const ArenaScope&);
+
+private:
+
+  Arena&      myArena;
+  Arena::Mark myMark;
+
+};
+
+//! Counter of heap allocations (operator new) of all threads. Counting replaces global operator new
+//! and is compiled only with RAYLAB_COUNT_ALLOCATIONS (defined in debug builds).
+class AllocationCounter
+{
+public:
+
+  //! Returns true if allocations are counted.
+  static bool IsAvailable();
+
+  //! Returns number of counted allocations since start.
+  static uint64_t Count();
+
+  //! Excludes allocations of the calling thread within the scope (growth of persistent
+  //! structures such as caches and trained trees, not transient data).
+  class Ignore
+  {
+  public:
+    Ignore();
+    ~Ignore();
+  private:
+    Ignore (const Ignore&);
+    Ignore& operator= (const Ignore&);
+  };
+
+};
@@ -0,0 +1,1541 @@
+#include "Benchmark.hpp"
+
+#include "Arena.hpp"
+#include "HugePages.hpp"
+#include "ImageIO.hpp"
+#include "Numa.hpp"
+#include "Random.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace
+{
+  //! Number of axis-aligned rays per side of the scene box checked for wide BVH.
+  const int THE_WIDE_CHECK_GRID = 32;
+
+  //! Computes RMS difference of two images.
+  double ComputeRmse (const std::vector<glm::vec4>& theImageA, const std::vector<glm::vec4>& theImageB)
+  {
+    if (theImageA.size() != theImageB.size() || theImageA.empty())
+    {
+      return 0.0;
+    }
+
+    double aSum = 0.0;
+    for (size_t anIdx = 0; anIdx < theImageA.size(); ++anIdx)
+    {
+      const glm::vec3 aDiff = glm::vec3 (theImageA[anIdx]) - glm::vec3 (theImageB[anIdx]);
+      aSum += glm::dot (aDiff, aDiff) / 3.0;
+    }
+
+    return std::sqrt (aSum / theImageA.size());
+  }
+
+  //! Escapes string for JSON output.
+  std::string EscapeJson (const std::string& theString)
+  {
+    std::string aResult;
+    for (size_t anIdx = 0; anIdx < theString.size(); ++anIdx)
+    {
+      if (theString[anIdx] == '\\' || theString[anIdx] == '"')
+      {
+        aResult += '\\';
+      }
+      aResult += theString[anIdx];
+    }
+
+    return aResult;
+  }
+
+  //! Inserts suffix before file extension.
+  std::string AddSuffix (const std::string& theFileName, const std::string& theSuffix)
+  {
+    const size_t aDot = theFileName.find_last_of ('.');
+    if (aDot == std::string::npos)
+    {
+      return theFileName + theSuffix;
+    }
+
+    return theFileName.substr (0, aDot) + theSuffix + theFileName.substr (aDot);
+  }
+
+  //! Moves vertices of the rest pose by travelling wave along the largest extent of the scene.
+  void DeformPositions (const std::vector<glm::vec3>& theRest,
+                        const Box&                    theBounds,
+                        float                         thePhase,
+                        std::vector<glm::vec3>&       thePositions)
+  {
+    const glm::vec3 aSize = theBounds.Size();
+    const int anAxis = aSize.x >= aSize.y ? (aSize.x >= aSize.z ? 0 : 2) : (aSize.y >= aSize.z ? 1 : 2);
+    const int anUp   = (anAxis + 1) % 3;
+
+    const float anAmplitude = aSize[anAxis] * 0.02f;
+    const float aFrequency  = 4.f * 3.14159265f / std::max (aSize[anAxis], FLT_MIN);
+
+    for (size_t anIdx = 0; anIdx < theRest.size(); ++anIdx)
+    {
+      thePositions[anIdx] = theRest[anIdx];
+      thePositions[anIdx][anUp] += anAmplitude * std::sin (theRest[anIdx][anAxis] * aFrequency + thePhase);
+    }
+  }
+
+  //! Returns transformations at evenly spaced motion keys: translation by theOffset and
+  //! rotation by theSpin degrees about the vertical axis through the center of vertices.
+  std::vector<glm::mat4> MotionKeys (const std::vector<glm::vec3>& thePositions,
+                                     const glm::vec3&              theOffset,
+                                     float                         theSpin,
+                                     int                           theNbKeys)
+  {
+    Box aBounds;
+    for (size_t anIdx = 0; anIdx < thePositions.size(); ++anIdx)
+    {
+      aBounds.Add (thePositions[anIdx]);
+    }
+    const glm::vec3 aCenter = aBounds.IsValid() ? aBounds.Center() : glm::vec3 (0.f);
+
+    std::vector<glm::mat4> aKeys (theNbKeys);
+    for (int aKey = 0; aKey < theNbKeys; ++aKey)
+    {
+      const float aTime = static_cast<float> (aKey) / (theNbKeys - 1);
+      aKeys[aKey] = glm::translate (glm::mat4 (1.f), aCenter + theOffset * aTime)
+                  * glm::rotate (glm::mat4 (1.f), glm::radians (theSpin * aTime), glm::vec3 (0.f, 1.f, 0.f))
+                  * glm::translate (glm::mat4 (1.f), -aCenter);
+    }
+
+    return aKeys;
+  }
+
+  //! Adds shapes with random placement inside the scene bounds: particles (spheres and discs)
+  //! and hair strands (curves). With theToTessellate they are added as triangle meshes.
+  void AddRandomShapes (Scene& theScene, int theNbSpheres, int theNbDiscs, int theNbCurves, bool theToTessellate)
+  {
+    const Box       aBounds = theScene.Bounds();
+    const glm::vec3 aSize   = aBounds.IsValid() ? aBounds.Size() : glm::vec3 (1.f);
+    const glm::vec3 aMin    = aBounds.IsValid() ? aBounds.Min : glm::vec3 (-0.5f);
+    const float     aDiag   = glm::length (aSize);
+
+    Material aMaterial;
+    aMaterial.Diffuse = glm::vec3 (0.7f, 0.5f, 0.3f);
+    theScene.Materials.push_back (aMaterial);
+    const int aMatIdx = static_cast<int> (theScene.Materials.size()) - 1;
+
+    Pcg32 aRandom (7);
+    auto aPoint = [&]()
+    {
+      return aMin + aSize * glm::vec3 (aRandom.NextFloat(), aRandom.NextFloat(), aRandom.NextFloat());
+    };
+    auto aDirection = [&]()
+    {
+      const float aZ   = 2.f * aRandom.NextFloat() - 1.f;
+      const float aPhi = 2.f * 3.14159265f * aRandom.NextFloat();
+      const float aR   = std::sqrt (std::max (0.f, 1.f - aZ * aZ));
+      return glm::vec3 (aR * std::cos (aPhi), aR * std::sin (aPhi), aZ);
+    };
+
+    // Mesh vertices get normals and texture coordinates only if the scene has them
+    auto anAddVertex = [&](const glm::vec3& thePos, const glm::vec3& theNormal)
+    {
+      if (!theScene.Normals.empty())
+      {
+        theScene.Normals.push_back (theNormal);
+      }
+      if (!theScene.TexCoords.empty())
+      {
+        theScene.TexCoords.push_back (glm::vec2 (0.f));
+      }
+      theScene.Positions.push_back (thePos);
+      return static_cast<int> (theScene.Positions.size()) - 1;
+    };
+
+    // Tubes and spheres are tessellated as grids of rings
+    auto anAddGrid = [&](int theFirst, int theNbRings, int theNbSides)
+    {
+      for (int aRing = 0; aRing + 1 < theNbRings; ++aRing)
+      {
+        for (int aSide = 0; aSide < theNbSides; ++aSide)
+        {
+          const int aV00 = theFirst + aRing * (theNbSides + 1) + aSide;
+          const int aV10 = aV00 + theNbSides + 1;
+          theScene.Triangles.push_back (glm::ivec4 (aV00, aV10, aV00 + 1, aMatIdx));
+          theScene.Triangles.push_back (glm::ivec4 (aV00 + 1, aV10, aV10 + 1, aMatIdx));
+        }
+      }
+    };
+
+    const int aNbSides = 16;
+    for (int anIdx = 0; anIdx < theNbSpheres; ++anIdx)
+    {
+      const Sphere aSphere (aPoint(), aDiag * (0.002f + 0.002f * aRandom.NextFloat()), aMatIdx);
+      if (!theToTessellate)
+      {
+        theScene.Spheres.push_back (aSphere);
+        continue;
+      }
+
+      const int aFirst = static_cast<int> (theScene.Positions.size());
+      for (int aRing = 0; aRing <= aNbSides / 2; ++aRing)
+      {
+        const float aTheta = 3.14159265f * aRing / (aNbSides / 2);
+        for (int aSide = 0; aSide <= aNbSides; ++aSide)
+        {
+          const float aPhi = 2.f * 3.14159265f * aSide / aNbSides;
+          const glm::vec3 aNormal (std::sin (aTheta) * std::cos (aPhi), std::cos (aTheta), std::sin (aTheta) * std::sin (aPhi));
+          anAddVertex (aSphere.Center + aNormal * aSphere.Radius, aNormal);
+        }
+      }
+      anAddGrid (aFirst, aNbSides / 2 + 1, aNbSides);
+    }
+
+    for (int anIdx = 0; anIdx < theNbDiscs; ++anIdx)
+    {
+      const Disc aDisc (aPoint(), aDirection(), aDiag * 0.006f, aMatIdx);
+      if (!theToTessellate)
+      {
+        theScene.Discs.push_back (aDisc);
+        continue;
+      }
+
+      glm::vec3 aX, aY;
+      ShapeBasis (aDisc.Normal, aX, aY);
+
+      const int aCenter = anAddVertex (aDisc.Center, aDisc.Normal);
+      for (int aSide = 0; aSide < aNbSides; ++aSide)
+      {
+        const float aPhi = 2.f * 3.14159265f * aSide / aNbSides;
+        anAddVertex (aDisc.Center + (aX * std::cos (aPhi) + aY * std::sin (aPhi)) * aDisc.Radius, aDisc.Normal);
+        theScene.Triangles.push_back (glm::ivec4 (aCenter, aCenter + 1 + aSide, aCenter + 1 + (aSide + 1) % aNbSides, aMatIdx));
+      }
+    }
+
+    // Strands grow upwards with random bends
+    const int aNbStrandSides = 8;
+    const int aNbStrandRings = 9;
+    for (int anIdx = 0; anIdx < theNbCurves; ++anIdx)
+    {
+      const float aLength = aDiag * 0.05f;
+      const glm::vec3 aGrowth = glm::normalize (glm::vec3 (0.f, 1.f, 0.f) + aDirection() * 0.5f) * aLength;
+
+      Curve aCurve;
+      aCurve.Points[0] = aPoint();
+      for (int aPnt = 1; aPnt < 4; ++aPnt)
+      {
+        aCurve.Points[aPnt] = aCurve.Points[0] + aGrowth * (aPnt / 3.f) + aDirection() * (aLength * 0.15f);
+      }
+      aCurve.Radius0  = aDiag * 0.0006f;
+      aCurve.Radius1  = aDiag * 0.0002f;
+      aCurve.Material = aMatIdx;
+      if (!theToTessellate)
+      {
+        theScene.Curves.push_back (aCurve);
+        continue;
+      }
+
+      const int aFirst = static_cast<int> (theScene.Positions.size());
+      for (int aRing = 0; aRing < aNbStrandRings; ++aRing)
+      {
+        const float aT = static_cast<float> (aRing) / (aNbStrandRings - 1);
+
+        glm::vec3 aX, aY;
+        ShapeBasis (glm::normalize (aCurve.Derivative (aT)), aX, aY);
+        for (int aSide = 0; aSide <= aNbStrandSides; ++aSide)
+        {
+          const float aPhi = 2.f * 3.14159265f * aSide / aNbStrandSides;
+          const glm::vec3 aNormal = aX * std::cos (aPhi) + aY * std::sin (aPhi);
+          anAddVertex (aCurve.Evaluate (aT) + aNormal * aCurve.RadiusAt (aT), aNormal);
+        }
+      }
+      anAddGrid (aFirst, aNbStrandRings, aNbStrandSides);
+    }
+  }
+
+  //! Displaces non-emissive surfaces by procedural bumps of theHeight times the scene size:
+  //! their triangles become patches tessellated on demand. Planar texture coordinates
+  //! are generated if the scene has none.
+  void AddDisplacement (Scene& theScene, float theHeight)
+  {
+    const Box   aBounds = theScene.Bounds();
+    const float aDiag   = aBounds.IsValid() ? glm::length (aBounds.Size()) : 1.f;
+
+    const int aSize = 256;
+    std::vector<glm::vec4> aTexels (aSize * aSize);
+    for (int aY = 0; aY < aSize; ++aY)
+    {
+      for (int aX = 0; aX < aSize; ++aX)
+      {
+        const float aU = 2.f * 3.14159265f * aX / aSize;
+        const float aV = 2.f * 3.14159265f * aY / aSize;
+        const float aBumps = std::sin (8.f * aU) * std::sin (8.f * aV);
+        const float aRidges = std::sin (27.f * aU + 5.f * std::sin (3.f * aV));
+        aTexels[aY * aSize + aX] = glm::vec4 (glm::clamp (0.5f + 0.35f * aBumps + 0.15f * aRidges, 0.f, 1.f));
+      }
+    }
+
+    theScene.Textures.push_back (Texture());
+    theScene.Textures.back().Init (aSize, aSize, aTexels.data());
+    const int aTexture = static_cast<int> (theScene.Textures.size()) - 1;
+
+    for (size_t aMatIdx = 0; aMatIdx < theScene.Materials.size(); ++aMatIdx)
+    {
+      Material& aMaterial = theScene.Materials[aMatIdx];
+      if (!aMaterial.IsEmissive())
+      {
+        aMaterial.DisplacementTexture = aTexture;
+        aMaterial.DisplacementScale   = theHeight * aDiag;
+      }
+    }
+
+    // Projection direction is oblique to all axes, so no axis-aligned face gets degenerate mapping
+    if (theScene.TexCoords.empty())
+    {
+      theScene.TexCoords.resize (theScene.Positions.size());
+      for (size_t aVertIdx = 0; aVertIdx < theScene.Positions.size(); ++aVertIdx)
+      {
+        const glm::vec3 aPos = (theScene.Positions[aVertIdx] - aBounds.Min) * (4.f / aDiag);
+        theScene.TexCoords[aVertIdx] = glm::vec2 (aPos.x + 0.6f * aPos.z, aPos.y + 0.8f * aPos.z);
+      }
+    }
+
+    std::vector<glm::ivec4> aTriangles;
+    for (size_t aTrgIdx = 0; aTrgIdx < theScene.Triangles.size(); ++aTrgIdx)
+    {
+      const glm::ivec4& aTriangle = theScene.Triangles[aTrgIdx];
+      (theScene.Materials[aTriangle.w].IsDisplaced() ? theScene.Patches : aTriangles).push_back (aTriangle);
+    }
+    theScene.Triangles.swap (aTriangles);
+  }
+
+  //! Configuration of single measured run.
+  struct BenchmarkRun
+  {
+    IntegratorMode Mode;
+    SimdIsa        Isa;
+    SamplerType    Sampler;
+    bool           IsGuided;
+  };
+}
+
+//=======================================================================
+//function : IsRequested
+//purpose  :
+//=======================================================================
+bool Benchmark::IsRequested (int theArgc, char** theArgv)
+{
+  for (int anArg = 1; anArg < theArgc; ++anArg)
+  {
+    if (std::strcmp (theArgv[anArg], "--benchmark") == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//=======================================================================
+//function : PrintUsage
+//purpose  :
+//=======================================================================
+void Benchmark::PrintUsage()
+{
+  std::cout << "Usage: App --benchmark scene.obj [options]"                       << std::endl
+            << "  --size WxH                       image size (640x360)"            << std::endl
+            << "  --spp N                          samples per pixel (16)"          << std::endl
+            << "  --target-error E                 adaptive sampling error (off)"   << std::endl
+            << "  --min-spp N                      adaptive sampling minimum (8)"   << std::endl
+            << "  --denoise N                      run denoiser every N samples (off)" << std::endl
+            << "  --depth N                        maximum path depth (5)"          << std::endl
+            << "  --bvh binned|sbvh                BVH build algorithm (binned)"    << std::endl
+            << "  --ref-growth G                   SBVH references per triangle (1.5)" << std::endl
+            << "  --bvh-optimize on|off            BVH treelet restructuring (off)" << std::endl
+            << "  --bvh-cache on|off               reuse BVH cached next to scene (off)" << std::endl
+            << "  --bvh-wide on|off                compressed 8-wide BVH traversal (off)" << std::endl
+            << "  --paging on|off                  out-of-core BVH in memory-mapped file (off)" << std::endl
+            << "  --page-block KB                  size limit of paged block (64)"   << std::endl
+            << "  --prefetch on|off                hint paged blocks from ray queues (on)" << std::endl
+            << "  --reorder on|off                 bin wavefront rays by BVH subtree (off)" << std::endl
+            << "  --shadow-batch on|off            trace shadow rays per tile (on)" << std::endl
+            << "  --lights uniform|power|bvh       emitter selection (bvh)"         << std::endl
+            << "  --env file.hdr                   environment light (none)"        << std::endl
+            << "  --sampler random|sobol|bluenoise|all  sample generators (sobol)"  << std::endl
+            << "  --guiding off|on|all             path guiding (off)"              << std::endl
+            << "  --reference N                    error vs N spp reference (off)"  << std::endl
+            << "  --error-goal E                   time to reach error E vs reference (off)" << std::endl
+            << "  --threads N                      number of threads (all)"         << std::endl
+            << "  --numa on|off                    pin threads and replicate BVH per NUMA node (off)" << std::endl
+            << "  --replica-budget MB              memory limit of NUMA replicas (1024)" << std::endl
+            << "  --huge-pages on|off              back BVH, geometry and framebuffer with 2 MB pages (off)" << std::endl
+            << "  --integrator path|wavefront|all  integrators to compare (all)"    << std::endl
+            << "  --simd scalar|sse|avx2|all       BSDF kernels of wavefront (best)" << std::endl
+            << "  --deform N                       BVH refit vs build on N deformed frames (off)" << std::endl
+            << "  --spheres N                      add N random particles (0)"      << std::endl
+            << "  --discs N                        add N random discs (0)"          << std::endl
+            << "  --curves N                       add N random hair strands (0)"   << std::endl
+            << "  --tessellate on|off              add shapes and displaced patches as triangles (off)" << std::endl
+            << "  --displace H                     displace surfaces by H of scene size (off)" << std::endl
+            << "  --tess-level L                   subdivision level of displaced patches (5)" << std::endl
+            << "  --tess-cache MB                  tessellation cache budget (256)" << std::endl
+            << "  --cache-budget MB                memory budget of all caches (unlimited)" << std::endl
+            << "  --motion dx dy dz                scene translation over shutter (off)" << std::endl
+            << "  --spin DEG                       scene rotation over shutter (off)" << std::endl
+            << "  --motion-keys K                  motion keys of scene (2)"        << std::endl
+            << "  --motion-bounds linear|union     motion BVH node bounds (linear)" << std::endl
+            << "  --camera ex ey ez tx ty tz       camera position and target"      << std::endl
+            << "  --camera-end ex ey ez tx ty tz   camera at shutter close (off)"   << std::endl
+            << "  --json file                      write results in JSON format"    << std::endl
+            << "  --out file.pfm|file.ppm          write rendered image"            << std::endl;
+}
+
+//=======================================================================
+//function : Parse
+//purpose  :
+//=======================================================================
+bool Benchmark::Parse (int theArgc, char** theArgv)
+{
+  myOptions = BenchmarkOptions();
+
+  for (int anArg = 1; anArg < theArgc; ++anArg)
+  {
+    const std::string aKey (theArgv[anArg]);
+    const int aNbLeft = theArgc - anArg - 1;
+
+    if (aKey == "--benchmark" && aNbLeft >= 1)
+    {
+      myOptions.SceneFile = theArgv[++anArg];
+    }
+    else if (aKey == "--size" && aNbLeft >= 1)
+    {
+      if (std::sscanf (theArgv[++anArg], "%dx%d", &myOptions.SizeX, &myOptions.SizeY) != 2
+       || myOptions.SizeX <= 0 || myOptions.SizeY <= 0)
+      {
+        std::cout << "Error: invalid image size " << theArgv[anArg] << std::endl;
+        return false;
+      }
+    }
+    else if (aKey == "--spp" && aNbLeft >= 1)
+    {
+      myOptions.NbSamples = std::max (1, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--target-error" && aNbLeft >= 1)
+    {
+      myOptions.TargetError = std::max (0.f, static_cast<float> (std::atof (theArgv[++anArg])));
+    }
+    else if (aKey == "--min-spp" && aNbLeft >= 1)
+    {
+      myOptions.MinSamples = std::max (2, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--denoise" && aNbLeft >= 1)
+    {
+      myOptions.DenoiseInterval = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--depth" && aNbLeft >= 1)
+    {
+      myOptions.MaxDepth = std::max (1, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--bvh" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "binned" && aName != "sbvh")
+      {
+        std::cout << "Error: unknown BVH build " << aName << std::endl;
+        return false;
+      }
+      myOptions.BvhMode = aName == "sbvh" ? BvhBuild_Spatial : BvhBuild_Binned;
+    }
+    else if (aKey == "--ref-growth" && aNbLeft >= 1)
+    {
+      myOptions.RefGrowth = std::max (1.f, static_cast<float> (std::atof (theArgv[++anArg])));
+    }
+    else if ((aKey == "--bvh-optimize" || aKey == "--bvh-cache" || aKey == "--bvh-wide") && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "on" && aName != "off")
+      {
+        std::cout << "Error: unknown " << aKey.substr (2) << " setting " << aName << std::endl;
+        return false;
+      }
+      (aKey == "--bvh-optimize" ? myOptions.ToOptimizeBvh
+     : aKey == "--bvh-cache"    ? myOptions.ToCacheBvh
+                                : myOptions.ToUseWideBvh) = aName == "on";
+    }
+    else if ((aKey == "--paging" || aKey == "--prefetch" || aKey == "--reorder") && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "on" && aName != "off")
+      {
+        std::cout << "Error: unknown " << aKey.substr (2) << " setting " << aName << std::endl;
+        return false;
+      }
+      (aKey == "--paging"   ? myOptions.ToPageBvh
+     : aKey == "--prefetch" ? myOptions.ToPrefetch
+                            : myOptions.ToReorderRays) = aName == "on";
+    }
+    else if (aKey == "--page-block" && aNbLeft >= 1)
+    {
+      myOptions.PageBlockKb = std::max (1, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--shadow-batch" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "on" && aName != "off")
+      {
+        std::cout << "Error: unknown shadow batching setting " << aName << std::endl;
+        return false;
+      }
+      myOptions.BatchShadows = aName == "on";
+    }
+    else if (aKey == "--lights" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName == "uniform")
+      {
+        myOptions.Lights = LightSampling_Uniform;
+      }
+      else if (aName == "power")
+      {
+        myOptions.Lights = LightSampling_Power;
+      }
+      else if (aName == "bvh")
+      {
+        myOptions.Lights = LightSampling_Bvh;
+      }
+      else
+      {
+        std::cout << "Error: unknown light sampling " << aName << std::endl;
+        return false;
+      }
+    }
+    else if (aKey == "--env" && aNbLeft >= 1)
+    {
+      myOptions.EnvironmentFile = theArgv[++anArg];
+    }
+    else if (aKey == "--sampler" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName == "all")
+      {
+        for (int aType = 0; aType < SamplerType_NB; ++aType)
+        {
+          myOptions.Samplers.push_back (static_cast<SamplerType> (aType));
+        }
+      }
+      else if (aName == "random" || aName == "sobol" || aName == "bluenoise")
+      {
+        myOptions.Samplers.push_back (aName == "random" ? SamplerType_Random : (aName == "sobol" ? SamplerType_Sobol : SamplerType_BlueNoise));
+      }
+      else
+      {
+        std::cout << "Error: unknown sampler " << aName << std::endl;
+        return false;
+      }
+    }
+    else if (aKey == "--guiding" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName == "off" || aName == "all")
+      {
+        myOptions.Guiding.push_back (false);
+      }
+      if (aName == "on" || aName == "all")
+      {
+        myOptions.Guiding.push_back (true);
+      }
+      if (aName != "off" && aName != "on" && aName != "all")
+      {
+        std::cout << "Error: unknown guiding setting " << aName << std::endl;
+        return false;
+      }
+    }
+    else if (aKey == "--deform" && aNbLeft >= 1)
+    {
+      myOptions.NbDeformFrames = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--reference" && aNbLeft >= 1)
+    {
+      myOptions.ReferenceSpp = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--error-goal" && aNbLeft >= 1)
+    {
+      myOptions.ErrorGoal = std::max (0.f, static_cast<float> (std::atof (theArgv[++anArg])));
+    }
+    else if (aKey == "--threads" && aNbLeft >= 1)
+    {
+      myOptions.NbThreads = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--numa" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "on" && aName != "off")
+      {
+        std::cout << "Error: unknown " << aKey.substr (2) << " setting " << aName << std::endl;
+        return false;
+      }
+      myOptions.ToUseNuma = aName == "on";
+    }
+    else if (aKey == "--replica-budget" && aNbLeft >= 1)
+    {
+      myOptions.ReplicaBudgetMb = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--huge-pages" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "on" && aName != "off")
+      {
+        std::cout << "Error: unknown " << aKey.substr (2) << " setting " << aName << std::endl;
+        return false;
+      }
+      myOptions.ToUseHugePages = aName == "on";
+    }
+    else if (aKey == "--integrator" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName == "path")
+      {
+        myOptions.Modes.push_back (IntegratorMode_PathTracing);
+      }
+      else if (aName == "wavefront")
+      {
+        myOptions.Modes.push_back (IntegratorMode_Wavefront);
+      }
+      else if (aName != "all")
+      {
+        std::cout << "Error: unknown integrator " << aName << std::endl;
+        return false;
+      }
+    }
+    else if (aKey == "--simd" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName == "all")
+      {
+        for (int anIsa = 0; anIsa <= BsdfBatch::SupportedIsa(); ++anIsa)
+        {
+          myOptions.Isas.push_back (static_cast<SimdIsa> (anIsa));
+        }
+      }
+      else if (aName == "scalar" || aName == "sse" || aName == "avx2")
+      {
+        const SimdIsa anIsa = aName == "scalar" ? SimdIsa_Scalar : (aName == "sse" ? SimdIsa_Sse : SimdIsa_Avx2);
+        if (anIsa > BsdfBatch::SupportedIsa())
+        {
+          std::cout << "Error: " << aName << " is not supported by CPU" << std::endl;
+          return false;
+        }
+        myOptions.Isas.push_back (anIsa);
+      }
+      else
+      {
+        std::cout << "Error: unknown instruction set " << aName << std::endl;
+        return false;
+      }
+    }
+    else if ((aKey == "--spheres" || aKey == "--discs" || aKey == "--curves") && aNbLeft >= 1)
+    {
+      (aKey == "--spheres" ? myOptions.NbSpheres
+     : aKey == "--discs"   ? myOptions.NbDiscs
+                           : myOptions.NbCurves) = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--tessellate" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "on" && aName != "off")
+      {
+        std::cout << "Error: unknown tessellation setting " << aName << std::endl;
+        return false;
+      }
+      myOptions.ToTessellate = aName == "on";
+    }
+    else if (aKey == "--displace" && aNbLeft >= 1)
+    {
+      myOptions.Displacement = static_cast<float> (std::atof (theArgv[++anArg]));
+    }
+    else if (aKey == "--tess-level" && aNbLeft >= 1)
+    {
+      myOptions.TessLevel = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--tess-cache" && aNbLeft >= 1)
+    {
+      myOptions.TessCacheMb = std::max (1, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--cache-budget" && aNbLeft >= 1)
+    {
+      myOptions.CacheBudgetMb = std::max (0, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--motion" && aNbLeft >= 3)
+    {
+      for (int aComp = 0; aComp < 3; ++aComp)
+      {
+        myOptions.Motion[aComp] = static_cast<float> (std::atof (theArgv[++anArg]));
+      }
+    }
+    else if (aKey == "--spin" && aNbLeft >= 1)
+    {
+      myOptions.Spin = static_cast<float> (std::atof (theArgv[++anArg]));
+    }
+    else if (aKey == "--motion-keys" && aNbLeft >= 1)
+    {
+      myOptions.NbMotionKeys = std::max (2, std::atoi (theArgv[++anArg]));
+    }
+    else if (aKey == "--motion-bounds" && aNbLeft >= 1)
+    {
+      const std::string aName (theArgv[++anArg]);
+      if (aName != "linear" && aName != "union")
+      {
+        std::cout << "Error: unknown motion bounds " << aName << std::endl;
+        return false;
+      }
+      myOptions.ToLerpMotion = aName == "linear";
+    }
+    else if ((aKey == "--camera" || aKey == "--camera-end") && aNbLeft >= 6)
+    {
+      const bool isEnd = aKey == "--camera-end";
+      for (int aComp = 0; aComp < 3; ++aComp)
+      {
+        (isEnd ? myOptions.EyeEnd : myOptions.Eye)[aComp] = static_cast<float> (std::atof (theArgv[++anArg]));
+      }
+      for (int aComp = 0; aComp < 3; ++aComp)
+      {
+        (isEnd ? myOptions.TargetEnd : myOptions.Target)[aComp] = static_cast<float> (std::atof (theArgv[++anArg]));
+      }
+      (isEnd ? myOptions.HasCameraEnd : myOptions.HasCamera) = true;
+    }
+    else if (aKey == "--json" && aNbLeft >= 1)
+    {
+      myOptions.JsonFile = theArgv[++anArg];
+    }
+    else if (aKey == "--out" && aNbLeft >= 1)
+    {
+      myOptions.ImageFile = theArgv[++anArg];
+    }
+    else
+    {
+      std::cout << "Error: unknown or incomplete option " << aKey << std::endl;
+      return false;
+    }
+  }
+
+  if (myOptions.SceneFile.empty())
+  {
+    std::cout << "Error: scene file is not specified" << std::endl;
+    return false;
+  }
+
+  if (myOptions.Modes.empty())
+  {
+    for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+    {
+      myOptions.Modes.push_back (static_cast<IntegratorMode> (aMode));
+    }
+  }
+
+  if (myOptions.Isas.empty())
+  {
+    myOptions.Isas.push_back (BsdfBatch::SupportedIsa());
+  }
+
+  if (myOptions.Samplers.empty())
+  {
+    myOptions.Samplers.push_back (SamplerType_Sobol);
+  }
+
+  if (myOptions.Guiding.empty())
+  {
+    myOptions.Guiding.push_back (false);
+  }
+
+  if (myOptions.ErrorGoal > 0.f && myOptions.ReferenceSpp <= 0)
+  {
+    std::cout << "Error: --error-goal requires --reference" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//=======================================================================
+//function : Run
+//purpose  :
+//=======================================================================
+int Benchmark::Run()
+{
+  Renderer aRenderer (myOptions.NbThreads);
+  aRenderer.SetNumaPinning (myOptions.ToUseNuma);
+  aRenderer.SetHugePages (myOptions.ToUseHugePages);
+  if (!aRenderer.LoadScene (myOptions.SceneFile))
+  {
+    return 1;
+  }
+
+  if (!myOptions.EnvironmentFile.empty() && !aRenderer.LoadEnvironment (myOptions.EnvironmentFile))
+  {
+    return 1;
+  }
+
+  BenchmarkBvh aBvh;
+  {
+    const auto aStart = std::chrono::steady_clock::now();
+    aRenderer.ChangeScene().SetMaxReferenceGrowth (myOptions.RefGrowth);
+    aRenderer.ChangeScene().SetBvhBuildMode (myOptions.BvhMode);
+    aRenderer.ChangeScene().SetBvhOptimization (myOptions.ToOptimizeBvh);
+    aRenderer.ChangeScene().SetBvhCache (myOptions.ToCacheBvh);
+    aRenderer.ChangeScene().SetWideBvh (myOptions.ToUseWideBvh, aRenderer.Pool());
+    aRenderer.ChangeScene().SetPageBlockSize (myOptions.PageBlockKb << 10);
+    aRenderer.ChangeScene().SetPrefetch (myOptions.ToPrefetch);
+    aRenderer.ChangeScene().SetPaging (myOptions.ToPageBvh, aRenderer.Pool());
+    aRenderer.ChangeScene().SetReplicaBudget (static_cast<size_t> (myOptions.ReplicaBudgetMb) << 20);
+    aRenderer.ChangeScene().SetMotionInterpolation (myOptions.ToLerpMotion, aRenderer.Pool());
+    if (myOptions.NbSpheres + myOptions.NbDiscs + myOptions.NbCurves > 0)
+    {
+      AddRandomShapes (aRenderer.ChangeScene(), myOptions.NbSpheres, myOptions.NbDiscs, myOptions.NbCurves, myOptions.ToTessellate);
+    }
+    if (myOptions.Displacement != 0.f)
+    {
+      AddDisplacement (aRenderer.ChangeScene(), myOptions.Displacement);
+    }
+    aRenderer.ChangeScene().SetTessellationLevel (myOptions.TessLevel);
+    aRenderer.ChangeScene().ChangeTessellation().SetBudget (static_cast<size_t> (myOptions.TessCacheMb) << 20);
+    aRenderer.ChangeMemory().SetBudget (MemoryTag_Caches, static_cast<size_t> (myOptions.CacheBudgetMb) << 20);
+    aRenderer.UpdateMemory();
+    if (myOptions.ToTessellate)
+    {
+      aRenderer.ChangeScene().TessellatePatches();
+    }
+    if (myOptions.Motion != glm::vec3 (0.f) || myOptions.Spin != 0.f)
+    {
+      aRenderer.ChangeScene().SetTransformMotion (MotionKeys (aRenderer.CurrentScene().Positions, myOptions.Motion,
+                                                                 myOptions.Spin, myOptions.NbMotionKeys));
+    }
+    aRenderer.ChangeScene().Commit (aRenderer.Pool());
+    aRenderer.ChangeScene().SetReplication (myOptions.ToUseNuma);
+    aBvh.BuildMs  = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - aStart).count();
+    aBvh.IsCached = aRenderer.CurrentScene().IsBvhFromCache();
+  }
+
+  aRenderer.SetMaxDepth (myOptions.MaxDepth);
+  aRenderer.SetShadowBatching (myOptions.BatchShadows);
+  aRenderer.SetRayReordering (myOptions.ToReorderRays);
+  aRenderer.SetLightSamplingMode (myOptions.Lights);
+  aRenderer.SetMaxSamples (myOptions.NbSamples);
+  aRenderer.SetTargetError (myOptions.TargetError);
+  aRenderer.SetMinSamples (myOptions.MinSamples);
+  aRenderer.SetDenoiseInterval (myOptions.DenoiseInterval);
+
+  Camera aCamera;
+  aCamera.SetMode (FREE);
+  aCamera.SetViewport (0, 0, myOptions.SizeX, myOptions.SizeY);
+  aCamera.SetFOV (45);
+
+  aRenderer.FitCamera (aCamera);
+  if (myOptions.HasCamera)
+  {
+    aCamera.SetPosition (myOptions.Eye);
+    aCamera.SetLookAt (myOptions.Target);
+  }
+  aCamera.Update();
+
+  if (myOptions.HasCameraEnd)
+  {
+    Camera aCameraEnd = aCamera;
+    aCameraEnd.SetPosition (myOptions.EyeEnd);
+    aCameraEnd.SetLookAt (myOptions.TargetEnd);
+    aCameraEnd.Update();
+    aRenderer.SetCameraEnd (aCameraEnd);
+  }
+
+  std::cout << "Benchmark: " << myOptions.SceneFile << ", " << myOptions.SizeX << "x" << myOptions.SizeY
+            << ", " << myOptions.NbSamples << " spp, depth " << myOptions.MaxDepth
+            << ", " << Scene::LightSamplingName (myOptions.Lights) << " light sampling"
+            << ", " << aRenderer.Pool().NbThreads() << " threads" << std::endl;
+  if (myOptions.TargetError > 0.f)
+  {
+    std::cout << "Adaptive sampling: target error " << myOptions.TargetError
+              << ", at least " << myOptions.MinSamples << " spp" << std::endl;
+  }
+
+  const Bvh& aHierarchy = aRenderer.CurrentScene().Hierarchy();
+  aBvh.NbNodes      = static_cast<int> (aHierarchy.Nodes().size());
+  aBvh.NbReferences = static_cast<int> (aHierarchy.Indices().size());
+  aBvh.SahCost      = aHierarchy.SahCost();
+  aBvh.Bytes        = aHierarchy.MemorySize();
+  aBvh.NbWideNodes  = static_cast<int> (aRenderer.CurrentScene().WideHierarchy().Nodes().size());
+  aBvh.WideBytes    = aRenderer.CurrentScene().WideHierarchy().MemorySize();
+  aBvh.GeometryBytes = aRenderer.CurrentScene().GeometrySize();
+  aBvh.NbShapeNodes  = static_cast<int> (aRenderer.CurrentScene().ShapeHierarchy().Nodes().size());
+  aBvh.ShapeBytes    = aRenderer.CurrentScene().ShapeHierarchy().MemorySize();
+  aBvh.NbMotionNodes = aRenderer.CurrentScene().MotionHierarchy().NbNodes();
+  aBvh.MotionBytes   = aRenderer.CurrentScene().MotionHierarchy().MemorySize();
+  if (!aRenderer.CurrentScene().PagedHierarchy().IsEmpty())
+  {
+    const PagedBvh& aPaged = aRenderer.CurrentScene().PagedHierarchy();
+    aBvh.NbPagedBlocks  = static_cast<int> (aPaged.Blocks().size());
+    aBvh.NbPagedNodes   = aPaged.NbNodes();
+    aBvh.NbReferences   = aPaged.NbReferences();
+    aBvh.PagedFileBytes = aPaged.FileSize();
+    aBvh.PagedTopBytes  = aPaged.MemorySize();
+  }
+  aBvh.NbReplicas   = aRenderer.CurrentScene().NbReplicas();
+  aBvh.ReplicaBytes = aRenderer.CurrentScene().ReplicaSize();
+  measureTraversal (aRenderer.CurrentScene(), aCamera, aBvh);
+  if (myOptions.ToUseWideBvh)
+  {
+    checkWideTraversal (aRenderer.CurrentScene(), aBvh);
+  }
+
+  std::cout << "BVH: " << Scene::BvhBuildName (myOptions.BvhMode) << (myOptions.ToOptimizeBvh ? " + treelets" : "")
+            << (aBvh.IsCached ? " from cache" : "") << " in " << aBvh.BuildMs << " ms, "
+            << aBvh.NbNodes << " nodes, " << aBvh.NbReferences << " references, SAH cost " << aBvh.SahCost
+            << ", " << aBvh.Bytes / 1024 << " KB" << std::endl;
+  if (myOptions.ToUseWideBvh)
+  {
+    std::cout << "Wide BVH: " << aBvh.NbWideNodes << " nodes, " << aBvh.WideBytes / 1024 << " KB ("
+              << 100.0 * aBvh.WideBytes / std::max<size_t> (aBvh.Bytes, 1) << "% of binary)" << std::endl;
+    if (aBvh.NbWideMismatches > 0)
+    {
+      std::cout << "    Error: " << aBvh.NbWideMismatches << " of " << aBvh.NbWideChecked
+                << " axis-aligned rays miss primitives reached by binary BVH" << std::endl;
+    }
+  }
+  {
+    const Scene& aScene = aRenderer.CurrentScene();
+    std::cout << "Geometry: " << aScene.Triangles.size() << " triangles, " << aScene.Spheres.size() << " spheres, "
+              << aScene.Discs.size() << " discs, " << aScene.Curves.size() << " curves, " << aScene.Patches.size() << " patches, "
+              << aBvh.GeometryBytes / 1024 << " KB";
+    if (aBvh.NbShapeNodes > 0)
+    {
+      std::cout << ", shape BVH " << aBvh.NbShapeNodes << " nodes, " << aBvh.ShapeBytes / 1024 << " KB";
+    }
+    std::cout << std::endl;
+  }
+  if (aBvh.NbPagedBlocks > 0)
+  {
+    std::cout << "Paged BVH: " << aBvh.NbPagedBlocks << " blocks of up to " << myOptions.PageBlockKb << " KB, "
+              << aBvh.NbPagedNodes << " nodes, file " << aBvh.PagedFileBytes / 1024 << " KB, "
+              << aBvh.PagedTopBytes / 1024 << " KB in RAM, " << aBvh.BlocksPerRay << " blocks per ray" << std::endl;
+  }
+  if (myOptions.ToUseNuma)
+  {
+    const NumaTopology& aTopology = NumaTopology::Get();
+    std::cout << "NUMA: " << aTopology.NbNodes() << " nodes, " << aTopology.NbCpus() << " CPUs, threads "
+              << (aRenderer.Pool().IsPinned() ? "pinned" : "not pinned") << ", " << aBvh.NbReplicas << " replicas, "
+              << aBvh.ReplicaBytes / 1024 << " KB" << std::endl;
+  }
+  if (aBvh.NbMotionNodes > 0)
+  {
+    const MotionBvh& aMotion = aRenderer.CurrentScene().MotionHierarchy();
+    std::cout << "Motion BVH: " << aMotion.NbSegments() << " segments, " << (aMotion.IsLinear() ? "interpolated" : "union")
+              << " bounds, " << aBvh.NbMotionNodes << " nodes, " << aBvh.MotionBytes / 1024 << " KB" << std::endl;
+  }
+  std::cout << "Traversal: " << aBvh.NodesPerRay << " nodes and " << aBvh.TrianglesPerRay << " triangles per ray, "
+            << aBvh.NbRays << " rays in " << aBvh.TraversalMs << " ms" << std::endl;
+
+  BenchmarkRefit aRefit;
+  if (myOptions.NbDeformFrames > 0)
+  {
+    aRefit = measureRefit (aRenderer);
+
+    std::cout << "BVH refit: " << aRefit.NbFrames << " frames, " << aRefit.RefitMs << " ms/frame ("
+              << aRefit.NbRebuilt << " subtrees rebuilt), full build " << aRefit.BuildMs << " ms, SAH cost "
+              << aRefit.RefitCost << " refitted vs " << aRefit.BuildCost << " rebuilt" << std::endl;
+  }
+
+  std::vector<BenchmarkResult> aResults;
+  std::vector<glm::vec4>       aReference;
+  std::vector<glm::vec4>       anImage;
+
+  // Wavefront integrator is measured with each requested instruction set,
+  // every integrator with each requested sampler and guiding setting
+  std::vector<BenchmarkRun> aRuns;
+  for (size_t aGuidingIdx = 0; aGuidingIdx < myOptions.Guiding.size(); ++aGuidingIdx)
+  {
+    for (size_t aSamplerIdx = 0; aSamplerIdx < myOptions.Samplers.size(); ++aSamplerIdx)
+    {
+      for (size_t aModeIdx = 0; aModeIdx < myOptions.Modes.size(); ++aModeIdx)
+      {
+        const IntegratorMode aMode = myOptions.Modes[aModeIdx];
+        const size_t aNbIsas = aMode == IntegratorMode_Wavefront ? myOptions.Isas.size() : 1;
+        for (size_t anIsaIdx = 0; anIsaIdx < aNbIsas; ++anIsaIdx)
+        {
+          const BenchmarkRun aRun = { aMode, aMode == IntegratorMode_Wavefront ? myOptions.Isas[anIsaIdx] : BsdfBatch::SupportedIsa(),
+                                      myOptions.Samplers[aSamplerIdx], myOptions.Guiding[aGuidingIdx] };
+          aRuns.push_back (aRun);
+        }
+      }
+    }
+  }
+
+  // Converged image for equal-spp error comparison of the runs
+  std::vector<glm::vec4> aGroundTruth;
+  if (myOptions.ReferenceSpp > 0)
+  {
+    aRenderer.SetMode (aRuns.front().Mode);
+    aRenderer.SetBsdfIsa (aRuns.front().Isa);
+    aRenderer.SetSampler (SamplerType_Sobol);
+    aRenderer.SetGuiding (false);
+    aRenderer.SetMaxSamples (myOptions.ReferenceSpp);
+    aRenderer.SetTargetError (0.f);
+    aRenderer.SetDenoiseInterval (0);
+    aRenderer.Reset();
+
+    double aTimeMs = 0.0;
+    for (aRenderer.RenderPass (aCamera); !aRenderer.IsConverged(); aRenderer.RenderPass (aCamera))
+    {
+      aTimeMs += aRenderer.LastPassTime();
+    }
+    aRenderer.Accumulator().Resolve (Layer_Color, aGroundTruth);
+
+    std::cout << "Reference: " << myOptions.ReferenceSpp << " spp in " << aTimeMs << " ms" << std::endl;
+
+    aRenderer.SetMaxSamples (myOptions.NbSamples);
+    aRenderer.SetTargetError (myOptions.TargetError);
+    aRenderer.SetDenoiseInterval (myOptions.DenoiseInterval);
+  }
+
+  for (size_t aRunIdx = 0; aRunIdx < aRuns.size(); ++aRunIdx)
+  {
+    const BenchmarkRun& aRun = aRuns[aRunIdx];
+
+    aRenderer.SetMode (aRun.Mode);
+    aRenderer.SetBsdfIsa (aRun.Isa);
+    aRenderer.SetSampler (aRun.Sampler);
+    aRenderer.SetGuiding (aRun.IsGuided);
+    aRenderer.Reset();
+
+    BenchmarkResult aResult;
+    aResult.Name = Renderer::ModeName (aRun.Mode);
+    if (aRun.Mode == IntegratorMode_Wavefront)
+    {
+      aResult.Name += std::string (" (") + BsdfBatch::IsaName (aRun.Isa) + ")";
+    }
+    if (myOptions.Samplers.size() > 1)
+    {
+      aResult.Name += std::string (" [") + PathSampler::TypeName (aRun.Sampler) + "]";
+    }
+    if (myOptions.Guiding.size() > 1)
+    {
+      aResult.Name += aRun.IsGuided ? " +guiding" : "";
+    }
+    aResult.Sampler  = PathSampler::TypeName (aRun.Sampler);
+    aResult.IsGuided = aRun.IsGuided;
+
+    // Each run starts with empty tessellation cache and cold paged BVH
+    aRenderer.ChangeScene().ChangeTessellation().Clear();
+    aRenderer.CurrentScene().PagedHierarchy().ReleasePages();
+    aRenderer.ChangeScene().ChangePagedHierarchy().ResetStats();
+
+    // Renderer stops at the sample limit or when all tiles reach the target error;
+    // the first pass may grow buffers and arenas, later ones must not allocate
+    aResult.NbAllocations = AllocationCounter::IsAvailable() ? 0 : -1;
+    for (int aPassIdx = 0;; ++aPassIdx)
+    {
+      const uint64_t aNbAllocations = AllocationCounter::Count();
+      aRenderer.RenderPass (aCamera);
+      if (aPassIdx > 0 && AllocationCounter::IsAvailable())
+      {
+        aResult.NbAllocations += static_cast<int64_t> (AllocationCounter::Count() - aNbAllocations);
+      }
+      aResult.MemoryPeak = std::max (aResult.MemoryPeak, aRenderer.Memory().TotalCurrent());
+      if (aRenderer.IsConverged())
+      {
+        break;
+      }
+
+      aResult.TimeMs += aRenderer.LastPassTime();
+      aResult.NbRays += aRenderer.LastPassRays();
+      aResult.Rays   += aRenderer.LastPassStats();
+
+      BenchmarkFrame aFrame;
+      aFrame.TimeMs = aRenderer.LastPassTime();
+      aFrame.Rays   = aRenderer.LastPassStats();
+      aResult.Frames.push_back (aFrame);
+
+      // Error is measured between passes and excluded from the time
+      if (myOptions.ErrorGoal > 0.f && aResult.GoalMs < 0.0)
+      {
+        aRenderer.Accumulator().Resolve (Layer_Color, anImage);
+        if (ComputeRmse (aGroundTruth, anImage) <= myOptions.ErrorGoal)
+        {
+          aResult.GoalMs  = aResult.TimeMs;
+          aResult.GoalSpp = aRenderer.Accumulator().AverageSamples();
+        }
+      }
+    }
+
+    const Framebuffer& aFramebuffer = aRenderer.Accumulator();
+    aResult.NbPasses = aFramebuffer.NbPasses();
+    aResult.AvgSpp   = aFramebuffer.AverageSamples();
+    if (myOptions.DenoiseInterval > 0)
+    {
+      aResult.DenoiseMs = aRenderer.ImageDenoiser().LastTime();
+    }
+    aFramebuffer.Resolve (Layer_Color, anImage);
+
+    const TessellationCache& aTessCache = aRenderer.CurrentScene().Tessellation();
+    aResult.TessHitRate     = aTessCache.HitRate();
+    aResult.NbTessMisses    = aTessCache.NbMisses();
+    aResult.NbTessEvictions = aTessCache.NbEvictions();
+    aResult.TessMs          = aTessCache.TessellationTime();
+    aResult.TessBytes       = aTessCache.MemoryUsed();
+
+    const PagingStats aPaging = aRenderer.CurrentScene().PagedHierarchy().Stats();
+    aResult.NbTouchedBlocks = aPaging.NbTouched;
+    aResult.TouchedBytes    = aPaging.TouchedBytes;
+    aResult.ResidentBytes   = aPaging.ResidentBytes;
+    aResult.NbPrefetched    = aPaging.NbPrefetched;
+
+    if (aRunIdx == 0)
+    {
+      aReference = anImage;
+    }
+    else
+    {
+      aResult.Rmse = ComputeRmse (aReference, anImage);
+    }
+
+    if (!aGroundTruth.empty())
+    {
+      aResult.Error = ComputeRmse (aGroundTruth, anImage);
+    }
+
+    if (!myOptions.ImageFile.empty())
+    {
+      const std::string aFile = aRuns.size() > 1
+                              ? AddSuffix (myOptions.ImageFile, std::string ("_") + std::to_string (aRunIdx))
+                              : myOptions.ImageFile;
+
+      ImageIO::Save (aFile, aFramebuffer.SizeX(), aFramebuffer.SizeY(), anImage);
+
+      if (myOptions.DenoiseInterval > 0)
+      {
+        std::vector<glm::vec4> aDenoised;
+        aFramebuffer.Resolve (Layer_Denoised, aDenoised);
+        ImageIO::Save (AddSuffix (aFile, "_denoised"), aFramebuffer.SizeX(), aFramebuffer.SizeY(), aDenoised);
+      }
+    }
+
+    char aLine[256];
+    std::snprintf (aLine, sizeof (aLine), "  %-28s %10.1f ms %8.2f ms/pass %7.1f spp %12llu rays %8.2f Mrays/s",
+                   aResult.Name.c_str(), aResult.TimeMs, aResult.TimeMs / std::max (aResult.NbPasses, 1), aResult.AvgSpp,
+                   static_cast<unsigned long long> (aResult.NbRays), aResult.NbRays / (aResult.TimeMs * 1.0e3));
+    std::cout << aLine;
+    if (myOptions.DenoiseInterval > 0)
+    {
+      std::cout << "  denoise " << aResult.DenoiseMs << " ms";
+    }
+    if (!aGroundTruth.empty())
+    {
+      std::cout << "  error " << aResult.Error;
+    }
+    if (myOptions.ErrorGoal > 0.f)
+    {
+      if (aResult.GoalMs >= 0.0)
+      {
+        std::cout << "  goal in " << aResult.GoalMs << " ms (" << aResult.GoalSpp << " spp)";
+      }
+      else
+      {
+        std::cout << "  goal not reached";
+      }
+    }
+    if (aRunIdx != 0)
+    {
+      std::cout << "  (RMSE vs " << aResults.front().Name << ": " << aResult.Rmse << ")";
+    }
+    std::cout << std::endl;
+    {
+      const RayStats& aRays = aResult.Rays;
+      const double aNbTraced = static_cast<double> (std::max<uint64_t> (aRays.NbCameraRays + aRays.NbBounceRays, 1));
+      std::cout << "    rays: " << aRays.NbCameraRays << " camera, " << aRays.NbBounceRays << " bounce, " << aRays.NbShadowRays << " shadow; "
+                << aRays.NbNodes / aNbTraced << " nodes and " << aRays.NbTriangles / aNbTraced << " triangles per ray, "
+                << aRays.NbShadingCalls << " shading calls, " << aRays.NbSamples() / (aResult.TimeMs * 1.0e3) << " Msamples/s" << std::endl;
+    }
+    if (!aRenderer.CurrentScene().Patches.empty())
+    {
+      std::cout << "    tessellation: hit rate " << 100.0 * aResult.TessHitRate << "%, " << aResult.NbTessMisses << " patches tessellated in "
+                << aResult.TessMs << " ms, " << aResult.NbTessEvictions << " evicted, " << aResult.TessBytes / 1024 << " KB resident" << std::endl;
+    }
+    if (aBvh.NbPagedBlocks > 0)
+    {
+      std::cout << "    paging: " << aResult.NbTouchedBlocks << " of " << aBvh.NbPagedBlocks << " blocks touched ("
+                << aResult.TouchedBytes / 1024 << " KB), " << aResult.ResidentBytes / 1024 << " KB resident, "
+                << aResult.NbPrefetched << " prefetch hints" << std::endl;
+    }
+    if (aResult.NbAllocations > 0)
+    {
+      std::cout << "    Error: " << aResult.NbAllocations << " heap allocations in render loop after the first pass" << std::endl;
+    }
+
+    aResults.push_back (aResult);
+  }
+
+  // Huge pages are assigned on the first fault, so they are reported after rendering
+  if (myOptions.ToUseHugePages)
+  {
+    const std::vector<HugePageRegion> aRegions = HugePages::Regions();
+
+    size_t aBytes = 0;
+    size_t aHugeBytes = 0;
+    for (size_t aRegionIdx = 0; aRegionIdx < aRegions.size(); ++aRegionIdx)
+    {
+      aBytes     += aRegions[aRegionIdx].Bytes;
+      aHugeBytes += aRegions[aRegionIdx].HugeBytes;
+    }
+
+    std::cout << "Huge pages: mode " << HugePages::SystemMode() << ", " << aRegions.size() << " regions, "
+              << aHugeBytes / 1024 << " of " << aBytes / 1024 << " KB backed" << std::endl;
+    for (size_t aRegionIdx = 0; aRegionIdx < aRegions.size(); ++aRegionIdx)
+    {
+      std::cout << "    " << aRegions[aRegionIdx].Name << ": " << aRegions[aRegionIdx].HugeBytes / 1024 << " of "
+                << aRegions[aRegionIdx].Bytes / 1024 << " KB" << std::endl;
+    }
+  }
+
+  // Peaks are taken over all runs, peak of each run is kept in its result
+  const MemoryStats& aMemory = aRenderer.Memory();
+  std::cout << "Memory: " << aMemory.TotalCurrent() / 1024 << " KB accounted (peak " << aMemory.TotalPeak() / 1024 << " KB), process "
+            << MemoryStats::ProcessResident() / 1024 << " KB resident (peak " << MemoryStats::ProcessPeak() / 1024 << " KB)" << std::endl;
+  for (int aTagIdx = 0; aTagIdx < MemoryTag_NB; ++aTagIdx)
+  {
+    const MemoryTag aTag = static_cast<MemoryTag> (aTagIdx);
+    std::cout << "    " << MemoryStats::TagName (aTag) << ": " << aMemory.Current (aTag) / 1024 << " KB (peak " << aMemory.Peak (aTag) / 1024 << " KB";
+    if (aMemory.Budget (aTag) != 0)
+    {
+      std::cout << ", budget " << aMemory.Budget (aTag) / 1024 << " KB" << (aMemory.IsOverBudget (aTag) ? ", over budget" : "");
+    }
+    std::cout << ")" << std::endl;
+  }
+
+  if (!myOptions.JsonFile.empty() && !writeJson (aResults, aBvh, aRefit, aMemory))
+  {
+    return 1;
+  }
+
+  if (aBvh.NbWideMismatches > 0)
+  {
+    return 1;
+  }
+
+  // Run fails if render loop of any integrator hits the heap (debug builds)
+  for (size_t aResultIdx = 0; aResultIdx < aResults.size(); ++aResultIdx)
+  {
+    if (aResults[aResultIdx].NbAllocations > 0)
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+//=======================================================================
+//function : measureTraversal
+//purpose  :
+//=======================================================================
+void Benchmark::measureTraversal (const Scene& theScene, const Camera& theCamera, BenchmarkBvh& theBvh)
+{
+  TraversalStats aStats;
+  Pcg32 aRandom;
+
+  const auto aStart = std::chrono::steady_clock::now();
+
+  int aNbRays = 0;
+  for (int aY = 0; aY < theCamera.window_height; ++aY)
+  {
+    for (int aX = 0; aX < theCamera.window_width; ++aX)
+    {
+      Ray aRay;
+      theCamera.GenerateRay (theCamera.viewport_x + aX + 0.5f, theCamera.viewport_y + aY + 0.5f, aRay);
+      if (theScene.HasMotion())
+      {
+        aRay.Time = aRandom.NextFloat();
+      }
+
+      SurfaceHit aHit;
+      ++aNbRays;
+      if (!theScene.Intersect (aRay, aHit, &aStats))
+      {
+        continue;
+      }
+
+      SurfacePoint aPoint;
+      theScene.Interpolate (aHit, aPoint);
+
+      // Uniform direction in the hemisphere facing the camera
+      const float aCosTheta = 2.f * aRandom.NextFloat() - 1.f;
+      const float aSinTheta = std::sqrt (std::max (0.f, 1.f - aCosTheta * aCosTheta));
+      const float aPhi      = 2.f * 3.14159265f * aRandom.NextFloat();
+
+      glm::vec3 aDir (aSinTheta * std::cos (aPhi), aSinTheta * std::sin (aPhi), aCosTheta);
+      if ((glm::dot (aDir, aPoint.GeomNormal) > 0.f) == (glm::dot (aRay.Direction, aPoint.GeomNormal) > 0.f))
+      {
+        aDir = -aDir;
+      }
+
+      ++aNbRays;
+      theScene.Intersect (Ray (aRay.PointAt (aHit.T), aDir, theScene.Epsilon(), FLT_MAX, aRay.Time), aHit, &aStats);
+    }
+  }
+
+  theBvh.TraversalMs     = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - aStart).count();
+  theBvh.NbRays          = aNbRays;
+  theBvh.NodesPerRay     = static_cast<double> (aStats.NbNodes)      / std::max (aNbRays, 1);
+  theBvh.TrianglesPerRay = static_cast<double> (aStats.NbPrimitives) / std::max (aNbRays, 1);
+  theBvh.BlocksPerRay    = static_cast<double> (aStats.NbBlocks)     / std::max (aNbRays, 1);
+}
+
+//=======================================================================
+//function : checkWideTraversal
+//purpose  :
+//=======================================================================
+void Benchmark::checkWideTraversal (const Scene& theScene, BenchmarkBvh& theBvh)
+{
+  const Bvh&     aBinary = theScene.Hierarchy();
+  const WideBvh& aWide   = theScene.WideHierarchy();
+  if (aBinary.Nodes().empty() || aWide.Nodes().empty())
+  {
+    return;
+  }
+
+  // Ray directions along the axes give infinite inverse components (and NaN slab
+  // distances for planes through the origin), which traversal must tolerate
+  const Box       aBounds = aBinary.Bounds();
+  const glm::vec3 aSize   = aBounds.Max - aBounds.Min;
+
+  std::vector<int> aWideStamps (theScene.Triangles.size(), -1);
+  std::vector<int> aReached;
+
+  const std::vector<int>& aBinaryIndices = aBinary.Indices();
+  const std::vector<int>& aWideIndices   = aWide.Indices();
+
+  int aRayIdx = 0;
+  for (int anAxis = 0; anAxis < 3; ++anAxis)
+  {
+    for (int aSign = -1; aSign <= 1; aSign += 2)
+    {
+      for (int aCell = 0; aCell < THE_WIDE_CHECK_GRID * THE_WIDE_CHECK_GRID; ++aCell, ++aRayIdx)
+      {
+        const int anAxisU = (anAxis + 1) % 3;
+        const int anAxisV = (anAxis + 2) % 3;
+
+        glm::vec3 anOrigin;
+        anOrigin[anAxis]  = aSign > 0 ? aBounds.Min[anAxis] - aSize[anAxis] : aBounds.Max[anAxis] + aSize[anAxis];
+        anOrigin[anAxisU] = aBounds.Min[anAxisU] + aSize[anAxisU] * (aCell % THE_WIDE_CHECK_GRID + 0.5f) / THE_WIDE_CHECK_GRID;
+        anOrigin[anAxisV] = aBounds.Min[anAxisV] + aSize[anAxisV] * (aCell / THE_WIDE_CHECK_GRID + 0.5f) / THE_WIDE_CHECK_GRID;
+
+        glm::vec3 aDirection (0.f);
+        aDirection[anAxis] = static_cast<float> (aSign);
+
+        const Ray aRay (anOrigin, aDirection);
+
+        aReached.clear();
+        auto aBinaryLeaf = [&](int theFirst, int theCount, float&) -> bool
+        {
+          aReached.insert (aReached.end(), aBinaryIndices.begin() + theFirst, aBinaryIndices.begin() + theFirst + theCount);
+          return false;
+        };
+        auto aWideLeaf = [&](int theFirst, int theCount, float&) -> bool
+        {
+          for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+          {
+            aWideStamps[aWideIndices[anIdx]] = aRayIdx;
+          }
+          return false;
+        };
+
+        float aTmax = FLT_MAX;
+        aBinary.Traverse (aRay, aTmax, aBinaryLeaf);
+        aTmax = FLT_MAX;
+        aWide.Traverse (aRay, aTmax, aWideLeaf);
+
+        // Wide boxes enclose (conservatively quantized) binary ones, so wide leaves reach at least the same primitives
+        for (size_t aReachedIdx = 0; aReachedIdx < aReached.size(); ++aReachedIdx)
+        {
+          if (aWideStamps[aReached[aReachedIdx]] != aRayIdx)
+          {
+            ++theBvh.NbWideMismatches;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  theBvh.NbWideChecked = aRayIdx;
+}
+
+//=======================================================================
+//function : measureRefit
+//purpose  :
+//=======================================================================
+BenchmarkRefit Benchmark::measureRefit (Renderer& theRenderer) const
+{
+  BenchmarkRefit aRefit;
+
+  Scene& aScene = theRenderer.ChangeScene();
+  const std::vector<glm::vec3> aRest = aScene.Positions;
+
+  // Deformed geometry should not replace cached hierarchy
+  const bool isCaching = aScene.IsUsingBvhCache();
+  aScene.SetBvhCache (false);
+  const Box aBounds = aScene.Bounds();
+
+  for (int aFrame = 1; aFrame <= myOptions.NbDeformFrames; ++aFrame)
+  {
+    DeformPositions (aRest, aBounds, 0.25f * aFrame, aScene.Positions);
+
+    const auto aStart = std::chrono::steady_clock::now();
+    aRefit.NbRebuilt += theRenderer.UpdateGeometry();
+    aRefit.RefitMs   += std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - aStart).count();
+  }
+
+  aRefit.NbFrames   = myOptions.NbDeformFrames;
+  aRefit.RefitMs   /= aRefit.NbFrames;
+  aRefit.RefitCost  = aScene.Hierarchy().SahCost();
+
+  const auto aStart = std::chrono::steady_clock::now();
+  aScene.Commit (theRenderer.Pool());
+  aRefit.BuildMs   = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - aStart).count();
+  aRefit.BuildCost = aScene.Hierarchy().SahCost();
+
+  aScene.Positions = aRest;
+  aScene.Commit (theRenderer.Pool());
+  aScene.SetBvhCache (isCaching);
+  theRenderer.Reset();
+
+  return aRefit;
+}
+
+//=======================================================================
+//function : writeJson
+//purpose  :
+//=======================================================================
+bool Benchmark::writeJson (const std::vector<BenchmarkResult>& theResults, const BenchmarkBvh& theBvh, const BenchmarkRefit& theRefit,
+                           const MemoryStats& theMemory) const
+{
+  std::ofstream aFile (myOptions.JsonFile.c_str());
+  if (!aFile.good())
+  {
+    std::cout << "Error: can't write file " << myOptions.JsonFile << std::endl;
+    return false;
+  }
+
+  aFile << "{\n"
+        << "  \"scene\": \"" << EscapeJson (myOptions.SceneFile) << "\",\n"
+        << "  \"width\": " << myOptions.SizeX << ",\n"
+        << "  \"height\": " << myOptions.SizeY << ",\n"
+        << "  \"spp\": " << myOptions.NbSamples << ",\n"
+        << "  \"target_error\": " << myOptions.TargetError << ",\n"
+        << "  \"max_depth\": " << myOptions.MaxDepth << ",\n"
+        << "  \"shadow_batch\": " << (myOptions.BatchShadows ? "true" : "false") << ",\n"
+        << "  \"ray_reorder\": " << (myOptions.ToReorderRays ? "true" : "false") << ",\n"
+        << "  \"numa\": { \"nodes\": " << NumaTopology::Get().NbNodes() << ", \"pinned\": " << (myOptions.ToUseNuma ? "true" : "false")
+        << ", \"replicas\": " << theBvh.NbReplicas << ", \"replica_bytes\": " << theBvh.ReplicaBytes << " },\n";
+
+  const std::vector<HugePageRegion> aRegions = HugePages::Regions();
+  aFile << "  \"huge_pages\": { \"enabled\": " << (myOptions.ToUseHugePages ? "true" : "false")
+        << ", \"mode\": \"" << HugePages::SystemMode() << "\", \"regions\": [";
+  for (size_t aRegionIdx = 0; aRegionIdx < aRegions.size(); ++aRegionIdx)
+  {
+    aFile << (aRegionIdx != 0 ? ", " : " ") << "{ \"name\": \"" << EscapeJson (aRegions[aRegionIdx].Name) << "\", \"bytes\": "
+          << aRegions[aRegionIdx].Bytes << ", \"huge_bytes\": " << aRegions[aRegionIdx].HugeBytes << " }";
+  }
+  aFile << (aRegions.empty() ? "] },\n" : " ] },\n")
+        << "  \"light_sampling\": \"" << Scene::LightSamplingName (myOptions.Lights) << "\",\n"
+        << "  \"environment\": \"" << EscapeJson (myOptions.EnvironmentFile) << "\",\n"
+        << "  \"reference_spp\": " << myOptions.ReferenceSpp << ",\n"
+        << "  \"error_goal\": " << myOptions.ErrorGoal << ",\n"
+        << "  \"bvh\": { \"build\": \"" << Scene::BvhBuildName (myOptions.BvhMode) << "\", \"ref_growth\": " << myOptions.RefGrowth
+        << ", \"optimized\": " << (myOptions.ToOptimizeBvh ? "true" : "false") << ", \"cached\": " << (theBvh.IsCached ? "true" : "false")
+        << ", \"build_ms\": " << theBvh.BuildMs << ", \"nodes\": " << theBvh.NbNodes << ", \"references\": " << theBvh.NbReferences
+        << ", \"sah\": " << theBvh.SahCost << ", \"bytes\": " << theBvh.Bytes << ", \"wide\": " << (myOptions.ToUseWideBvh ? "true" : "false")
+        << ", \"wide_nodes\": " << theBvh.NbWideNodes << ", \"wide_bytes\": " << theBvh.WideBytes
+        << ", \"wide_checked_rays\": " << theBvh.NbWideChecked << ", \"wide_mismatches\": " << theBvh.NbWideMismatches
+        << ", \"geometry_bytes\": " << theBvh.GeometryBytes << ", \"shape_nodes\": " << theBvh.NbShapeNodes
+        << ", \"shape_bytes\": " << theBvh.ShapeBytes << ", \"tess_level\": " << myOptions.TessLevel
+        << ", \"tess_cache_bytes\": " << (static_cast<size_t> (myOptions.TessCacheMb) << 20)
+        << ", \"motion_keys\": " << (theBvh.NbMotionNodes > 0 ? myOptions.NbMotionKeys : 1)
+        << ", \"motion_bounds\": \"" << (myOptions.ToLerpMotion ? "linear" : "union") << "\""
+        << ", \"motion_nodes\": " << theBvh.NbMotionNodes << ", \"motion_bytes\": " << theBvh.MotionBytes
+        << ", \"paged\": " << (theBvh.NbPagedBlocks > 0 ? "true" : "false") << ", \"paged_blocks\": " << theBvh.NbPagedBlocks
+        << ", \"paged_nodes\": " << theBvh.NbPagedNodes << ", \"paged_file_bytes\": " << theBvh.PagedFileBytes
+        << ", \"paged_top_bytes\": " << theBvh.PagedTopBytes << ", \"blocks_per_ray\": " << theBvh.BlocksPerRay
+        << ", \"rays\": " << theBvh.NbRays << ", \"traversal_ms\": " << theBvh.TraversalMs << ", \"nodes_per_ray\": " << theBvh.NodesPerRay
+        << ", \"triangles_per_ray\": " << theBvh.TrianglesPerRay << " },\n";
+  if (theRefit.NbFrames > 0)
+  {
+    aFile << "  \"refit\": { \"frames\": " << theRefit.NbFrames << ", \"refit_ms\": " << theRefit.RefitMs
+          << ", \"rebuilt_subtrees\": " << theRefit.NbRebuilt << ", \"build_ms\": " << theRefit.BuildMs
+          << ", \"refit_sah\": " << theRefit.RefitCost << ", \"build_sah\": " << theRefit.BuildCost << " },\n";
+  }
+  aFile << "  \"memory\": { \"total_bytes\": " << theMemory.TotalCurrent() << ", \"total_peak_bytes\": " << theMemory.TotalPeak()
+        << ", \"process_resident_bytes\": " << MemoryStats::ProcessResident() << ", \"process_peak_bytes\": " << MemoryStats::ProcessPeak()
+        << ", \"categories\": [";
+  for (int aTagIdx = 0; aTagIdx < MemoryTag_NB; ++aTagIdx)
+  {
+    const MemoryTag aTag = static_cast<MemoryTag> (aTagIdx);
+    aFile << (aTagIdx != 0 ? ", " : " ") << "{ \"name\": \"" << MemoryStats::TagName (aTag) << "\", \"bytes\": " << theMemory.Current (aTag)
+          << ", \"peak_bytes\": " << theMemory.Peak (aTag) << ", \"budget_bytes\": " << theMemory.Budget (aTag)
+          << ", \"over_budget\": " << (theMemory.IsOverBudget (aTag) ? "true" : "false") << " }";
+  }
+  aFile << " ] },\n"
+        << "  \"integrators\": [\n";
+
+  for (size_t anIdx = 0; anIdx < theResults.size(); ++anIdx)
+  {
+    const BenchmarkResult& aResult = theResults[anIdx];
+
+    aFile << "    {\n"
+          << "      \"name\": \"" << EscapeJson (aResult.Name) << "\",\n"
+          << "      \"sampler\": \"" << aResult.Sampler << "\",\n"
+          << "      \"guiding\": " << (aResult.IsGuided ? "true" : "false") << ",\n"
+          << "      \"time_ms\": " << aResult.TimeMs << ",\n"
+          << "      \"ms_per_pass\": " << aResult.TimeMs / std::max (aResult.NbPasses, 1) << ",\n"
+          << "      \"passes\": " << aResult.NbPasses << ",\n"
+          << "      \"avg_spp\": " << aResult.AvgSpp << ",\n"
+          << "      \"rays\": " << aResult.NbRays << ",\n"
+          << "      \"mrays_per_s\": " << aResult.NbRays / (aResult.TimeMs * 1.0e3) << ",\n"
+          << "      \"denoise_ms\": " << aResult.DenoiseMs << ",\n"
+          << "      \"rmse\": " << aResult.Rmse << ",\n"
+          << "      \"error\": " << aResult.Error << ",\n"
+          << "      \"goal_ms\": " << aResult.GoalMs << ",\n"
+          << "      \"goal_spp\": " << aResult.GoalSpp << ",\n"
+          << "      \"allocations\": " << aResult.NbAllocations << ",\n"
+          << "      \"memory_peak_bytes\": " << aResult.MemoryPeak << ",\n"
+          << "      \"tess_hit_rate\": " << aResult.TessHitRate << ",\n"
+          << "      \"tess_misses\": " << aResult.NbTessMisses << ",\n"
+          << "      \"tess_evictions\": " << aResult.NbTessEvictions << ",\n"
+          << "      \"tess_ms\": " << aResult.TessMs << ",\n"
+          << "      \"tess_bytes\": " << aResult.TessBytes << ",\n"
+          << "      \"paged_touched_blocks\": " << aResult.NbTouchedBlocks << ",\n"
+          << "      \"paged_touched_bytes\": " << aResult.TouchedBytes << ",\n"
+          << "      \"paged_resident_bytes\": " << aResult.ResidentBytes << ",\n"
+          << "      \"paged_prefetched\": " << aResult.NbPrefetched << ",\n"
+          << "      \"frames\": [";
+    for (size_t aFrameIdx = 0; aFrameIdx < aResult.Frames.size(); ++aFrameIdx)
+    {
+      const BenchmarkFrame& aFrame = aResult.Frames[aFrameIdx];
+      const double aNbTraced = static_cast<double> (std::max<uint64_t> (aFrame.Rays.NbCameraRays + aFrame.Rays.NbBounceRays, 1));
+      const double aTimeUs   = std::max (aFrame.TimeMs, 1.0e-3) * 1.0e3;
+      aFile << (aFrameIdx != 0 ? ",\n" : "\n") << "        { \"pass\": " << aFrameIdx << ", \"time_ms\": " << aFrame.TimeMs
+            << ", \"camera_rays\": " << aFrame.Rays.NbCameraRays << ", \"bounce_rays\": " << aFrame.Rays.NbBounceRays
+            << ", \"shadow_rays\": " << aFrame.Rays.NbShadowRays << ", \"mrays_per_s\": " << aFrame.Rays.NbRays() / aTimeUs
+            << ", \"nodes_per_ray\": " << aFrame.Rays.NbNodes / aNbTraced << ", \"triangles_per_ray\": " << aFrame.Rays.NbTriangles / aNbTraced
+            << ", \"shading_calls\": " << aFrame.Rays.NbShadingCalls << ", \"msamples_per_s\": " << aFrame.Rays.NbSamples() / aTimeUs << " }";
+    }
+    aFile << (aResult.Frames.empty() ? "]\n" : "\n      ]\n")
+          << "    }" << (anIdx + 1 < theResults.size() ? "," : "") << "\n";
+  }
+
+  aFile << "  ]\n"
+        << "}\n";
+
+  return true;
+}
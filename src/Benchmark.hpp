@@ -0,0 +1,216 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Renderer.hpp"
+
+//! Options of headless benchmark run.
+struct BenchmarkOptions
+{
+  std::string                 SceneFile;       //!< OBJ scene to render
+  int                         SizeX;           //!< image width
+  int                         SizeY;           //!< image height
+  int                         NbSamples;       //!< samples per pixel (maximum with adaptive sampling)
+  float                       TargetError;     //!< target error of adaptive sampling (0 - disabled)
+  int                         MinSamples;      //!< samples per pixel before testing tile error
+  int                         DenoiseInterval; //!< samples between denoiser runs (0 - disabled)
+  int                         MaxDepth;        //!< maximum path depth
+  BvhBuild                    BvhMode;         //!< algorithm of building BVH
+  float                       RefGrowth;       //!< limit of BVH references per triangle (spatial splits)
+  bool                        ToOptimizeBvh;   //!< restructure BVH treelets after build
+  bool                        ToCacheBvh;      //!< read and write BVH cache next to the scene
+  bool                        ToUseWideBvh;    //!< traverse compressed 8-wide BVH
+  bool                        ToPageBvh;       //!< page BVH and triangles from memory-mapped file
+  int                         PageBlockKb;     //!< size limit of paged block in KB
+  bool                        ToPrefetch;      //!< hint paged blocks from wavefront ray queues
+  bool                        ToReorderRays;   //!< bin wavefront rays by BVH subtree
+  bool                        BatchShadows;    //!< trace shadow rays per tile (path tracing)
+  LightSampling               Lights;          //!< strategy of emitter selection
+  std::string                 EnvironmentFile; //!< HDR environment light (optional)
+  int                         NbThreads;       //!< number of threads (0 - all)
+  bool                        ToUseNuma;       //!< pin threads to NUMA nodes and replicate BVH per node
+  int                         ReplicaBudgetMb; //!< limit of memory of NUMA replicas in MB
+  bool                        ToUseHugePages;  //!< back BVH, geometry and framebuffer with 2 MB pages
+  std::vector<IntegratorMode> Modes;           //!< integrators to compare
+  std::vector<SimdIsa>        Isas;            //!< BSDF kernels to compare (wavefront only)
+  std::vector<SamplerType>    Samplers;        //!< sample generators to compare
+  std::vector<bool>           Guiding;         //!< path guiding settings to compare
+  int                         NbDeformFrames;  //!< frames of BVH refit test on deformed scene (0 - disabled)
+  int                         NbSpheres;       //!< random particles added to the scene
+  int                         NbDiscs;         //!< random discs added to the scene
+  int                         NbCurves;        //!< random hair strands added to the scene
+  bool                        ToTessellate;    //!< add particles and strands as triangles instead of analytic shapes, pre-tessellate displaced patches
+  float                       Displacement;    //!< height of procedural displacement relative to scene size (0 - disabled)
+  int                         TessLevel;       //!< subdivision level of displaced patches
+  int                         TessCacheMb;     //!< budget of tessellation cache in MB
+  int                         CacheBudgetMb;   //!< budget of all caches in MB (0 - unlimited)
+  glm::vec3                   Motion;          //!< translation of the scene over the shutter interval
+  float                       Spin;            //!< rotation of the scene over the shutter interval (degrees)
+  int                         NbMotionKeys;    //!< number of motion keys
+  bool                        ToLerpMotion;    //!< interpolate node bounds of motion BVH in time
+  int                         ReferenceSpp;    //!< samples per pixel of reference image (0 - no reference)
+  float                       ErrorGoal;       //!< error vs reference at which time to target error is taken (0 - disabled)
+  bool                        HasCamera;       //!< camera is given explicitly
+  glm::vec3                   Eye;             //!< camera position
+  glm::vec3                   Target;          //!< camera target
+  bool                        HasCameraEnd;    //!< camera moves over the shutter interval
+  glm::vec3                   EyeEnd;          //!< camera position at the end of the shutter interval
+  glm::vec3                   TargetEnd;       //!< camera target at the end of the shutter interval
+  std::string                 JsonFile;        //!< output file of results (optional)
+  std::string                 ImageFile;       //!< output image (optional, PFM or PPM)
+
+  BenchmarkOptions()
+  : SizeX (640), SizeY (360), NbSamples (16), TargetError (0.f), MinSamples (8), DenoiseInterval (0), MaxDepth (5), BvhMode (BvhBuild_Binned), RefGrowth (1.5f), ToOptimizeBvh (false), ToCacheBvh (false), ToUseWideBvh (false), ToPageBvh (false), PageBlockKb (64), ToPrefetch (true), ToReorderRays (false), BatchShadows (true), Lights (LightSampling_Bvh), NbThreads (0), ToUseNuma (false), ReplicaBudgetMb (1024), ToUseHugePages (false), NbDeformFrames (0), NbSpheres (0), NbDiscs (0), NbCurves (0), ToTessellate (false), Displacement (0.f), TessLevel (5), TessCacheMb (256), CacheBudgetMb (0),
+    Motion (0.f), Spin (0.f), NbMotionKeys (2), ToLerpMotion (true), ReferenceSpp (0), ErrorGoal (0.f),
+    HasCamera (false), Eye (0.f), Target (0.f, 0.f, -1.f), HasCameraEnd (false), EyeEnd (0.f), TargetEnd (0.f, 0.f, -1.f)
+  {
+    //
+  }
+};
+
+//! Ray statistics of single rendered pass.
+struct BenchmarkFrame
+{
+  double   TimeMs; //!< time of the pass
+  RayStats Rays;   //!< rays, traversal work and shading calls of the pass
+
+  BenchmarkFrame() : TimeMs (0.0) {}
+};
+
+//! Measured performance of single integrator.
+struct BenchmarkResult
+{
+  std::string Name;      //!< integrator name
+  std::string Sampler;   //!< sampler name
+  bool        IsGuided;  //!< path guiding was enabled
+  double      TimeMs;    //!< total rendering time
+  uint64_t    NbRays;    //!< total number of traced rays
+  int         NbPasses;  //!< number of rendered passes
+  double      AvgSpp;    //!< average samples per pixel
+  double      Rmse;      //!< RMS difference from the first integrator
+  double      Error;     //!< RMS difference from the reference image (equal-spp error)
+  double      DenoiseMs; //!< time of the last denoiser run
+  double      GoalMs;    //!< rendering time until the error dropped to the goal (-1 - not reached)
+  double      GoalSpp;   //!< average samples per pixel at the goal
+  double      TessHitRate;     //!< hit rate of tessellation cache
+  uint64_t    NbTessMisses;    //!< tessellated patches (cache misses)
+  uint64_t    NbTessEvictions; //!< micro-meshes evicted from the cache
+  double      TessMs;          //!< tessellation time summed over threads
+  size_t      TessBytes;       //!< size of resident micro-meshes at the end
+  int         NbTouchedBlocks; //!< paged blocks traversed during the run
+  size_t      TouchedBytes;    //!< size of touched paged blocks
+  size_t      ResidentBytes;   //!< paged bytes in RAM at the end
+  uint64_t    NbPrefetched;    //!< prefetch hints issued
+  int64_t     NbAllocations;   //!< heap allocations in passes after the first one (-1 - not counted)
+  size_t      MemoryPeak;      //!< peak of memory accounted by the renderer during the run
+  RayStats    Rays;            //!< ray statistics summed over passes
+  std::vector<BenchmarkFrame> Frames; //!< ray statistics of each pass
+
+  BenchmarkResult() : IsGuided (false), TimeMs (0.0), NbRays (0), NbPasses (0), AvgSpp (0.0), Rmse (0.0), Error (0.0), DenoiseMs (0.0), GoalMs (-1.0), GoalSpp (0.0),
+                      TessHitRate (0.0), NbTessMisses (0), NbTessEvictions (0), TessMs (0.0), TessBytes (0),
+                      NbTouchedBlocks (0), TouchedBytes (0), ResidentBytes (0), NbPrefetched (0), NbAllocations (-1), MemoryPeak (0) {}
+};
+
+//! Measured BVH build and traversal work.
+struct BenchmarkBvh
+{
+  double BuildMs;         //!< time of building BVH (or reading it from cache)
+  bool   IsCached;        //!< BVH was read from cache
+  int    NbNodes;         //!< number of nodes
+  int    NbReferences;    //!< number of primitive references in leaves
+  double SahCost;         //!< SAH cost
+  size_t Bytes;           //!< size of binary nodes and indices
+  int    NbWideNodes;     //!< number of compressed 8-wide nodes (0 - disabled)
+  size_t WideBytes;       //!< size of compressed 8-wide nodes and indices
+  size_t GeometryBytes;   //!< size of vertices, triangles and analytic shapes
+  int    NbShapeNodes;    //!< number of nodes of analytic shape hierarchy
+  size_t ShapeBytes;      //!< size of analytic shape hierarchy
+  int    NbMotionNodes;   //!< number of motion BVH nodes over all time segments (0 - static scene)
+  size_t MotionBytes;     //!< size of motion BVH nodes and indices
+  int    NbPagedBlocks;   //!< number of blocks of out-of-core BVH (0 - disabled)
+  int    NbPagedNodes;    //!< number of nodes in paged blocks
+  size_t PagedFileBytes;  //!< size of the mapped file
+  size_t PagedTopBytes;   //!< size of top tree and block table kept in RAM
+  int    NbReplicas;      //!< number of NUMA replicas of BVH and triangles
+  size_t ReplicaBytes;    //!< memory of all NUMA replicas
+  double TraversalMs;     //!< time of tracing measured rays
+  int    NbRays;          //!< number of measured rays (primary and one diffuse bounce)
+  double NodesPerRay;     //!< visited nodes per ray
+  double TrianglesPerRay; //!< tested triangles per ray
+  double BlocksPerRay;    //!< entered paged blocks per ray
+  int    NbWideChecked;   //!< number of axis-aligned rays traced through both wide and binary BVH
+  int    NbWideMismatches; //!< checked rays reaching fewer primitives in wide BVH than in binary one
+
+  BenchmarkBvh() : BuildMs (0.0), IsCached (false), NbNodes (0), NbReferences (0), SahCost (0.0), Bytes (0), NbWideNodes (0), WideBytes (0), GeometryBytes (0), NbShapeNodes (0), ShapeBytes (0), NbMotionNodes (0), MotionBytes (0),
+                   NbPagedBlocks (0), NbPagedNodes (0), PagedFileBytes (0), PagedTopBytes (0), NbReplicas (0), ReplicaBytes (0), TraversalMs (0.0), NbRays (0), NodesPerRay (0.0), TrianglesPerRay (0.0), BlocksPerRay (0.0),
+                   NbWideChecked (0), NbWideMismatches (0) {}
+};
+
+//! Measured BVH update on deformed scene.
+struct BenchmarkRefit
+{
+  int    NbFrames;   //!< number of deformed frames
+  double BuildMs;    //!< time of full build of the deformed scene
+  double RefitMs;    //!< average time of refit per frame
+  int    NbRebuilt;  //!< total number of rebuilt subtrees
+  double BuildCost;  //!< SAH cost after full build of the last frame
+  double RefitCost;  //!< SAH cost after refit of the last frame
+
+  BenchmarkRefit() : NbFrames (0), BuildMs (0.0), RefitMs (0.0), NbRebuilt (0), BuildCost (0.0), RefitCost (0.0) {}
+};
+
+//! Headless benchmark comparing integrators on the same scene and camera.
+//! Usage: App --benchmark scene.obj [--size WxH] [--spp N] [--target-error E] [--min-spp N]
+//!            [--denoise N] [--depth D] [--bvh binned|sbvh] [--ref-growth G] [--bvh-optimize on|off]
+//!            [--bvh-cache on|off] [--bvh-wide on|off] [--paging on|off] [--page-block KB] [--prefetch on|off]
+//!            [--reorder on|off] [--shadow-batch on|off] [--lights uniform|power|bvh] [--env file.hdr] [--threads N]
+//!            [--numa on|off] [--replica-budget MB] [--huge-pages on|off] [--integrator path|wavefront|all] [--simd scalar|sse|avx2|all]
+//!            [--sampler random|sobol|bluenoise|all] [--guiding off|on|all] [--reference N] [--error-goal E]
+//!            [--deform N] [--spheres N] [--discs N] [--curves N] [--tessellate on|off]
+//!            [--displace H] [--tess-level L] [--tess-cache MB] [--cache-budget MB] [--motion dx dy dz] [--spin DEG] [--motion-keys K] [--motion-bounds linear|union]
+//!            [--camera ex ey ez tx ty tz] [--camera-end ex ey ez tx ty tz]
+//!            [--json results.json] [--out image.pfm]
+class Benchmark
+{
+public:
+
+  //! Returns true if command line requests benchmark mode.
+  static bool IsRequested (int theArgc, char** theArgv);
+
+  //! Prints usage of command line options.
+  static void PrintUsage();
+
+  //! Parses command line, returns false on error.
+  bool Parse (int theArgc, char** theArgv);
+
+  //! Runs benchmark, returns process exit code.
+  int Run();
+
+  //! Returns options.
+  const BenchmarkOptions& Options() const { return myOptions; }
+
+private:
+
+  //! Counts traversal steps of primary rays and one diffuse bounce.
+  static void measureTraversal (const Scene& theScene, const Camera& theCamera, BenchmarkBvh& theBvh);
+
+  //! Traces axis-aligned rays (with zero direction components) through wide and binary BVH
+  //! and counts rays, for which wide traversal misses primitives reached by the binary one.
+  static void checkWideTraversal (const Scene& theScene, BenchmarkBvh& theBvh);
+
+  //! Measures BVH refit against full build on animated deformation of the scene
+  //! (the original geometry is restored afterwards).
+  BenchmarkRefit measureRefit (Renderer& theRenderer) const;
+
+  //! Writes results in JSON format.
+  bool writeJson (const std::vector<BenchmarkResult>& theResults, const BenchmarkBvh& theBvh, const BenchmarkRefit& theRefit,
+                  const MemoryStats& theMemory) const;
+
+private:
+
+  BenchmarkOptions myOptions;
+
+};
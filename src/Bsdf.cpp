@@ -0,0 +1,241 @@
+#include "Bsdf.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const float THE_PI = 3.14159265358979f;
+
+  //! Schlick approximation of Fresnel reflectance.
+  inline glm::vec3 FresnelSchlick (const glm::vec3& theF0, float theCos)
+  {
+    const float aM  = std::min (std::max (1.f - theCos, 0.f), 1.f);
+    const float aM2 = aM * aM;
+    return theF0 + (glm::vec3 (1.f) - theF0) * (aM2 * aM2 * aM);
+  }
+}
+
+//=======================================================================
+//function : GgxD
+//purpose  :
+//=======================================================================
+float Bsdf::GgxD (const glm::vec3& theWh, float theAlpha)
+{
+  if (theWh.z <= 0.f)
+  {
+    return 0.f;
+  }
+
+  const float anAlpha2 = theAlpha * theAlpha;
+  const float aDenom   = theWh.z * theWh.z * (anAlpha2 - 1.f) + 1.f;
+
+  return anAlpha2 / (THE_PI * aDenom * aDenom);
+}
+
+//=======================================================================
+//function : GgxLambda
+//purpose  :
+//=======================================================================
+float Bsdf::GgxLambda (const glm::vec3& theW, float theAlpha)
+{
+  const float aCos2 = theW.z * theW.z;
+  if (aCos2 <= 0.f)
+  {
+    return 1.0e10f;
+  }
+
+  const float aTan2 = std::max (1.f - aCos2, 0.f) / aCos2;
+
+  return 0.5f * (std::sqrt (1.f + theAlpha * theAlpha * aTan2) - 1.f);
+}
+
+//=======================================================================
+//function : GgxSampleVisible
+//purpose  :
+//=======================================================================
+glm::vec3 Bsdf::GgxSampleVisible (const glm::vec3& theWo, float theAlpha, float theU1, float theU2)
+{
+  // Transform view direction to hemisphere configuration
+  const glm::vec3 aVh = glm::normalize (glm::vec3 (theAlpha * theWo.x, theAlpha * theWo.y, theWo.z));
+
+  const float aLenSq = aVh.x * aVh.x + aVh.y * aVh.y;
+
+  const glm::vec3 aT1 = aLenSq > 0.f ? glm::vec3 (-aVh.y, aVh.x, 0.f) / std::sqrt (aLenSq) : glm::vec3 (1.f, 0.f, 0.f);
+  const glm::vec3 aT2 = glm::cross (aVh, aT1);
+
+  // Sample projected area
+  const float aR   = std::sqrt (theU1);
+  const float aPhi = 2.f * THE_PI * theU2;
+  const float aS   = 0.5f * (1.f + aVh.z);
+
+  const float aP1 = aR * std::cos (aPhi);
+  const float aP2 = (1.f - aS) * std::sqrt (std::max (1.f - aP1 * aP1, 0.f)) + aS * aR * std::sin (aPhi);
+
+  const glm::vec3 aNh = aP1 * aT1 + aP2 * aT2 + std::sqrt (std::max (1.f - aP1 * aP1 - aP2 * aP2, 0.f)) * aVh;
+
+  // Transform back to ellipsoid configuration
+  return glm::normalize (glm::vec3 (theAlpha * aNh.x, theAlpha * aNh.y, std::max (aNh.z, 0.f)));
+}
+
+//=======================================================================
+//function : FresnelDielectric
+//purpose  :
+//=======================================================================
+float Bsdf::FresnelDielectric (float theCosI, float theEta)
+{
+  const float aSin2T = theEta * theEta * std::max (1.f - theCosI * theCosI, 0.f);
+  if (aSin2T >= 1.f)
+  {
+    return 1.f; // total internal reflection
+  }
+
+  const float aCosT = std::sqrt (1.f - aSin2T);
+
+  const float aRs = (theEta * theCosI - aCosT) / (theEta * theCosI + aCosT);
+  const float aRp = (theCosI - theEta * aCosT) / (theCosI + theEta * aCosT);
+
+  return 0.5f * (aRs * aRs + aRp * aRp);
+}
+
+//=======================================================================
+//function : Spread
+//purpose  :
+//=======================================================================
+float Bsdf::Spread (const Material& theMaterial)
+{
+  switch (theMaterial.Type)
+  {
+    case MaterialType_Diffuse:
+      return 0.25f;
+    case MaterialType_Glossy:
+      return 0.25f * theMaterial.Roughness;
+    default:
+      return 0.f;
+  }
+}
+
+//=======================================================================
+//function : Eval
+//purpose  :
+//=======================================================================
+glm::vec3 Bsdf::Eval (const Material&  theMaterial,
+                      const glm::vec3& theAlbedo,
+                      const glm::vec3& theWo,
+                      const glm::vec3& theWi,
+                      float&           thePdf)
+{
+  thePdf = 0.f;
+
+  if (theWo.z <= 0.f || theWi.z <= 0.f)
+  {
+    return glm::vec3 (0.f);
+  }
+
+  switch (theMaterial.Type)
+  {
+    case MaterialType_Diffuse:
+    {
+      thePdf = theWi.z * (1.f / THE_PI);
+      return theAlbedo * thePdf;
+    }
+    case MaterialType_Glossy:
+    {
+      const glm::vec3 aWh = glm::normalize (theWo + theWi);
+
+      const float aD = GgxD (aWh, theMaterial.Roughness);
+      const float aLambdaO = GgxLambda (theWo, theMaterial.Roughness);
+      const float aLambdaI = GgxLambda (theWi, theMaterial.Roughness);
+
+      thePdf = aD / (4.f * theWo.z * (1.f + aLambdaO));
+
+      return FresnelSchlick (theAlbedo, glm::dot (theWi, aWh)) * (aD / (4.f * theWo.z * (1.f + aLambdaO + aLambdaI)));
+    }
+    default:
+      return glm::vec3 (0.f);
+  }
+}
+
+//=======================================================================
+//function : Sample
+//purpose  :
+//=======================================================================
+bool Bsdf::Sample (const Material&  theMaterial,
+                   const glm::vec3& theAlbedo,
+                   const glm::vec3& theWo,
+                   const glm::vec3& theRnd,
+                   BsdfSample&      theSample)
+{
+  theSample.IsSpecular = false;
+
+  switch (theMaterial.Type)
+  {
+    case MaterialType_Diffuse:
+    {
+      if (theWo.z <= 0.f)
+      {
+        return false;
+      }
+
+      // Cosine-weighted hemisphere sampling
+      const float aR   = std::sqrt (theRnd.x);
+      const float aPhi = 2.f * THE_PI * theRnd.y;
+
+      theSample.Wi     = glm::vec3 (aR * std::cos (aPhi), aR * std::sin (aPhi), std::sqrt (std::max (1.f - theRnd.x, 0.f)));
+      theSample.Pdf    = theSample.Wi.z * (1.f / THE_PI);
+      theSample.Weight = theAlbedo;
+
+      return theSample.Pdf > 0.f;
+    }
+    case MaterialType_Glossy:
+    {
+      if (theWo.z <= 0.f)
+      {
+        return false;
+      }
+
+      const glm::vec3 aWh = GgxSampleVisible (theWo, theMaterial.Roughness, theRnd.x, theRnd.y);
+
+      theSample.Wi = 2.f * glm::dot (theWo, aWh) * aWh - theWo;
+      if (theSample.Wi.z <= 0.f)
+      {
+        return false;
+      }
+
+      const float aLambdaO = GgxLambda (theWo,        theMaterial.Roughness);
+      const float aLambdaI = GgxLambda (theSample.Wi, theMaterial.Roughness);
+
+      theSample.Pdf    = GgxD (aWh, theMaterial.Roughness) / (4.f * theWo.z * (1.f + aLambdaO));
+      theSample.Weight = FresnelSchlick (theAlbedo, glm::dot (theSample.Wi, aWh)) * ((1.f + aLambdaO) / (1.f + aLambdaO + aLambdaI));
+
+      return theSample.Pdf > 0.f;
+    }
+    case MaterialType_Dielectric:
+    {
+      const bool  isEntering = theWo.z > 0.f;
+      const float aCosI      = std::abs (theWo.z);
+      const float anEta      = isEntering ? 1.f / theMaterial.Ior : theMaterial.Ior;
+
+      const float aFresnel = FresnelDielectric (aCosI, anEta);
+
+      theSample.IsSpecular = true;
+      theSample.Pdf        = 0.f;
+      theSample.Weight     = glm::vec3 (1.f);
+
+      if (theRnd.z < aFresnel)
+      {
+        theSample.Wi = glm::vec3 (-theWo.x, -theWo.y, theWo.z);
+      }
+      else
+      {
+        const float aCosT = std::sqrt (std::max (1.f - anEta * anEta * (1.f - aCosI * aCosI), 0.f));
+
+        theSample.Wi = glm::vec3 (-anEta * theWo.x, -anEta * theWo.y, isEntering ? -aCosT : aCosT);
+      }
+
+      return true;
+    }
+    default:
+      return false;
+  }
+}
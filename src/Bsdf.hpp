@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Scene.hpp"
+
+//! Orthonormal shading frame (Z axis is the normal).
+struct Frame
+{
+  glm::vec3 X;
+  glm::vec3 Y;
+  glm::vec3 Z;
+
+  Frame() : X (1.f, 0.f, 0.f), Y (0.f, 1.f, 0.f), Z (0.f, 0.f, 1.f) {}
+
+  //! Builds frame around the given unit normal (Duff et al., "Building an Orthonormal Basis, Revisited").
+  explicit Frame (const glm::vec3& theNormal) : Z (theNormal)
+  {
+    const float aSign = theNormal.z >= 0.f ? 1.f : -1.f;
+    const float aA = -1.f / (aSign + theNormal.z);
+    const float aB = theNormal.x * theNormal.y * aA;
+
+    X = glm::vec3 (1.f + aSign * theNormal.x * theNormal.x * aA, aSign * aB, -aSign * theNormal.x);
+    Y = glm::vec3 (aB, aSign + theNormal.y * theNormal.y * aA, -theNormal.y);
+  }
+
+  //! Transforms world direction into local frame.
+  glm::vec3 ToLocal (const glm::vec3& theDir) const
+  {
+    return glm::vec3 (glm::dot (theDir, X), glm::dot (theDir, Y), glm::dot (theDir, Z));
+  }
+
+  //! Transforms local direction into world space.
+  glm::vec3 ToWorld (const glm::vec3& theDir) const
+  {
+    return X * theDir.x + Y * theDir.y + Z * theDir.z;
+  }
+};
+
+//! Result of BSDF sampling.
+struct BsdfSample
+{
+  glm::vec3 Wi;         //!< sampled direction (local frame)
+  glm::vec3 Weight;     //!< BSDF * cosine / pdf
+  float     Pdf;        //!< solid angle density (0 for delta lobes)
+  bool      IsSpecular; //!< sampled from delta lobe
+};
+
+//! Evaluation and sampling of material scattering models.
+//! All directions are in the local shading frame and point away from the surface.
+class Bsdf
+{
+public:
+
+  //! Evaluates BSDF multiplied by cosine for directions theWo and theWi.
+  //! Returns zero for delta lobes. Density of sampling theWi is written to thePdf.
+  static glm::vec3 Eval (const Material&  theMaterial,
+                         const glm::vec3& theAlbedo,
+                         const glm::vec3& theWo,
+                         const glm::vec3& theWi,
+                         float&           thePdf);
+
+  //! Samples incident direction for the given outgoing one using random numbers theRnd.
+  static bool Sample (const Material&  theMaterial,
+                      const glm::vec3& theAlbedo,
+                      const glm::vec3& theWo,
+                      const glm::vec3& theRnd,
+                      BsdfSample&      theSample);
+
+  //! Returns true if the material has only delta lobes (can not be light sampled).
+  static bool IsDelta (const Material& theMaterial) { return theMaterial.Type == MaterialType_Dielectric; }
+
+  //! Returns angular spread used to widen ray differentials after scattering.
+  static float Spread (const Material& theMaterial);
+
+public:
+
+  //! Returns GGX normal distribution value.
+  static float GgxD (const glm::vec3& theWh, float theAlpha);
+
+  //! Returns GGX Smith lambda function.
+  static float GgxLambda (const glm::vec3& theW, float theAlpha);
+
+  //! Samples GGX distribution of visible normals (Heitz 2018).
+  static glm::vec3 GgxSampleVisible (const glm::vec3& theWo, float theAlpha, float theU1, float theU2);
+
+  //! Returns unpolarized Fresnel reflectance of dielectric interface (theCosI > 0, theEta = etaI / etaT).
+  static float FresnelDielectric (float theCosI, float theEta);
+
+};
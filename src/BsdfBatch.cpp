@@ -0,0 +1,254 @@
+#include "BsdfBatch.hpp"
+
+#include "Bsdf.hpp"
+#include "BsdfKernels.hpp"
+#include "SimdSse.hpp"
+
+#ifdef RAYLAB_HAS_X86
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+namespace
+{
+#ifdef RAYLAB_HAS_X86
+
+  //! Executes CPUID instruction.
+  void CpuId (int theLeaf, int theSubLeaf, int theRegs[4])
+  {
+  #if defined(_MSC_VER)
+    __cpuidex (theRegs, theLeaf, theSubLeaf);
+  #else
+    unsigned int aRegs[4] = {};
+    __cpuid_count (theLeaf, theSubLeaf, aRegs[0], aRegs[1], aRegs[2], aRegs[3]);
+    for (int anIdx = 0; anIdx < 4; ++anIdx)
+    {
+      theRegs[anIdx] = static_cast<int> (aRegs[anIdx]);
+    }
+  #endif
+  }
+
+  //! Returns true if OS saves AVX registers on context switch.
+  bool IsAvxStateEnabled()
+  {
+  #if defined(_MSC_VER)
+    return (_xgetbv (0) & 0x6) == 0x6;
+  #else
+    unsigned int anEax = 0, anEdx = 0;
+    __asm__ ("xgetbv" : "=a" (anEax), "=d" (anEdx) : "c" (0));
+    return (anEax & 0x6) == 0x6;
+  #endif
+  }
+
+  //! Detects the widest supported instruction set.
+  SimdIsa DetectIsa()
+  {
+    int aRegs[4];
+    CpuId (0, 0, aRegs);
+
+    const int aMaxLeaf = aRegs[0];
+    if (aMaxLeaf < 7)
+    {
+      return SimdIsa_Sse;
+    }
+
+    CpuId (1, 0, aRegs);
+    const bool hasOsxsave = (aRegs[2] & (1 << 27)) != 0;
+    const bool hasAvx     = (aRegs[2] & (1 << 28)) != 0;
+
+    CpuId (7, 0, aRegs);
+    const bool hasAvx2 = (aRegs[1] & (1 << 5)) != 0;
+
+    return hasOsxsave && hasAvx && hasAvx2 && IsAvxStateEnabled() ? SimdIsa_Avx2 : SimdIsa_Sse;
+  }
+
+#endif // RAYLAB_HAS_X86
+
+  //! Processes records with the reference implementation.
+  void ShadeScalar (const Material& theMaterial, HitRecords& theRecords, int theFirst, int theCount)
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      const Frame aFrame (glm::vec3 (theRecords.NormalX[anIdx], theRecords.NormalY[anIdx], theRecords.NormalZ[anIdx]));
+
+      const glm::vec3 aWo     = aFrame.ToLocal (glm::vec3 (theRecords.WoX[anIdx],     theRecords.WoY[anIdx],     theRecords.WoZ[anIdx]));
+      const glm::vec3 aLight  = aFrame.ToLocal (glm::vec3 (theRecords.LightX[anIdx],  theRecords.LightY[anIdx],  theRecords.LightZ[anIdx]));
+      const glm::vec3 anAlbedo               (theRecords.AlbedoR[anIdx], theRecords.AlbedoG[anIdx], theRecords.AlbedoB[anIdx]);
+
+      float aLightPdf = 0.f;
+      const glm::vec3 aLightBsdf = Bsdf::Eval (theMaterial, anAlbedo, aWo, aLight, aLightPdf);
+
+      theRecords.LightBsdfR[anIdx] = aLightBsdf.x;
+      theRecords.LightBsdfG[anIdx] = aLightBsdf.y;
+      theRecords.LightBsdfB[anIdx] = aLightBsdf.z;
+      theRecords.LightPdf[anIdx]   = aLightPdf;
+
+      BsdfSample aSample;
+      const bool isSampled = Bsdf::Sample (theMaterial, anAlbedo, aWo,
+                                           glm::vec3 (theRecords.Rnd0[anIdx], theRecords.Rnd1[anIdx], theRecords.Rnd2[anIdx]), aSample);
+
+      const glm::vec3 aWi = isSampled ? aFrame.ToWorld (aSample.Wi) : glm::vec3 (0.f);
+
+      theRecords.WiX[anIdx]       = aWi.x;
+      theRecords.WiY[anIdx]       = aWi.y;
+      theRecords.WiZ[anIdx]       = aWi.z;
+      theRecords.WeightR[anIdx]   = isSampled ? aSample.Weight.x : 0.f;
+      theRecords.WeightG[anIdx]   = isSampled ? aSample.Weight.y : 0.f;
+      theRecords.WeightB[anIdx]   = isSampled ? aSample.Weight.z : 0.f;
+      theRecords.Pdf[anIdx]       = isSampled ? aSample.Pdf : 0.f;
+      theRecords.IsSampled[anIdx] = isSampled ? -1 : 0;
+    }
+  }
+
+  //! Fills kernel arguments for the range of records.
+  BsdfKernelArgs MakeKernelArgs (const Material& theMaterial, HitRecords& theRecords, int theFirst, int theCount)
+  {
+    BsdfKernelArgs anArgs;
+
+    anArgs.Type  = theMaterial.Type == MaterialType_Diffuse ? BsdfKernel_Diffuse
+                 : theMaterial.Type == MaterialType_Glossy  ? BsdfKernel_Glossy
+                                                            : BsdfKernel_Dielectric;
+    anArgs.Alpha = theMaterial.Roughness;
+    anArgs.Ior   = theMaterial.Ior;
+    anArgs.Count = theCount;
+
+    anArgs.NormalX = &theRecords.NormalX[theFirst]; anArgs.NormalY = &theRecords.NormalY[theFirst]; anArgs.NormalZ = &theRecords.NormalZ[theFirst];
+    anArgs.WoX     = &theRecords.WoX[theFirst];     anArgs.WoY     = &theRecords.WoY[theFirst];     anArgs.WoZ     = &theRecords.WoZ[theFirst];
+    anArgs.AlbedoR = &theRecords.AlbedoR[theFirst]; anArgs.AlbedoG = &theRecords.AlbedoG[theFirst]; anArgs.AlbedoB = &theRecords.AlbedoB[theFirst];
+    anArgs.LightX  = &theRecords.LightX[theFirst];  anArgs.LightY  = &theRecords.LightY[theFirst];  anArgs.LightZ  = &theRecords.LightZ[theFirst];
+    anArgs.Rnd0    = &theRecords.Rnd0[theFirst];    anArgs.Rnd1    = &theRecords.Rnd1[theFirst];    anArgs.Rnd2    = &theRecords.Rnd2[theFirst];
+
+    anArgs.LightBsdfR = &theRecords.LightBsdfR[theFirst];
+    anArgs.LightBsdfG = &theRecords.LightBsdfG[theFirst];
+    anArgs.LightBsdfB = &theRecords.LightBsdfB[theFirst];
+    anArgs.LightPdf   = &theRecords.LightPdf[theFirst];
+
+    anArgs.WiX     = &theRecords.WiX[theFirst];     anArgs.WiY     = &theRecords.WiY[theFirst];     anArgs.WiZ     = &theRecords.WiZ[theFirst];
+    anArgs.WeightR = &theRecords.WeightR[theFirst]; anArgs.WeightG = &theRecords.WeightG[theFirst]; anArgs.WeightB = &theRecords.WeightB[theFirst];
+    anArgs.Pdf     = &theRecords.Pdf[theFirst];
+
+    anArgs.IsSampled = &theRecords.IsSampled[theFirst];
+
+    return anArgs;
+  }
+}
+
+#ifdef RAYLAB_HAS_X86
+
+//=======================================================================
+//function : ShadeBsdfBatchSse
+//purpose  :
+//=======================================================================
+void ShadeBsdfBatchSse (const BsdfKernelArgs& theArgs)
+{
+  BsdfKernels::ShadeBatch<SseFloat> (theArgs);
+}
+
+#endif
+
+//=======================================================================
+//function : Resize
+//purpose  :
+//=======================================================================
+void HitRecords::Resize (int theSize)
+{
+  const size_t aSize = static_cast<size_t> ((theSize + Width - 1) / Width * Width);
+
+  std::vector<float>* anArrays[] =
+  {
+    &PositionX, &PositionY, &PositionZ, &NormalX, &NormalY, &NormalZ, &U, &V,
+    &WoX, &WoY, &WoZ, &AlbedoR, &AlbedoG, &AlbedoB, &LightX, &LightY, &LightZ,
+    &Rnd0, &Rnd1, &Rnd2, &LightBsdfR, &LightBsdfG, &LightBsdfB, &LightPdf,
+    &WiX, &WiY, &WiZ, &WeightR, &WeightG, &WeightB, &Pdf
+  };
+
+  for (size_t anIdx = 0; anIdx < sizeof (anArrays) / sizeof (anArrays[0]); ++anIdx)
+  {
+    anArrays[anIdx]->resize (aSize);
+  }
+
+  IsSampled.resize (aSize);
+}
+
+//=======================================================================
+//function : SetEmpty
+//purpose  :
+//=======================================================================
+void HitRecords::SetEmpty (int theIdx)
+{
+  PositionX[theIdx] = PositionY[theIdx] = PositionZ[theIdx] = 0.f;
+  U[theIdx] = V[theIdx] = 0.f;
+
+  NormalX[theIdx] = NormalY[theIdx] = 0.f; NormalZ[theIdx] = 1.f;
+  WoX[theIdx]     = WoY[theIdx]     = 0.f; WoZ[theIdx]     = 1.f;
+
+  AlbedoR[theIdx] = AlbedoG[theIdx] = AlbedoB[theIdx] = 0.f;
+  LightX[theIdx]  = LightY[theIdx]  = LightZ[theIdx]  = 0.f;
+  Rnd0[theIdx]    = Rnd1[theIdx]    = Rnd2[theIdx]    = 0.5f;
+}
+
+//=======================================================================
+//function : SupportedIsa
+//purpose  :
+//=======================================================================
+SimdIsa BsdfBatch::SupportedIsa()
+{
+#ifdef RAYLAB_HAS_X86
+  static const SimdIsa anIsa = DetectIsa();
+  return anIsa;
+#else
+  return SimdIsa_Scalar;
+#endif
+}
+
+//=======================================================================
+//function : IsaName
+//purpose  :
+//=======================================================================
+const char* BsdfBatch::IsaName (int theIsa)
+{
+  switch (theIsa)
+  {
+    case SimdIsa_Scalar: return "Scalar";
+    case SimdIsa_Sse:    return "SSE2";
+    case SimdIsa_Avx2:   return "AVX2";
+  }
+
+  return "Unknown";
+}
+
+//=======================================================================
+//function : Shade
+//purpose  :
+//=======================================================================
+void BsdfBatch::Shade (const Material& theMaterial,
+                       HitRecords&     theRecords,
+                       int             theFirst,
+                       int             theCount,
+                       SimdIsa         theIsa)
+{
+  if (theCount <= 0)
+  {
+    return;
+  }
+
+  const SimdIsa anIsa = theIsa < SupportedIsa() ? theIsa : SupportedIsa();
+
+#ifdef RAYLAB_HAS_X86
+  if (anIsa == SimdIsa_Avx2)
+  {
+    ShadeBsdfBatchAvx2 (MakeKernelArgs (theMaterial, theRecords, theFirst, theCount));
+    return;
+  }
+  if (anIsa == SimdIsa_Sse)
+  {
+    ShadeBsdfBatchSse (MakeKernelArgs (theMaterial, theRecords, theFirst, theCount));
+    return;
+  }
+#endif
+
+  ShadeScalar (theMaterial, theRecords, theFirst, theCount);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Scene.hpp"
+
+//! Instruction sets of batched BSDF kernels.
+enum SimdIsa
+{
+  SimdIsa_Scalar, //!< reference implementation (Bsdf class)
+  SimdIsa_Sse,    //!< 4-wide SSE2
+  SimdIsa_Avx2,   //!< 8-wide AVX2
+  SimdIsa_NB
+};
+
+//! Structure-of-arrays records of shading points sharing single material.
+//! Directions are in world space. Inputs are filled by the caller, outputs
+//! are written by BsdfBatch::Shade().
+struct HitRecords
+{
+  //! Number of lanes processed together by the widest kernel (records are padded to it).
+  static const int Width = 8;
+
+  // Inputs
+  std::vector<float> PositionX, PositionY, PositionZ;
+  std::vector<float> NormalX,   NormalY,   NormalZ;   //!< shading normal
+  std::vector<float> U,         V;                    //!< texture coordinates
+  std::vector<float> WoX,       WoY,       WoZ;       //!< direction to the previous vertex
+  std::vector<float> AlbedoR,   AlbedoG,   AlbedoB;
+  std::vector<float> LightX,    LightY,    LightZ;    //!< direction to the emitter (zero if not sampled)
+  std::vector<float> Rnd0,      Rnd1,      Rnd2;      //!< random numbers for BSDF sampling
+
+  // Outputs
+  std::vector<float>   LightBsdfR, LightBsdfG, LightBsdfB; //!< BSDF * cosine for the emitter direction
+  std::vector<float>   LightPdf;                           //!< BSDF density of the emitter direction
+  std::vector<float>   WiX, WiY, WiZ;                      //!< sampled direction
+  std::vector<float>   WeightR, WeightG, WeightB;          //!< BSDF * cosine / pdf of the sample
+  std::vector<float>   Pdf;                                //!< density of the sample
+  std::vector<int32_t> IsSampled;                          //!< -1 if sample is valid, 0 otherwise
+
+  //! Returns number of allocated records.
+  int Size() const { return static_cast<int> (PositionX.size()); }
+
+  //! Returns size of all arrays in bytes (31 float arrays and IsSampled).
+  size_t MemorySize() const { return PositionX.size() * (31 * sizeof (float) + sizeof (int32_t)); }
+
+  //! Allocates records (rounded up to multiple of Width).
+  void Resize (int theSize);
+
+  //! Sets inputs of the record to values producing no scattering (used for padding).
+  void SetEmpty (int theIdx);
+};
+
+//! Batched evaluation and sampling of BSDFs over SoA hit records.
+//! Kernels produce the same results as Bsdf::Eval() and Bsdf::Sample() up to
+//! rounding (SIMD versions use polynomial sine and cosine).
+class BsdfBatch
+{
+public:
+
+  //! Returns the widest instruction set supported by the CPU.
+  static SimdIsa SupportedIsa();
+
+  //! Returns name of the instruction set.
+  static const char* IsaName (int theIsa);
+
+  //! Evaluates BSDF for emitter directions and samples new directions for records
+  //! [theFirst, theFirst + theCount). theFirst and theCount should be multiples of
+  //! HitRecords::Width (unsupported ISA falls back to the next narrower one).
+  static void Shade (const Material& theMaterial,
+                     HitRecords&     theRecords,
+                     int             theFirst,
+                     int             theCount,
+                     SimdIsa         theIsa);
+
+};
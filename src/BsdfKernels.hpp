@@ -0,0 +1,320 @@
+#pragma once
+
+#include <cstdint>
+
+//! Scattering models supported by kernels (mirrors MaterialType).
+enum BsdfKernelType
+{
+  BsdfKernel_Diffuse,
+  BsdfKernel_Glossy,
+  BsdfKernel_Dielectric
+};
+
+//! Raw pointers to the range of hit records processed by SIMD kernel.
+//! Kernels are compiled in translation units with different instruction
+//! sets, so they only see plain arrays (no STL or GLM code is shared).
+struct BsdfKernelArgs
+{
+  int   Type;  //!< BsdfKernelType
+  float Alpha; //!< GGX roughness
+  float Ior;   //!< index of refraction
+  int   Count; //!< number of records (multiple of SIMD width)
+
+  const float* NormalX; const float* NormalY; const float* NormalZ;
+  const float* WoX;     const float* WoY;     const float* WoZ;
+  const float* AlbedoR; const float* AlbedoG; const float* AlbedoB;
+  const float* LightX;  const float* LightY;  const float* LightZ;
+  const float* Rnd0;    const float* Rnd1;    const float* Rnd2;
+
+  float* LightBsdfR; float* LightBsdfG; float* LightBsdfB; float* LightPdf;
+  float* WiX;        float* WiY;        float* WiZ;
+  float* WeightR;    float* WeightG;    float* WeightB;    float* Pdf;
+  int32_t* IsSampled;
+};
+
+//! Processes records with SSE2 kernel.
+void ShadeBsdfBatchSse (const BsdfKernelArgs& theArgs);
+
+//! Processes records with AVX2 kernel (compiled with AVX2 enabled, call only if CPU supports it).
+void ShadeBsdfBatchAvx2 (const BsdfKernelArgs& theArgs);
+
+//! Generic BSDF kernel over SIMD type V.
+//! V provides arithmetic operators, broadcast constructor from float, static
+//! Load()/Store()/StoreMask() and functions Less(), Greater(), Equal(), And(),
+//! Or(), Select(), Min(), Max(), Sqrt() and Abs() found by argument-dependent lookup.
+//! The math mirrors Bsdf::Eval() and Bsdf::Sample() lane by lane.
+namespace BsdfKernels
+{
+  const float THE_PI = 3.14159265358979f;
+
+  //! SIMD three-component vector.
+  template<class V>
+  struct Vec3
+  {
+    V X, Y, Z;
+
+    Vec3() {}
+    Vec3 (const V& theX, const V& theY, const V& theZ) : X (theX), Y (theY), Z (theZ) {}
+  };
+
+  template<class V>
+  inline V Dot (const Vec3<V>& theA, const Vec3<V>& theB)
+  {
+    return theA.X * theB.X + theA.Y * theB.Y + theA.Z * theB.Z;
+  }
+
+  template<class V>
+  inline Vec3<V> Normalize (const Vec3<V>& theA)
+  {
+    const V anInvLen = V (1.f) / Sqrt (Dot (theA, theA));
+    return Vec3<V> (theA.X * anInvLen, theA.Y * anInvLen, theA.Z * anInvLen);
+  }
+
+  //! Computes sine and cosine of 2 * PI * theTurns for theTurns in [0, 1].
+  template<class V>
+  inline void SinCos2Pi (const V& theTurns, V& theSin, V& theCos)
+  {
+    // Shift by half turn into [-PI, PI], then reflect into [-PI / 2, PI / 2]
+    V anAngle = (theTurns - V (0.5f)) * V (2.f * THE_PI);
+
+    const V isAbove = Greater (anAngle, V ( 0.5f * THE_PI));
+    const V isBelow = Less    (anAngle, V (-0.5f * THE_PI));
+
+    anAngle = Select (isAbove, V ( THE_PI) - anAngle, anAngle);
+    anAngle = Select (isBelow, V (-THE_PI) - anAngle, anAngle);
+
+    const V anAngle2 = anAngle * anAngle;
+
+    // Taylor polynomials (error below 1e-7 on [-PI / 2, PI / 2])
+    V aSin = V (-2.5052108e-8f);
+    aSin = aSin * anAngle2 + V ( 2.7557319e-6f);
+    aSin = aSin * anAngle2 + V (-1.9841270e-4f);
+    aSin = aSin * anAngle2 + V ( 8.3333333e-3f);
+    aSin = aSin * anAngle2 + V (-1.6666667e-1f);
+    aSin = (aSin * anAngle2 + V (1.f)) * anAngle;
+
+    V aCos = V (2.0876757e-9f);
+    aCos = aCos * anAngle2 + V (-2.7557319e-7f);
+    aCos = aCos * anAngle2 + V ( 2.4801587e-5f);
+    aCos = aCos * anAngle2 + V (-1.3888889e-3f);
+    aCos = aCos * anAngle2 + V ( 4.1666667e-2f);
+    aCos = aCos * anAngle2 + V (-0.5f);
+    aCos = aCos * anAngle2 + V (1.f);
+
+    // Undo half turn shift and reflection
+    theSin = -aSin;
+    theCos = Select (Or (isAbove, isBelow), aCos, -aCos);
+  }
+
+  //! GGX normal distribution.
+  template<class V>
+  inline V GgxD (const Vec3<V>& theWh, const V& theAlpha2)
+  {
+    const V aDenom = theWh.Z * theWh.Z * (theAlpha2 - V (1.f)) + V (1.f);
+    return Select (Greater (theWh.Z, V (0.f)), theAlpha2 / (V (THE_PI) * aDenom * aDenom), V (0.f));
+  }
+
+  //! GGX Smith lambda function.
+  template<class V>
+  inline V GgxLambda (const Vec3<V>& theW, const V& theAlpha2)
+  {
+    const V aCos2 = theW.Z * theW.Z;
+    const V aTan2 = Max (V (1.f) - aCos2, V (0.f)) / Max (aCos2, V (1.0e-30f));
+
+    return Select (Greater (aCos2, V (0.f)), V (0.5f) * (Sqrt (V (1.f) + theAlpha2 * aTan2) - V (1.f)), V (1.0e10f));
+  }
+
+  //! Schlick approximation of Fresnel reflectance (single channel).
+  template<class V>
+  inline V FresnelSchlick (const V& theF0, const V& theCos)
+  {
+    const V aM  = Min (Max (V (1.f) - theCos, V (0.f)), V (1.f));
+    const V aM2 = aM * aM;
+    return theF0 + (V (1.f) - theF0) * (aM2 * aM2 * aM);
+  }
+
+  //! Samples GGX distribution of visible normals (Heitz 2018).
+  template<class V>
+  inline Vec3<V> GgxSampleVisible (const Vec3<V>& theWo, const V& theAlpha, const V& theU1, const V& theU2)
+  {
+    const Vec3<V> aVh = Normalize (Vec3<V> (theAlpha * theWo.X, theAlpha * theWo.Y, theWo.Z));
+
+    const V aLenSq    = aVh.X * aVh.X + aVh.Y * aVh.Y;
+    const V hasLength = Greater (aLenSq, V (0.f));
+    const V anInvLen  = V (1.f) / Sqrt (Select (hasLength, aLenSq, V (1.f)));
+
+    const Vec3<V> aT1 (Select (hasLength, -aVh.Y * anInvLen, V (1.f)),
+                       Select (hasLength,  aVh.X * anInvLen, V (0.f)),
+                       V (0.f));
+    const Vec3<V> aT2 (aVh.Y * aT1.Z - aVh.Z * aT1.Y,
+                       aVh.Z * aT1.X - aVh.X * aT1.Z,
+                       aVh.X * aT1.Y - aVh.Y * aT1.X);
+
+    V aSin, aCos;
+    SinCos2Pi (theU2, aSin, aCos);
+
+    const V aR = Sqrt (theU1);
+    const V aS = V (0.5f) * (V (1.f) + aVh.Z);
+
+    const V aP1 = aR * aCos;
+    const V aP2 = (V (1.f) - aS) * Sqrt (Max (V (1.f) - aP1 * aP1, V (0.f))) + aS * aR * aSin;
+    const V aP3 = Sqrt (Max (V (1.f) - aP1 * aP1 - aP2 * aP2, V (0.f)));
+
+    const Vec3<V> aNh (aP1 * aT1.X + aP2 * aT2.X + aP3 * aVh.X,
+                       aP1 * aT1.Y + aP2 * aT2.Y + aP3 * aVh.Y,
+                       aP1 * aT1.Z + aP2 * aT2.Z + aP3 * aVh.Z);
+
+    return Normalize (Vec3<V> (theAlpha * aNh.X, theAlpha * aNh.Y, Max (aNh.Z, V (0.f))));
+  }
+
+  //! Shades records: builds shading frames, evaluates BSDF for emitter directions
+  //! and samples continuation directions.
+  template<class V>
+  inline void ShadeBatch (const BsdfKernelArgs& theArgs)
+  {
+    const V anAlpha  (theArgs.Alpha);
+    const V anAlpha2 (theArgs.Alpha * theArgs.Alpha);
+    const V aZero    (0.f);
+    const V anOne    (1.f);
+
+    for (int anIdx = 0; anIdx < theArgs.Count; anIdx += V::Width)
+    {
+      const Vec3<V> aN      (V::Load (theArgs.NormalX + anIdx), V::Load (theArgs.NormalY + anIdx), V::Load (theArgs.NormalZ + anIdx));
+      const Vec3<V> aWoW    (V::Load (theArgs.WoX     + anIdx), V::Load (theArgs.WoY     + anIdx), V::Load (theArgs.WoZ     + anIdx));
+      const Vec3<V> aLightW (V::Load (theArgs.LightX  + anIdx), V::Load (theArgs.LightY  + anIdx), V::Load (theArgs.LightZ  + anIdx));
+      const Vec3<V> anAlb   (V::Load (theArgs.AlbedoR + anIdx), V::Load (theArgs.AlbedoG + anIdx), V::Load (theArgs.AlbedoB + anIdx));
+
+      const V aRnd0 = V::Load (theArgs.Rnd0 + anIdx);
+      const V aRnd1 = V::Load (theArgs.Rnd1 + anIdx);
+      const V aRnd2 = V::Load (theArgs.Rnd2 + anIdx);
+
+      // Shading frame (Duff et al. 2017)
+      const V aSign = Select (Less (aN.Z, aZero), V (-1.f), anOne);
+      const V anA   = V (-1.f) / (aSign + aN.Z);
+      const V aB    = aN.X * aN.Y * anA;
+
+      const Vec3<V> aFrameX (anOne + aSign * aN.X * aN.X * anA, aSign * aB, -aSign * aN.X);
+      const Vec3<V> aFrameY (aB, aSign + aN.Y * aN.Y * anA, -aN.Y);
+
+      const Vec3<V> aWo (Dot (aWoW,    aFrameX), Dot (aWoW,    aFrameY), Dot (aWoW,    aN));
+      const Vec3<V> aWl (Dot (aLightW, aFrameX), Dot (aLightW, aFrameY), Dot (aLightW, aN));
+
+      const V isAbove = Greater (aWo.Z, aZero);
+
+      Vec3<V> aLightBsdf (aZero, aZero, aZero);
+      V       aLightPdf = aZero;
+
+      Vec3<V> aWi;
+      Vec3<V> aWeight;
+      V       aPdf = aZero;
+      V       isSampled;
+
+      switch (theArgs.Type)
+      {
+        case BsdfKernel_Diffuse:
+        {
+          const V isValid = And (isAbove, Greater (aWl.Z, aZero));
+
+          aLightPdf  = Select (isValid, aWl.Z * V (1.f / THE_PI), aZero);
+          aLightBsdf = Vec3<V> (anAlb.X * aLightPdf, anAlb.Y * aLightPdf, anAlb.Z * aLightPdf);
+
+          // Cosine-weighted hemisphere sampling
+          V aSin, aCos;
+          SinCos2Pi (aRnd1, aSin, aCos);
+
+          const V aR = Sqrt (aRnd0);
+
+          aWi       = Vec3<V> (aR * aCos, aR * aSin, Sqrt (Max (anOne - aRnd0, aZero)));
+          aPdf      = aWi.Z * V (1.f / THE_PI);
+          aWeight   = anAlb;
+          isSampled = And (isAbove, Greater (aPdf, aZero));
+          break;
+        }
+        case BsdfKernel_Glossy:
+        {
+          const V isValid = And (isAbove, Greater (aWl.Z, aZero));
+
+          const V aWoZ4     = V (4.f) * aWo.Z;
+          const V aLambdaO  = GgxLambda (aWo, anAlpha2);
+
+          // Emitter direction
+          {
+            const Vec3<V> aWh = Normalize (Vec3<V> (aWo.X + aWl.X, aWo.Y + aWl.Y, aWo.Z + aWl.Z));
+
+            const V aD       = GgxD (aWh, anAlpha2);
+            const V aLambdaI = GgxLambda (aWl, anAlpha2);
+            const V aCosH    = Dot (aWl, aWh);
+            const V aScale   = Select (isValid, aD / (aWoZ4 * (anOne + aLambdaO + aLambdaI)), aZero);
+
+            aLightPdf  = Select (isValid, aD / (aWoZ4 * (anOne + aLambdaO)), aZero);
+            aLightBsdf = Vec3<V> (FresnelSchlick (anAlb.X, aCosH) * aScale,
+                                  FresnelSchlick (anAlb.Y, aCosH) * aScale,
+                                  FresnelSchlick (anAlb.Z, aCosH) * aScale);
+          }
+
+          // Sampling of visible normals
+          {
+            const Vec3<V> aWh = GgxSampleVisible (aWo, anAlpha, aRnd0, aRnd1);
+
+            const V aCosO = V (2.f) * Dot (aWo, aWh);
+            aWi = Vec3<V> (aCosO * aWh.X - aWo.X, aCosO * aWh.Y - aWo.Y, aCosO * aWh.Z - aWo.Z);
+
+            const V aLambdaI = GgxLambda (aWi, anAlpha2);
+            const V aCosH    = Dot (aWi, aWh);
+            const V aScale   = (anOne + aLambdaO) / (anOne + aLambdaO + aLambdaI);
+
+            aPdf      = GgxD (aWh, anAlpha2) / (aWoZ4 * (anOne + aLambdaO));
+            aWeight   = Vec3<V> (FresnelSchlick (anAlb.X, aCosH) * aScale,
+                                 FresnelSchlick (anAlb.Y, aCosH) * aScale,
+                                 FresnelSchlick (anAlb.Z, aCosH) * aScale);
+            isSampled = And (And (isAbove, Greater (aWi.Z, aZero)), Greater (aPdf, aZero));
+          }
+          break;
+        }
+        default: // BsdfKernel_Dielectric
+        {
+          const V aCosI = Abs (aWo.Z);
+          const V anEta = Select (isAbove, V (1.f / theArgs.Ior), V (theArgs.Ior));
+
+          const V aSin2T = anEta * anEta * Max (anOne - aCosI * aCosI, aZero);
+          const V aCosT  = Sqrt (Max (anOne - aSin2T, aZero));
+
+          const V aRs = (anEta * aCosI - aCosT) / (anEta * aCosI + aCosT);
+          const V aRp = (aCosI - anEta * aCosT) / (aCosI + anEta * aCosT);
+
+          const V aFresnel = Select (Less (aSin2T, anOne), V (0.5f) * (aRs * aRs + aRp * aRp), anOne);
+
+          const V isReflected = Less (aRnd2, aFresnel);
+
+          aWi = Vec3<V> (Select (isReflected, -aWo.X, -anEta * aWo.X),
+                         Select (isReflected, -aWo.Y, -anEta * aWo.Y),
+                         Select (isReflected,  aWo.Z, Select (isAbove, -aCosT, aCosT)));
+
+          aWeight   = Vec3<V> (anOne, anOne, anOne);
+          isSampled = Equal (aZero, aZero);
+          break;
+        }
+      }
+
+      // Back to world space
+      const Vec3<V> aWiW (aFrameX.X * aWi.X + aFrameY.X * aWi.Y + aN.X * aWi.Z,
+                          aFrameX.Y * aWi.X + aFrameY.Y * aWi.Y + aN.Y * aWi.Z,
+                          aFrameX.Z * aWi.X + aFrameY.Z * aWi.Y + aN.Z * aWi.Z);
+
+      V::Store (theArgs.LightBsdfR + anIdx, aLightBsdf.X);
+      V::Store (theArgs.LightBsdfG + anIdx, aLightBsdf.Y);
+      V::Store (theArgs.LightBsdfB + anIdx, aLightBsdf.Z);
+      V::Store (theArgs.LightPdf   + anIdx, aLightPdf);
+
+      V::Store (theArgs.WiX     + anIdx, aWiW.X);
+      V::Store (theArgs.WiY     + anIdx, aWiW.Y);
+      V::Store (theArgs.WiZ     + anIdx, aWiW.Z);
+      V::Store (theArgs.WeightR + anIdx, aWeight.X);
+      V::Store (theArgs.WeightG + anIdx, aWeight.Y);
+      V::Store (theArgs.WeightB + anIdx, aWeight.Z);
+      V::Store (theArgs.Pdf     + anIdx, aPdf);
+
+      V::StoreMask (theArgs.IsSampled + anIdx, isSampled);
+    }
+  }
+}
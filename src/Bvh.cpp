@@ -0,0 +1,1301 @@
+#include "Bvh.hpp"
+
+#include "HugePages.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+namespace
+{
+  //! Depth after which splits fall back to object median to bound tree depth.
+  const int THE_MEDIAN_SPLIT_DEPTH = 64;
+
+  //! Relative cost of node traversal step in SAH.
+  const float THE_TRAVERSAL_COST = 1.f;
+
+  //! Minimum number of subtrees refitted in parallel.
+  const int THE_REFIT_SUBTREES = 64;
+
+  //! Build task for the node covering index range [Begin, End).
+  struct BuildTask
+  {
+    int Node;
+    int Begin;
+    int End;
+    int Depth;
+  };
+
+  //! Size of subtree: nodes and primitive references.
+  struct SubtreeSize
+  {
+    int Nodes;
+    int References;
+  };
+
+  //! Computes sizes of subtrees reachable from theNode.
+  SubtreeSize ComputeSizes (const std::vector<BvhNode>& theNodes, int theNode, std::vector<SubtreeSize>& theSizes)
+  {
+    const BvhNode& aNode = theNodes[theNode];
+
+    SubtreeSize aSize = { 1, aNode.Count };
+    if (!aNode.IsLeaf())
+    {
+      const SubtreeSize aLft = ComputeSizes (theNodes, aNode.LeftOrFirst,     theSizes);
+      const SubtreeSize aRgh = ComputeSizes (theNodes, aNode.LeftOrFirst + 1, theSizes);
+      aSize.Nodes     += aLft.Nodes + aRgh.Nodes;
+      aSize.References = aLft.References + aRgh.References;
+    }
+
+    theSizes[theNode] = aSize;
+    return aSize;
+  }
+
+  //! SAH bin.
+  struct Bin
+  {
+    Box Bounds;
+    int Count;
+
+    Bin() : Count (0) {}
+  };
+
+  //! Bin of spatial split search counting references entering and leaving it.
+  struct SpatialBin
+  {
+    Box Bounds;
+    int Entry;
+    int Exit;
+
+    SpatialBin() : Entry (0), Exit (0) {}
+  };
+
+  //! Primitive reference of spatial split build (bounds may be clipped).
+  struct Reference
+  {
+    int Prim;
+    Box Bounds;
+  };
+
+  //! Build task of spatial split build owning its references.
+  struct SpatialTask
+  {
+    int                    Node;
+    int                    Depth;
+    std::vector<Reference> Refs;
+  };
+
+  //! Maximum number of leaves of restructured treelet.
+  const int THE_TREELET_SIZE = 7;
+
+  //! Number of treelet restructuring passes.
+  const int THE_TREELET_PASSES = 3;
+
+  //! Minimum overlap of object split children (relative to root area) to try spatial split.
+  const float THE_SPATIAL_OVERLAP = 1.0e-5f;
+
+  //! Returns intersection of two boxes (may be invalid).
+  inline Box Intersection (const Box& theBox1, const Box& theBox2)
+  {
+    return Box (glm::max (theBox1.Min, theBox2.Min), glm::min (theBox1.Max, theBox2.Max));
+  }
+
+  //! Returns the box with coordinates along the axis limited by [theMin, theMax].
+  inline Box ClipSlab (const Box& theBox, int theAxis, float theMin, float theMax)
+  {
+    Box aBox = theBox;
+    aBox.Min[theAxis] = std::max (aBox.Min[theAxis], theMin);
+    aBox.Max[theAxis] = std::min (aBox.Max[theAxis], theMax);
+    return aBox;
+  }
+}
+
+//=======================================================================
+//function : Bvh
+//purpose  :
+//=======================================================================
+Bvh::Bvh()
+: myNbPrims (0),
+  myNbBins (16),
+  myMaxLeafSize (4),
+  myNbGarbage (0),
+  myRebuildThreshold (1.5f)
+{
+  //
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void Bvh::Clear()
+{
+  myNodes.clear();
+  myIndices.clear();
+  mySubtrees.clear();
+  myNbPrims = 0;
+  myTopNodes.clear();
+  myNbGarbage = 0;
+}
+
+//=======================================================================
+//function : Build
+//purpose  :
+//=======================================================================
+void Bvh::Build (const std::vector<Box>& theBoxes)
+{
+  Clear();
+
+  const int aNbPrims = static_cast<int> (theBoxes.size());
+  if (aNbPrims == 0)
+  {
+    return;
+  }
+
+  std::vector<glm::vec3> aCenters (aNbPrims);
+
+  myNbPrims = aNbPrims;
+  myIndices.resize (aNbPrims);
+  for (int anIdx = 0; anIdx < aNbPrims; ++anIdx)
+  {
+    myIndices[anIdx] = anIdx;
+    aCenters[anIdx]  = theBoxes[anIdx].Center();
+  }
+
+  myNodes.reserve (2 * aNbPrims / myMaxLeafSize + 1);
+  myNodes.push_back (BvhNode());
+
+  buildNode (theBoxes, aCenters, 0, 0, aNbPrims, 0);
+
+  selectSubtrees();
+}
+
+//=======================================================================
+//function : buildNode
+//purpose  :
+//=======================================================================
+void Bvh::buildNode (const std::vector<Box>&       theBoxes,
+                     const std::vector<glm::vec3>& theCenters,
+                     int                           theNode,
+                     int                           theBegin,
+                     int                           theEnd,
+                     int                           theDepth)
+{
+  std::vector<BuildTask> aTasks;
+  aTasks.push_back (BuildTask { theNode, theBegin, theEnd, theDepth });
+
+  std::vector<Bin>   aBins (myNbBins);
+  std::vector<Box>   aRghBounds (myNbBins);
+  std::vector<int>   aRghCounts (myNbBins);
+
+  while (!aTasks.empty())
+  {
+    const BuildTask aTask = aTasks.back();
+    aTasks.pop_back();
+
+    Box aBounds;
+    Box aCenterBounds;
+    for (int anIdx = aTask.Begin; anIdx < aTask.End; ++anIdx)
+    {
+      aBounds.Add (theBoxes[myIndices[anIdx]]);
+      aCenterBounds.Add (theCenters[myIndices[anIdx]]);
+    }
+
+    BvhNode& aNode = myNodes[aTask.Node];
+    aNode.Bounds      = aBounds;
+    aNode.LeftOrFirst = aTask.Begin;
+    aNode.Count       = aTask.End - aTask.Begin;
+
+    const int aCount = aTask.End - aTask.Begin;
+    if (aCount <= 1 || aTask.Depth >= MaxDepth - 1)
+    {
+      continue;
+    }
+
+    // Find the best split among all axes using binned SAH
+    float aBestCost  = FLT_MAX;
+    int   aBestAxis  = -1;
+    int   aBestSplit = -1;
+
+    const glm::vec3 aCenterSize = aCenterBounds.Size();
+
+    for (int anAxis = 0; anAxis < 3 && aTask.Depth < THE_MEDIAN_SPLIT_DEPTH; ++anAxis)
+    {
+      if (aCenterSize[anAxis] <= 0.f)
+      {
+        continue;
+      }
+
+      const float aScale = myNbBins / aCenterSize[anAxis];
+
+      std::fill (aBins.begin(), aBins.end(), Bin());
+
+      for (int anIdx = aTask.Begin; anIdx < aTask.End; ++anIdx)
+      {
+        const int aPrim = myIndices[anIdx];
+        const int aBin  = std::min (static_cast<int> ((theCenters[aPrim][anAxis] - aCenterBounds.Min[anAxis]) * aScale), myNbBins - 1);
+
+        aBins[aBin].Bounds.Add (theBoxes[aPrim]);
+        aBins[aBin].Count++;
+      }
+
+      Box aRghBox;
+      int aRghCount = 0;
+      for (int aBin = myNbBins - 1; aBin > 0; --aBin)
+      {
+        aRghBox.Add (aBins[aBin].Bounds);
+        aRghCount += aBins[aBin].Count;
+
+        aRghBounds[aBin] = aRghBox;
+        aRghCounts[aBin] = aRghCount;
+      }
+
+      Box aLftBox;
+      int aLftCount = 0;
+      for (int aSplit = 1; aSplit < myNbBins; ++aSplit)
+      {
+        aLftBox.Add (aBins[aSplit - 1].Bounds);
+        aLftCount += aBins[aSplit - 1].Count;
+
+        if (aLftCount == 0 || aRghCounts[aSplit] == 0)
+        {
+          continue;
+        }
+
+        const float aCost = aLftBox.Area() * aLftCount + aRghBounds[aSplit].Area() * aRghCounts[aSplit];
+        if (aCost < aBestCost)
+        {
+          aBestCost  = aCost;
+          aBestAxis  = anAxis;
+          aBestSplit = aSplit;
+        }
+      }
+    }
+
+    int aMiddle = -1;
+
+    if (aBestAxis != -1)
+    {
+      const float aLeafCost  = static_cast<float> (aCount);
+      const float aSplitCost = THE_TRAVERSAL_COST + aBestCost / std::max (aBounds.Area(), FLT_MIN);
+
+      if (aSplitCost >= aLeafCost && aCount <= myMaxLeafSize)
+      {
+        continue;
+      }
+
+      const float aScale = myNbBins / aCenterSize[aBestAxis];
+      const float aMin   = aCenterBounds.Min[aBestAxis];
+
+      aMiddle = static_cast<int> (std::partition (myIndices.begin() + aTask.Begin, myIndices.begin() + aTask.End, [&](int thePrim)
+      {
+        return std::min (static_cast<int> ((theCenters[thePrim][aBestAxis] - aMin) * aScale), myNbBins - 1) < aBestSplit;
+      }) - myIndices.begin());
+    }
+    else
+    {
+      if (aCount <= myMaxLeafSize)
+      {
+        continue;
+      }
+
+      // All centers coincide (or the tree is too deep): split at object median
+      const int anAxis = aCenterSize.x >= aCenterSize.y ? (aCenterSize.x >= aCenterSize.z ? 0 : 2)
+                                                        : (aCenterSize.y >= aCenterSize.z ? 1 : 2);
+
+      aMiddle = aTask.Begin + aCount / 2;
+      std::nth_element (myIndices.begin() + aTask.Begin, myIndices.begin() + aMiddle, myIndices.begin() + aTask.End, [&](int thePrim1, int thePrim2)
+      {
+        return theCenters[thePrim1][anAxis] < theCenters[thePrim2][anAxis];
+      });
+    }
+
+    const int aLft = static_cast<int> (myNodes.size());
+
+    myNodes[aTask.Node].LeftOrFirst = aLft;
+    myNodes[aTask.Node].Count       = 0;
+
+    myNodes.push_back (BvhNode());
+    myNodes.push_back (BvhNode());
+
+    aTasks.push_back (BuildTask { aLft + 1, aMiddle, aTask.End, aTask.Depth + 1 });
+    aTasks.push_back (BuildTask { aLft, aTask.Begin, aMiddle, aTask.Depth + 1 });
+  }
+}
+
+//=======================================================================
+//function : BuildSpatial
+//purpose  :
+//=======================================================================
+void Bvh::BuildSpatial (const std::vector<Box>& theBoxes, const ClipFunc& theClip, float theMaxGrowth)
+{
+  Clear();
+
+  const int aNbPrims = static_cast<int> (theBoxes.size());
+  if (aNbPrims == 0)
+  {
+    return;
+  }
+
+  myNbPrims = aNbPrims;
+
+  const size_t aMaxRefs = std::max (static_cast<size_t> (aNbPrims), static_cast<size_t> (aNbPrims * std::max (theMaxGrowth, 1.f)));
+  size_t aNbRefs = aNbPrims;
+
+  std::vector<SpatialTask> aTasks (1);
+  aTasks[0].Node  = 0;
+  aTasks[0].Depth = 0;
+  aTasks[0].Refs.resize (aNbPrims);
+
+  Box aRootBounds;
+  for (int aPrim = 0; aPrim < aNbPrims; ++aPrim)
+  {
+    aTasks[0].Refs[aPrim].Prim   = aPrim;
+    aTasks[0].Refs[aPrim].Bounds = theBoxes[aPrim];
+    aRootBounds.Add (theBoxes[aPrim]);
+  }
+
+  const float aMinOverlap = aRootBounds.Area() * THE_SPATIAL_OVERLAP;
+
+  myNodes.reserve (2 * aNbPrims / myMaxLeafSize + 1);
+  myIndices.reserve (aNbPrims);
+  myNodes.push_back (BvhNode());
+
+  std::vector<Bin>        aBins (myNbBins);
+  std::vector<SpatialBin> aSpatialBins (myNbBins);
+  std::vector<Box>        aRghBounds (myNbBins);
+  std::vector<int>        aRghCounts (myNbBins);
+
+  while (!aTasks.empty())
+  {
+    SpatialTask aTask;
+    aTask.Node  = aTasks.back().Node;
+    aTask.Depth = aTasks.back().Depth;
+    aTask.Refs.swap (aTasks.back().Refs);
+    aTasks.pop_back();
+
+    std::vector<Reference>& aRefs = aTask.Refs;
+    const int aCount = static_cast<int> (aRefs.size());
+
+    Box aBounds;
+    Box aCenterBounds;
+    for (int anIdx = 0; anIdx < aCount; ++anIdx)
+    {
+      aBounds.Add (aRefs[anIdx].Bounds);
+      aCenterBounds.Add (aRefs[anIdx].Bounds.Center());
+    }
+
+    // Leaves are emitted in depth-first order, so subtrees keep contiguous index ranges
+    auto aMakeLeaf = [&]()
+    {
+      BvhNode& aLeaf = myNodes[aTask.Node];
+      aLeaf.Bounds      = aBounds;
+      aLeaf.LeftOrFirst = static_cast<int> (myIndices.size());
+      aLeaf.Count       = aCount;
+
+      for (int anIdx = 0; anIdx < aCount; ++anIdx)
+      {
+        myIndices.push_back (aRefs[anIdx].Prim);
+      }
+    };
+
+    if (aCount <= 1 || aTask.Depth >= MaxDepth - 1)
+    {
+      aMakeLeaf();
+      continue;
+    }
+
+    // Object split: binned SAH over reference centers
+    float aBestCost  = FLT_MAX;
+    int   aBestAxis  = -1;
+    int   aBestSplit = -1;
+    Box   aBestLft;
+    Box   aBestRgh;
+
+    const glm::vec3 aCenterSize = aCenterBounds.Size();
+
+    for (int anAxis = 0; anAxis < 3 && aTask.Depth < THE_MEDIAN_SPLIT_DEPTH; ++anAxis)
+    {
+      if (aCenterSize[anAxis] <= 0.f)
+      {
+        continue;
+      }
+
+      const float aScale = myNbBins / aCenterSize[anAxis];
+
+      std::fill (aBins.begin(), aBins.end(), Bin());
+
+      for (int anIdx = 0; anIdx < aCount; ++anIdx)
+      {
+        const int aBin = std::min (static_cast<int> ((aRefs[anIdx].Bounds.Center()[anAxis] - aCenterBounds.Min[anAxis]) * aScale), myNbBins - 1);
+
+        aBins[aBin].Bounds.Add (aRefs[anIdx].Bounds);
+        aBins[aBin].Count++;
+      }
+
+      Box aRghBox;
+      int aRghCount = 0;
+      for (int aBin = myNbBins - 1; aBin > 0; --aBin)
+      {
+        aRghBox.Add (aBins[aBin].Bounds);
+        aRghCount += aBins[aBin].Count;
+
+        aRghBounds[aBin] = aRghBox;
+        aRghCounts[aBin] = aRghCount;
+      }
+
+      Box aLftBox;
+      int aLftCount = 0;
+      for (int aSplit = 1; aSplit < myNbBins; ++aSplit)
+      {
+        aLftBox.Add (aBins[aSplit - 1].Bounds);
+        aLftCount += aBins[aSplit - 1].Count;
+
+        if (aLftCount == 0 || aRghCounts[aSplit] == 0)
+        {
+          continue;
+        }
+
+        const float aCost = aLftBox.Area() * aLftCount + aRghBounds[aSplit].Area() * aRghCounts[aSplit];
+        if (aCost < aBestCost)
+        {
+          aBestCost  = aCost;
+          aBestAxis  = anAxis;
+          aBestSplit = aSplit;
+          aBestLft   = aLftBox;
+          aBestRgh   = aRghBounds[aSplit];
+        }
+      }
+    }
+
+    // Spatial split: tried only if children of object split overlap noticeably
+    bool  isSpatial   = false;
+    float aSplitPlane = 0.f;
+
+    const bool toTrySpatial = aNbRefs < aMaxRefs
+                           && aTask.Depth < THE_MEDIAN_SPLIT_DEPTH
+                           && (aBestAxis == -1 || Intersection (aBestLft, aBestRgh).Area() > aMinOverlap);
+
+    const glm::vec3 aSize = aBounds.Size();
+    for (int anAxis = 0; anAxis < 3 && toTrySpatial; ++anAxis)
+    {
+      if (aSize[anAxis] <= 0.f)
+      {
+        continue;
+      }
+
+      const float aBinSize = aSize[anAxis] / myNbBins;
+      const float aScale   = myNbBins / aSize[anAxis];
+
+      std::fill (aSpatialBins.begin(), aSpatialBins.end(), SpatialBin());
+
+      for (int anIdx = 0; anIdx < aCount; ++anIdx)
+      {
+        const Reference& aRef = aRefs[anIdx];
+
+        const int aFirst = std::max (std::min (static_cast<int> ((aRef.Bounds.Min[anAxis] - aBounds.Min[anAxis]) * aScale), myNbBins - 1), 0);
+        const int aLast  = std::max (std::min (static_cast<int> ((aRef.Bounds.Max[anAxis] - aBounds.Min[anAxis]) * aScale), myNbBins - 1), aFirst);
+
+        for (int aBin = aFirst; aBin <= aLast; ++aBin)
+        {
+          if (aFirst == aLast)
+          {
+            aSpatialBins[aBin].Bounds.Add (aRef.Bounds);
+            continue;
+          }
+
+          const float aMin = aBounds.Min[anAxis] + aBinSize * aBin;
+          const float aMax = aBin == myNbBins - 1 ? aBounds.Max[anAxis] : aMin + aBinSize;
+
+          const Box aPart = Intersection (theClip (aRef.Prim, ClipSlab (aRef.Bounds, anAxis, aMin, aMax)), aRef.Bounds);
+          if (aPart.IsValid())
+          {
+            aSpatialBins[aBin].Bounds.Add (aPart);
+          }
+        }
+
+        aSpatialBins[aFirst].Entry++;
+        aSpatialBins[aLast].Exit++;
+      }
+
+      Box aRghBox;
+      int aRghCount = 0;
+      for (int aBin = myNbBins - 1; aBin > 0; --aBin)
+      {
+        aRghBox.Add (aSpatialBins[aBin].Bounds);
+        aRghCount += aSpatialBins[aBin].Exit;
+
+        aRghBounds[aBin] = aRghBox;
+        aRghCounts[aBin] = aRghCount;
+      }
+
+      Box aLftBox;
+      int aLftCount = 0;
+      for (int aSplit = 1; aSplit < myNbBins; ++aSplit)
+      {
+        aLftBox.Add (aSpatialBins[aSplit - 1].Bounds);
+        aLftCount += aSpatialBins[aSplit - 1].Entry;
+
+        const int aNbDuplicates = aLftCount + aRghCounts[aSplit] - aCount;
+        if (aLftCount == 0 || aRghCounts[aSplit] == 0
+         || (aLftCount == aCount && aRghCounts[aSplit] == aCount)
+         || aNbRefs + aNbDuplicates > aMaxRefs)
+        {
+          continue;
+        }
+
+        const float aCost = aLftBox.Area() * aLftCount + aRghBounds[aSplit].Area() * aRghCounts[aSplit];
+        if (aCost < aBestCost)
+        {
+          aBestCost   = aCost;
+          aBestAxis   = anAxis;
+          isSpatial   = true;
+          aSplitPlane = aBounds.Min[anAxis] + aBinSize * aSplit;
+        }
+      }
+    }
+
+    SpatialTask aLft;
+    SpatialTask aRgh;
+
+    if (aBestAxis != -1)
+    {
+      const float aLeafCost  = static_cast<float> (aCount);
+      const float aSplitCost = THE_TRAVERSAL_COST + aBestCost / std::max (aBounds.Area(), FLT_MIN);
+
+      if (aSplitCost >= aLeafCost && aCount <= myMaxLeafSize)
+      {
+        aMakeLeaf();
+        continue;
+      }
+    }
+    else if (aCount <= myMaxLeafSize)
+    {
+      aMakeLeaf();
+      continue;
+    }
+
+    if (isSpatial)
+    {
+      for (int anIdx = 0; anIdx < aCount; ++anIdx)
+      {
+        const Reference& aRef = aRefs[anIdx];
+        if (aRef.Bounds.Max[aBestAxis] <= aSplitPlane)
+        {
+          aLft.Refs.push_back (aRef);
+        }
+        else if (aRef.Bounds.Min[aBestAxis] >= aSplitPlane)
+        {
+          aRgh.Refs.push_back (aRef);
+        }
+        else
+        {
+          Reference aPart = aRef;
+          aPart.Bounds = Intersection (theClip (aRef.Prim, ClipSlab (aRef.Bounds, aBestAxis, -FLT_MAX, aSplitPlane)), aRef.Bounds);
+          if (aPart.Bounds.IsValid())
+          {
+            aLft.Refs.push_back (aPart);
+          }
+
+          aPart.Bounds = Intersection (theClip (aRef.Prim, ClipSlab (aRef.Bounds, aBestAxis, aSplitPlane, FLT_MAX)), aRef.Bounds);
+          if (aPart.Bounds.IsValid())
+          {
+            aRgh.Refs.push_back (aPart);
+          }
+        }
+      }
+
+      aNbRefs += aLft.Refs.size() + aRgh.Refs.size() - aCount;
+    }
+    else if (aBestAxis != -1)
+    {
+      const float aScale = myNbBins / aCenterSize[aBestAxis];
+      const float aMin   = aCenterBounds.Min[aBestAxis];
+
+      for (int anIdx = 0; anIdx < aCount; ++anIdx)
+      {
+        const int aBin = std::min (static_cast<int> ((aRefs[anIdx].Bounds.Center()[aBestAxis] - aMin) * aScale), myNbBins - 1);
+        (aBin < aBestSplit ? aLft.Refs : aRgh.Refs).push_back (aRefs[anIdx]);
+      }
+    }
+
+    if (aLft.Refs.empty() || aRgh.Refs.empty())
+    {
+      if (isSpatial)
+      {
+        aNbRefs -= aLft.Refs.size() + aRgh.Refs.size() - aCount;
+      }
+
+      if (aCount <= myMaxLeafSize)
+      {
+        aMakeLeaf();
+        continue;
+      }
+
+      // All centers coincide (or the tree is too deep): split at object median
+      const int anAxis = aCenterSize.x >= aCenterSize.y ? (aCenterSize.x >= aCenterSize.z ? 0 : 2)
+                                                        : (aCenterSize.y >= aCenterSize.z ? 1 : 2);
+
+      std::nth_element (aRefs.begin(), aRefs.begin() + aCount / 2, aRefs.end(), [&](const Reference& theRef1, const Reference& theRef2)
+      {
+        return theRef1.Bounds.Center()[anAxis] < theRef2.Bounds.Center()[anAxis];
+      });
+
+      aLft.Refs.assign (aRefs.begin(), aRefs.begin() + aCount / 2);
+      aRgh.Refs.assign (aRefs.begin() + aCount / 2, aRefs.end());
+    }
+
+    const int aLftNode = static_cast<int> (myNodes.size());
+
+    BvhNode& aNode = myNodes[aTask.Node];
+    aNode.Bounds      = aBounds;
+    aNode.LeftOrFirst = aLftNode;
+    aNode.Count       = 0;
+
+    myNodes.push_back (BvhNode());
+    myNodes.push_back (BvhNode());
+
+    std::vector<Reference>().swap (aRefs);
+
+    aTasks.push_back (SpatialTask());
+    aTasks.back().Node  = aLftNode + 1;
+    aTasks.back().Depth = aTask.Depth + 1;
+    aTasks.back().Refs.swap (aRgh.Refs);
+
+    aTasks.push_back (SpatialTask());
+    aTasks.back().Node  = aLftNode;
+    aTasks.back().Depth = aTask.Depth + 1;
+    aTasks.back().Refs.swap (aLft.Refs);
+  }
+
+  selectSubtrees();
+}
+
+//=======================================================================
+//function : Optimize
+//purpose  :
+//=======================================================================
+void Bvh::Optimize (ThreadPool& thePool)
+{
+  if (myNodes.empty())
+  {
+    return;
+  }
+
+  for (int aPass = 0; aPass < THE_TREELET_PASSES; ++aPass)
+  {
+    const float aCost = SahCost();
+
+    // Bottom-up order: subtrees in parallel (treelets never leave the subtree), then top nodes
+    std::vector<float> aCosts (myNodes.size(), 0.f);
+
+    thePool.ParallelFor (static_cast<int> (mySubtrees.size()), [&](int theSubtree, int)
+    {
+      std::vector<int> aNodes;
+      subtreeNodes (mySubtrees[theSubtree].Node, aNodes);
+
+      for (size_t anIdx = aNodes.size(); anIdx-- > 0;)
+      {
+        optimizeTreelet (aNodes[anIdx], aCosts);
+      }
+    });
+
+    for (size_t anIdx = myTopNodes.size(); anIdx-- > 0;)
+    {
+      optimizeTreelet (myTopNodes[anIdx], aCosts);
+    }
+
+    // Subtree roots may have moved
+    selectSubtrees();
+
+    if (SahCost() > aCost * 0.99f)
+    {
+      break;
+    }
+  }
+
+  compact();
+}
+
+//=======================================================================
+//function : optimizeTreelet
+//purpose  :
+//=======================================================================
+void Bvh::optimizeTreelet (int theNode, std::vector<float>& theCosts)
+{
+  const BvhNode& aRoot = myNodes[theNode];
+  if (aRoot.IsLeaf())
+  {
+    theCosts[theNode] = aRoot.Bounds.Area() * static_cast<float> (aRoot.Count);
+    return;
+  }
+
+  const float anOldCost = THE_TRAVERSAL_COST * aRoot.Bounds.Area() + theCosts[aRoot.LeftOrFirst] + theCosts[aRoot.LeftOrFirst + 1];
+
+  // Grow treelet by expanding the leaf with the largest area
+  int aLeaves[THE_TREELET_SIZE]    = { aRoot.LeftOrFirst, aRoot.LeftOrFirst + 1 };
+  int aPairs [THE_TREELET_SIZE - 1] = { aRoot.LeftOrFirst };
+  int aNbLeaves = 2;
+
+  while (aNbLeaves < THE_TREELET_SIZE)
+  {
+    int   aBest     = -1;
+    float aBestArea = -1.f;
+    for (int aLeaf = 0; aLeaf < aNbLeaves; ++aLeaf)
+    {
+      const BvhNode& aNode = myNodes[aLeaves[aLeaf]];
+      if (!aNode.IsLeaf() && aNode.Bounds.Area() > aBestArea)
+      {
+        aBest     = aLeaf;
+        aBestArea = aNode.Bounds.Area();
+      }
+    }
+
+    if (aBest == -1)
+    {
+      break;
+    }
+
+    const int aChildren = myNodes[aLeaves[aBest]].LeftOrFirst;
+
+    aPairs[aNbLeaves - 1]  = aChildren;
+    aLeaves[aBest]         = aChildren;
+    aLeaves[aNbLeaves++]   = aChildren + 1;
+  }
+
+  if (aNbLeaves < 3)
+  {
+    theCosts[theNode] = anOldCost;
+    return;
+  }
+
+  // Optimal topology over subsets of treelet leaves (dynamic programming)
+  const int aNbSubsets = 1 << aNbLeaves;
+
+  Box   aBounds[1 << THE_TREELET_SIZE];
+  float aCosts [1 << THE_TREELET_SIZE];
+  int   aSplits[1 << THE_TREELET_SIZE];
+
+  for (int aSubset = 1; aSubset < aNbSubsets; ++aSubset)
+  {
+    const int aLowest = aSubset & -aSubset;
+    if (aSubset == aLowest)
+    {
+      int aLeaf = 0;
+      while ((1 << aLeaf) != aSubset)
+      {
+        ++aLeaf;
+      }
+
+      aBounds[aSubset] = myNodes[aLeaves[aLeaf]].Bounds;
+      aCosts [aSubset] = theCosts[aLeaves[aLeaf]];
+      continue;
+    }
+
+    aBounds[aSubset] = aBounds[aLowest];
+    aBounds[aSubset].Add (aBounds[aSubset ^ aLowest]);
+
+    // Partitions are enumerated once: the part with the lowest leaf goes left
+    float aBest  = FLT_MAX;
+    int   aSplit = aLowest;
+    for (int aPart = (aSubset - 1) & aSubset; aPart != 0; aPart = (aPart - 1) & aSubset)
+    {
+      if ((aPart & aLowest) != 0)
+      {
+        const float aCost = aCosts[aPart] + aCosts[aSubset ^ aPart];
+        if (aCost < aBest)
+        {
+          aBest  = aCost;
+          aSplit = aPart;
+        }
+      }
+    }
+
+    aCosts [aSubset] = THE_TRAVERSAL_COST * aBounds[aSubset].Area() + aBest;
+    aSplits[aSubset] = aSplit;
+  }
+
+  const int aFull = aNbSubsets - 1;
+  if (aCosts[aFull] >= anOldCost * 0.9999f)
+  {
+    theCosts[theNode] = anOldCost;
+    return;
+  }
+
+  // Rewrite the treelet reusing child pairs of its inner nodes
+  BvhNode aLeafNodes[THE_TREELET_SIZE];
+  float   aLeafCosts[THE_TREELET_SIZE];
+  for (int aLeaf = 0; aLeaf < aNbLeaves; ++aLeaf)
+  {
+    aLeafNodes[aLeaf] = myNodes[aLeaves[aLeaf]];
+    aLeafCosts[aLeaf] = theCosts[aLeaves[aLeaf]];
+  }
+
+  std::pair<int, int> aStack[2 * THE_TREELET_SIZE];
+  int aHead = 0;
+  int aNextPair = 0;
+
+  aStack[aHead++] = std::make_pair (aFull, theNode);
+  while (aHead > 0)
+  {
+    const int aSubset = aStack[aHead - 1].first;
+    const int aSlot   = aStack[aHead - 1].second;
+    --aHead;
+
+    if ((aSubset & (aSubset - 1)) == 0)
+    {
+      int aLeaf = 0;
+      while ((1 << aLeaf) != aSubset)
+      {
+        ++aLeaf;
+      }
+
+      myNodes[aSlot]  = aLeafNodes[aLeaf];
+      theCosts[aSlot] = aLeafCosts[aLeaf];
+      continue;
+    }
+
+    const int aPair = aPairs[aNextPair++];
+
+    BvhNode& aNode = myNodes[aSlot];
+    aNode.Bounds      = aBounds[aSubset];
+    aNode.LeftOrFirst = aPair;
+    aNode.Count       = 0;
+    theCosts[aSlot]   = aCosts[aSubset];
+
+    aStack[aHead++] = std::make_pair (aSplits[aSubset], aPair);
+    aStack[aHead++] = std::make_pair (aSubset ^ aSplits[aSubset], aPair + 1);
+  }
+}
+
+//=======================================================================
+//function : compact
+//purpose  :
+//=======================================================================
+void Bvh::compact()
+{
+  std::vector<BvhNode> aNodes;
+  std::vector<int>     anIndices;
+  aNodes.reserve (myNodes.size() - myNbGarbage);
+  anIndices.reserve (myIndices.size());
+
+  // Pairs of children are allocated when their parent is visited
+  std::vector<std::pair<int, int> > aStack (1, std::make_pair (0, 0));
+  aNodes.push_back (myNodes[0]);
+
+  while (!aStack.empty())
+  {
+    const int anOld = aStack.back().first;
+    const int aNew  = aStack.back().second;
+    aStack.pop_back();
+
+    const BvhNode& aNode = myNodes[anOld];
+    if (aNode.IsLeaf())
+    {
+      aNodes[aNew].LeftOrFirst = static_cast<int> (anIndices.size());
+      anIndices.insert (anIndices.end(), myIndices.begin() + aNode.LeftOrFirst, myIndices.begin() + aNode.LeftOrFirst + aNode.Count);
+      continue;
+    }
+
+    const int aLft = static_cast<int> (aNodes.size());
+    aNodes[aNew].LeftOrFirst = aLft;
+    aNodes.push_back (myNodes[aNode.LeftOrFirst]);
+    aNodes.push_back (myNodes[aNode.LeftOrFirst + 1]);
+
+    aStack.push_back (std::make_pair (aNode.LeftOrFirst + 1, aLft + 1));
+    aStack.push_back (std::make_pair (aNode.LeftOrFirst,     aLft));
+  }
+
+  myNodes.swap (aNodes);
+  myIndices.swap (anIndices);
+  myNbGarbage = 0;
+
+  selectSubtrees();
+}
+
+//=======================================================================
+//function : AdoptHugePages
+//purpose  :
+//=======================================================================
+void Bvh::AdoptHugePages (const std::string& theName)
+{
+  HugePages::Adopt (myNodes,   theName + " nodes");
+  HugePages::Adopt (myIndices, theName + " indices");
+}
+
+//=======================================================================
+//function : Write
+//purpose  :
+//=======================================================================
+void Bvh::Write (std::ostream& theStream) const
+{
+  const int aSizes[3] = { myNbPrims, static_cast<int> (myNodes.size()), static_cast<int> (myIndices.size()) };
+
+  theStream.write (reinterpret_cast<const char*> (aSizes), sizeof (aSizes));
+  theStream.write (reinterpret_cast<const char*> (myNodes.data()),   myNodes.size()   * sizeof (BvhNode));
+  theStream.write (reinterpret_cast<const char*> (myIndices.data()), myIndices.size() * sizeof (int));
+}
+
+//=======================================================================
+//function : Read
+//purpose  :
+//=======================================================================
+bool Bvh::Read (std::istream& theStream)
+{
+  Clear();
+
+  int aSizes[3] = { 0, 0, 0 };
+  if (!theStream.read (reinterpret_cast<char*> (aSizes), sizeof (aSizes))
+   || aSizes[0] <= 0 || aSizes[1] <= 0 || aSizes[2] < aSizes[0])
+  {
+    return false;
+  }
+
+  myNodes.resize (aSizes[1]);
+  myIndices.resize (aSizes[2]);
+  if (!theStream.read (reinterpret_cast<char*> (myNodes.data()),   myNodes.size()   * sizeof (BvhNode))
+   || !theStream.read (reinterpret_cast<char*> (myIndices.data()), myIndices.size() * sizeof (int)))
+  {
+    Clear();
+    return false;
+  }
+
+  // Reject references out of range, so that corrupted file can't crash traversal
+  for (size_t aNodeIdx = 0; aNodeIdx < myNodes.size(); ++aNodeIdx)
+  {
+    const BvhNode& aNode = myNodes[aNodeIdx];
+    const bool isValid = aNode.IsLeaf() ? aNode.LeftOrFirst >= 0 && aNode.LeftOrFirst + aNode.Count <= aSizes[2]
+                                        : aNode.Count == 0 && aNode.LeftOrFirst > static_cast<int> (aNodeIdx) && aNode.LeftOrFirst + 1 < aSizes[1];
+    if (!isValid)
+    {
+      Clear();
+      return false;
+    }
+  }
+
+  for (size_t anIdx = 0; anIdx < myIndices.size(); ++anIdx)
+  {
+    if (myIndices[anIdx] < 0 || myIndices[anIdx] >= aSizes[0])
+    {
+      Clear();
+      return false;
+    }
+  }
+
+  myNbPrims = aSizes[0];
+
+  selectSubtrees();
+  return true;
+}
+
+//=======================================================================
+//function : selectSubtrees
+//purpose  :
+//=======================================================================
+void Bvh::selectSubtrees()
+{
+  mySubtrees.clear();
+  myTopNodes.clear();
+
+  if (myNodes.empty())
+  {
+    return;
+  }
+
+  // Expand the hierarchy level by level until there is enough work for all threads
+  std::vector<std::pair<int, int> > aFront (1, std::make_pair (0, 0));
+  for (;;)
+  {
+    if (aFront.size() >= static_cast<size_t> (THE_REFIT_SUBTREES))
+    {
+      break;
+    }
+
+    std::vector<std::pair<int, int> > aNext;
+    for (size_t anIdx = 0; anIdx < aFront.size(); ++anIdx)
+    {
+      const BvhNode& aNode = myNodes[aFront[anIdx].first];
+      if (aNode.IsLeaf())
+      {
+        aNext.push_back (aFront[anIdx]);
+      }
+      else
+      {
+        myTopNodes.push_back (aFront[anIdx].first);
+        aNext.push_back (std::make_pair (aNode.LeftOrFirst,     aFront[anIdx].second + 1));
+        aNext.push_back (std::make_pair (aNode.LeftOrFirst + 1, aFront[anIdx].second + 1));
+      }
+    }
+
+    if (aNext.size() == aFront.size())
+    {
+      break;
+    }
+
+    aFront.swap (aNext);
+  }
+
+  std::vector<int> aNodes;
+  for (size_t anIdx = 0; anIdx < aFront.size(); ++anIdx)
+  {
+    Subtree aSubtree;
+    aSubtree.Node  = aFront[anIdx].first;
+    aSubtree.Depth = aFront[anIdx].second;
+    aSubtree.Begin = static_cast<int> (myIndices.size());
+    aSubtree.End   = 0;
+
+    subtreeNodes (aSubtree.Node, aNodes);
+
+    float aCost = 0.f;
+    for (size_t aNodeIdx = 0; aNodeIdx < aNodes.size(); ++aNodeIdx)
+    {
+      const BvhNode& aNode = myNodes[aNodes[aNodeIdx]];
+      if (aNode.IsLeaf())
+      {
+        aSubtree.Begin = std::min (aSubtree.Begin, aNode.LeftOrFirst);
+        aSubtree.End   = std::max (aSubtree.End,   aNode.LeftOrFirst + aNode.Count);
+      }
+
+      aCost += aNode.Bounds.Area() * (aNode.IsLeaf() ? static_cast<float> (aNode.Count) : THE_TRAVERSAL_COST);
+    }
+
+    aSubtree.BuildCost = aCost / std::max (myNodes[aSubtree.Node].Bounds.Area(), FLT_MIN);
+    mySubtrees.push_back (aSubtree);
+  }
+}
+
+//=======================================================================
+//function : subtreeNodes
+//purpose  :
+//=======================================================================
+void Bvh::subtreeNodes (int theRoot, std::vector<int>& theNodes) const
+{
+  theNodes.clear();
+  theNodes.push_back (theRoot);
+
+  for (size_t anIdx = 0; anIdx < theNodes.size(); ++anIdx)
+  {
+    const BvhNode& aNode = myNodes[theNodes[anIdx]];
+    if (!aNode.IsLeaf())
+    {
+      theNodes.push_back (aNode.LeftOrFirst);
+      theNodes.push_back (aNode.LeftOrFirst + 1);
+    }
+  }
+}
+
+//=======================================================================
+//function : refitSubtree
+//purpose  :
+//=======================================================================
+float Bvh::refitSubtree (const std::vector<Box>& theBoxes, const std::vector<int>& theNodes)
+{
+  // Children are listed after their parents, so reverse order goes bottom-up
+  float aCost = 0.f;
+  for (size_t anIdx = theNodes.size(); anIdx-- > 0;)
+  {
+    BvhNode& aNode = myNodes[theNodes[anIdx]];
+
+    Box aBounds;
+    if (aNode.IsLeaf())
+    {
+      for (int aPrimIdx = aNode.LeftOrFirst; aPrimIdx < aNode.LeftOrFirst + aNode.Count; ++aPrimIdx)
+      {
+        aBounds.Add (theBoxes[myIndices[aPrimIdx]]);
+      }
+    }
+    else
+    {
+      aBounds.Add (myNodes[aNode.LeftOrFirst].Bounds);
+      aBounds.Add (myNodes[aNode.LeftOrFirst + 1].Bounds);
+    }
+
+    aNode.Bounds = aBounds;
+    aCost += aBounds.Area() * (aNode.IsLeaf() ? static_cast<float> (aNode.Count) : THE_TRAVERSAL_COST);
+  }
+
+  return theNodes.empty() ? 0.f : aCost / std::max (myNodes[theNodes[0]].Bounds.Area(), FLT_MIN);
+}
+
+//=======================================================================
+//function : Refit
+//purpose  :
+//=======================================================================
+int Bvh::Refit (const std::vector<Box>& theBoxes, ThreadPool& thePool)
+{
+  if (myNodes.empty() || static_cast<int> (theBoxes.size()) != myNbPrims)
+  {
+    return -1;
+  }
+
+  const int aNbSubtrees = static_cast<int> (mySubtrees.size());
+
+  std::vector<uint8_t> toRebuild (aNbSubtrees, 0);
+  std::vector<int>     aNbNodes  (aNbSubtrees, 0);
+
+  thePool.ParallelFor (aNbSubtrees, [&](int theSubtree, int)
+  {
+    std::vector<int> aNodes;
+    subtreeNodes (mySubtrees[theSubtree].Node, aNodes);
+
+    const float aCost = refitSubtree (theBoxes, aNodes);
+
+    toRebuild[theSubtree] = aCost > mySubtrees[theSubtree].BuildCost * myRebuildThreshold ? 1 : 0;
+    aNbNodes[theSubtree]  = static_cast<int> (aNodes.size());
+  });
+
+  // Degraded subtrees are rebuilt in place of their roots, old descendants become garbage
+  int aNbRebuilt = 0;
+
+  std::vector<glm::vec3> aCenters;
+  std::vector<int>       aNodes;
+  for (int aSubtreeIdx = 0; aSubtreeIdx < aNbSubtrees; ++aSubtreeIdx)
+  {
+    if (!toRebuild[aSubtreeIdx])
+    {
+      continue;
+    }
+
+    if (aCenters.empty())
+    {
+      aCenters.resize (theBoxes.size());
+      for (size_t aPrim = 0; aPrim < theBoxes.size(); ++aPrim)
+      {
+        aCenters[aPrim] = theBoxes[aPrim].Center();
+      }
+    }
+
+    Subtree& aSubtree = mySubtrees[aSubtreeIdx];
+    buildNode (theBoxes, aCenters, aSubtree.Node, aSubtree.Begin, aSubtree.End, aSubtree.Depth);
+
+    subtreeNodes (aSubtree.Node, aNodes);
+    aSubtree.BuildCost = refitSubtree (theBoxes, aNodes);
+
+    myNbGarbage += aNbNodes[aSubtreeIdx] - 1;
+    ++aNbRebuilt;
+  }
+
+  if (myNbGarbage > static_cast<int> (myNodes.size()) / 2)
+  {
+    return -1;
+  }
+
+  for (size_t anIdx = myTopNodes.size(); anIdx-- > 0;)
+  {
+    BvhNode& aNode = myNodes[myTopNodes[anIdx]];
+
+    aNode.Bounds = myNodes[aNode.LeftOrFirst].Bounds;
+    aNode.Bounds.Add (myNodes[aNode.LeftOrFirst + 1].Bounds);
+  }
+
+  return aNbRebuilt;
+}
+
+//=======================================================================
+//function : SahCost
+//purpose  :
+//=======================================================================
+float Bvh::SahCost() const
+{
+  if (myNodes.empty())
+  {
+    return 0.f;
+  }
+
+  const float aRootArea = std::max (myNodes[0].Bounds.Area(), FLT_MIN);
+
+  std::vector<int> aNodes;
+  subtreeNodes (0, aNodes);
+
+  float aCost = 0.f;
+  for (size_t aNodeIdx = 0; aNodeIdx < aNodes.size(); ++aNodeIdx)
+  {
+    const BvhNode& aNode = myNodes[aNodes[aNodeIdx]];
+
+    aCost += aNode.Bounds.Area() / aRootArea * (aNode.IsLeaf() ? static_cast<float> (aNode.Count) : THE_TRAVERSAL_COST);
+  }
+
+  return aCost;
+}
+
+//=======================================================================
+//function : Depth
+//purpose  :
+//=======================================================================
+int Bvh::Depth() const
+{
+  if (myNodes.empty())
+  {
+    return 0;
+  }
+
+  int aMaxDepth = 0;
+
+  std::vector<std::pair<int, int> > aStack (1, std::make_pair (0, 1));
+  while (!aStack.empty())
+  {
+    const std::pair<int, int> anItem = aStack.back();
+    aStack.pop_back();
+
+    aMaxDepth = std::max (aMaxDepth, anItem.second);
+
+    const BvhNode& aNode = myNodes[anItem.first];
+    if (!aNode.IsLeaf())
+    {
+      aStack.push_back (std::make_pair (aNode.LeftOrFirst,     anItem.second + 1));
+      aStack.push_back (std::make_pair (aNode.LeftOrFirst + 1, anItem.second + 1));
+    }
+  }
+
+  return aMaxDepth;
+}
+
+//=======================================================================
+//function : CutSubtrees
+//purpose  :
+//=======================================================================
+void Bvh::CutSubtrees (size_t theMaxBytes, size_t theRefBytes, std::vector<BvhNode>& theTop, std::vector<int>& theRoots) const
+{
+  theTop.clear();
+  theRoots.clear();
+  if (myNodes.empty())
+  {
+    return;
+  }
+
+  std::vector<SubtreeSize> aSizes (myNodes.size());
+  ComputeSizes (myNodes, 0, aSizes);
+
+  // Subtrees are emitted in depth-first order, so that neighbors get close indices
+  std::vector<std::pair<int, int> > aStack (1, std::make_pair (0, 0)); // source node and top slot
+  theTop.resize (1);
+  while (!aStack.empty())
+  {
+    const int aSrc = aStack.back().first;
+    const int aDst = aStack.back().second;
+    aStack.pop_back();
+
+    const BvhNode& aNode = myNodes[aSrc];
+    theTop[aDst].Bounds = aNode.Bounds;
+
+    const size_t aBytes = aSizes[aSrc].Nodes * sizeof (BvhNode) + aSizes[aSrc].References * theRefBytes;
+    if (!aNode.IsLeaf() && aBytes > theMaxBytes)
+    {
+      const int aChild = static_cast<int> (theTop.size());
+      theTop[aDst].LeftOrFirst = aChild;
+      theTop[aDst].Count       = 0;
+      theTop.resize (theTop.size() + 2);
+
+      // Right child is pushed first, so the left subtree is emitted first
+      aStack.push_back (std::make_pair (aNode.LeftOrFirst + 1, aChild + 1));
+      aStack.push_back (std::make_pair (aNode.LeftOrFirst,     aChild));
+      continue;
+    }
+
+    theTop[aDst].LeftOrFirst = static_cast<int> (theRoots.size());
+    theTop[aDst].Count       = 1;
+    theRoots.push_back (aSrc);
+  }
+}
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <cfloat>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "Ray.hpp"
+
+class ThreadPool;
+
+//! Axis-aligned bounding box.
+struct Box
+{
+  glm::vec3 Min;
+  glm::vec3 Max;
+
+  //! Creates empty (invalid) box.
+  Box() : Min (FLT_MAX), Max (-FLT_MAX) {}
+
+  Box (const glm::vec3& theMin, const glm::vec3& theMax) : Min (theMin), Max (theMax) {}
+
+  //! Returns true if box is not empty.
+  bool IsValid() const { return Min.x <= Max.x && Min.y <= Max.y && Min.z <= Max.z; }
+
+  //! Enlarges box to contain the given point.
+  void Add (const glm::vec3& thePoint) { Min = glm::min (Min, thePoint); Max = glm::max (Max, thePoint); }
+
+  //! Enlarges box to contain the given box.
+  void Add (const Box& theBox) { Min = glm::min (Min, theBox.Min); Max = glm::max (Max, theBox.Max); }
+
+  //! Returns center of the box.
+  glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+
+  //! Returns size of the box.
+  glm::vec3 Size() const { return Max - Min; }
+
+  //! Returns surface area of the box (0 for empty box).
+  float Area() const
+  {
+    if (!IsValid())
+    {
+      return 0.f;
+    }
+
+    const glm::vec3 aSize = Max - Min;
+    return 2.f * (aSize.x * aSize.y + aSize.y * aSize.z + aSize.z * aSize.x);
+  }
+};
+
+//! Counters of traversal work.
+struct TraversalStats
+{
+  uint64_t NbNodes;      //!< visited nodes
+  uint64_t NbPrimitives; //!< primitives referenced by visited leaves
+  uint64_t NbBlocks;     //!< entered blocks of paged hierarchy
+
+  TraversalStats() : NbNodes (0), NbPrimitives (0), NbBlocks (0) {}
+
+  //! Adds work of another traversal.
+  TraversalStats& operator+= (const TraversalStats& theOther)
+  {
+    NbNodes      += theOther.NbNodes;
+    NbPrimitives += theOther.NbPrimitives;
+    NbBlocks     += theOther.NbBlocks;
+    return *this;
+  }
+};
+
+//! Node of binary BVH (32 bytes). Children of inner node are stored
+//! next to each other, so only the index of the left one is kept.
+struct BvhNode
+{
+  Box Bounds;
+  int LeftOrFirst; //!< index of left child for inner node or first primitive index for leaf
+  int Count;       //!< number of primitives in leaf (0 for inner node)
+
+  bool IsLeaf() const { return Count > 0; }
+};
+
+//! Bounding volume hierarchy built with binned SAH.
+//! The hierarchy is geometry agnostic: it is built over primitive boxes,
+//! and leaves reference primitives through the index array.
+//! Spatial split build (SBVH) may reference primitive from several leaves.
+class Bvh
+{
+public:
+
+  //! Returns bounds of the part of primitive thePrim inside theClip box.
+  typedef std::function<Box (int thePrim, const Box& theClip)> ClipFunc;
+
+  //! Maximum depth of the hierarchy (size of traversal stack).
+  static const int MaxDepth = 128;
+
+  //! Creates empty hierarchy.
+  Bvh();
+
+  //! Builds hierarchy over the given primitive boxes.
+  void Build (const std::vector<Box>& theBoxes);
+
+  //! Builds hierarchy choosing between object and spatial splits (Stich et al., "Spatial
+  //! splits in bounding volume hierarchies", 2009). Primitives straddling spatial split
+  //! are referenced from both sides with bounds clipped by theClip. Number of references
+  //! is limited by theMaxGrowth times the number of primitives.
+  void BuildSpatial (const std::vector<Box>& theBoxes, const ClipFunc& theClip, float theMaxGrowth);
+
+  //! Lowers SAH cost of the built hierarchy by restructuring treelets of up to 7 nodes
+  //! (Karras and Aila, "Fast parallel construction of high-quality BVHs", 2013).
+  //! Independent subtrees are processed in parallel, nodes are laid out depth-first afterwards.
+  void Optimize (ThreadPool& thePool);
+
+  //! Writes hierarchy in binary form.
+  void Write (std::ostream& theStream) const;
+
+  //! Reads hierarchy written by Write(), returns false on error.
+  bool Read (std::istream& theStream);
+
+  //! Updates bounds of all nodes for moved primitives keeping the topology (theBoxes must
+  //! describe the same primitives as on Build()). Subtrees whose SAH cost grew more than
+  //! RebuildThreshold() times since they were built are rebuilt. Returns number of rebuilt
+  //! subtrees, or -1 if the whole hierarchy has to be built again by the caller (number of
+  //! primitives changed or rebuilt subtrees left too many unused nodes), so that it can use
+  //! the same builder and optimization as for the original hierarchy.
+  int Refit (const std::vector<Box>& theBoxes, ThreadPool& thePool);
+
+  //! Returns ratio of subtree SAH cost to its cost after build that triggers rebuild on Refit().
+  float RebuildThreshold() const { return myRebuildThreshold; }
+
+  //! Sets ratio of subtree SAH cost that triggers rebuild on Refit().
+  void SetRebuildThreshold (float theRatio) { myRebuildThreshold = theRatio < 1.f ? 1.f : theRatio; }
+
+  //! Releases all data.
+  void Clear();
+
+  //! Returns true if hierarchy is empty.
+  bool IsEmpty() const { return myNodes.empty(); }
+
+  //! Returns hierarchy nodes (root is the first one). After partial rebuilds some
+  //! nodes may be unreachable from the root.
+  const std::vector<BvhNode>& Nodes() const { return myNodes; }
+
+  //! Returns primitive indices referenced by leaves.
+  const std::vector<int>& Indices() const { return myIndices; }
+
+  //! Returns size of nodes and indices in bytes.
+  size_t MemorySize() const { return myNodes.size() * sizeof (BvhNode) + myIndices.size() * sizeof (int); }
+
+  //! Moves nodes and indices into storage advised for huge pages (see HugePages::Adopt()),
+  //! registered as "<theName> nodes" and "<theName> indices".
+  void AdoptHugePages (const std::string& theName);
+
+  //! Returns number of primitives the hierarchy was built for.
+  int NbPrimitives() const { return myNbPrims; }
+
+  //! Returns bounds of the whole hierarchy.
+  Box Bounds() const { return myNodes.empty() ? Box() : myNodes[0].Bounds; }
+
+  //! Returns number of SAH bins used for split search.
+  int NbBins() const { return myNbBins; }
+
+  //! Sets number of SAH bins used for split search.
+  void SetNbBins (int theNbBins) { myNbBins = theNbBins < 2 ? 2 : theNbBins; }
+
+  //! Returns maximum number of primitives in leaf.
+  int MaxLeafSize() const { return myMaxLeafSize; }
+
+  //! Sets maximum number of primitives in leaf.
+  void SetMaxLeafSize (int theSize) { myMaxLeafSize = theSize < 1 ? 1 : theSize; }
+
+  //! Returns SAH cost of the hierarchy (normalized by root area).
+  float SahCost() const;
+
+  //! Returns depth of the hierarchy.
+  int Depth() const;
+
+  //! Cuts the hierarchy into subtrees of up to theMaxBytes, where node takes sizeof (BvhNode)
+  //! and primitive reference theRefBytes. Subtree roots are stored into theRoots in depth-first
+  //! order, nodes above them into theTop (children next to each other, leaf LeftOrFirst is
+  //! index in theRoots and Count is 1).
+  void CutSubtrees (size_t theMaxBytes, size_t theRefBytes, std::vector<BvhNode>& theTop, std::vector<int>& theRoots) const;
+
+public:
+
+  //! Intersects ray with node bounds; returns entry distance or FLT_MAX if missed.
+  static float IntersectBox (const Box& theBox,
+                             const glm::vec3& theOrigin,
+                             const glm::vec3& theInvDir,
+                             float theTmin,
+                             float theTmax)
+  {
+    const glm::vec3 aT0 = (theBox.Min - theOrigin) * theInvDir;
+    const glm::vec3 aT1 = (theBox.Max - theOrigin) * theInvDir;
+
+    const glm::vec3 aTmin = glm::min (aT0, aT1);
+    const glm::vec3 aTmax = glm::max (aT0, aT1);
+
+    const float aNear = glm::max (glm::max (aTmin.x, aTmin.y), glm::max (aTmin.z, theTmin));
+    const float aFar  = glm::min (glm::min (aTmax.x, aTmax.y), glm::min (aTmax.z, theTmax));
+
+    return aNear <= aFar ? aNear : FLT_MAX;
+  }
+
+  //! Traverses the hierarchy in front-to-back order. For each reached leaf calls
+  //! theLeaf (theFirst, theCount, theTmax), which may shorten theTmax on hit and
+  //! returns true to terminate traversal. Visited nodes are counted into theStats (optional).
+  template<class LeafFunc>
+  void Traverse (const Ray& theRay, float& theTmax, LeafFunc& theLeaf, TraversalStats* theStats = NULL) const
+  {
+    if (!myNodes.empty())
+    {
+      TraverseSubtree (0, theRay, theTmax, theLeaf, theStats);
+    }
+  }
+
+  //! Same as Traverse(), but starts at node theRoot.
+  template<class LeafFunc>
+  void TraverseSubtree (int theRoot, const Ray& theRay, float& theTmax, LeafFunc& theLeaf, TraversalStats* theStats = NULL) const
+  {
+    const glm::vec3 anInvDir (1.f / theRay.Direction.x,
+                              1.f / theRay.Direction.y,
+                              1.f / theRay.Direction.z);
+
+    auto aLeafFunc = [&](int theFirst, int theCount, float& theLeafTmax) -> bool
+    {
+      if (theStats != NULL)
+      {
+        theStats->NbPrimitives += theCount;
+      }
+      return theLeaf (theFirst, theCount, theLeafTmax);
+    };
+
+    TraverseNodes (myNodes.data(), theRoot, theRay, anInvDir, theTmax, aLeafFunc, theStats);
+  }
+
+  //! Traverses binary nodes (children stored next to each other) from theRoot in front-to-back
+  //! order calling theLeaf (theFirst, theCount, theTmax) for reached leaves. Visited nodes are
+  //! counted into theStats (optional). Returns true if traversal was terminated by theLeaf.
+  template<class LeafFunc>
+  static bool TraverseNodes (const BvhNode*   theNodes,
+                             int              theRoot,
+                             const Ray&       theRay,
+                             const glm::vec3& theInvDir,
+                             float&           theTmax,
+                             LeafFunc&        theLeaf,
+                             TraversalStats*  theStats)
+  {
+    if (IntersectBox (theNodes[theRoot].Bounds, theRay.Origin, theInvDir, theRay.Tmin, theTmax) == FLT_MAX)
+    {
+      return false;
+    }
+
+    int aStack[MaxDepth];
+    int aHead = 0;
+
+    for (int aNode = theRoot;;)
+    {
+      const BvhNode& aCurrent = theNodes[aNode];
+
+      if (theStats != NULL)
+      {
+        ++theStats->NbNodes;
+      }
+
+      if (aCurrent.IsLeaf())
+      {
+        if (theLeaf (aCurrent.LeftOrFirst, aCurrent.Count, theTmax))
+        {
+          return true;
+        }
+      }
+      else
+      {
+        const int aLft = aCurrent.LeftOrFirst;
+        const int aRgh = aCurrent.LeftOrFirst + 1;
+
+        const float aTimeLft = IntersectBox (theNodes[aLft].Bounds, theRay.Origin, theInvDir, theRay.Tmin, theTmax);
+        const float aTimeRgh = IntersectBox (theNodes[aRgh].Bounds, theRay.Origin, theInvDir, theRay.Tmin, theTmax);
+
+        if (aTimeLft != FLT_MAX && aTimeRgh != FLT_MAX)
+        {
+          aNode = aTimeLft <= aTimeRgh ? aLft : aRgh;
+          aStack[aHead++] = aTimeLft <= aTimeRgh ? aRgh : aLft;
+          continue;
+        }
+        else if (aTimeLft != FLT_MAX)
+        {
+          aNode = aLft;
+          continue;
+        }
+        else if (aTimeRgh != FLT_MAX)
+        {
+          aNode = aRgh;
+          continue;
+        }
+      }
+
+      if (aHead == 0)
+      {
+        return false;
+      }
+
+      aNode = aStack[--aHead];
+    }
+  }
+
+private:
+
+  //! Subtree refitted by single task, also unit of partial rebuild.
+  struct Subtree
+  {
+    int   Node;      //!< root node
+    int   Begin;     //!< first primitive index
+    int   End;       //!< last primitive index (exclusive)
+    int   Depth;     //!< depth of the root
+    float BuildCost; //!< SAH cost (normalized by root area) after build
+  };
+
+  //! Builds node covering primitive indices [theBegin, theEnd) and its descendants.
+  void buildNode (const std::vector<Box>&       theBoxes,
+                  const std::vector<glm::vec3>& theCenters,
+                  int                           theNode,
+                  int                           theBegin,
+                  int                           theEnd,
+                  int                           theDepth);
+
+  //! Splits the hierarchy into top nodes and subtrees for parallel refit.
+  void selectSubtrees();
+
+  //! Restructures treelet rooted at theNode, theCosts holds SAH costs of processed nodes.
+  void optimizeTreelet (int theNode, std::vector<float>& theCosts);
+
+  //! Rewrites nodes and indices in depth-first order dropping unreachable nodes.
+  void compact();
+
+  //! Collects nodes of the subtree in pre-order.
+  void subtreeNodes (int theRoot, std::vector<int>& theNodes) const;
+
+  //! Updates bounds of the subtree nodes (pre-order list) and returns its SAH cost.
+  float refitSubtree (const std::vector<Box>& theBoxes, const std::vector<int>& theNodes);
+
+private:
+
+  std::vector<BvhNode> myNodes;
+  std::vector<int>     myIndices;
+  std::vector<Subtree> mySubtrees; //!< roots of subtrees refitted in parallel
+  std::vector<int>     myTopNodes; //!< nodes above the subtrees (parents first)
+
+  int   myNbPrims;
+  int   myNbBins;
+  int   myMaxLeafSize;
+  int   myNbGarbage;        //!< nodes orphaned by partial rebuilds
+  float myRebuildThreshold;
+
+};
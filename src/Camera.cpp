@@ -10,6 +10,8 @@ Camera::Camera () {
   field_of_view = 45;
   camera_position_delta = glm::vec3 (0, 0, 0);
   camera_scale = .5f;
+  camera_heading = 0;
+  camera_pitch = 0;
   max_pitch_rate = 5;
   max_heading_rate = 5;
   move_camera = false;
@@ -58,6 +60,8 @@ void Camera::Update () {
   view = glm::lookAt (camera_position, camera_look_at, camera_up);
   model = glm::mat4 (1.0f);
   MVP = projection * view * model;
+  //the inverse is used to unproject screen points into primary rays
+  inverse_VP = glm::inverse (projection * view);
 }
 
 //Setting Functions
@@ -200,4 +204,32 @@ void Camera::GetMatricies (glm::mat4 &P, glm::mat4 &V, glm::mat4 &M) {
   P = projection;
   V = view;
   M = model;
+}
+
+//Ray Generation Functions
+void Camera::GenerateRay (float x, float y, Ray &ray) const {
+  //unproject the point on the near and far clipping planes
+  //this works the same way for both perspective and orthogonal projections
+  glm::vec4 ndc (2.f * (x - viewport_x) / window_width - 1.f, 2.f * (y - viewport_y) / window_height - 1.f, -1.f, 1.f);
+  glm::vec4 near_point = inverse_VP * ndc;
+  ndc.z = 1.f;
+  glm::vec4 far_point = inverse_VP * ndc;
+
+  glm::vec3 origin = glm::vec3 (near_point) / near_point.w;
+  ray.Origin = origin;
+  ray.Direction = glm::normalize (glm::vec3 (far_point) / far_point.w - origin);
+  ray.Tmin = 0.f;
+  ray.Tmax = FLT_MAX;
+}
+
+void Camera::GenerateRay (float x, float y, Ray &ray, RayDifferential &diff) const {
+  GenerateRay (x, y, ray);
+  //the differentials are exact for the pinhole model: just trace the neighboring pixels
+  Ray ray_x, ray_y;
+  GenerateRay (x + 1.f, y, ray_x);
+  GenerateRay (x, y + 1.f, ray_y);
+  diff.dOdx = ray_x.Origin - ray.Origin;
+  diff.dOdy = ray_y.Origin - ray.Origin;
+  diff.dDdx = ray_x.Direction - ray.Direction;
+  diff.dDdy = ray_y.Direction - ray.Direction;
 }
\ No newline at end of file
@@ -21,6 +21,8 @@ Written by Hammad Mazhar
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "Ray.hpp"
+
 enum CameraType {
   ORTHO, FREE
 };
@@ -73,6 +75,13 @@ public:
   void GetViewport (int &loc_x, int &loc_y, int &width, int &height);
   void GetMatricies (glm::mat4 &P, glm::mat4 &V, glm::mat4 &M);
 
+  //Ray Generation Functions
+  //Generates a primary ray through the given point of the viewport (in pixels, origin at the bottom-left corner)
+  //The differentials describe how the ray changes when moving by one pixel along X and Y
+  void GenerateRay (float x, float y, Ray &ray, RayDifferential &diff) const;
+  //Generates a primary ray without differentials
+  void GenerateRay (float x, float y, Ray &ray) const;
+
   CameraType camera_mode;
 
   int viewport_x;
@@ -106,6 +115,7 @@ public:
   glm::mat4 view;
   glm::mat4 model;
   glm::mat4 MVP;
+  glm::mat4 inverse_VP;
 
 };
 #endif
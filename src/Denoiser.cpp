@@ -0,0 +1,234 @@
+#include "Denoiser.hpp"
+
+#include "DenoiserKernels.hpp"
+#include "SimdSse.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+  //! Single-lane vector type for the reference kernel and image borders.
+  struct ScalarFloat
+  {
+    static const int Width = 1;
+
+    float Data;
+
+    ScalarFloat() {}
+    ScalarFloat (float theValue) : Data (theValue) {}
+
+    static ScalarFloat Load (const float* thePtr) { return *thePtr; }
+
+    static void Store (float* thePtr, const ScalarFloat& theVec) { *thePtr = theVec.Data; }
+  };
+
+  inline ScalarFloat operator+ (const ScalarFloat& theA, const ScalarFloat& theB) { return theA.Data + theB.Data; }
+  inline ScalarFloat operator- (const ScalarFloat& theA, const ScalarFloat& theB) { return theA.Data - theB.Data; }
+  inline ScalarFloat operator* (const ScalarFloat& theA, const ScalarFloat& theB) { return theA.Data * theB.Data; }
+  inline ScalarFloat operator/ (const ScalarFloat& theA, const ScalarFloat& theB) { return theA.Data / theB.Data; }
+
+  inline ScalarFloat Min (const ScalarFloat& theA, const ScalarFloat& theB) { return std::min (theA.Data, theB.Data); }
+  inline ScalarFloat Max (const ScalarFloat& theA, const ScalarFloat& theB) { return std::max (theA.Data, theB.Data); }
+  inline ScalarFloat Abs (const ScalarFloat& theA) { return std::abs (theA.Data); }
+
+  //! Albedo below this value is not divided out of the color.
+  const float THE_MIN_ALBEDO = 1.0e-2f;
+}
+
+#ifdef RAYLAB_HAS_X86
+
+//=======================================================================
+//function : DenoiseSpanSse
+//purpose  :
+//=======================================================================
+void DenoiseSpanSse (const DenoiserKernelArgs& theArgs)
+{
+  DenoiserKernels::FilterSpan<SseFloat> (theArgs);
+}
+
+#endif
+
+//=======================================================================
+//function : Denoiser
+//purpose  :
+//=======================================================================
+Denoiser::Denoiser()
+: myIsa (BsdfBatch::SupportedIsa()),
+  myLastTime (0.0),
+  mySizeX (0),
+  mySizeY (0)
+{
+  //
+}
+
+//=======================================================================
+//function : SetIsa
+//purpose  :
+//=======================================================================
+void Denoiser::SetIsa (SimdIsa theIsa)
+{
+  myIsa = std::min (theIsa, BsdfBatch::SupportedIsa());
+}
+
+//=======================================================================
+//function : MemorySize
+//purpose  :
+//=======================================================================
+size_t Denoiser::MemorySize() const
+{
+  size_t aSize = myDepth.size() * sizeof (float);
+  for (int aChannel = 0; aChannel < 3; ++aChannel)
+  {
+    aSize += (myColor[0][aChannel].size() + myColor[1][aChannel].size()
+            + myAlbedo[aChannel].size() + myNormal[aChannel].size()) * sizeof (float);
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : Run
+//purpose  :
+//=======================================================================
+void Denoiser::Run (Framebuffer& theFramebuffer, ThreadPool& thePool)
+{
+  const auto aStart = std::chrono::steady_clock::now();
+
+  mySizeX = theFramebuffer.SizeX();
+  mySizeY = theFramebuffer.SizeY();
+
+  const size_t aSize = static_cast<size_t> (mySizeX) * mySizeY;
+  for (int aComp = 0; aComp < 3; ++aComp)
+  {
+    myColor[0][aComp].resize (aSize);
+    myColor[1][aComp].resize (aSize);
+    myAlbedo[aComp]  .resize (aSize);
+    myNormal[aComp]  .resize (aSize);
+  }
+  myDepth.resize (aSize);
+
+  const LayerBuffer& aColor   = theFramebuffer.Layer (Layer_Color);
+  const LayerBuffer& anAlbedo = theFramebuffer.Layer (Layer_Albedo);
+  const LayerBuffer& aNormal  = theFramebuffer.Layer (Layer_Normal);
+  const LayerBuffer& aDepth   = theFramebuffer.Layer (Layer_Depth);
+
+  const float aRoundWeight = theFramebuffer.RoundWeight();
+
+  // Average samples into SoA planes and demodulate albedo
+  thePool.ParallelFor (mySizeY, [&](int theRow, int)
+  {
+    for (int aPixel = theRow * mySizeX; aPixel < (theRow + 1) * mySizeX; ++aPixel)
+    {
+      const float anInvCount = aColor[aPixel].w > 0.f ? 1.f / aColor[aPixel].w : 0.f;
+
+      const glm::vec3 anAvgAlbedo = glm::vec3 (anAlbedo[aPixel]) * anInvCount;
+      const glm::vec3 anAvgNormal = glm::vec3 (aNormal[aPixel])  * anInvCount;
+      const glm::vec3 anAvgColor  = theFramebuffer.Color (aPixel, aRoundWeight);
+      const float     aNormalLen  = glm::length (anAvgNormal);
+
+      for (int aComp = 0; aComp < 3; ++aComp)
+      {
+        const float aValue = anAvgColor[aComp];
+
+        myColor[0][aComp][aPixel] = anAvgAlbedo[aComp] > THE_MIN_ALBEDO ? aValue / anAvgAlbedo[aComp] : aValue;
+        myAlbedo[aComp][aPixel]   = anAvgAlbedo[aComp];
+        myNormal[aComp][aPixel]   = aNormalLen > 0.f ? anAvgNormal[aComp] / aNormalLen : 0.f;
+      }
+
+      myDepth[aPixel] = aDepth[aPixel].x * anInvCount;
+    }
+  });
+
+  int aSrc = 0;
+  for (int anIter = 0; anIter < myParams.NbIterations; ++anIter, aSrc = 1 - aSrc)
+  {
+    filter (anIter, aSrc, thePool);
+  }
+
+  LayerBuffer& aResult = theFramebuffer.ChangeLayer (Layer_Denoised);
+
+  thePool.ParallelFor (mySizeY, [&](int theRow, int)
+  {
+    for (int aPixel = theRow * mySizeX; aPixel < (theRow + 1) * mySizeX; ++aPixel)
+    {
+      glm::vec4 aValue (0.f, 0.f, 0.f, 1.f);
+      for (int aComp = 0; aComp < 3; ++aComp)
+      {
+        const float anAlbedoComp = myAlbedo[aComp][aPixel];
+
+        aValue[aComp] = myColor[aSrc][aComp][aPixel] * (anAlbedoComp > THE_MIN_ALBEDO ? anAlbedoComp : 1.f);
+      }
+
+      aResult[aPixel] = aValue;
+    }
+  });
+
+  myLastTime = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - aStart).count();
+}
+
+//=======================================================================
+//function : filter
+//purpose  :
+//=======================================================================
+void Denoiser::filter (int theIteration, int theSrc, ThreadPool& thePool)
+{
+  DenoiserKernelArgs anArgs;
+
+  anArgs.SizeX = mySizeX;
+  anArgs.SizeY = mySizeY;
+  anArgs.Step  = 1 << theIteration;
+
+  // Color tolerance shrinks with each iteration as the noise is removed
+  anArgs.InvSigmaColor  = static_cast<float> (1 << theIteration) / (myParams.SigmaColor * myParams.SigmaColor);
+  anArgs.InvSigmaNormal = 1.f / myParams.SigmaNormal;
+  anArgs.InvSigmaDepth  = 1.f / myParams.SigmaDepth;
+  anArgs.InvSigmaAlbedo = 1.f / (myParams.SigmaAlbedo * myParams.SigmaAlbedo);
+
+  anArgs.ColorR  = myColor[theSrc][0].data(); anArgs.ColorG  = myColor[theSrc][1].data(); anArgs.ColorB  = myColor[theSrc][2].data();
+  anArgs.AlbedoR = myAlbedo[0].data();        anArgs.AlbedoG = myAlbedo[1].data();        anArgs.AlbedoB = myAlbedo[2].data();
+  anArgs.NormalX = myNormal[0].data();        anArgs.NormalY = myNormal[1].data();        anArgs.NormalZ = myNormal[2].data();
+  anArgs.Depth   = myDepth.data();
+
+  anArgs.ResultR = myColor[1 - theSrc][0].data();
+  anArgs.ResultG = myColor[1 - theSrc][1].data();
+  anArgs.ResultB = myColor[1 - theSrc][2].data();
+
+  const int aWidth = myIsa == SimdIsa_Avx2 ? 8 : (myIsa == SimdIsa_Sse ? 4 : 1);
+
+  // SIMD span keeps all taps inside the row, borders are filtered by scalar kernel
+  const int aBorder    = 2 * anArgs.Step;
+  const int aSimdFirst = std::min (aBorder, mySizeX);
+  const int aSimdLast  = aSimdFirst + std::max (mySizeX - aBorder - aSimdFirst, 0) / aWidth * aWidth;
+
+  thePool.ParallelFor (mySizeY, [&](int theRow, int)
+  {
+    DenoiserKernelArgs aRowArgs = anArgs;
+    aRowArgs.Row = theRow;
+
+    aRowArgs.MinX = 0;
+    aRowArgs.MaxX = aSimdFirst;
+    DenoiserKernels::FilterSpan<ScalarFloat> (aRowArgs);
+
+    aRowArgs.MinX = aSimdFirst;
+    aRowArgs.MaxX = aSimdLast;
+  #ifdef RAYLAB_HAS_X86
+    if (myIsa == SimdIsa_Avx2)
+    {
+      DenoiseSpanAvx2 (aRowArgs);
+    }
+    else if (myIsa == SimdIsa_Sse)
+    {
+      DenoiseSpanSse (aRowArgs);
+    }
+    else
+  #endif
+    {
+      DenoiserKernels::FilterSpan<ScalarFloat> (aRowArgs);
+    }
+
+    aRowArgs.MinX = aSimdLast;
+    aRowArgs.MaxX = mySizeX;
+    DenoiserKernels::FilterSpan<ScalarFloat> (aRowArgs);
+  });
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+#include "BsdfBatch.hpp"
+#include "Framebuffer.hpp"
+#include "ThreadPool.hpp"
+
+//! Parameters of the denoiser.
+struct DenoiserParams
+{
+  int   NbIterations; //!< number of à-trous iterations (filter radius is 2^(N+1) pixels)
+  float SigmaColor;   //!< tolerance of relative color difference (halved each iteration)
+  float SigmaNormal;  //!< tolerance of normal deviation (1 - cosine)
+  float SigmaDepth;   //!< tolerance of relative depth difference per pixel
+  float SigmaAlbedo;  //!< tolerance of albedo difference
+
+  DenoiserParams() : NbIterations (5), SigmaColor (2.f), SigmaNormal (0.1f), SigmaDepth (0.05f), SigmaAlbedo (0.1f) {}
+};
+
+//! Edge-avoiding à-trous wavelet denoiser (Dammertz et al. 2010).
+//! Filters accumulated color into Layer_Denoised using albedo, normal and
+//! depth layers as edge stops. Color is divided by albedo before filtering
+//! and multiplied back afterwards, so that texture detail is preserved.
+//! Rows are filtered in parallel, pixels of the row with SIMD kernels.
+class Denoiser
+{
+public:
+
+  //! Creates denoiser.
+  Denoiser();
+
+  //! Returns parameters.
+  const DenoiserParams& Params() const { return myParams; }
+
+  //! Returns parameters for modification.
+  DenoiserParams& ChangeParams() { return myParams; }
+
+  //! Returns instruction set of filter kernels.
+  SimdIsa Isa() const { return myIsa; }
+
+  //! Sets instruction set of filter kernels (clamped to the supported one).
+  void SetIsa (SimdIsa theIsa);
+
+  //! Filters color layer of the framebuffer and stores result into Layer_Denoised.
+  void Run (Framebuffer& theFramebuffer, ThreadPool& thePool);
+
+  //! Returns time of the last run (in milliseconds).
+  double LastTime() const { return myLastTime; }
+
+  //! Returns size of filter buffers in bytes.
+  size_t MemorySize() const;
+
+private:
+
+  //! Performs one filter iteration from myColor[theSrc] to myColor[1 - theSrc].
+  void filter (int theIteration, int theSrc, ThreadPool& thePool);
+
+private:
+
+  DenoiserParams myParams;
+  SimdIsa        myIsa;
+  double         myLastTime;
+  int            mySizeX;
+  int            mySizeY;
+
+  std::vector<float> myColor[2][3]; //!< ping-pong buffers of demodulated color
+  std::vector<float> myAlbedo[3];
+  std::vector<float> myNormal[3];
+  std::vector<float> myDepth;
+
+};
@@ -0,0 +1,28 @@
+// This file is compiled with AVX2 enabled (see App.vcxproj), so it must not
+// include headers with inline functions shared with other translation units.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#if defined(__clang__)
+  #pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+  #pragma GCC target("avx2")
+#endif
+
+#include "DenoiserKernels.hpp"
+#include "SimdAvx2.hpp"
+
+//=======================================================================
+//function : DenoiseSpanAvx2
+//purpose  :
+//=======================================================================
+void DenoiseSpanAvx2 (const DenoiserKernelArgs& theArgs)
+{
+  DenoiserKernels::FilterSpan<AvxFloat> (theArgs);
+}
+
+#if defined(__clang__)
+  #pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+
+//! Raw pointers to SoA image planes processed by one à-trous iteration.
+//! Like BsdfKernelArgs, kernels are compiled with different instruction
+//! sets and see only plain arrays.
+struct DenoiserKernelArgs
+{
+  int SizeX;  //!< image width
+  int SizeY;  //!< image height
+  int Step;   //!< distance between filter taps in pixels (2^iteration)
+  int Row;    //!< processed row
+  int MinX;   //!< first processed pixel of the row
+  int MaxX;   //!< last processed pixel of the row (exclusive, MaxX - MinX is multiple of SIMD width)
+
+  float InvSigmaColor;  //!< 1 / sigma^2 of relative color difference
+  float InvSigmaNormal; //!< 1 / sigma of normal deviation (1 - cosine)
+  float InvSigmaDepth;  //!< 1 / sigma of relative depth difference per tap step
+  float InvSigmaAlbedo; //!< 1 / sigma^2 of albedo difference
+
+  const float* ColorR;  const float* ColorG;  const float* ColorB;  //!< input (demodulated) color
+  const float* AlbedoR; const float* AlbedoG; const float* AlbedoB;
+  const float* NormalX; const float* NormalY; const float* NormalZ;
+  const float* Depth;
+
+  float* ResultR; float* ResultG; float* ResultB;
+};
+
+//! Filters row span with SSE2 kernel.
+void DenoiseSpanSse (const DenoiserKernelArgs& theArgs);
+
+//! Filters row span with AVX2 kernel (compiled with AVX2 enabled, call only if CPU supports it).
+void DenoiseSpanAvx2 (const DenoiserKernelArgs& theArgs);
+
+//! Generic edge-avoiding à-trous kernel (Dammertz et al. 2010) over SIMD type V.
+//! V provides arithmetic operators, broadcast constructor from float, static
+//! Load()/Store() and functions Min(), Max() and Abs() found by argument-dependent
+//! lookup. Taps outside the image are skipped, so SIMD spans must keep all taps
+//! inside the row (the scalar instantiation handles image borders).
+namespace DenoiserKernels
+{
+  //! Returns exp (-x) for x >= 0 (Taylor series of x / 32 squared five times,
+  //! relative error below 1e-3; x is clamped to 20).
+  template<class V>
+  inline V ExpNeg (const V& theX)
+  {
+    const V anX = Min (theX, V (20.f)) * V (1.f / 32.f);
+
+    V aRes = V (1.f) - anX * (V (1.f) - anX * (V (1.f / 2.f) - anX * (V (1.f / 6.f) - anX * (V (1.f / 24.f) - anX * V (1.f / 120.f)))));
+    aRes = aRes * aRes;
+    aRes = aRes * aRes;
+    aRes = aRes * aRes;
+    aRes = aRes * aRes;
+    aRes = aRes * aRes;
+
+    return aRes;
+  }
+
+  //! Filters pixels [MinX, MaxX) of the row with 5x5 B3-spline kernel.
+  template<class V>
+  void FilterSpan (const DenoiserKernelArgs& theArgs)
+  {
+    static const float THE_WEIGHTS[5] = { 1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+
+    for (int aX = theArgs.MinX; aX < theArgs.MaxX; aX += V::Width)
+    {
+      const int aPixel = theArgs.Row * theArgs.SizeX + aX;
+
+      const V aColorR   = V::Load (theArgs.ColorR  + aPixel), aColorG   = V::Load (theArgs.ColorG  + aPixel), aColorB   = V::Load (theArgs.ColorB  + aPixel);
+      const V anAlbedoR = V::Load (theArgs.AlbedoR + aPixel), anAlbedoG = V::Load (theArgs.AlbedoG + aPixel), anAlbedoB = V::Load (theArgs.AlbedoB + aPixel);
+      const V aNormalX  = V::Load (theArgs.NormalX + aPixel), aNormalY  = V::Load (theArgs.NormalY + aPixel), aNormalZ  = V::Load (theArgs.NormalZ + aPixel);
+      const V aDepth    = V::Load (theArgs.Depth   + aPixel);
+
+      // Color difference is relative to the brightness of the center pixel
+      const V aLuminance = aColorR * V (0.2126f) + aColorG * V (0.7152f) + aColorB * V (0.0722f);
+      const V anInvColor = V (theArgs.InvSigmaColor) / (aLuminance * aLuminance + V (1.0e-2f));
+      const V anInvDepth = V (theArgs.InvSigmaDepth) / (aDepth + V (1.0e-4f));
+
+      V aSumR (0.f), aSumG (0.f), aSumB (0.f), aSumW (0.f);
+
+      for (int aDy = -2; aDy <= 2; ++aDy)
+      {
+        const int aRowQ = theArgs.Row + aDy * theArgs.Step;
+        if (aRowQ < 0 || aRowQ >= theArgs.SizeY)
+        {
+          continue;
+        }
+
+        for (int aDx = -2; aDx <= 2; ++aDx)
+        {
+          const int aColQ = aX + aDx * theArgs.Step;
+          if (aColQ < 0 || aColQ + V::Width > theArgs.SizeX)
+          {
+            continue;
+          }
+
+          const int aTap = aRowQ * theArgs.SizeX + aColQ;
+
+          const V aTapR = V::Load (theArgs.ColorR + aTap), aTapG = V::Load (theArgs.ColorG + aTap), aTapB = V::Load (theArgs.ColorB + aTap);
+
+          const V aDr = aColorR - aTapR, aDg = aColorG - aTapG, aDb = aColorB - aTapB;
+          const V aColorDist = (aDr * aDr + aDg * aDg + aDb * aDb) * anInvColor;
+
+          const V aDar = anAlbedoR - V::Load (theArgs.AlbedoR + aTap);
+          const V aDag = anAlbedoG - V::Load (theArgs.AlbedoG + aTap);
+          const V aDab = anAlbedoB - V::Load (theArgs.AlbedoB + aTap);
+          const V anAlbedoDist = (aDar * aDar + aDag * aDag + aDab * aDab) * V (theArgs.InvSigmaAlbedo);
+
+          const V aCos = aNormalX * V::Load (theArgs.NormalX + aTap)
+                       + aNormalY * V::Load (theArgs.NormalY + aTap)
+                       + aNormalZ * V::Load (theArgs.NormalZ + aTap);
+          const V aNormalDist = Max (V (1.f) - aCos, V (0.f)) * V (theArgs.InvSigmaNormal);
+
+          // Depth changes linearly with screen distance on slanted surfaces
+          const int aTapDist = theArgs.Step * (aDx * aDx > aDy * aDy ? (aDx < 0 ? -aDx : aDx) : (aDy < 0 ? -aDy : aDy));
+          const V aDepthDist = Abs (aDepth - V::Load (theArgs.Depth + aTap)) * anInvDepth * V (aTapDist > 0 ? 1.f / aTapDist : 0.f);
+
+          const V aWeight = V (THE_WEIGHTS[aDx + 2] * THE_WEIGHTS[aDy + 2]) * ExpNeg (aColorDist + anAlbedoDist + aNormalDist + aDepthDist);
+
+          aSumR = aSumR + aTapR * aWeight;
+          aSumG = aSumG + aTapG * aWeight;
+          aSumB = aSumB + aTapB * aWeight;
+          aSumW = aSumW + aWeight;
+        }
+      }
+
+      // Center tap always has positive weight
+      const V anInvSum = V (1.f) / aSumW;
+
+      V::Store (theArgs.ResultR + aPixel, aSumR * anInvSum);
+      V::Store (theArgs.ResultG + aPixel, aSumG * anInvSum);
+      V::Store (theArgs.ResultB + aPixel, aSumB * anInvSum);
+    }
+  }
+}
@@ -0,0 +1,287 @@
+#include "Environment.hpp"
+
+#include "ImageIO.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const float THE_PI = 3.14159265358979f;
+
+  //! Resolution of the coarse distribution used for MIS weights.
+  const int THE_COARSE_SIZE_X = 64;
+  const int THE_COARSE_SIZE_Y = 32;
+
+  //! Returns luminance of linear RGB color.
+  inline float Luminance (const glm::vec3& theColor)
+  {
+    return 0.2126f * theColor.x + 0.7152f * theColor.y + 0.0722f * theColor.z;
+  }
+}
+
+//=======================================================================
+//function : Environment
+//purpose  :
+//=======================================================================
+Environment::Environment()
+: mySizeX (0),
+  mySizeY (0),
+  myCoarseX (0),
+  myCoarseY (0),
+  myIntensity (1.f)
+{
+  //
+}
+
+//=======================================================================
+//function : Load
+//purpose  :
+//=======================================================================
+bool Environment::Load (const std::string& theFileName, ThreadPool& thePool)
+{
+  Clear();
+
+  int aSizeX = 0;
+  int aSizeY = 0;
+  std::vector<glm::vec4> aPixels;
+  if (!ImageIO::Load (theFileName, aSizeX, aSizeY, aPixels))
+  {
+    return false;
+  }
+
+  myFileName = theFileName;
+  mySizeX    = aSizeX;
+  mySizeY    = aSizeY;
+
+  // Image rows are stored from bottom to top
+  myPixels.resize (aPixels.size());
+  for (int aY = 0; aY < aSizeY; ++aY)
+  {
+    for (int aX = 0; aX < aSizeX; ++aX)
+    {
+      myPixels[aY * aSizeX + aX] = glm::vec3 (aPixels[(aSizeY - 1 - aY) * aSizeX + aX]);
+    }
+  }
+
+  build (thePool);
+  return true;
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void Environment::Clear()
+{
+  myFileName.clear();
+  myPixels.clear();
+  myRows.clear();
+  myMarginal.Clear();
+  myCoarse.clear();
+
+  mySizeX   = 0;
+  mySizeY   = 0;
+  myCoarseX = 0;
+  myCoarseY = 0;
+}
+
+//=======================================================================
+//function : MemorySize
+//purpose  :
+//=======================================================================
+size_t Environment::MemorySize() const
+{
+  size_t aSize = myPixels.size() * sizeof (glm::vec3) + myCoarse.size() * sizeof (float) + myMarginal.MemorySize();
+  for (size_t aRow = 0; aRow < myRows.size(); ++aRow)
+  {
+    aSize += myRows[aRow].MemorySize();
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : build
+//purpose  :
+//=======================================================================
+void Environment::build (ThreadPool& thePool)
+{
+  myRows.assign (mySizeY, AliasTable());
+
+  // Rows are independent, so their tables are built in parallel.
+  // Pixel weight includes sine of latitude (solid angle of the pixel).
+  std::vector<float> aRowWeights (mySizeY, 0.f);
+  thePool.ParallelFor (mySizeY, [&](int theRow, int)
+  {
+    const float aSinTheta = std::sin ((theRow + 0.5f) / mySizeY * THE_PI);
+
+    std::vector<float> aWeights (mySizeX);
+    for (int aX = 0; aX < mySizeX; ++aX)
+    {
+      aWeights[aX] = std::max (Luminance (myPixels[theRow * mySizeX + aX]), 0.f) * aSinTheta;
+    }
+
+    if (myRows[theRow].Build (aWeights))
+    {
+      aRowWeights[theRow] = myRows[theRow].Total();
+    }
+  });
+
+  if (!myMarginal.Build (aRowWeights))
+  {
+    return;
+  }
+
+  // Coarse cells accumulate probabilities of covered pixels
+  myCoarseX = std::min (mySizeX, THE_COARSE_SIZE_X);
+  myCoarseY = std::min (mySizeY, THE_COARSE_SIZE_Y);
+  myCoarse.assign (myCoarseX * myCoarseY, 0.f);
+
+  thePool.ParallelFor (myCoarseY, [&](int theCellY, int)
+  {
+    const int aMinY = theCellY * mySizeY / myCoarseY;
+    const int aMaxY = (theCellY + 1) * mySizeY / myCoarseY;
+
+    for (int aY = aMinY; aY < aMaxY; ++aY)
+    {
+      if (myRows[aY].IsEmpty())
+      {
+        continue;
+      }
+
+      const float aRowProb = myMarginal.Prob (aY);
+      for (int aX = 0; aX < mySizeX; ++aX)
+      {
+        myCoarse[theCellY * myCoarseX + aX * myCoarseX / mySizeX] += aRowProb * myRows[aY].Prob (aX);
+      }
+    }
+  });
+}
+
+//=======================================================================
+//function : toUV
+//purpose  :
+//=======================================================================
+glm::vec2 Environment::toUV (const glm::vec3& theDirection)
+{
+  const float aPhi   = std::atan2 (theDirection.x, -theDirection.z);
+  const float aTheta = std::acos (std::min (std::max (theDirection.y, -1.f), 1.f));
+
+  return glm::vec2 (aPhi / (2.f * THE_PI) + 0.5f, aTheta / THE_PI);
+}
+
+//=======================================================================
+//function : pixelOf
+//purpose  :
+//=======================================================================
+int Environment::pixelOf (const glm::vec2& theUV) const
+{
+  const int aX = std::min (std::max (static_cast<int> (theUV.x * mySizeX), 0), mySizeX - 1);
+  const int aY = std::min (std::max (static_cast<int> (theUV.y * mySizeY), 0), mySizeY - 1);
+
+  return aY * mySizeX + aX;
+}
+
+//=======================================================================
+//function : Eval
+//purpose  :
+//=======================================================================
+glm::vec3 Environment::Eval (const glm::vec3& theDirection) const
+{
+  if (myPixels.empty())
+  {
+    return glm::vec3 (0.f);
+  }
+
+  return myPixels[pixelOf (toUV (theDirection))] * myIntensity;
+}
+
+//=======================================================================
+//function : Sample
+//purpose  :
+//=======================================================================
+bool Environment::Sample (const glm::vec2& theUV, glm::vec3& theDirection, glm::vec3& theRadiance, float& thePdf) const
+{
+  if (myMarginal.IsEmpty())
+  {
+    return false;
+  }
+
+  // Random numbers are remapped by the tables to jitter the direction inside the pixel
+  float aRowProb = 0.f;
+  float aRowU    = 0.f;
+  const int aY = myMarginal.Sample (theUV.y, aRowProb, aRowU);
+
+  float aColProb = 0.f;
+  float aColU    = 0.f;
+  const int aX = myRows[aY].Sample (theUV.x, aColProb, aColU);
+
+  const float aPhi   = ((aX + aColU) / mySizeX - 0.5f) * 2.f * THE_PI;
+  const float aTheta = (aY + aRowU) / mySizeY * THE_PI;
+
+  const float aSinTheta = std::sin (aTheta);
+  if (aSinTheta <= 0.f)
+  {
+    return false;
+  }
+
+  theDirection = glm::vec3 (aSinTheta * std::sin (aPhi), std::cos (aTheta), -aSinTheta * std::cos (aPhi));
+  theRadiance  = myPixels[aY * mySizeX + aX] * myIntensity;
+
+  // Density is constant in the image plane, Jacobian of the mapping is 2 pi^2 sin(theta)
+  thePdf = aRowProb * aColProb * mySizeX * mySizeY / (2.f * THE_PI * THE_PI * aSinTheta);
+  return true;
+}
+
+//=======================================================================
+//function : Pdf
+//purpose  :
+//=======================================================================
+float Environment::Pdf (const glm::vec3& theDirection) const
+{
+  if (myMarginal.IsEmpty())
+  {
+    return 0.f;
+  }
+
+  const float aSinTheta = std::sqrt (std::max (1.f - theDirection.y * theDirection.y, 0.f));
+  if (aSinTheta <= 0.f)
+  {
+    return 0.f;
+  }
+
+  const int aPixel = pixelOf (toUV (theDirection));
+  const int aY = aPixel / mySizeX;
+  if (myRows[aY].IsEmpty())
+  {
+    return 0.f;
+  }
+
+  return myMarginal.Prob (aY) * myRows[aY].Prob (aPixel - aY * mySizeX) * mySizeX * mySizeY / (2.f * THE_PI * THE_PI * aSinTheta);
+}
+
+//=======================================================================
+//function : MisPdf
+//purpose  :
+//=======================================================================
+float Environment::MisPdf (const glm::vec3& theDirection) const
+{
+  if (myCoarse.empty())
+  {
+    return 0.f;
+  }
+
+  const float aSinTheta = std::sqrt (std::max (1.f - theDirection.y * theDirection.y, 0.f));
+  if (aSinTheta <= 0.f)
+  {
+    return 0.f;
+  }
+
+  const glm::vec2 aUV = toUV (theDirection);
+
+  const int aX = std::min (std::max (static_cast<int> (aUV.x * myCoarseX), 0), myCoarseX - 1);
+  const int aY = std::min (std::max (static_cast<int> (aUV.y * myCoarseY), 0), myCoarseY - 1);
+
+  return myCoarse[aY * myCoarseX + aX] * myCoarseX * myCoarseY / (2.f * THE_PI * THE_PI * aSinTheta);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "AliasTable.hpp"
+
+class ThreadPool;
+
+//! Distant environment light given by HDR image in latitude-longitude mapping
+//! (Y axis points to the top row, -Z to the image center).
+//! Directions are importance sampled proportionally to pixel luminance by 2D
+//! alias table (marginal table over rows and conditional table per row), so that
+//! sampling takes constant time. Coarse copy of the distribution is kept for
+//! evaluating densities of MIS weights cheaply.
+class Environment
+{
+public:
+
+  //! Creates empty environment.
+  Environment();
+
+  //! Loads image (HDR, PFM or PPM) and builds sampling tables using the pool.
+  bool Load (const std::string& theFileName, ThreadPool& thePool);
+
+  //! Releases all data.
+  void Clear();
+
+  //! Returns true if no image is loaded.
+  bool IsEmpty() const { return myPixels.empty(); }
+
+  //! Returns name of the loaded file.
+  const std::string& FileName() const { return myFileName; }
+
+  //! Returns image width.
+  int SizeX() const { return mySizeX; }
+
+  //! Returns image height.
+  int SizeY() const { return mySizeY; }
+
+  //! Returns size of the image and sampling tables in bytes.
+  size_t MemorySize() const;
+
+  //! Returns radiance scale.
+  float Intensity() const { return myIntensity; }
+
+  //! Sets radiance scale (does not affect sampling).
+  void SetIntensity (float theIntensity) { myIntensity = theIntensity; }
+
+  //! Returns radiance arriving from the direction.
+  glm::vec3 Eval (const glm::vec3& theDirection) const;
+
+  //! Samples direction by two random numbers. Returns false if the image is black.
+  bool Sample (const glm::vec2& theUV, glm::vec3& theDirection, glm::vec3& theRadiance, float& thePdf) const;
+
+  //! Returns solid angle density of sampling the direction by Sample().
+  float Pdf (const glm::vec3& theDirection) const;
+
+  //! Returns approximate solid angle density from the coarse distribution (for MIS weights).
+  float MisPdf (const glm::vec3& theDirection) const;
+
+private:
+
+  //! Builds sampling tables.
+  void build (ThreadPool& thePool);
+
+  //! Returns texture coordinates of the direction.
+  static glm::vec2 toUV (const glm::vec3& theDirection);
+
+  //! Returns pixel index of texture coordinates.
+  int pixelOf (const glm::vec2& theUV) const;
+
+private:
+
+  std::string             myFileName;
+  std::vector<glm::vec3>  myPixels;    //!< radiance, first row is the top one
+  std::vector<AliasTable> myRows;      //!< conditional distributions of columns
+  AliasTable              myMarginal;  //!< distribution of rows
+  std::vector<float>      myCoarse;    //!< probabilities of coarse cells
+  int                     mySizeX;
+  int                     mySizeY;
+  int                     myCoarseX;
+  int                     myCoarseY;
+  float                   myIntensity;
+
+};
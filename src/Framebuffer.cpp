@@ -0,0 +1,496 @@
+#include "Framebuffer.hpp"
+
+#include "Arena.hpp"
+#include "HugePages.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  //! Maps value in [0, 1] to blue-cyan-green-yellow-red color ramp.
+  glm::vec3 FalseColor (float theValue)
+  {
+    static const glm::vec3 THE_RAMP[] =
+    {
+      glm::vec3 (0.f, 0.f, 1.f),
+      glm::vec3 (0.f, 1.f, 1.f),
+      glm::vec3 (0.f, 1.f, 0.f),
+      glm::vec3 (1.f, 1.f, 0.f),
+      glm::vec3 (1.f, 0.f, 0.f)
+    };
+
+    const float aPos  = std::max (0.f, std::min (theValue, 1.f)) * 3.999f;
+    const int   anIdx = static_cast<int> (aPos);
+
+    return glm::mix (THE_RAMP[anIdx], THE_RAMP[anIdx + 1], aPos - anIdx);
+  }
+}
+
+//=======================================================================
+//function : Framebuffer
+//purpose  :
+//=======================================================================
+Framebuffer::Framebuffer()
+: mySizeX (0),
+  mySizeY (0),
+  myNbTilesX (0),
+  myNbTilesY (0),
+  myNbPasses (0),
+  myLastWeight (0.f)
+{
+  //
+}
+
+//=======================================================================
+//function : Resize
+//purpose  :
+//=======================================================================
+void Framebuffer::Resize (int theSizeX, int theSizeY, ThreadPool& thePool)
+{
+  theSizeX = std::max (theSizeX, 1);
+  theSizeY = std::max (theSizeY, 1);
+
+  if (theSizeX == mySizeX && theSizeY == mySizeY)
+  {
+    return;
+  }
+
+  mySizeX = theSizeX;
+  mySizeY = theSizeY;
+
+  myNbTilesX = (mySizeX + TileSize - 1) / TileSize;
+  myNbTilesY = (mySizeY + TileSize - 1) / TileSize;
+
+  // Buffers are allocated anew and left untouched until Clear(), so they are advised before the first fault
+  for (int aLayer = 0; aLayer < Layer_NB; ++aLayer)
+  {
+    LayerBuffer (aLayer != Layer_Samples ? mySizeX * mySizeY : 0).swap (myLayers[aLayer]);
+    HugePages::Advise (myLayers[aLayer].data(), myLayers[aLayer].size() * sizeof (glm::vec4),
+                       std::string ("framebuffer ") + LayerName (aLayer));
+  }
+
+  LayerBuffer (mySizeX * mySizeY).swap (myHalfColor);
+  HugePages::Advise (myHalfColor.data(), myHalfColor.size() * sizeof (glm::vec4), "framebuffer half color");
+
+  // Round buffers are allocated by the first FinishRound()
+  LayerBuffer().swap (myRounds);
+  LayerBuffer().swap (myRoundColor);
+  LayerBuffer().swap (myRoundHalf);
+  myLastWeight = 0.f;
+  myTileErrors.resize (NbTiles());
+
+  Clear (thePool);
+}
+
+//=======================================================================
+//function : AdoptHugePages
+//purpose  :
+//=======================================================================
+void Framebuffer::AdoptHugePages (ThreadPool& thePool)
+{
+  // Accumulated samples are kept, layers are copied only when huge pages are toggled
+  for (int aLayer = 0; aLayer < Layer_NB; ++aLayer)
+  {
+    adoptHugePages (myLayers[aLayer], std::string ("framebuffer ") + LayerName (aLayer), thePool);
+  }
+  adoptHugePages (myHalfColor, "framebuffer half color", thePool);
+  if (!myRounds.empty())
+  {
+    adoptHugePages (myRounds,     "framebuffer rounds",           thePool);
+    adoptHugePages (myRoundColor, "framebuffer round color",      thePool);
+    adoptHugePages (myRoundHalf,  "framebuffer round half color", thePool);
+  }
+}
+
+//=======================================================================
+//function : adoptHugePages
+//purpose  :
+//=======================================================================
+void Framebuffer::adoptHugePages (LayerBuffer& theBuffer, const std::string& theName, ThreadPool& thePool)
+{
+  const size_t aBytes = theBuffer.size() * sizeof (glm::vec4);
+  if (HugePages::IsAdvised (theBuffer.data(), aBytes, theName))
+  {
+    return;
+  }
+  else if (aBytes < HugePages::PageSize)
+  {
+    HugePages::Advise (theBuffer.data(), aBytes, theName);
+    return;
+  }
+
+  // New buffer is left unwritten until the tiles are copied by the threads which render them
+  LayerBuffer aCopy (theBuffer.size());
+  HugePages::Advise (aCopy.data(), aBytes, theName);
+
+  thePool.ParallelFor (NbTiles(), [&](int theTile, int)
+  {
+    int aMinX, aMinY, aMaxX, aMaxY;
+    TileRect (theTile, aMinX, aMinY, aMaxX, aMaxY);
+
+    for (int aY = aMinY; aY < aMaxY; ++aY)
+    {
+      std::copy (theBuffer.begin() + aY * mySizeX + aMinX, theBuffer.begin() + aY * mySizeX + aMaxX, aCopy.begin() + aY * mySizeX + aMinX);
+    }
+  });
+
+  theBuffer.swap (aCopy);
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void Framebuffer::Clear (ThreadPool& thePool)
+{
+  thePool.ParallelFor (NbTiles(), [&](int theTile, int)
+  {
+    int aMinX, aMinY, aMaxX, aMaxY;
+    TileRect (theTile, aMinX, aMinY, aMaxX, aMaxY);
+
+    for (int aY = aMinY; aY < aMaxY; ++aY)
+    {
+      for (int aLayer = 0; aLayer < Layer_NB; ++aLayer)
+      {
+        if (!myLayers[aLayer].empty())
+        {
+          std::fill (myLayers[aLayer].begin() + aY * mySizeX + aMinX, myLayers[aLayer].begin() + aY * mySizeX + aMaxX, glm::vec4 (0.f));
+        }
+      }
+
+      std::fill (myHalfColor.begin() + aY * mySizeX + aMinX, myHalfColor.begin() + aY * mySizeX + aMaxX, glm::vec4 (0.f));
+    }
+  });
+
+  std::fill (myTileErrors.begin(), myTileErrors.end(), 0.f);
+
+  // Accumulation starts as single round (capacity is kept for the next FinishRound())
+  myRounds.clear();
+  myRoundColor.clear();
+  myRoundHalf.clear();
+  myLastWeight = 0.f;
+
+  myActiveTiles.resize (NbTiles());
+  for (int aTile = 0; aTile < NbTiles(); ++aTile)
+  {
+    myActiveTiles[aTile] = aTile;
+  }
+
+  myNbPasses = 0;
+}
+
+//=======================================================================
+//function : FinishRound
+//purpose  :
+//=======================================================================
+void Framebuffer::FinishRound (ThreadPool& thePool)
+{
+  const size_t aSize = myHalfColor.size();
+  if (myRounds.empty())
+  {
+    // Buffers persist across passes until the next Clear()
+    AllocationCounter::Ignore anIgnore;
+
+    myRounds    .resize (aSize);
+    myRoundColor.resize (aSize);
+    myRoundHalf .resize (aSize);
+    HugePages::Advise (myRounds    .data(), aSize * sizeof (glm::vec4), "framebuffer rounds");
+    HugePages::Advise (myRoundColor.data(), aSize * sizeof (glm::vec4), "framebuffer round color");
+    HugePages::Advise (myRoundHalf .data(), aSize * sizeof (glm::vec4), "framebuffer round half color");
+
+    std::fill (myRounds    .begin(), myRounds    .end(), glm::vec4 (0.f));
+    std::fill (myRoundColor.begin(), myRoundColor.end(), glm::vec4 (0.f));
+    std::fill (myRoundHalf .begin(), myRoundHalf .end(), glm::vec4 (0.f));
+  }
+
+  const float aWeight = sampleWeight();
+  if (aWeight <= 0.f)
+  {
+    return;
+  }
+
+  const LayerBuffer& aColor = myLayers[Layer_Color];
+  thePool.ParallelFor (mySizeY, [&](int theRow, int)
+  {
+    for (int aPixel = theRow * mySizeX; aPixel < (theRow + 1) * mySizeX; ++aPixel)
+    {
+      const glm::vec4 aRound = aColor[aPixel] - myRoundColor[aPixel];
+      myRounds[aPixel]    += aRound * aWeight;
+      myRoundColor[aPixel] = aColor[aPixel];
+      myRoundHalf[aPixel]  = myHalfColor[aPixel];
+    }
+  });
+  myLastWeight = aWeight;
+}
+
+//=======================================================================
+//function : RoundWeight
+//purpose  :
+//=======================================================================
+float Framebuffer::RoundWeight() const
+{
+  if (myRounds.empty())
+  {
+    return 0.f;
+  }
+
+  const float aWeight = sampleWeight();
+  return aWeight > 0.f ? aWeight : myLastWeight;
+}
+
+//=======================================================================
+//function : sampleWeight
+//purpose  :
+//=======================================================================
+float Framebuffer::sampleWeight() const
+{
+  // Difference of full and half estimates has the variance of the full one,
+  // which is the variance of a sample over the number of samples
+  const LayerBuffer& aColor = myLayers[Layer_Color];
+
+  double aSum     = 0.0;
+  size_t aNbTaken = 0;
+  for (size_t aPixel = 0; aPixel < aColor.size(); ++aPixel)
+  {
+    const glm::vec4 aFull = aColor[aPixel]      - myRoundColor[aPixel];
+    const glm::vec4 aHalf = myHalfColor[aPixel] - myRoundHalf[aPixel];
+    if (aFull.w < 2.f || aHalf.w < 1.f)
+    {
+      continue;
+    }
+
+    const glm::vec3 aDiff = glm::vec3 (aFull) / aFull.w - glm::vec3 (aHalf) / aHalf.w;
+
+    aSum += glm::dot (aDiff, aDiff) * aFull.w / 3.0;
+    ++aNbTaken;
+  }
+
+  if (aNbTaken == 0)
+  {
+    return 0.f;
+  }
+
+  return static_cast<float> (aNbTaken / std::max (aSum, aNbTaken * 1.0e-12));
+}
+
+//=======================================================================
+//function : Color
+//purpose  :
+//=======================================================================
+glm::vec3 Framebuffer::Color (int thePixel, float theRoundWeight) const
+{
+  const glm::vec4& aColor = myLayers[Layer_Color][thePixel];
+  if (!myRounds.empty())
+  {
+    glm::vec4 aSum = myRounds[thePixel];
+
+    const glm::vec4 aRound = aColor - myRoundColor[thePixel];
+    if (aRound.w > 0.f && theRoundWeight > 0.f)
+    {
+      aSum += aRound * theRoundWeight;
+    }
+
+    if (aSum.w > 0.f)
+    {
+      return glm::vec3 (aSum) / aSum.w;
+    }
+  }
+
+  return aColor.w > 0.f ? glm::vec3 (aColor) / aColor.w : glm::vec3 (0.f);
+}
+
+//=======================================================================
+//function : TileRect
+//purpose  :
+//=======================================================================
+void Framebuffer::TileRect (int theTile, int& theMinX, int& theMinY, int& theMaxX, int& theMaxY) const
+{
+  theMinX = (theTile % myNbTilesX) * TileSize;
+  theMinY = (theTile / myNbTilesX) * TileSize;
+
+  theMaxX = std::min (theMinX + TileSize, mySizeX);
+  theMaxY = std::min (theMinY + TileSize, mySizeY);
+}
+
+//=======================================================================
+//function : UpdateActiveTiles
+//purpose  :
+//=======================================================================
+void Framebuffer::UpdateActiveTiles (float theTargetError, int theMinSamples, ThreadPool& thePool)
+{
+  const LayerBuffer& aColor = myLayers[Layer_Color];
+
+  // Error of the pixel is |I - A| / sqrt (I), where I is the full estimate and
+  // A is the estimate from half of samples (all pixels of tile share sample count)
+  thePool.ParallelFor (NbTiles(), [&](int theTile, int)
+  {
+    int aMinX, aMinY, aMaxX, aMaxY;
+    TileRect (theTile, aMinX, aMinY, aMaxX, aMaxY);
+
+    const float aNbSamples = aColor[aMinY * mySizeX + aMinX].w;
+
+    if (aNbSamples < 2.f || theTargetError <= 0.f)
+    {
+      myTileErrors[theTile] = 0.f;
+      return;
+    }
+
+    float anError = 0.f;
+    for (int aY = aMinY; aY < aMaxY; ++aY)
+    {
+      for (int aX = aMinX; aX < aMaxX; ++aX)
+      {
+        const int aPixel = aY * mySizeX + aX;
+
+        const glm::vec3 aFull = glm::vec3 (aColor[aPixel]) / aColor[aPixel].w;
+        const glm::vec3 aHalf = glm::vec3 (myHalfColor[aPixel]) / myHalfColor[aPixel].w;
+
+        const glm::vec3 aDiff = glm::abs (aFull - aHalf);
+
+        anError += (aDiff.x + aDiff.y + aDiff.z) / std::sqrt (aFull.x + aFull.y + aFull.z + 1.0e-3f);
+      }
+    }
+
+    myTileErrors[theTile] = anError / ((aMaxX - aMinX) * (aMaxY - aMinY));
+  });
+
+  myActiveTiles.clear();
+
+  for (int aTile = 0; aTile < NbTiles(); ++aTile)
+  {
+    int aMinX, aMinY, aMaxX, aMaxY;
+    TileRect (aTile, aMinX, aMinY, aMaxX, aMaxY);
+
+    if (theTargetError <= 0.f
+     || aColor[aMinY * mySizeX + aMinX].w < static_cast<float> (std::max (theMinSamples, 2))
+     || myTileErrors[aTile] > theTargetError)
+    {
+      myActiveTiles.push_back (aTile);
+    }
+  }
+}
+
+//=======================================================================
+//function : AverageSamples
+//purpose  :
+//=======================================================================
+float Framebuffer::AverageSamples() const
+{
+  const LayerBuffer& aColor = myLayers[Layer_Color];
+  if (aColor.empty())
+  {
+    return 0.f;
+  }
+
+  double aSum = 0.0;
+  for (size_t anIdx = 0; anIdx < aColor.size(); ++anIdx)
+  {
+    aSum += aColor[anIdx].w;
+  }
+
+  return static_cast<float> (aSum / aColor.size());
+}
+
+//=======================================================================
+//function : MemorySize
+//purpose  :
+//=======================================================================
+size_t Framebuffer::MemorySize() const
+{
+  size_t aSize = (myHalfColor.size() + myRounds.size() + myRoundColor.size() + myRoundHalf.size()) * sizeof (glm::vec4)
+               + myTileErrors.size() * sizeof (float)
+               + myActiveTiles.size() * sizeof (int);
+  for (int aLayer = 0; aLayer < Layer_NB; ++aLayer)
+  {
+    aSize += myLayers[aLayer].size() * sizeof (glm::vec4);
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : Resolve
+//purpose  :
+//=======================================================================
+void Framebuffer::Resolve (FramebufferLayer theLayer, std::vector<glm::vec4>& thePixels) const
+{
+  if (theLayer == Layer_Samples)
+  {
+    const LayerBuffer& aColor = myLayers[Layer_Color];
+
+    thePixels.resize (aColor.size());
+
+    const float aScale = 1.f / std::max (static_cast<float> (myNbPasses), 1.f);
+    for (size_t anIdx = 0; anIdx < aColor.size(); ++anIdx)
+    {
+      thePixels[anIdx] = glm::vec4 (FalseColor (aColor[anIdx].w * aScale), 1.f);
+    }
+
+    return;
+  }
+
+  const LayerBuffer& aData = myLayers[theLayer];
+
+  thePixels.resize (aData.size());
+
+  const float aRoundWeight = theLayer == Layer_Color ? RoundWeight() : 0.f;
+
+  float aMaxValue = 0.f;
+  for (size_t anIdx = 0; anIdx < aData.size(); ++anIdx)
+  {
+    const glm::vec3 aValue = theLayer == Layer_Color
+                           ? Color (static_cast<int> (anIdx), aRoundWeight)
+                           : (aData[anIdx].w > 0.f ? glm::vec3 (aData[anIdx]) / aData[anIdx].w : glm::vec3 (0.f));
+
+    thePixels[anIdx] = glm::vec4 (aValue, 1.f);
+
+    aMaxValue = std::max (aMaxValue, aValue.x);
+  }
+
+  if (theLayer == Layer_Normal)
+  {
+    for (size_t anIdx = 0; anIdx < thePixels.size(); ++anIdx)
+    {
+      thePixels[anIdx] = glm::vec4 (glm::vec3 (thePixels[anIdx]) * 0.5f + 0.5f, 1.f);
+    }
+  }
+  else if (theLayer == Layer_Depth && aMaxValue > 0.f)
+  {
+    for (size_t anIdx = 0; anIdx < thePixels.size(); ++anIdx)
+    {
+      thePixels[anIdx] = glm::vec4 (glm::vec3 (thePixels[anIdx].x / aMaxValue), 1.f);
+    }
+  }
+  else if (IsCostLayer (theLayer) && aMaxValue > 0.f)
+  {
+    for (size_t anIdx = 0; anIdx < thePixels.size(); ++anIdx)
+    {
+      thePixels[anIdx] = glm::vec4 (FalseColor (thePixels[anIdx].x / aMaxValue), 1.f);
+    }
+  }
+}
+
+//=======================================================================
+//function : LayerName
+//purpose  :
+//=======================================================================
+const char* Framebuffer::LayerName (int theLayer)
+{
+  switch (theLayer)
+  {
+    case Layer_Color:    return "Color";
+    case Layer_Albedo:   return "Albedo";
+    case Layer_Normal:   return "Normal";
+    case Layer_Depth:    return "Depth";
+    case Layer_Samples:  return "Samples";
+    case Layer_Denoised: return "Denoised";
+#ifdef RAYLAB_COST_LAYERS
+    case Layer_CostNodes:     return "Cost: nodes";
+    case Layer_CostTriangles: return "Cost: triangles";
+    case Layer_CostShadows:   return "Cost: shadow rays";
+    case Layer_CostDepth:     return "Cost: path depth";
+#endif
+    default:           return "Unknown";
+  }
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+class ThreadPool;
+
+//! Allocator leaving default-constructed elements unwritten, so that pages of the buffer
+//! are placed on NUMA node of the thread which writes them first (not of the resizing one).
+template<class T>
+struct FirstTouchAllocator : public std::allocator<T>
+{
+  template<class U> struct rebind { typedef FirstTouchAllocator<U> other; };
+
+  FirstTouchAllocator() {}
+
+  template<class U> FirstTouchAllocator (const FirstTouchAllocator<U>&) {}
+
+  //! Skips value initialization (elements must be written before use).
+  template<class U> void construct (U*) {}
+
+  template<class U, class... Args> void construct (U* thePtr, Args&&... theArgs)
+  {
+    ::new (static_cast<void*> (thePtr)) U (std::forward<Args> (theArgs)...);
+  }
+};
+
+// Per-pixel cost layers are accumulated in debug builds (or when requested explicitly)
+#if defined(_DEBUG) && !defined(RAYLAB_COST_LAYERS)
+  #define RAYLAB_COST_LAYERS
+#endif
+
+//! Pixels of framebuffer layer.
+typedef std::vector<glm::vec4, FirstTouchAllocator<glm::vec4> > LayerBuffer;
+
+//! Layers (AOVs) accumulated by the framebuffer.
+enum FramebufferLayer
+{
+  Layer_Color,  //!< radiance estimate
+  Layer_Albedo, //!< albedo of the first hit
+  Layer_Normal, //!< shading normal of the first hit
+  Layer_Depth,  //!< distance to the first hit
+  Layer_Samples,  //!< heatmap of samples per pixel (derived from the color layer, not accumulated)
+  Layer_Denoised, //!< filtered color (written by Denoiser, not accumulated)
+#ifdef RAYLAB_COST_LAYERS
+  Layer_CostNodes,     //!< BVH nodes visited by extension rays of the sample
+  Layer_CostTriangles, //!< primitives tested by extension rays of the sample
+  Layer_CostShadows,   //!< shadow rays traced by the sample
+  Layer_CostDepth,     //!< extension rays traced by the sample (path length)
+#endif
+  Layer_NB
+};
+
+//! Progressive accumulation buffer split into square tiles.
+//! Each layer stores sum of samples in RGB and number of samples in W.
+//! Every second color sample is also accumulated into a half-buffer, so that
+//! the difference of the two estimates gives per-tile error used by adaptive
+//! sampling to stop converged tiles. Accumulation may be split into rounds
+//! (e.g. by learning iterations of path guiding); resolved color then combines
+//! averages of the rounds with weights inverse to their variance.
+class Framebuffer
+{
+public:
+
+  //! Size of square tile in pixels.
+  static const int TileSize = 32;
+
+  //! Creates empty framebuffer.
+  Framebuffer();
+
+  //! Resizes framebuffer (clears accumulated data on change).
+  void Resize (int theSizeX, int theSizeY, ThreadPool& thePool);
+
+  //! Moves layers into storage advised for huge pages if HugePages::IsEnabled() (back to
+  //! regular pages otherwise), keeping accumulated samples. Tiles are copied in parallel as
+  //! in Clear() to keep their NUMA placement. Resize() advises new layers itself.
+  void AdoptHugePages (ThreadPool& thePool);
+
+  //! Clears accumulated data. Tiles are cleared in parallel, so that their
+  //! pages are first touched by the threads which render them.
+  void Clear (ThreadPool& thePool);
+
+  //! Returns width in pixels.
+  int SizeX() const { return mySizeX; }
+
+  //! Returns height in pixels.
+  int SizeY() const { return mySizeY; }
+
+  //! Returns number of accumulated passes.
+  int NbPasses() const { return myNbPasses; }
+
+  //! Increments number of accumulated passes.
+  void FinishPass() { ++myNbPasses; }
+
+  //! Finishes accumulation round: its samples are stored with weight inverse to their
+  //! variance (estimated over the image from the half-buffer) and a new round starts.
+  //! Round with less than two samples per pixel continues, as its variance is unknown.
+  void FinishRound (ThreadPool& thePool);
+
+  //! Returns weight of a sample of the current round (inverse of its variance, the weight of
+  //! the last finished round if unknown, 0 without rounds).
+  float RoundWeight() const;
+
+  //! Returns averaged color of the pixel with rounds combined by their weights
+  //! (theRoundWeight is the weight of the current round given by RoundWeight()).
+  glm::vec3 Color (int thePixel, float theRoundWeight) const;
+
+  //! Returns number of tiles.
+  int NbTiles() const { return myNbTilesX * myNbTilesY; }
+
+  //! Returns pixel range [theMinX, theMaxX) x [theMinY, theMaxY) covered by the tile.
+  void TileRect (int theTile, int& theMinX, int& theMinY, int& theMaxX, int& theMaxY) const;
+
+  //! Adds sample of the given layer to the pixel.
+  void AddSample (FramebufferLayer theLayer, int thePixel, const glm::vec3& theValue)
+  {
+    if (theLayer == Layer_Color && (static_cast<int> (myLayers[Layer_Color][thePixel].w) & 1) != 0)
+    {
+      myHalfColor[thePixel] += glm::vec4 (theValue, 1.f);
+    }
+
+    myLayers[theLayer][thePixel] += glm::vec4 (theValue, 1.f);
+  }
+
+  //! Returns tiles to be rendered in the next pass.
+  const std::vector<int>& ActiveTiles() const { return myActiveTiles; }
+
+  //! Returns estimated relative error of the tile (zero until the tile has two samples
+  //! or if adaptive sampling is disabled).
+  float TileError (int theTile) const { return myTileErrors[theTile]; }
+
+  //! Returns average number of samples per pixel.
+  float AverageSamples() const;
+
+  //! Returns size of all layers and tile data in bytes.
+  size_t MemorySize() const;
+
+  //! Re-estimates tile errors and rebuilds the list of active tiles.
+  //! Tiles with at least theMinSamples samples and error below theTargetError
+  //! are excluded; all tiles remain active if theTargetError is not positive.
+  void UpdateActiveTiles (float theTargetError, int theMinSamples, ThreadPool& thePool);
+
+  //! Returns raw accumulated data of the layer (empty for derived layers).
+  const LayerBuffer& Layer (FramebufferLayer theLayer) const { return myLayers[theLayer]; }
+
+  //! Returns raw data of the layer for modification (used to store filtered layers).
+  LayerBuffer& ChangeLayer (FramebufferLayer theLayer) { return myLayers[theLayer]; }
+
+  //! Resolves averaged layer values for display (normals are mapped to [0, 1],
+  //! depth is normalized by its maximum, sample counts are shown in false color).
+  void Resolve (FramebufferLayer theLayer, std::vector<glm::vec4>& thePixels) const;
+
+  //! Returns name of the layer.
+  static const char* LayerName (int theLayer);
+
+  //! Returns true if the layer holds per-pixel cost (shown as heatmap normalized by the image maximum).
+  static bool IsCostLayer (int theLayer)
+  {
+#ifdef RAYLAB_COST_LAYERS
+    return theLayer >= Layer_CostNodes && theLayer <= Layer_CostDepth;
+#else
+    (void)theLayer;
+    return false;
+#endif
+  }
+
+private:
+
+  //! Returns inverse variance of a sample of the current round (0 if unknown).
+  float sampleWeight() const;
+
+  //! Moves buffer of full size into storage advised by HugePages::Advise() (see AdoptHugePages()).
+  void adoptHugePages (LayerBuffer& theBuffer, const std::string& theName, ThreadPool& thePool);
+
+private:
+
+  int mySizeX;
+  int mySizeY;
+  int myNbTilesX;
+  int myNbTilesY;
+  int myNbPasses;
+
+  LayerBuffer        myLayers[Layer_NB];
+  LayerBuffer        myHalfColor;   //!< sum of odd color samples
+  LayerBuffer        myRounds;      //!< finished rounds: weighted sum of their samples in RGB and sum of weights in W (empty - single round)
+  LayerBuffer        myRoundColor;  //!< color sums at the start of the current round
+  LayerBuffer        myRoundHalf;   //!< half-buffer sums at the start of the current round
+  float              myLastWeight;  //!< sample weight of the last finished round
+  std::vector<float> myTileErrors;
+  std::vector<int>   myActiveTiles;
+
+};
@@ -0,0 +1,215 @@
+#include "HugePages.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+
+#if !defined(_WIN32)
+  #include <sys/mman.h>
+#endif
+
+namespace
+{
+  //! Arrays are advised for huge pages.
+  bool THE_IS_ENABLED = false;
+
+  //! Registered arrays.
+  std::vector<HugePageRegion> THE_REGIONS;
+
+  //! Guards registered arrays.
+  std::mutex THE_MUTEX;
+
+  //! Returns index of registered array theName (-1 if not registered).
+  int FindRegion (const std::string& theName)
+  {
+    for (size_t anIdx = 0; anIdx < THE_REGIONS.size(); ++anIdx)
+    {
+      if (THE_REGIONS[anIdx].Name == theName)
+      {
+        return static_cast<int> (anIdx);
+      }
+    }
+    return -1;
+  }
+}
+
+//=======================================================================
+//function : IsEnabled
+//purpose  :
+//=======================================================================
+bool HugePages::IsEnabled()
+{
+  return THE_IS_ENABLED;
+}
+
+//=======================================================================
+//function : SetEnabled
+//purpose  :
+//=======================================================================
+void HugePages::SetEnabled (bool theToUse)
+{
+  THE_IS_ENABLED = theToUse;
+}
+
+//=======================================================================
+//function : SystemMode
+//purpose  :
+//=======================================================================
+std::string HugePages::SystemMode()
+{
+#if defined(_WIN32)
+  return "unsupported";
+#else
+  // Selected mode is in brackets, e.g. "always [madvise] never"
+  std::ifstream aFile ("/sys/kernel/mm/transparent_hugepage/enabled");
+
+  std::string aLine;
+  std::getline (aFile, aLine);
+
+  const size_t aFirst = aLine.find ('[');
+  const size_t aLast  = aLine.find (']');
+  if (aFirst == std::string::npos || aLast == std::string::npos || aLast < aFirst)
+  {
+    return "unsupported";
+  }
+  return aLine.substr (aFirst + 1, aLast - aFirst - 1);
+#endif
+}
+
+//=======================================================================
+//function : Advise
+//purpose  :
+//=======================================================================
+void HugePages::Advise (const void* theData, size_t theBytes, const std::string& theName)
+{
+  std::lock_guard<std::mutex> aLock (THE_MUTEX);
+
+  const int anIdx = FindRegion (theName);
+  if (anIdx != -1)
+  {
+    THE_REGIONS.erase (THE_REGIONS.begin() + anIdx);
+  }
+
+  if (theData == nullptr || theBytes < PageSize)
+  {
+    return;
+  }
+
+#if !defined(_WIN32)
+  // Arrays are registered with the requested mode even if they have no whole huge page
+  // inside or madvise() fails, so that Adopt() doesn't copy them again on every call
+  HugePageRegion aRegion;
+  aRegion.Name      = theName;
+  aRegion.Data      = theData;
+  aRegion.Bytes     = theBytes;
+  aRegion.HugeBytes = 0;
+  aRegion.IsHuge    = THE_IS_ENABLED;
+  THE_REGIONS.push_back (aRegion);
+
+  // Only whole huge pages inside of the array can be used
+  const uintptr_t aFirst = (reinterpret_cast<uintptr_t> (theData) + PageSize - 1) & ~static_cast<uintptr_t> (PageSize - 1);
+  const uintptr_t aLast  = (reinterpret_cast<uintptr_t> (theData) + theBytes) & ~static_cast<uintptr_t> (PageSize - 1);
+  if (aLast <= aFirst)
+  {
+    return;
+  }
+
+  // Disabled arrays are advised explicitly as well, so that they don't get
+  // huge pages in "always" mode and the benchmark can compare both cases
+  madvise (reinterpret_cast<void*> (aFirst), aLast - aFirst, THE_IS_ENABLED ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+}
+
+//=======================================================================
+//function : IsAdvised
+//purpose  :
+//=======================================================================
+bool HugePages::IsAdvised (const void* theData, size_t theBytes, const std::string& theName)
+{
+#if defined(_WIN32)
+  (void)theData;
+  (void)theBytes;
+  (void)theName;
+  return true;
+#else
+  std::lock_guard<std::mutex> aLock (THE_MUTEX);
+
+  const int anIdx = FindRegion (theName);
+  if (anIdx == -1)
+  {
+    return theBytes < PageSize;
+  }
+
+  const HugePageRegion& aRegion = THE_REGIONS[anIdx];
+  return aRegion.Data == theData && aRegion.Bytes == theBytes && aRegion.IsHuge == THE_IS_ENABLED;
+#endif
+}
+
+//=======================================================================
+//function : Regions
+//purpose  :
+//=======================================================================
+std::vector<HugePageRegion> HugePages::Regions()
+{
+  std::vector<HugePageRegion> aRegions;
+  {
+    std::lock_guard<std::mutex> aLock (THE_MUTEX);
+    for (size_t anIdx = 0; anIdx < THE_REGIONS.size(); ++anIdx)
+    {
+      if (THE_REGIONS[anIdx].IsHuge)
+      {
+        aRegions.push_back (THE_REGIONS[anIdx]);
+      }
+    }
+  }
+
+#if !defined(_WIN32)
+  if (aRegions.empty())
+  {
+    return aRegions;
+  }
+
+  // Each mapping starts with "start-end perms ..." line followed by "Key: value kB" lines;
+  // huge pages of the mapping are assumed to be spread evenly over it
+  std::ifstream aFile ("/proc/self/smaps");
+
+  uintptr_t aMapStart = 0;
+  uintptr_t aMapEnd   = 0;
+
+  std::string aLine;
+  while (std::getline (aFile, aLine))
+  {
+    unsigned long long aStart = 0;
+    unsigned long long anEnd  = 0;
+    unsigned long long aKb    = 0;
+    if (std::sscanf (aLine.c_str(), "%llx-%llx ", &aStart, &anEnd) == 2)
+    {
+      aMapStart = static_cast<uintptr_t> (aStart);
+      aMapEnd   = static_cast<uintptr_t> (anEnd);
+    }
+    else if (std::sscanf (aLine.c_str(), "AnonHugePages: %llu kB", &aKb) == 1 && aKb != 0 && aMapEnd > aMapStart)
+    {
+      for (size_t anIdx = 0; anIdx < aRegions.size(); ++anIdx)
+      {
+        const uintptr_t aFirst = std::max (aMapStart, reinterpret_cast<uintptr_t> (aRegions[anIdx].Data));
+        const uintptr_t aLast  = std::min (aMapEnd, reinterpret_cast<uintptr_t> (aRegions[anIdx].Data) + aRegions[anIdx].Bytes);
+        if (aLast > aFirst)
+        {
+          aRegions[anIdx].HugeBytes += static_cast<size_t> (static_cast<double> (aKb) * 1024.0
+                                                          * static_cast<double> (aLast - aFirst)
+                                                          / static_cast<double> (aMapEnd - aMapStart));
+        }
+      }
+    }
+  }
+
+  for (size_t anIdx = 0; anIdx < aRegions.size(); ++anIdx)
+  {
+    aRegions[anIdx].HugeBytes = std::min (aRegions[anIdx].HugeBytes, aRegions[anIdx].Bytes);
+  }
+#endif
+
+  return aRegions;
+}
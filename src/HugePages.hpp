@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//! Large array registered for huge pages.
+struct HugePageRegion
+{
+  std::string Name;      //!< name of the array
+  const void* Data;      //!< start of the array
+  size_t      Bytes;     //!< size of the array
+  size_t      HugeBytes; //!< part of the array currently backed by huge pages (0 if unknown)
+  bool        IsHuge;    //!< advised for huge pages (MADV_NOHUGEPAGE otherwise)
+};
+
+//! Transparent huge pages (2 MB) for large read-mostly arrays (BVH, geometry, framebuffer).
+//! Random access over such arrays misses TLB often; with huge pages one TLB entry covers
+//! 512 regular pages. Arrays are advised with madvise(MADV_HUGEPAGE) before they are first
+//! written, so that the kernel backs them with huge pages on fault; if the kernel has no
+//! huge pages to spare, regular ones are used. Linux only (no-op elsewhere).
+class HugePages
+{
+public:
+
+  //! Size of huge page.
+  static const size_t PageSize = 2 * 1024 * 1024;
+
+  //! Returns true if large arrays are advised for huge pages.
+  static bool IsEnabled();
+
+  //! Enables huge pages for arrays adopted or advised later.
+  static void SetEnabled (bool theToUse);
+
+  //! Returns mode of transparent huge pages of the system ("always", "madvise", "never" or "unsupported").
+  static std::string SystemMode();
+
+  //! Advises array theData of theBytes which is not written yet (huge pages if enabled,
+  //! regular ones otherwise) and registers it as theName with the advised mode. Arrays
+  //! smaller than PageSize are only unregistered.
+  static void Advise (const void* theData, size_t theBytes, const std::string& theName);
+
+  //! Returns true if array theName is registered at theData of theBytes with the current
+  //! mode, or if it is smaller than PageSize and not registered (nothing to advise then).
+  static bool IsAdvised (const void* theData, size_t theBytes, const std::string& theName);
+
+  //! Moves elements of theArray into new storage advised by Advise(), so that already
+  //! written arrays get huge pages when enabled and regular ones otherwise (also in
+  //! "always" mode of the system). Does nothing if the array is already advised.
+  template<class T, class Alloc>
+  static void Adopt (std::vector<T, Alloc>& theArray, const std::string& theName)
+  {
+    const size_t aBytes = theArray.size() * sizeof (T);
+    if (IsAdvised (theArray.data(), aBytes, theName))
+    {
+      return;
+    }
+    else if (aBytes < PageSize)
+    {
+      // Only unregisters array shrunk below huge page
+      Advise (theArray.data(), aBytes, theName);
+      return;
+    }
+
+    std::vector<T, Alloc> aCopy;
+    aCopy.reserve (theArray.size());
+    Advise (aCopy.data(), aBytes, theName);
+    aCopy.assign (theArray.begin(), theArray.end());
+    theArray.swap (aCopy);
+  }
+
+  //! Returns arrays advised for huge pages with their backing (read from /proc/self/smaps).
+  static std::vector<HugePageRegion> Regions();
+
+};
@@ -0,0 +1,355 @@
+#include "ImageIO.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+  //! Converts sRGB encoded value to linear.
+  inline float SrgbToLinear (float theValue)
+  {
+    return theValue <= 0.04045f ? theValue / 12.92f : std::pow ((theValue + 0.055f) / 1.055f, 2.4f);
+  }
+
+  //! Converts linear value to sRGB encoded.
+  inline float LinearToSrgb (float theValue)
+  {
+    theValue = std::min (std::max (theValue, 0.f), 1.f);
+    return theValue <= 0.0031308f ? theValue * 12.92f : 1.055f * std::pow (theValue, 1.f / 2.4f) - 0.055f;
+  }
+
+  //! Returns lower-case extension of the file name.
+  std::string Extension (const std::string& theFileName)
+  {
+    const size_t aDot = theFileName.find_last_of ('.');
+    if (aDot == std::string::npos)
+    {
+      return "";
+    }
+
+    std::string anExt = theFileName.substr (aDot + 1);
+    std::transform (anExt.begin(), anExt.end(), anExt.begin(), ::tolower);
+    return anExt;
+  }
+
+  //! Reads next header token of PPM/PFM file skipping comments.
+  bool ReadToken (FILE* theFile, char* theBuffer, int theSize)
+  {
+    int aChar = fgetc (theFile);
+    for (;;)
+    {
+      while (aChar != EOF && isspace (aChar))
+      {
+        aChar = fgetc (theFile);
+      }
+
+      if (aChar != '#')
+      {
+        break;
+      }
+
+      while (aChar != EOF && aChar != '\n')
+      {
+        aChar = fgetc (theFile);
+      }
+    }
+
+    int aLength = 0;
+    while (aChar != EOF && !isspace (aChar) && aLength < theSize - 1)
+    {
+      theBuffer[aLength++] = static_cast<char> (aChar);
+      aChar = fgetc (theFile);
+    }
+
+    theBuffer[aLength] = '\0';
+    return aLength > 0;
+  }
+
+  //! Reads scanline of Radiance RGBE file (flat or new-style run-length encoded).
+  bool ReadRgbeScanline (FILE* theFile, int theSizeX, std::vector<unsigned char>& theLine)
+  {
+    theLine.resize (theSizeX * 4);
+
+    unsigned char aHeader[4];
+    if (fread (aHeader, 1, 4, theFile) != 4)
+    {
+      return false;
+    }
+
+    const bool isEncoded = theSizeX >= 8 && theSizeX < 32768 && aHeader[0] == 2 && aHeader[1] == 2 && (aHeader[2] & 0x80) == 0;
+    if (!isEncoded)
+    {
+      std::copy (aHeader, aHeader + 4, theLine.begin());
+      return theSizeX == 1 || fread (&theLine[4], 1, (theSizeX - 1) * 4, theFile) == static_cast<size_t> ((theSizeX - 1) * 4);
+    }
+
+    if (((aHeader[2] << 8) | aHeader[3]) != theSizeX)
+    {
+      return false;
+    }
+
+    // Channels are stored one after another, each as runs and literal dumps
+    for (int aChannel = 0; aChannel < 4; ++aChannel)
+    {
+      for (int aX = 0; aX < theSizeX;)
+      {
+        const int aCount = fgetc (theFile);
+        if (aCount == EOF)
+        {
+          return false;
+        }
+
+        if (aCount > 128)
+        {
+          const int aValue = fgetc (theFile);
+          if (aValue == EOF || aX + aCount - 128 > theSizeX)
+          {
+            return false;
+          }
+
+          for (int anIdx = 0; anIdx < aCount - 128; ++anIdx, ++aX)
+          {
+            theLine[aX * 4 + aChannel] = static_cast<unsigned char> (aValue);
+          }
+        }
+        else
+        {
+          if (aCount == 0 || aX + aCount > theSizeX)
+          {
+            return false;
+          }
+
+          for (int anIdx = 0; anIdx < aCount; ++anIdx, ++aX)
+          {
+            const int aValue = fgetc (theFile);
+            if (aValue == EOF)
+            {
+              return false;
+            }
+
+            theLine[aX * 4 + aChannel] = static_cast<unsigned char> (aValue);
+          }
+        }
+      }
+    }
+
+    return true;
+  }
+
+  //! Loads Radiance RGBE (.hdr) image.
+  bool LoadRgbe (FILE* theFile, int& theSizeX, int& theSizeY, std::vector<glm::vec4>& thePixels)
+  {
+    char aLine[256];
+    if (fgets (aLine, sizeof (aLine), theFile) == NULL || strncmp (aLine, "#?", 2) != 0)
+    {
+      return false;
+    }
+
+    // Header lines end with an empty line, followed by resolution string
+    bool isRgbe = true;
+    while (fgets (aLine, sizeof (aLine), theFile) != NULL && aLine[0] != '\n' && aLine[0] != '\r')
+    {
+      if (strncmp (aLine, "FORMAT=", 7) == 0)
+      {
+        isRgbe = strncmp (aLine + 7, "32-bit_rle_rgbe", 15) == 0;
+      }
+    }
+
+    if (!isRgbe || fgets (aLine, sizeof (aLine), theFile) == NULL || sscanf (aLine, "-Y %d +X %d", &theSizeY, &theSizeX) != 2
+     || theSizeX <= 0 || theSizeY <= 0)
+    {
+      return false;
+    }
+
+    thePixels.resize (theSizeX * theSizeY);
+
+    std::vector<unsigned char> aScanline;
+    for (int aY = 0; aY < theSizeY; ++aY)
+    {
+      if (!ReadRgbeScanline (theFile, theSizeX, aScanline))
+      {
+        return false;
+      }
+
+      // File stores rows from top to bottom
+      glm::vec4* aRow = &thePixels[(theSizeY - 1 - aY) * theSizeX];
+      for (int aX = 0; aX < theSizeX; ++aX)
+      {
+        const unsigned char* aRgbe = &aScanline[aX * 4];
+
+        const float aScale = aRgbe[3] != 0 ? std::ldexp (1.f, aRgbe[3] - (128 + 8)) : 0.f;
+        aRow[aX] = glm::vec4 ((aRgbe[0] + 0.5f) * aScale, (aRgbe[1] + 0.5f) * aScale, (aRgbe[2] + 0.5f) * aScale, 1.f);
+      }
+    }
+
+    return true;
+  }
+}
+
+//=======================================================================
+//function : Load
+//purpose  :
+//=======================================================================
+bool ImageIO::Load (const std::string& theFileName,
+                    int& theSizeX,
+                    int& theSizeY,
+                    std::vector<glm::vec4>& thePixels)
+{
+  FILE* aFile = fopen (theFileName.c_str(), "rb");
+  if (aFile == NULL)
+  {
+    return false;
+  }
+
+  if (Extension (theFileName) == "hdr")
+  {
+    const bool isOk = LoadRgbe (aFile, theSizeX, theSizeY, thePixels);
+
+    fclose (aFile);
+    return isOk;
+  }
+
+  char aMagic[8], aSizeX[32], aSizeY[32], aRange[32];
+
+  bool isOk = ReadToken (aFile, aMagic, 8)
+           && ReadToken (aFile, aSizeX, 32)
+           && ReadToken (aFile, aSizeY, 32)
+           && ReadToken (aFile, aRange, 32);
+
+  theSizeX = isOk ? atoi (aSizeX) : 0;
+  theSizeY = isOk ? atoi (aSizeY) : 0;
+
+  isOk = isOk && theSizeX > 0 && theSizeY > 0;
+
+  if (isOk && strcmp (aMagic, "P6") == 0)
+  {
+    const int aMaxValue = atoi (aRange);
+
+    std::vector<unsigned char> aData (theSizeX * theSizeY * 3 * (aMaxValue > 255 ? 2 : 1));
+    isOk = aMaxValue > 0 && fread (aData.data(), 1, aData.size(), aFile) == aData.size();
+
+    thePixels.resize (theSizeX * theSizeY);
+    for (int aY = 0; aY < theSizeY && isOk; ++aY)
+    {
+      for (int aX = 0; aX < theSizeX; ++aX)
+      {
+        const int aSrc = (theSizeY - 1 - aY) * theSizeX + aX;
+
+        glm::vec4& aPixel = thePixels[aY * theSizeX + aX];
+        for (int aChannel = 0; aChannel < 3; ++aChannel)
+        {
+          const int aValue = aMaxValue > 255 ? (aData[(aSrc * 3 + aChannel) * 2] << 8) | aData[(aSrc * 3 + aChannel) * 2 + 1]
+                                             : aData[aSrc * 3 + aChannel];
+
+          aPixel[aChannel] = SrgbToLinear (static_cast<float> (aValue) / aMaxValue);
+        }
+
+        aPixel.w = 1.f;
+      }
+    }
+  }
+  else if (isOk && (strcmp (aMagic, "PF") == 0 || strcmp (aMagic, "Pf") == 0))
+  {
+    const int  aNbChannels = aMagic[1] == 'F' ? 3 : 1;
+    const bool isSwapped   = atof (aRange) > 0.0; // positive scale means big-endian data
+
+    std::vector<float> aData (theSizeX * theSizeY * aNbChannels);
+    isOk = fread (aData.data(), sizeof (float), aData.size(), aFile) == aData.size();
+
+    thePixels.resize (theSizeX * theSizeY);
+    for (size_t anIdx = 0; anIdx < thePixels.size() && isOk; ++anIdx)
+    {
+      for (int aChannel = 0; aChannel < 3; ++aChannel)
+      {
+        float aValue = aData[anIdx * aNbChannels + (aNbChannels == 3 ? aChannel : 0)];
+        if (isSwapped)
+        {
+          unsigned char* aBytes = reinterpret_cast<unsigned char*> (&aValue);
+          std::swap (aBytes[0], aBytes[3]);
+          std::swap (aBytes[1], aBytes[2]);
+        }
+
+        thePixels[anIdx][aChannel] = aValue;
+      }
+
+      thePixels[anIdx].w = 1.f;
+    }
+  }
+  else
+  {
+    isOk = false;
+  }
+
+  fclose (aFile);
+  return isOk;
+}
+
+//=======================================================================
+//function : Save
+//purpose  :
+//=======================================================================
+bool ImageIO::Save (const std::string& theFileName,
+                    int theSizeX,
+                    int theSizeY,
+                    const std::vector<glm::vec4>& thePixels)
+{
+  if (theSizeX <= 0 || theSizeY <= 0 || thePixels.size() < static_cast<size_t> (theSizeX * theSizeY))
+  {
+    return false;
+  }
+
+  const std::string anExt = Extension (theFileName);
+  if (anExt != "pfm" && anExt != "ppm")
+  {
+    return false;
+  }
+
+  FILE* aFile = fopen (theFileName.c_str(), "wb");
+  if (aFile == NULL)
+  {
+    return false;
+  }
+
+  bool isOk = true;
+
+  if (anExt == "pfm")
+  {
+    fprintf (aFile, "PF\n%d %d\n-1.0\n", theSizeX, theSizeY);
+
+    std::vector<float> aData (theSizeX * theSizeY * 3);
+    for (size_t anIdx = 0; anIdx < aData.size() / 3; ++anIdx)
+    {
+      aData[anIdx * 3 + 0] = thePixels[anIdx].x;
+      aData[anIdx * 3 + 1] = thePixels[anIdx].y;
+      aData[anIdx * 3 + 2] = thePixels[anIdx].z;
+    }
+
+    isOk = fwrite (aData.data(), sizeof (float), aData.size(), aFile) == aData.size();
+  }
+  else
+  {
+    fprintf (aFile, "P6\n%d %d\n255\n", theSizeX, theSizeY);
+
+    std::vector<unsigned char> aData (theSizeX * theSizeY * 3);
+    for (int aY = 0; aY < theSizeY; ++aY)
+    {
+      for (int aX = 0; aX < theSizeX; ++aX)
+      {
+        const glm::vec4& aPixel = thePixels[(theSizeY - 1 - aY) * theSizeX + aX];
+        for (int aChannel = 0; aChannel < 3; ++aChannel)
+        {
+          aData[(aY * theSizeX + aX) * 3 + aChannel] = static_cast<unsigned char> (LinearToSrgb (aPixel[aChannel]) * 255.f + 0.5f);
+        }
+      }
+    }
+
+    isOk = fwrite (aData.data(), 1, aData.size(), aFile) == aData.size();
+  }
+
+  fclose (aFile);
+  return isOk;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+//! Reading and writing of simple image formats.
+//! Supported formats: binary PPM (P6, 8-bit sRGB), PFM (linear float)
+//! and Radiance RGBE (.hdr, loading only).
+//! Pixel rows are stored from bottom to top.
+class ImageIO
+{
+public:
+
+  //! Loads image into linear RGBA pixels. Returns false on error.
+  static bool Load (const std::string& theFileName,
+                    int& theSizeX,
+                    int& theSizeY,
+                    std::vector<glm::vec4>& thePixels);
+
+  //! Saves linear RGBA pixels (format chosen by extension). Returns false on error.
+  static bool Save (const std::string& theFileName,
+                    int theSizeX,
+                    int theSizeY,
+                    const std::vector<glm::vec4>& thePixels);
+
+};
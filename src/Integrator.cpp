@@ -0,0 +1,456 @@
+#include "Integrator.hpp"
+
+#include "Bsdf.hpp"
+
+#include <algorithm>
+
+namespace
+{
+  //! Power heuristic for multiple importance sampling (beta = 2).
+  inline float PowerHeuristic (float thePdfA, float thePdfB)
+  {
+    const float aA = thePdfA * thePdfA;
+    const float aB = thePdfB * thePdfB;
+    return aA + aB > 0.f ? aA / (aA + aB) : 0.f;
+  }
+
+  //! Offsets ray origin along geometric normal to the side of the given direction.
+  inline glm::vec3 OffsetOrigin (const glm::vec3& thePoint, const glm::vec3& theNormal, const glm::vec3& theDir, float theEpsilon)
+  {
+    return thePoint + theNormal * (glm::dot (theDir, theNormal) > 0.f ? theEpsilon : -theEpsilon);
+  }
+
+  //! Returns maximum component of the vector.
+  inline float MaxComponent (const glm::vec3& theVec)
+  {
+    return std::max (theVec.x, std::max (theVec.y, theVec.z));
+  }
+
+  //! Returns luminance of linear RGB color.
+  inline float Luminance (const glm::vec3& theColor)
+  {
+    return 0.2126f * theColor.x + 0.7152f * theColor.y + 0.0722f * theColor.z;
+  }
+
+  //! Adds contribution to the path radiance and to radiance gathered by its recorded vertices.
+  inline void AddRadiance (PathState& thePath, const glm::vec3& theContribution)
+  {
+    thePath.Radiance += theContribution;
+    for (int aVertex = 0; aVertex < thePath.NbGuideVertices; ++aVertex)
+    {
+      thePath.GuideVertices[aVertex].Incident += theContribution;
+    }
+  }
+}
+
+//=======================================================================
+//function : StartPath
+//purpose  :
+//=======================================================================
+void Integrator::StartPath (const Scene&       theScene,
+                            const Camera&      theCamera,
+                            const Framebuffer& theFramebuffer,
+                            int                thePixel,
+                            PathState&         thePath) const
+{
+  const int aPixelX = thePixel % theFramebuffer.SizeX();
+  const int aPixelY = thePixel / theFramebuffer.SizeX();
+
+  // Sample index follows per-pixel count, so that adaptive sampling keeps sequences contiguous
+  const uint32_t anIndex = static_cast<uint32_t> (theFramebuffer.Layer (Layer_Color)[thePixel].w);
+  thePath.Sampler.Start (myParams.Sampler, aPixelX, aPixelY, thePixel, anIndex);
+
+  // Framebuffer may have lower resolution than the camera viewport
+  const float aScaleX = static_cast<float> (theCamera.window_width)  / theFramebuffer.SizeX();
+  const float aScaleY = static_cast<float> (theCamera.window_height) / theFramebuffer.SizeY();
+
+  const glm::vec2 aJitter = thePath.Sampler.Next2D();
+
+  const float aX = theCamera.viewport_x + (aPixelX + aJitter.x) * aScaleX;
+  const float aY = theCamera.viewport_y + (aPixelY + aJitter.y) * aScaleY;
+
+  theCamera.GenerateRay (aX, aY, thePath.Current, thePath.Diff);
+
+  // Time is drawn only with motion, so that static scenes keep their sample sequences
+  thePath.Current.Time = 0.f;
+  if (theScene.HasMotion() || myCameraEnd != NULL)
+  {
+    thePath.Current.Time = thePath.Sampler.Next1D();
+  }
+
+  // Camera ray moves linearly between the camera poses at shutter open and close
+  if (myCameraEnd != NULL)
+  {
+    Ray             aRayEnd;
+    RayDifferential aDiffEnd;
+    myCameraEnd->GenerateRay (aX, aY, aRayEnd, aDiffEnd);
+
+    const float aTime = thePath.Current.Time;
+    thePath.Current.Origin    = glm::mix (thePath.Current.Origin, aRayEnd.Origin, aTime);
+    thePath.Current.Direction = glm::normalize (glm::mix (thePath.Current.Direction, aRayEnd.Direction, aTime));
+
+    thePath.Diff.dOdx = glm::mix (thePath.Diff.dOdx, aDiffEnd.dOdx, aTime);
+    thePath.Diff.dOdy = glm::mix (thePath.Diff.dOdy, aDiffEnd.dOdy, aTime);
+    thePath.Diff.dDdx = glm::mix (thePath.Diff.dDdx, aDiffEnd.dDdx, aTime);
+    thePath.Diff.dDdy = glm::mix (thePath.Diff.dDdy, aDiffEnd.dDdy, aTime);
+  }
+
+  thePath.Diff.dOdx *= aScaleX;
+  thePath.Diff.dDdx *= aScaleX;
+  thePath.Diff.dOdy *= aScaleY;
+  thePath.Diff.dDdy *= aScaleY;
+
+  thePath.Throughput = glm::vec3 (1.f);
+  thePath.Radiance   = glm::vec3 (0.f);
+  thePath.PrevPdf    = 0.f;
+  thePath.IsSpecular = false;
+  thePath.Depth      = 0;
+  thePath.Pixel      = thePixel;
+
+  thePath.GuideVertices   = NULL;
+  thePath.NbGuideVertices = 0;
+}
+
+//=======================================================================
+//function : ShadeHit
+//purpose  :
+//=======================================================================
+bool Integrator::ShadeHit (const Scene&      theScene,
+                           const SurfaceHit& theHit,
+                           PathState&        thePath,
+                           ShadowRay&        theShadow,
+                           AovSample*        theAov) const
+{
+  theShadow.IsValid = false;
+
+  ShadingPoint aPoint;
+  if (!PrepareShading (theScene, theHit, thePath, aPoint, theAov))
+  {
+    return false;
+  }
+
+  const Material& aMaterial = theScene.Materials[aPoint.Surface.Material];
+
+  const Frame aFrame (aPoint.Surface.Normal);
+  const glm::vec3 aLocalWo = aFrame.ToLocal (aPoint.Wo);
+
+  glm::vec3 aLightBsdf (0.f);
+  float     aLightPdf = 0.f;
+  if (aPoint.HasLight)
+  {
+    aLightBsdf = Bsdf::Eval (aMaterial, aPoint.Albedo, aLocalWo, aFrame.ToLocal (aPoint.LightDir), aLightPdf);
+  }
+
+  // Direction chosen from path guide doesn't need BSDF sample
+  BsdfSample aSample;
+  const bool isSampled = !aPoint.ToSampleGuide && Bsdf::Sample (aMaterial, aPoint.Albedo, aLocalWo, aPoint.BsdfRnd, aSample);
+  if (isSampled)
+  {
+    aSample.Wi = aFrame.ToWorld (aSample.Wi);
+  }
+
+  return FinishShading (theScene, aPoint, aLightBsdf, aLightPdf, aSample, isSampled, thePath, theShadow);
+}
+
+//=======================================================================
+//function : AddEscaped
+//purpose  :
+//=======================================================================
+void Integrator::AddEscaped (const Scene& theScene, PathState& thePath) const
+{
+  const Environment& anEnv = theScene.EnvironmentLight();
+  if (anEnv.IsEmpty())
+  {
+    return;
+  }
+
+  const glm::vec3 aRadiance = anEnv.Eval (thePath.Current.Direction);
+  if (thePath.Depth == 0 || thePath.IsSpecular)
+  {
+    AddRadiance (thePath, thePath.Throughput * aRadiance);
+  }
+  else
+  {
+    AddRadiance (thePath, thePath.Throughput * aRadiance * PowerHeuristic (thePath.PrevPdf, theScene.EnvironmentPdf (thePath.Current.Direction)));
+  }
+}
+
+//=======================================================================
+//function : AddShadow
+//purpose  :
+//=======================================================================
+void Integrator::AddShadow (const ShadowRay& theShadow, glm::vec3& theRadiance, GuideVertex* theVertices) const
+{
+  theRadiance += theShadow.Contribution;
+  for (int aVertex = 0; aVertex < theShadow.NbGuideVertices; ++aVertex)
+  {
+    theVertices[aVertex].Incident += theShadow.Contribution;
+  }
+}
+
+//=======================================================================
+//function : RecordPath
+//purpose  :
+//=======================================================================
+void Integrator::RecordPath (const PathState& thePath) const
+{
+  for (int aVertexIdx = 0; aVertexIdx < thePath.NbGuideVertices; ++aVertexIdx)
+  {
+    const GuideVertex& aVertex = thePath.GuideVertices[aVertexIdx];
+
+    // Incident radiance is the gathered contribution divided by throughput at the vertex.
+    // Emission is gathered with MIS weights and direct light of the vertex itself is not
+    // recorded, so the guide learns only what light sampling leaves to directional sampling
+    glm::vec3 aRadiance (0.f);
+    for (int aComp = 0; aComp < 3; ++aComp)
+    {
+      aRadiance[aComp] = aVertex.Throughput[aComp] > 0.f ? aVertex.Incident[aComp] / aVertex.Throughput[aComp] : 0.f;
+    }
+
+    myGuide->Record (aVertex.Tree, aVertex.Direction, Luminance (aRadiance) / aVertex.Pdf);
+  }
+}
+
+//=======================================================================
+//function : PrepareShading
+//purpose  :
+//=======================================================================
+bool Integrator::PrepareShading (const Scene&      theScene,
+                                 const SurfaceHit& theHit,
+                                 PathState&        thePath,
+                                 ShadingPoint&     thePoint,
+                                 AovSample*        theAov) const
+{
+  SurfacePoint& aSurface = thePoint.Surface;
+  theScene.Interpolate (theHit, aSurface);
+
+  const Material& aMaterial = theScene.Materials[aSurface.Material];
+
+  const glm::vec3 aRayDir = thePath.Current.Direction;
+
+  thePoint.Wo = -aRayDir;
+
+  // Add emission (weighted against light sampling of the previous vertex)
+  if (aMaterial.IsEmissive() && glm::dot (aRayDir, aSurface.GeomNormal) < 0.f)
+  {
+    if (thePath.Depth == 0 || thePath.IsSpecular)
+    {
+      AddRadiance (thePath, thePath.Throughput * aMaterial.Emission);
+    }
+    else
+    {
+      const float aLightPdf = theScene.EmitterPdf (thePath.Current.Origin, theHit.Triangle, aRayDir, theHit.T, theHit.Time);
+
+      AddRadiance (thePath, thePath.Throughput * aMaterial.Emission * PowerHeuristic (thePath.PrevPdf, aLightPdf));
+    }
+  }
+
+  // Fetch albedo with the filter footprint given by ray differentials
+  thePath.Diff.Transfer (thePath.Current, theHit.T, aSurface.GeomNormal);
+
+  thePoint.Albedo = aMaterial.Type == MaterialType_Glossy ? aMaterial.Specular : aMaterial.Diffuse;
+  if (aMaterial.DiffuseTexture >= 0)
+  {
+    glm::vec2 aDuvDx;
+    glm::vec2 aDuvDy;
+    thePath.Diff.ComputeUVDerivatives (aSurface.Dpdu, aSurface.Dpdv, aDuvDx, aDuvDy);
+
+    thePoint.Albedo *= glm::vec3 (theScene.Textures[aMaterial.DiffuseTexture].Sample (aSurface.TexCoord, aDuvDx, aDuvDy));
+  }
+
+  if (theAov != NULL)
+  {
+    theAov->Albedo = thePoint.Albedo;
+    theAov->Normal = aSurface.Normal;
+    theAov->Depth  = theHit.T;
+  }
+
+  if (thePath.Depth >= myParams.MaxDepth)
+  {
+    return false;
+  }
+
+  // Opaque surfaces are two-sided
+  if (!Bsdf::IsDelta (aMaterial) && glm::dot (thePoint.Wo, aSurface.GeomNormal) < 0.f)
+  {
+    aSurface.Normal     = -aSurface.Normal;
+    aSurface.GeomNormal = -aSurface.GeomNormal;
+  }
+
+  // Next event estimation (sample values are always consumed to keep sequences aligned)
+  const float     aLightU  = thePath.Sampler.Next1D();
+  const glm::vec2 aLightUV = thePath.Sampler.Next2D();
+
+  thePoint.HasLight = !Bsdf::IsDelta (aMaterial) && theScene.SampleEmitter (aSurface.Position, aLightU, aLightUV, thePoint.Light, thePath.Current.Time);
+  thePoint.LightDir = thePoint.HasLight ? thePoint.Light.Direction : glm::vec3 (0.f);
+
+  const glm::vec2 aBsdfUV = thePath.Sampler.Next2D();
+  thePoint.BsdfRnd = glm::vec3 (aBsdfUV, thePath.Sampler.Next1D());
+
+  // Guided directions are sampled from mixture of BSDF and learned distribution (one-sample MIS);
+  // the tree is also kept by the recorded vertex, so that recording doesn't search it again
+  thePoint.GuideTree     = -1;
+  thePoint.IsGuided      = false;
+  thePoint.ToSampleGuide = false;
+  if (myGuide != NULL && (myGuide->IsTrained() || thePath.GuideVertices != NULL) && !Bsdf::IsDelta (aMaterial))
+  {
+    thePoint.GuideTree = myGuide->FindTree (aSurface.Position, aSurface.GeomNormal);
+    thePoint.IsGuided  = myGuide->IsTrained() && myGuide->CanSample (thePoint.GuideTree);
+  }
+
+  // Technique is chosen by the first BSDF number rescaled for the chosen one, so that
+  // both keep stratification of the sequence (extra dimensions would break it)
+  if (thePoint.IsGuided)
+  {
+    const float aBsdfFraction = myGuide->Params().BsdfFraction;
+    if (thePoint.BsdfRnd.x < aBsdfFraction)
+    {
+      thePoint.BsdfRnd.x = std::min (thePoint.BsdfRnd.x / aBsdfFraction, 0.99999994f);
+    }
+    else
+    {
+      thePoint.ToSampleGuide = true;
+      thePoint.GuideRnd      = glm::vec2 (std::min ((thePoint.BsdfRnd.x - aBsdfFraction) / (1.f - aBsdfFraction), 0.99999994f), thePoint.BsdfRnd.y);
+    }
+  }
+
+  return true;
+}
+
+//=======================================================================
+//function : FinishShading
+//purpose  :
+//=======================================================================
+bool Integrator::FinishShading (const Scene&        theScene,
+                                const ShadingPoint& thePoint,
+                                const glm::vec3&    theLightBsdf,
+                                float               theLightPdf,
+                                const BsdfSample&   theSample,
+                                bool                isSampled,
+                                PathState&          thePath,
+                                ShadowRay&          theShadow) const
+{
+  const SurfacePoint& aSurface  = thePoint.Surface;
+  const Material&     aMaterial = theScene.Materials[aSurface.Material];
+
+  const float anEpsilon = theScene.Epsilon();
+
+  const int   aGuideTree    = thePoint.GuideTree;
+  const bool  isGuided      = thePoint.IsGuided;
+  const float aBsdfFraction = isGuided ? myGuide->Params().BsdfFraction : 1.f;
+
+  theShadow.IsValid         = false;
+  theShadow.NbGuideVertices = thePath.NbGuideVertices;
+  if (thePoint.HasLight && MaxComponent (theLightBsdf) > 0.f && glm::dot (thePoint.LightDir, aSurface.GeomNormal) > 0.f)
+  {
+    const EmitterSample& aLight = thePoint.Light;
+
+    float aDirectionPdf = theLightPdf;
+    if (isGuided)
+    {
+      aDirectionPdf = aBsdfFraction * theLightPdf + (1.f - aBsdfFraction) * myGuide->Pdf (aGuideTree, thePoint.LightDir);
+    }
+
+    const float aLightWeight = PowerHeuristic (aLight.MisPdf, aDirectionPdf) / aLight.Pdf;
+
+    theShadow.Segment      = Ray (OffsetOrigin (aSurface.Position, aSurface.GeomNormal, thePoint.LightDir, anEpsilon), thePoint.LightDir, 0.f, aLight.Distance - 2.f * anEpsilon, thePath.Current.Time);
+    theShadow.Contribution = thePath.Throughput * theLightBsdf * aLight.Radiance * aLightWeight;
+    theShadow.IsValid      = true;
+  }
+
+  BsdfSample aSample   = theSample;
+  bool       hasSample = isSampled;
+  if (isGuided)
+  {
+    if (!thePoint.ToSampleGuide)
+    {
+      if (hasSample)
+      {
+        const float aMixturePdf = aBsdfFraction * aSample.Pdf + (1.f - aBsdfFraction) * myGuide->Pdf (aGuideTree, aSample.Wi);
+
+        aSample.Weight *= aSample.Pdf / aMixturePdf;
+        aSample.Pdf     = aMixturePdf;
+      }
+    }
+    else
+    {
+      float aGuidePdf = 0.f;
+      aSample.Wi = myGuide->Sample (aGuideTree, thePoint.GuideRnd, aGuidePdf);
+
+      const Frame aFrame (aSurface.Normal);
+
+      float aBsdfPdf = 0.f;
+      const glm::vec3 aBsdf = Bsdf::Eval (aMaterial, thePoint.Albedo, aFrame.ToLocal (thePoint.Wo), aFrame.ToLocal (aSample.Wi), aBsdfPdf);
+
+      aSample.Pdf        = aBsdfFraction * aBsdfPdf + (1.f - aBsdfFraction) * aGuidePdf;
+      aSample.Weight     = aSample.Pdf > 0.f ? aBsdf / aSample.Pdf : glm::vec3 (0.f);
+      aSample.IsSpecular = false;
+
+      hasSample = aSample.Pdf > 0.f && MaxComponent (aBsdf) > 0.f;
+    }
+  }
+
+  // Continue path by the BSDF sample
+  if (!hasSample)
+  {
+    return false;
+  }
+
+  const glm::vec3 aRayDir = thePath.Current.Direction;
+  const glm::vec3 aWi     = aSample.Wi;
+
+  const bool isReflected = glm::dot (aWi, aSurface.GeomNormal) * glm::dot (thePoint.Wo, aSurface.GeomNormal) > 0.f;
+  if (!isReflected && !Bsdf::IsDelta (aMaterial))
+  {
+    return false; // shading normal leaked direction below the surface
+  }
+
+  if (aSample.IsSpecular)
+  {
+    if (isReflected)
+    {
+      thePath.Diff.Reflect (aRayDir, aSurface.Normal);
+    }
+    else
+    {
+      const bool isEntering = glm::dot (aRayDir, aSurface.Normal) < 0.f;
+
+      thePath.Diff.Refract (aRayDir, aWi, isEntering ? aSurface.Normal : -aSurface.Normal, isEntering ? 1.f / aMaterial.Ior : aMaterial.Ior);
+    }
+  }
+  else
+  {
+    thePath.Diff.Scatter (aWi, Bsdf::Spread (aMaterial));
+  }
+
+  thePath.Throughput *= aSample.Weight;
+  thePath.PrevPdf     = aSample.Pdf;
+  thePath.IsSpecular  = aSample.IsSpecular;
+
+  thePath.Current = Ray (OffsetOrigin (aSurface.Position, aSurface.GeomNormal, aWi, anEpsilon), aWi, 0.f, FLT_MAX, thePath.Current.Time);
+
+  // Russian roulette
+  if (++thePath.Depth > 3)
+  {
+    const float aSurvival = std::min (MaxComponent (thePath.Throughput), 0.95f);
+    if (thePath.Sampler.Next1D() >= aSurvival)
+    {
+      return false;
+    }
+
+    thePath.Throughput /= aSurvival;
+  }
+
+  // Keep vertex until the path is finished to learn radiance arriving along the direction
+  if (thePath.GuideVertices != NULL && aGuideTree >= 0 && !aSample.IsSpecular && aSample.Pdf > 0.f && thePath.NbGuideVertices < myParams.MaxDepth)
+  {
+    GuideVertex& aVertex = thePath.GuideVertices[thePath.NbGuideVertices++];
+    aVertex.Tree       = aGuideTree;
+    aVertex.Direction  = aWi;
+    aVertex.Throughput = thePath.Throughput;
+    aVertex.Incident   = glm::vec3 (0.f);
+    aVertex.Pdf        = aSample.Pdf;
+  }
+
+  return MaxComponent (thePath.Throughput) > 0.f;
+}
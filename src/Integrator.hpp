@@ -0,0 +1,280 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bsdf.hpp"
+#include "Camera.h"
+#include "Framebuffer.hpp"
+#include "PathGuide.hpp"
+#include "Sampler.hpp"
+#include "Scene.hpp"
+#include "ThreadPool.hpp"
+
+//! Parameters shared by all integrators.
+struct IntegratorParams
+{
+  int         MaxDepth;     //!< maximum number of bounces
+  SamplerType Sampler;      //!< generator of sample values
+  bool        BatchShadows; //!< trace shadow rays of the whole tile at once (per-pixel integrator)
+
+  IntegratorParams() : MaxDepth (5), Sampler (SamplerType_Sobol), BatchShadows (true) {}
+};
+
+//! First-hit values written into AOV layers.
+struct AovSample
+{
+  glm::vec3 Albedo;
+  glm::vec3 Normal;
+  float     Depth;
+
+  AovSample() : Albedo (0.f), Normal (0.f), Depth (0.f) {}
+};
+
+//! Ray and traversal counters of a pass. Integrators count into locals of a tile or chunk
+//! and add them to the slot of the worker thread, slots are merged after the pass, so the
+//! hot loop uses no atomics. Nodes and triangles are counted for camera and bounce rays,
+//! traversal of shadow rays is not measured.
+struct RayStats
+{
+  uint64_t NbCameraRays;   //!< primary rays (one per sample)
+  uint64_t NbBounceRays;   //!< extension rays after the first hit
+  uint64_t NbShadowRays;   //!< traced shadow rays
+  uint64_t NbNodes;        //!< visited BVH nodes
+  uint64_t NbTriangles;    //!< primitives referenced by visited leaves
+  uint64_t NbShadingCalls; //!< shaded hits
+
+  RayStats() : NbCameraRays (0), NbBounceRays (0), NbShadowRays (0), NbNodes (0), NbTriangles (0), NbShadingCalls (0) {}
+
+  //! Returns number of traced rays of all types.
+  uint64_t NbRays() const { return NbCameraRays + NbBounceRays + NbShadowRays; }
+
+  //! Returns number of path samples (one camera ray each).
+  uint64_t NbSamples() const { return NbCameraRays; }
+
+  //! Adds traversal work of extension rays.
+  void AddTraversal (const TraversalStats& theStats)
+  {
+    NbNodes     += theStats.NbNodes;
+    NbTriangles += theStats.NbPrimitives;
+  }
+
+  //! Adds counters of another thread or pass.
+  RayStats& operator+= (const RayStats& theOther)
+  {
+    NbCameraRays   += theOther.NbCameraRays;
+    NbBounceRays   += theOther.NbBounceRays;
+    NbShadowRays   += theOther.NbShadowRays;
+    NbNodes        += theOther.NbNodes;
+    NbTriangles    += theOther.NbTriangles;
+    NbShadingCalls += theOther.NbShadingCalls;
+    return *this;
+  }
+};
+
+#ifdef RAYLAB_COST_LAYERS
+//! Work of single path sample written into cost layers.
+//! Shadow rays are only counted, their traversal is not measured.
+struct PathCost
+{
+  TraversalStats Traversal; //!< work of extension rays
+  int            NbShadows; //!< traced shadow rays
+  int            NbRays;    //!< traced extension rays
+
+  PathCost() : NbShadows (0), NbRays (0) {}
+
+  //! Adds the cost as sample of the cost layers.
+  void AddSample (Framebuffer& theFramebuffer, int thePixel) const
+  {
+    theFramebuffer.AddSample (Layer_CostNodes,     thePixel, glm::vec3 (static_cast<float> (Traversal.NbNodes)));
+    theFramebuffer.AddSample (Layer_CostTriangles, thePixel, glm::vec3 (static_cast<float> (Traversal.NbPrimitives)));
+    theFramebuffer.AddSample (Layer_CostShadows,   thePixel, glm::vec3 (static_cast<float> (NbShadows)));
+    theFramebuffer.AddSample (Layer_CostDepth,     thePixel, glm::vec3 (static_cast<float> (NbRays)));
+  }
+};
+#endif
+
+//! State of single light path.
+struct PathState
+{
+  Ray             Current;    //!< ray to be traced next
+  RayDifferential Diff;       //!< differentials of the current ray
+  glm::vec3       Throughput; //!< product of BSDF weights
+  glm::vec3       Radiance;   //!< accumulated radiance
+  float           PrevPdf;    //!< density of the last BSDF sample (for MIS)
+  bool            IsSpecular; //!< last bounce was specular
+  int             Depth;      //!< number of bounces
+  int             Pixel;      //!< framebuffer pixel
+  PathSampler     Sampler;    //!< sample values of the path
+  GuideVertex*    GuideVertices;   //!< vertices recorded for path guiding (NULL if not learning)
+  int             NbGuideVertices; //!< number of recorded vertices
+};
+
+//! Shadow ray generated by next event estimation.
+struct ShadowRay
+{
+  Ray       Segment;         //!< ray limited by the distance to the light
+  glm::vec3 Contribution;    //!< radiance added if the segment is unoccluded
+  int       NbGuideVertices; //!< number of path vertices receiving the contribution
+  bool      IsValid;
+};
+
+//! Shading point between surface setup and BSDF evaluation.
+//! Holds everything BSDF kernels need, so that the evaluation can be
+//! done for many points at once.
+struct ShadingPoint
+{
+  SurfacePoint  Surface;       //!< interpolated surface (normals face Wo for non-delta materials)
+  glm::vec3     Wo;            //!< direction to the previous path vertex
+  glm::vec3     Albedo;        //!< albedo modulated by texture
+  EmitterSample Light;         //!< emitter sampled for next event estimation
+  glm::vec3     LightDir;      //!< direction to the sampled emitter
+  bool          HasLight;      //!< emitter sample is valid
+  glm::vec3     BsdfRnd;       //!< random numbers for BSDF sampling
+  glm::vec2     GuideRnd;      //!< random numbers for sampling path guide
+  int           GuideTree;     //!< directional tree of path guide (-1 if neither sampled nor recorded)
+  bool          IsGuided;      //!< direction is sampled from mixture of BSDF and path guide
+  bool          ToSampleGuide; //!< mixture has chosen path guide instead of BSDF
+};
+
+//! Base class of rendering algorithms.
+//! Both per-pixel and wavefront integrators share path setup and shading
+//! routines, so that they produce identical estimates and differ only in
+//! scheduling and data layout.
+class Integrator
+{
+public:
+
+  //! Creates integrator.
+  Integrator() : myGuide (NULL), myCameraEnd (NULL) {}
+
+  //! Releases resources.
+  virtual ~Integrator() {}
+
+  //! Returns name of the integrator.
+  virtual const char* Name() const = 0;
+
+  //! Renders one pass (one sample per pixel) and accumulates it into the framebuffer.
+  //! Returns number of traced rays.
+  virtual uint64_t Render (const Scene&    theScene,
+                           const Camera&   theCamera,
+                           Framebuffer&    theFramebuffer,
+                           ThreadPool&     thePool) = 0;
+
+  //! Returns size of buffers kept between passes in bytes.
+  virtual size_t MemorySize() const { return 0; }
+
+  //! Returns bytes of thread arena taken by one loop iteration of Render() (a tile or a chunk),
+  //! reserved in arenas of all threads before each pass.
+  virtual size_t ArenaSize() const { return 0; }
+
+  //! Returns ray statistics of the last Render() call.
+  const RayStats& Stats() const { return myStats; }
+
+  //! Returns integrator parameters.
+  const IntegratorParams& Params() const { return myParams; }
+
+  //! Returns integrator parameters for modification.
+  IntegratorParams& ChangeParams() { return myParams; }
+
+  //! Returns path guide (NULL if guiding is disabled).
+  PathGuide* Guide() const { return myGuide; }
+
+  //! Sets path guide used for sampling and learning (NULL disables guiding).
+  void SetGuide (PathGuide* theGuide) { myGuide = theGuide; }
+
+  //! Returns camera at the end of the shutter interval (NULL if the camera does not move).
+  const Camera* CameraEnd() const { return myCameraEnd; }
+
+  //! Sets camera at the end of the shutter interval; camera passed to Render() is taken
+  //! at the start and rays are interpolated between both (NULL disables camera motion).
+  void SetCameraEnd (const Camera* theCamera) { myCameraEnd = theCamera; }
+
+protected:
+
+  //! Clears per-thread statistics (at the start of Render()).
+  void ResetStats (int theNbThreads) { myThreadStats.assign (theNbThreads, ThreadRayStats()); }
+
+  //! Returns statistics of the worker thread.
+  RayStats& ThreadStats (int theThreadId) { return myThreadStats[theThreadId].Stats; }
+
+  //! Merges per-thread statistics into Stats() (at the end of Render()).
+  void MergeStats()
+  {
+    myStats = RayStats();
+    for (size_t aThread = 0; aThread < myThreadStats.size(); ++aThread)
+    {
+      myStats += myThreadStats[aThread].Stats;
+    }
+  }
+
+  //! Returns true if paths should keep vertices for learning of the path guide.
+  bool IsRecordingGuide() const { return myGuide != NULL && myGuide->IsLearning(); }
+
+  //! Initializes path for the next sample of the pixel (by number of accumulated
+  //! samples) and generates camera ray. Ray time is sampled if the scene or camera moves.
+  void StartPath (const Scene&       theScene,
+                  const Camera&      theCamera,
+                  const Framebuffer& theFramebuffer,
+                  int                thePixel,
+                  PathState&         thePath) const;
+
+  //! Shades the hit of the path: adds emission, prepares shadow ray for next event
+  //! estimation and samples BSDF to continue the path. First-hit values are written
+  //! to theAov if it is not NULL. Returns false if the path is terminated.
+  bool ShadeHit (const Scene&      theScene,
+                 const SurfaceHit& theHit,
+                 PathState&        thePath,
+                 ShadowRay&        theShadow,
+                 AovSample*        theAov) const;
+
+  //! Adds radiance of environment to the path escaping the scene
+  //! (weighted against light sampling of the previous vertex).
+  void AddEscaped (const Scene& theScene, PathState& thePath) const;
+
+  //! Adds contribution of unoccluded shadow ray to theRadiance and to the path vertices theVertices.
+  void AddShadow (const ShadowRay& theShadow, glm::vec3& theRadiance, GuideVertex* theVertices) const;
+
+  //! Records radiance gathered by the vertices of the finished path into the path guide.
+  void RecordPath (const PathState& thePath) const;
+
+  //! First part of ShadeHit(): adds emission, fetches albedo, samples emitter and draws
+  //! random numbers for BSDF sampling. Returns false if the path is terminated.
+  bool PrepareShading (const Scene&      theScene,
+                       const SurfaceHit& theHit,
+                       PathState&        thePath,
+                       ShadingPoint&     thePoint,
+                       AovSample*        theAov) const;
+
+  //! Second part of ShadeHit(): takes BSDF value for the emitter direction (theLightBsdf
+  //! and theLightPdf) and BSDF sample (with theSample.Wi in world space, ignored if
+  //! isSampled is false), prepares shadow ray and continues the path. With trained
+  //! path guide the direction is drawn from mixture of the BSDF and the guide.
+  bool FinishShading (const Scene&        theScene,
+                      const ShadingPoint& thePoint,
+                      const glm::vec3&    theLightBsdf,
+                      float               theLightPdf,
+                      const BsdfSample&   theSample,
+                      bool                isSampled,
+                      PathState&          thePath,
+                      ShadowRay&          theShadow) const;
+
+protected:
+
+  //! Counters of single worker thread. Padding is larger than a cache line, so counters
+  //! of neighbor threads never share one (whatever the alignment of the array).
+  struct ThreadRayStats
+  {
+    RayStats Stats;
+    char     Padding[64];
+  };
+
+protected:
+
+  IntegratorParams            myParams;
+  PathGuide*                  myGuide;
+  const Camera*               myCameraEnd;
+  std::vector<ThreadRayStats> myThreadStats; //!< counters of worker threads
+  RayStats                    myStats;       //!< merged counters of the last Render()
+
+};
@@ -0,0 +1,431 @@
+#include "LightBvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const float THE_PI = 3.14159265358979f;
+
+  //! Number of bins per axis used to evaluate splits.
+  const int THE_NB_BINS = 12;
+
+  //! Number of bits in emitter trails (one bit per tree level below the root).
+  const int THE_TRAIL_BITS = 64;
+
+  //! Returns ceil (log2 (theCount)) for positive counts.
+  int CeilLog2 (int theCount)
+  {
+    int aLog = 0;
+    while ((int64_t (1) << aLog) < theCount)
+    {
+      ++aLog;
+    }
+    return aLog;
+  }
+
+  //! Returns cos (max (0, A - B)) for angles given by sines and cosines.
+  float CosSubClamped (float theSinA, float theCosA, float theSinB, float theCosB)
+  {
+    if (theCosA > theCosB)
+    {
+      return 1.f;
+    }
+
+    return theCosA * theCosB + theSinA * theSinB;
+  }
+
+  //! Returns sin (max (0, A - B)) for angles given by sines and cosines.
+  float SinSubClamped (float theSinA, float theCosA, float theSinB, float theCosB)
+  {
+    if (theCosA > theCosB)
+    {
+      return 0.f;
+    }
+
+    return theSinA * theCosB - theCosA * theSinB;
+  }
+
+  //! Returns sine for the cosine.
+  float SinFromCos (float theCos)
+  {
+    return std::sqrt (std::max (0.f, 1.f - theCos * theCos));
+  }
+
+  //! Returns orientation measure of bounds (solid angle weighted by cosine).
+  float OrientationMeasure (const LightBounds& theBounds)
+  {
+    const float aThetaO = std::acos (std::max (-1.f, std::min (theBounds.CosThetaO, 1.f)));
+    const float aThetaE = std::acos (std::max (-1.f, std::min (theBounds.CosThetaE, 1.f)));
+    const float aThetaW = std::min (aThetaO + aThetaE, THE_PI);
+    const float aSinO   = std::sin (aThetaO);
+
+    return 2.f * THE_PI * (1.f - theBounds.CosThetaO)
+         + THE_PI / 2.f * (2.f * aThetaW * aSinO - std::cos (aThetaO - 2.f * aThetaW) - 2.f * aThetaO * aSinO + theBounds.CosThetaO);
+  }
+
+  //! Returns cost of node with the given bounds (Kr scales elongated boxes).
+  float SplitCost (const LightBounds& theBounds, float theKr)
+  {
+    return theBounds.Power * OrientationMeasure (theBounds) * theBounds.Bounds.Area() * theKr;
+  }
+
+  //! Rotates vector around unit axis by angle.
+  glm::vec3 Rotate (const glm::vec3& theVec, const glm::vec3& theAxis, float theAngle)
+  {
+    const float aCos = std::cos (theAngle);
+    const float aSin = std::sin (theAngle);
+
+    return theVec * aCos + glm::cross (theAxis, theVec) * aSin + theAxis * glm::dot (theAxis, theVec) * (1.f - aCos);
+  }
+}
+
+//=======================================================================
+//function : Importance
+//purpose  :
+//=======================================================================
+float LightBounds::Importance (const glm::vec3& thePoint) const
+{
+  const glm::vec3 aCenter = Bounds.Center();
+  const float aRadius2 = glm::dot (Bounds.Size(), Bounds.Size()) * 0.25f;
+
+  // Distance is clamped to avoid singularity for points inside the bounds
+  glm::vec3 aToPoint = thePoint - aCenter;
+  const float aDist2 = std::max (glm::dot (aToPoint, aToPoint), aRadius2);
+  if (aDist2 <= 0.f)
+  {
+    return Power;
+  }
+
+  const float aLength = glm::length (aToPoint);
+  aToPoint = aLength > 0.f ? aToPoint / aLength : Axis;
+
+  const float aCosW = glm::dot (Axis, aToPoint);
+  const float aSinW = SinFromCos (aCosW);
+
+  // Cone of directions subtended by the bounding sphere
+  float aCosB = -1.f;
+  if (aLength * aLength > aRadius2)
+  {
+    aCosB = std::sqrt (std::max (0.f, 1.f - aRadius2 / (aLength * aLength)));
+  }
+  const float aSinB = SinFromCos (aCosB);
+
+  // Minimum angle between emission cone and direction to the point
+  const float aSinO = SinFromCos (CosThetaO);
+  const float aCosX = CosSubClamped (aSinW, aCosW, aSinO, CosThetaO);
+  const float aSinX = SinSubClamped (aSinW, aCosW, aSinO, CosThetaO);
+  const float aCosP = CosSubClamped (aSinX, aCosX, aSinB, aCosB);
+  if (aCosP <= CosThetaE)
+  {
+    return 0.f;
+  }
+
+  return Power * aCosP / aDist2;
+}
+
+//=======================================================================
+//function : Union
+//purpose  :
+//=======================================================================
+LightBounds LightBounds::Union (const LightBounds& theA, const LightBounds& theB)
+{
+  if (theA.Power <= 0.f)
+  {
+    return theB;
+  }
+  if (theB.Power <= 0.f)
+  {
+    return theA;
+  }
+
+  LightBounds aRes;
+  aRes.Bounds = theA.Bounds;
+  aRes.Bounds.Add (theB.Bounds);
+  aRes.Power     = theA.Power + theB.Power;
+  aRes.CosThetaE = std::min (theA.CosThetaE, theB.CosThetaE);
+
+  // Bounding cone of two cones
+  const float aThetaA = std::acos (std::max (-1.f, std::min (theA.CosThetaO, 1.f)));
+  const float aThetaB = std::acos (std::max (-1.f, std::min (theB.CosThetaO, 1.f)));
+  const float aThetaD = std::acos (std::max (-1.f, std::min (glm::dot (theA.Axis, theB.Axis), 1.f)));
+
+  if (std::min (aThetaD + aThetaB, THE_PI) <= aThetaA)
+  {
+    aRes.Axis      = theA.Axis;
+    aRes.CosThetaO = theA.CosThetaO;
+    return aRes;
+  }
+  if (std::min (aThetaD + aThetaA, THE_PI) <= aThetaB)
+  {
+    aRes.Axis      = theB.Axis;
+    aRes.CosThetaO = theB.CosThetaO;
+    return aRes;
+  }
+
+  const float aThetaO = (aThetaA + aThetaD + aThetaB) * 0.5f;
+  const glm::vec3 anAxis = glm::cross (theA.Axis, theB.Axis);
+  if (aThetaO >= THE_PI || glm::dot (anAxis, anAxis) <= 0.f)
+  {
+    aRes.Axis      = theA.Axis;
+    aRes.CosThetaO = -1.f;
+    return aRes;
+  }
+
+  aRes.Axis      = glm::normalize (Rotate (theA.Axis, glm::normalize (anAxis), aThetaO - aThetaA));
+  aRes.CosThetaO = std::cos (aThetaO);
+  return aRes;
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void LightBvh::Clear()
+{
+  myNodes.clear();
+  myTrails.clear();
+}
+
+//=======================================================================
+//function : Build
+//purpose  :
+//=======================================================================
+void LightBvh::Build (const std::vector<LightBounds>& theEmitters)
+{
+  Clear();
+
+  if (theEmitters.empty())
+  {
+    return;
+  }
+
+  std::vector<int> anOrder (theEmitters.size());
+  for (size_t anIdx = 0; anIdx < anOrder.size(); ++anIdx)
+  {
+    anOrder[anIdx] = static_cast<int> (anIdx);
+  }
+
+  myNodes.reserve (2 * theEmitters.size());
+  myTrails.resize (theEmitters.size(), 0);
+
+  build (theEmitters, anOrder, 0, static_cast<int> (anOrder.size()), 0, 0);
+}
+
+//=======================================================================
+//function : build
+//purpose  :
+//=======================================================================
+int LightBvh::build (const std::vector<LightBounds>& theEmitters,
+                     std::vector<int>&               theOrder,
+                     int                             theBegin,
+                     int                             theEnd,
+                     int                             theDepth,
+                     uint64_t                        theTrail)
+{
+  const int aNodeIdx = static_cast<int> (myNodes.size());
+  myNodes.push_back (LightBvhNode());
+
+  if (theEnd - theBegin == 1)
+  {
+    const int anEmitter = theOrder[theBegin];
+
+    myNodes[aNodeIdx].Bounds         = theEmitters[anEmitter];
+    myNodes[aNodeIdx].RightOrEmitter = anEmitter;
+    myNodes[aNodeIdx].IsLeaf         = true;
+
+    myTrails[anEmitter] = theTrail;
+    return aNodeIdx;
+  }
+
+  Box aCenterBounds;
+  LightBounds aBounds;
+  for (int anIdx = theBegin; anIdx < theEnd; ++anIdx)
+  {
+    aCenterBounds.Add (theEmitters[theOrder[anIdx]].Bounds.Center());
+    aBounds = LightBounds::Union (aBounds, theEmitters[theOrder[anIdx]]);
+  }
+
+  // Find split plane with the lowest SAOH cost among binned candidates
+  float aBestCost  = FLT_MAX;
+  int   aBestAxis  = -1;
+  int   aBestSplit = -1;
+
+  const glm::vec3 aCenterSize = aCenterBounds.Size();
+  const glm::vec3 aBoundsSize = aBounds.Bounds.Size();
+  const float     aMaxSize    = std::max (aBoundsSize.x, std::max (aBoundsSize.y, aBoundsSize.z));
+
+  // Count median splits reach all leaves within ceil (log2 (count)) levels, so switching
+  // to them once SAOH could overflow the trail keeps every leaf at depth <= 64
+  const bool toSplitBySaoh = theDepth + CeilLog2 (theEnd - theBegin) < THE_TRAIL_BITS;
+
+  for (int anAxis = 0; anAxis < 3 && toSplitBySaoh; ++anAxis)
+  {
+    if (aCenterSize[anAxis] <= 0.f)
+    {
+      continue;
+    }
+
+    LightBounds aBins[THE_NB_BINS];
+
+    const float aScale = THE_NB_BINS / aCenterSize[anAxis];
+    for (int anIdx = theBegin; anIdx < theEnd; ++anIdx)
+    {
+      const LightBounds& anEmitter = theEmitters[theOrder[anIdx]];
+
+      const int aBin = std::min (static_cast<int> ((anEmitter.Bounds.Center()[anAxis] - aCenterBounds.Min[anAxis]) * aScale), THE_NB_BINS - 1);
+      aBins[aBin] = LightBounds::Union (aBins[aBin], anEmitter);
+    }
+
+    const float aKr = aBoundsSize[anAxis] > 0.f ? aMaxSize / aBoundsSize[anAxis] : 1.f;
+
+    LightBounds aRight[THE_NB_BINS];
+    for (int aBin = THE_NB_BINS - 1; aBin > 0; --aBin)
+    {
+      aRight[aBin] = aBin + 1 < THE_NB_BINS ? LightBounds::Union (aBins[aBin], aRight[aBin + 1]) : aBins[aBin];
+    }
+
+    LightBounds aLeft;
+    for (int aSplit = 1; aSplit < THE_NB_BINS; ++aSplit)
+    {
+      aLeft = LightBounds::Union (aLeft, aBins[aSplit - 1]);
+      if (aLeft.Power <= 0.f || aRight[aSplit].Power <= 0.f)
+      {
+        continue;
+      }
+
+      const float aCost = SplitCost (aLeft, aKr) + SplitCost (aRight[aSplit], aKr);
+      if (aCost < aBestCost)
+      {
+        aBestCost  = aCost;
+        aBestAxis  = anAxis;
+        aBestSplit = aSplit;
+      }
+    }
+  }
+
+  int aMiddle = (theBegin + theEnd) / 2;
+  if (aBestAxis >= 0)
+  {
+    const float aScale = THE_NB_BINS / aCenterSize[aBestAxis];
+    const float aMin   = aCenterBounds.Min[aBestAxis];
+
+    aMiddle = static_cast<int> (std::partition (theOrder.begin() + theBegin, theOrder.begin() + theEnd, [&](int theEmitter)
+    {
+      const int aBin = std::min (static_cast<int> ((theEmitters[theEmitter].Bounds.Center()[aBestAxis] - aMin) * aScale), THE_NB_BINS - 1);
+      return aBin < aBestSplit;
+    }) - theOrder.begin());
+  }
+
+  if (aBestAxis < 0 || aMiddle == theBegin || aMiddle == theEnd)
+  {
+    // Coincident centers (or too deep): split by count along the largest extent
+    int anAxis = 0;
+    for (int aComp = 1; aComp < 3; ++aComp)
+    {
+      anAxis = aCenterSize[aComp] > aCenterSize[anAxis] ? aComp : anAxis;
+    }
+
+    aMiddle = (theBegin + theEnd) / 2;
+    std::nth_element (theOrder.begin() + theBegin, theOrder.begin() + aMiddle, theOrder.begin() + theEnd, [&](int theA, int theB)
+    {
+      return theEmitters[theA].Bounds.Center()[anAxis] < theEmitters[theB].Bounds.Center()[anAxis];
+    });
+  }
+
+  build (theEmitters, theOrder, theBegin, aMiddle, theDepth + 1, theTrail);
+
+  const int aRight = build (theEmitters, theOrder, aMiddle, theEnd, theDepth + 1, theTrail | (uint64_t (1) << theDepth));
+
+  myNodes[aNodeIdx].Bounds         = aBounds;
+  myNodes[aNodeIdx].RightOrEmitter = aRight;
+  myNodes[aNodeIdx].IsLeaf         = false;
+
+  return aNodeIdx;
+}
+
+//=======================================================================
+//function : Sample
+//purpose  :
+//=======================================================================
+int LightBvh::Sample (const glm::vec3& thePoint, float theU, float& theProb) const
+{
+  theProb = 0.f;
+  if (myNodes.empty() || myNodes.front().Bounds.Importance (thePoint) <= 0.f)
+  {
+    return -1;
+  }
+
+  float aProb = 1.f;
+  int   aNode = 0;
+
+  while (!myNodes[aNode].IsLeaf)
+  {
+    const float aLeft  = myNodes[aNode + 1].Bounds.Importance (thePoint);
+    const float aRight = myNodes[myNodes[aNode].RightOrEmitter].Bounds.Importance (thePoint);
+    if (aLeft <= 0.f && aRight <= 0.f)
+    {
+      return -1;
+    }
+
+    // Random number is rescaled to be reused at the next level
+    const float aProbLeft = aLeft / (aLeft + aRight);
+    if (theU < aProbLeft)
+    {
+      theU   = std::min (theU / aProbLeft, 0.99999994f);
+      aProb *= aProbLeft;
+      aNode  = aNode + 1;
+    }
+    else
+    {
+      theU   = std::min ((theU - aProbLeft) / (1.f - aProbLeft), 0.99999994f);
+      aProb *= 1.f - aProbLeft;
+      aNode  = myNodes[aNode].RightOrEmitter;
+    }
+  }
+
+  theProb = aProb;
+  return myNodes[aNode].RightOrEmitter;
+}
+
+//=======================================================================
+//function : Prob
+//purpose  :
+//=======================================================================
+float LightBvh::Prob (const glm::vec3& thePoint, int theEmitter) const
+{
+  if (myNodes.empty())
+  {
+    return 0.f;
+  }
+
+  uint64_t aTrail = myTrails[theEmitter];
+
+  float aProb = 1.f;
+  int   aNode = 0;
+
+  while (!myNodes[aNode].IsLeaf)
+  {
+    const float aLeft  = myNodes[aNode + 1].Bounds.Importance (thePoint);
+    const float aRight = myNodes[myNodes[aNode].RightOrEmitter].Bounds.Importance (thePoint);
+    if (aLeft <= 0.f && aRight <= 0.f)
+    {
+      return 0.f;
+    }
+
+    if ((aTrail & 1u) == 0)
+    {
+      aProb *= aLeft / (aLeft + aRight);
+      aNode  = aNode + 1;
+    }
+    else
+    {
+      aProb *= aRight / (aLeft + aRight);
+      aNode  = myNodes[aNode].RightOrEmitter;
+    }
+
+    aTrail >>= 1u;
+  }
+
+  return aProb;
+}
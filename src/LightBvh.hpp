@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.hpp"
+
+//! Spatial and directional bounds of emitters (Conty and Kulla 2018).
+//! Emission directions lie within CosThetaO of Axis, each emitter
+//! radiates up to CosThetaE away from its normal.
+struct LightBounds
+{
+  Box       Bounds;    //!< bounding box of emitters
+  glm::vec3 Axis;      //!< axis of the cone of normals
+  float     CosThetaO; //!< cosine of the spread of normals around the axis
+  float     CosThetaE; //!< cosine of the emission angle relative to normal
+  float     Power;     //!< total emitted power
+
+  LightBounds() : Axis (0.f, 0.f, 1.f), CosThetaO (1.f), CosThetaE (1.f), Power (0.f) {}
+
+  //! Returns estimated contribution of emitters to the point (conservative in orientation).
+  float Importance (const glm::vec3& thePoint) const;
+
+  //! Returns bounds enclosing both arguments.
+  static LightBounds Union (const LightBounds& theA, const LightBounds& theB);
+};
+
+//! Node of light hierarchy. Left child follows the node, so only the
+//! index of the right child is kept.
+struct LightBvhNode
+{
+  LightBounds Bounds;
+  int         RightOrEmitter; //!< right child for inner node or emitter index for leaf
+  bool        IsLeaf;
+};
+
+//! Binary hierarchy over emitters for sampling lights proportionally to
+//! their estimated contribution to the shading point. Built top-down with
+//! the surface area orientation heuristic, one emitter per leaf.
+class LightBvh
+{
+public:
+
+  //! Creates empty hierarchy.
+  LightBvh() {}
+
+  //! Builds hierarchy over bounds of individual emitters.
+  void Build (const std::vector<LightBounds>& theEmitters);
+
+  //! Releases all data.
+  void Clear();
+
+  //! Returns true if hierarchy is empty.
+  bool IsEmpty() const { return myNodes.empty(); }
+
+  //! Returns hierarchy nodes (root is the first one).
+  const std::vector<LightBvhNode>& Nodes() const { return myNodes; }
+
+  //! Returns size of nodes and emitter trails in bytes.
+  size_t MemorySize() const { return myNodes.size() * sizeof (LightBvhNode) + myTrails.size() * sizeof (uint64_t); }
+
+  //! Selects emitter for the point by random number theU.
+  //! Returns emitter index and its probability, or -1 if no emitter contributes.
+  int Sample (const glm::vec3& thePoint, float theU, float& theProb) const;
+
+  //! Returns probability of selecting the emitter for the point by Sample().
+  float Prob (const glm::vec3& thePoint, int theEmitter) const;
+
+private:
+
+  //! Builds subtree over emitters [theBegin, theEnd) of theOrder, returns index of its root.
+  int build (const std::vector<LightBounds>& theEmitters,
+             std::vector<int>&               theOrder,
+             int                             theBegin,
+             int                             theEnd,
+             int                             theDepth,
+             uint64_t                        theTrail);
+
+private:
+
+  std::vector<LightBvhNode> myNodes;
+  std::vector<uint64_t>     myTrails; //!< path from root to emitter leaf (bit per level, 1 - right)
+
+};
@@ -0,0 +1,131 @@
+#include "Memory.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+  #include <psapi.h>
+#endif
+
+namespace
+{
+#if !defined(_WIN32)
+  //! Reads value in kB of the key from /proc/self/status (0 if not found).
+  size_t ReadStatus (const char* theKey)
+  {
+    std::ifstream aFile ("/proc/self/status");
+
+    std::string aLine;
+    while (std::getline (aFile, aLine))
+    {
+      unsigned long long aKb = 0;
+      if (aLine.compare (0, std::string (theKey).size(), theKey) == 0
+       && std::sscanf (aLine.c_str() + std::string (theKey).size(), ": %llu kB", &aKb) == 1)
+      {
+        return static_cast<size_t> (aKb) * 1024;
+      }
+    }
+    return 0;
+  }
+#endif
+}
+
+//=======================================================================
+//function : TagName
+//purpose  :
+//=======================================================================
+const char* MemoryStats::TagName (MemoryTag theTag)
+{
+  switch (theTag)
+  {
+    case MemoryTag_Geometry:     return "geometry";
+    case MemoryTag_Bvh:          return "bvh";
+    case MemoryTag_Textures:     return "textures";
+    case MemoryTag_Framebuffers: return "framebuffers";
+    case MemoryTag_RenderState:  return "render state";
+    case MemoryTag_Caches:       return "caches";
+    case MemoryTag_Ui:           return "ui";
+    default:                     return "unknown";
+  }
+}
+
+//=======================================================================
+//function : ProcessResident
+//purpose  :
+//=======================================================================
+size_t MemoryStats::ProcessResident()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS aCounters;
+  return GetProcessMemoryInfo (GetCurrentProcess(), &aCounters, sizeof (aCounters)) ? aCounters.WorkingSetSize : 0;
+#else
+  return ReadStatus ("VmRSS");
+#endif
+}
+
+//=======================================================================
+//function : ProcessPeak
+//purpose  :
+//=======================================================================
+size_t MemoryStats::ProcessPeak()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS aCounters;
+  return GetProcessMemoryInfo (GetCurrentProcess(), &aCounters, sizeof (aCounters)) ? aCounters.PeakWorkingSetSize : 0;
+#else
+  return ReadStatus ("VmHWM");
+#endif
+}
+
+//=======================================================================
+//function : MemoryStats
+//purpose  :
+//=======================================================================
+MemoryStats::MemoryStats()
+: myTotalPeak (0)
+{
+  std::fill (myCurrent, myCurrent + MemoryTag_NB, static_cast<size_t> (0));
+  std::fill (myPeak,    myPeak    + MemoryTag_NB, static_cast<size_t> (0));
+  std::fill (myBudget,  myBudget  + MemoryTag_NB, static_cast<size_t> (0));
+}
+
+//=======================================================================
+//function : TotalCurrent
+//purpose  :
+//=======================================================================
+size_t MemoryStats::TotalCurrent() const
+{
+  size_t aTotal = 0;
+  for (int aTag = 0; aTag < MemoryTag_NB; ++aTag)
+  {
+    aTotal += myCurrent[aTag];
+  }
+  return aTotal;
+}
+
+//=======================================================================
+//function : Set
+//purpose  :
+//=======================================================================
+void MemoryStats::Set (MemoryTag theTag, size_t theBytes)
+{
+  myCurrent[theTag] = theBytes;
+  myPeak[theTag]    = std::max (myPeak[theTag], theBytes);
+  myTotalPeak       = std::max (myTotalPeak, TotalCurrent());
+}
+
+//=======================================================================
+//function : ResetPeaks
+//purpose  :
+//=======================================================================
+void MemoryStats::ResetPeaks()
+{
+  std::copy (myCurrent, myCurrent + MemoryTag_NB, myPeak);
+  myTotalPeak = TotalCurrent();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+
+//! Categories of memory accounted by the renderer.
+enum MemoryTag
+{
+  MemoryTag_Geometry,     //!< vertices, triangles and analytic shapes
+  MemoryTag_Bvh,          //!< all hierarchies (binary, wide, motion, paged top, replicas, lights)
+  MemoryTag_Textures,     //!< material textures and environment map
+  MemoryTag_Framebuffers, //!< accumulated layers (AOVs) and denoiser buffers
+  MemoryTag_RenderState,  //!< integrator queues and path state, thread arenas
+  MemoryTag_Caches,       //!< tessellation cache, path guide, resident paged blocks
+  MemoryTag_Ui,           //!< textures and buffers of the viewer (set by the GUI)
+  MemoryTag_NB
+};
+
+//! Current and peak memory per category with optional budgets. Sizes are gathered from
+//! components on update (not by hooking allocations), so peaks are the largest updated
+//! values. Budgets of caches are enforced by the renderer, others are only reported.
+class MemoryStats
+{
+public:
+
+  //! Returns name of the category.
+  static const char* TagName (MemoryTag theTag);
+
+  //! Returns resident memory of the process in bytes (0 if unknown).
+  static size_t ProcessResident();
+
+  //! Returns peak resident memory of the process in bytes (0 if unknown).
+  static size_t ProcessPeak();
+
+  //! Creates empty statistics without budgets.
+  MemoryStats();
+
+  //! Returns current bytes of the category.
+  size_t Current (MemoryTag theTag) const { return myCurrent[theTag]; }
+
+  //! Returns peak bytes of the category.
+  size_t Peak (MemoryTag theTag) const { return myPeak[theTag]; }
+
+  //! Returns current bytes of all categories.
+  size_t TotalCurrent() const;
+
+  //! Returns peak of bytes of all categories together.
+  size_t TotalPeak() const { return myTotalPeak; }
+
+  //! Updates current bytes of the category (and peaks).
+  void Set (MemoryTag theTag, size_t theBytes);
+
+  //! Returns budget of the category in bytes (0 - unlimited).
+  size_t Budget (MemoryTag theTag) const { return myBudget[theTag]; }
+
+  //! Sets budget of the category in bytes (0 - unlimited).
+  void SetBudget (MemoryTag theTag, size_t theBytes) { myBudget[theTag] = theBytes; }
+
+  //! Returns true if the category exceeds its budget.
+  bool IsOverBudget (MemoryTag theTag) const { return myBudget[theTag] != 0 && myCurrent[theTag] > myBudget[theTag]; }
+
+  //! Resets peaks to the current values.
+  void ResetPeaks();
+
+private:
+
+  size_t myCurrent[MemoryTag_NB];
+  size_t myPeak[MemoryTag_NB];
+  size_t myBudget[MemoryTag_NB];
+  size_t myTotalPeak;
+
+};
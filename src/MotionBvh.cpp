@@ -0,0 +1,134 @@
+#include "MotionBvh.hpp"
+
+#include "ThreadPool.hpp"
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void MotionBvh::Clear()
+{
+  mySegments.clear();
+  myBounds  = Box();
+  myNbPrims = 0;
+}
+
+//=======================================================================
+//function : Build
+//purpose  :
+//=======================================================================
+void MotionBvh::Build (const std::vector<Box>& theBoxes, int theNbKeys, bool theIsLinear, ThreadPool& thePool)
+{
+  Clear();
+
+  myIsLinear = theIsLinear;
+  if (theNbKeys < 2 || theBoxes.empty())
+  {
+    return;
+  }
+
+  const size_t aNbPrims = theBoxes.size() / theNbKeys;
+
+  myNbPrims = static_cast<int> (aNbPrims);
+  mySegments.resize (theNbKeys - 1);
+
+  thePool.ParallelFor (theNbKeys - 1, [&](int theSegment, int)
+  {
+    const Box* aBoxes0 = &theBoxes[aNbPrims * theSegment];
+    const Box* aBoxes1 = &theBoxes[aNbPrims * (theSegment + 1)];
+
+    // Linear bounds have time-averaged area of the averaged box, so SAH over
+    // averaged boxes approximates the cost of traversal at random ray time
+    std::vector<Box> aBuildBoxes (aNbPrims);
+    for (size_t aPrim = 0; aPrim < aNbPrims; ++aPrim)
+    {
+      if (theIsLinear)
+      {
+        aBuildBoxes[aPrim] = Box ((aBoxes0[aPrim].Min + aBoxes1[aPrim].Min) * 0.5f,
+                                  (aBoxes0[aPrim].Max + aBoxes1[aPrim].Max) * 0.5f);
+      }
+      else
+      {
+        aBuildBoxes[aPrim] = aBoxes0[aPrim];
+        aBuildBoxes[aPrim].Add (aBoxes1[aPrim]);
+      }
+    }
+
+    Bvh aBvh;
+    aBvh.Build (aBuildBoxes);
+
+    SegmentTree& aTree = mySegments[theSegment];
+    aTree.Indices = aBvh.Indices();
+    aTree.Nodes.resize (aBvh.Nodes().size());
+
+    // Children are built after their parents, so reverse order visits them first
+    for (size_t aNodeIdx = aBvh.Nodes().size(); aNodeIdx-- > 0;)
+    {
+      const BvhNode& aSource = aBvh.Nodes()[aNodeIdx];
+      MotionBvhNode& aNode = aTree.Nodes[aNodeIdx];
+
+      aNode.LeftOrFirst = aSource.LeftOrFirst;
+      aNode.Count       = aSource.Count;
+      aNode.Bounds0     = Box();
+      aNode.Bounds1     = Box();
+
+      if (aSource.IsLeaf())
+      {
+        for (int anIdx = aSource.LeftOrFirst; anIdx < aSource.LeftOrFirst + aSource.Count; ++anIdx)
+        {
+          aNode.Bounds0.Add (aBoxes0[aTree.Indices[anIdx]]);
+          aNode.Bounds1.Add (aBoxes1[aTree.Indices[anIdx]]);
+        }
+      }
+      else
+      {
+        for (int aChild = aSource.LeftOrFirst; aChild <= aSource.LeftOrFirst + 1; ++aChild)
+        {
+          aNode.Bounds0.Add (aTree.Nodes[aChild].Bounds0);
+          aNode.Bounds1.Add (aTree.Nodes[aChild].Bounds1);
+        }
+      }
+
+      if (!theIsLinear)
+      {
+        aNode.Bounds0.Add (aNode.Bounds1);
+        aNode.Bounds1 = aNode.Bounds0;
+      }
+    }
+  });
+
+  for (size_t aSegment = 0; aSegment < mySegments.size(); ++aSegment)
+  {
+    myBounds.Add (mySegments[aSegment].Nodes[0].Bounds0);
+    myBounds.Add (mySegments[aSegment].Nodes[0].Bounds1);
+  }
+}
+
+//=======================================================================
+//function : NbNodes
+//purpose  :
+//=======================================================================
+int MotionBvh::NbNodes() const
+{
+  size_t aNbNodes = 0;
+  for (size_t aSegment = 0; aSegment < mySegments.size(); ++aSegment)
+  {
+    aNbNodes += mySegments[aSegment].Nodes.size();
+  }
+  return static_cast<int> (aNbNodes);
+}
+
+//=======================================================================
+//function : MemorySize
+//purpose  :
+//=======================================================================
+size_t MotionBvh::MemorySize() const
+{
+  size_t aSize = 0;
+  for (size_t aSegment = 0; aSegment < mySegments.size(); ++aSegment)
+  {
+    aSize += mySegments[aSegment].Nodes.size()   * sizeof (MotionBvhNode)
+           + mySegments[aSegment].Indices.size() * sizeof (int);
+  }
+  return aSize;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <vector>
+
+#include "Bvh.hpp"
+
+class ThreadPool;
+
+//! Node of motion hierarchy (56 bytes) with bounds at both ends of its time segment.
+//! Bounds at time Tau of the segment are interpolated linearly, which is conservative
+//! for primitives whose vertices move linearly within the segment.
+struct MotionBvhNode
+{
+  Box Bounds0;     //!< bounds at the segment start
+  Box Bounds1;     //!< bounds at the segment end
+  int LeftOrFirst; //!< index of left child for inner node or first primitive index for leaf
+  int Count;       //!< number of primitives in leaf (0 for inner node)
+
+  bool IsLeaf() const { return Count > 0; }
+};
+
+//! Bounding volume hierarchy over moving primitives. Shutter interval [0, 1] is split
+//! into equal segments between motion keys, each segment has its own hierarchy.
+//! Node bounds are interpolated by ray time, so fast moving primitives do not
+//! inflate boxes over the whole shutter as unions of swept bounds do.
+class MotionBvh
+{
+public:
+
+  //! Creates empty hierarchy.
+  MotionBvh() : myNbPrims (0), myIsLinear (true) {}
+
+  //! Builds hierarchies over primitive boxes at theNbKeys motion keys (theBoxes holds boxes
+  //! of all primitives at the first key, then at the second one and so on). Topology of each
+  //! segment is built with binned SAH over time-averaged boxes. With theIsLinear set to false
+  //! both node bounds are unions over the segment (for comparison).
+  void Build (const std::vector<Box>& theBoxes, int theNbKeys, bool theIsLinear, ThreadPool& thePool);
+
+  //! Releases all data.
+  void Clear();
+
+  //! Returns true if hierarchy is empty.
+  bool IsEmpty() const { return mySegments.empty(); }
+
+  //! Returns number of time segments.
+  int NbSegments() const { return static_cast<int> (mySegments.size()); }
+
+  //! Returns true if node bounds are interpolated in time.
+  bool IsLinear() const { return myIsLinear; }
+
+  //! Returns total number of nodes.
+  int NbNodes() const;
+
+  //! Returns size of nodes and indices in bytes.
+  size_t MemorySize() const;
+
+  //! Returns bounds over the whole shutter interval.
+  Box Bounds() const { return myBounds; }
+
+  //! Returns segment containing time theTime (in [0, 1]) and position theTau within it.
+  static int Segment (float theTime, int theNbSegments, float& theTau)
+  {
+    const float aTime = glm::clamp (theTime, 0.f, 1.f) * theNbSegments;
+    const int aSegment = glm::min (static_cast<int> (aTime), theNbSegments - 1);
+
+    theTau = aTime - aSegment;
+    return aSegment;
+  }
+
+  //! Traverses the hierarchy of the segment of ray time in front-to-back order with the
+  //! same leaf callback as Bvh::Traverse(). Visited nodes are counted into theStats (optional).
+  template<class LeafFunc>
+  void Traverse (const Ray& theRay, float& theTmax, LeafFunc& theLeaf, TraversalStats* theStats = NULL) const
+  {
+    if (mySegments.empty())
+    {
+      return;
+    }
+
+    float aTau = 0.f;
+    const SegmentTree& aTree = mySegments[Segment (theRay.Time, NbSegments(), aTau)];
+
+    const std::vector<MotionBvhNode>& aNodes = aTree.Nodes;
+
+    const glm::vec3 anInvDir (1.f / theRay.Direction.x,
+                              1.f / theRay.Direction.y,
+                              1.f / theRay.Direction.z);
+
+    if (Bvh::IntersectBox (boundsAt (aNodes[0], aTau), theRay.Origin, anInvDir, theRay.Tmin, theTmax) == FLT_MAX)
+    {
+      return;
+    }
+
+    int aStack[Bvh::MaxDepth];
+    int aHead = 0;
+
+    for (int aNode = 0;;)
+    {
+      const MotionBvhNode& aCurrent = aNodes[aNode];
+
+      if (theStats != NULL)
+      {
+        ++theStats->NbNodes;
+        theStats->NbPrimitives += aCurrent.Count;
+      }
+
+      if (aCurrent.IsLeaf())
+      {
+        if (theLeaf (aCurrent.LeftOrFirst, aCurrent.Count, theTmax))
+        {
+          return;
+        }
+      }
+      else
+      {
+        const int aLft = aCurrent.LeftOrFirst;
+        const int aRgh = aCurrent.LeftOrFirst + 1;
+
+        const float aTimeLft = Bvh::IntersectBox (boundsAt (aNodes[aLft], aTau), theRay.Origin, anInvDir, theRay.Tmin, theTmax);
+        const float aTimeRgh = Bvh::IntersectBox (boundsAt (aNodes[aRgh], aTau), theRay.Origin, anInvDir, theRay.Tmin, theTmax);
+
+        if (aTimeLft != FLT_MAX && aTimeRgh != FLT_MAX)
+        {
+          aNode = aTimeLft <= aTimeRgh ? aLft : aRgh;
+          aStack[aHead++] = aTimeLft <= aTimeRgh ? aRgh : aLft;
+          continue;
+        }
+        else if (aTimeLft != FLT_MAX)
+        {
+          aNode = aLft;
+          continue;
+        }
+        else if (aTimeRgh != FLT_MAX)
+        {
+          aNode = aRgh;
+          continue;
+        }
+      }
+
+      if (aHead == 0)
+      {
+        return;
+      }
+
+      aNode = aStack[--aHead];
+    }
+  }
+
+  //! Returns primitive indices referenced by leaves of the segment hierarchy.
+  const std::vector<int>& Indices (int theSegment) const { return mySegments[theSegment].Indices; }
+
+private:
+
+  //! Returns node bounds at position theTau of its segment.
+  static Box boundsAt (const MotionBvhNode& theNode, float theTau)
+  {
+    return Box (theNode.Bounds0.Min + (theNode.Bounds1.Min - theNode.Bounds0.Min) * theTau,
+                theNode.Bounds0.Max + (theNode.Bounds1.Max - theNode.Bounds0.Max) * theTau);
+  }
+
+private:
+
+  //! Hierarchy of single time segment.
+  struct SegmentTree
+  {
+    std::vector<MotionBvhNode> Nodes;
+    std::vector<int>           Indices;
+  };
+
+private:
+
+  std::vector<SegmentTree> mySegments;
+  Box                      myBounds;
+  int                      myNbPrims;
+  bool                     myIsLinear;
+
+};
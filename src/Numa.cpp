@@ -0,0 +1,279 @@
+#include "Numa.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+namespace
+{
+  //! Node of the calling thread set by pinning.
+  thread_local int THE_CURRENT_NODE = -1;
+
+#if !defined(_WIN32)
+  //! Parses list of ranges like "0-3,8,10-11".
+  std::vector<int> ParseList (const std::string& theList)
+  {
+    std::vector<int> aValues;
+
+    std::stringstream aStream (theList);
+    std::string aRange;
+    while (std::getline (aStream, aRange, ','))
+    {
+      const size_t aDash = aRange.find ('-');
+
+      int aFirst = 0;
+      int aLast  = 0;
+      if (std::sscanf (aRange.c_str(), "%d", &aFirst) != 1)
+      {
+        continue;
+      }
+
+      aLast = aFirst;
+      if (aDash != std::string::npos)
+      {
+        std::sscanf (aRange.c_str() + aDash + 1, "%d", &aLast);
+      }
+
+      for (int aValue = aFirst; aValue <= aLast; ++aValue)
+      {
+        aValues.push_back (aValue);
+      }
+    }
+
+    return aValues;
+  }
+
+  //! Reads the first line of the text file (empty string if it can't be read).
+  std::string ReadLine (const std::string& theFile)
+  {
+    std::ifstream aFile (theFile.c_str());
+
+    std::string aLine;
+    std::getline (aFile, aLine);
+    return aLine;
+  }
+#endif
+}
+
+//=======================================================================
+//function : Get
+//purpose  :
+//=======================================================================
+const NumaTopology& NumaTopology::Get()
+{
+  static const NumaTopology THE_TOPOLOGY;
+  return THE_TOPOLOGY;
+}
+
+//=======================================================================
+//function : NumaTopology
+//purpose  :
+//=======================================================================
+NumaTopology::NumaTopology()
+{
+#if defined(_WIN32)
+  ULONG aHighestNode = 0;
+  if (GetNumaHighestNodeNumber (&aHighestNode))
+  {
+    DWORD_PTR aProcessMask = 0;
+    DWORD_PTR aSystemMask  = 0;
+    GetProcessAffinityMask (GetCurrentProcess(), &aProcessMask, &aSystemMask);
+
+    for (ULONG aNodeId = 0; aNodeId <= aHighestNode; ++aNodeId)
+    {
+      ULONGLONG aMask = 0;
+      if (!GetNumaNodeProcessorMask (static_cast<UCHAR> (aNodeId), &aMask))
+      {
+        continue;
+      }
+
+      NumaNode aNode;
+      aNode.Id = static_cast<int> (aNodeId);
+      for (int aCpu = 0; aCpu < static_cast<int> (sizeof (DWORD_PTR) * 8); ++aCpu)
+      {
+        if ((aMask & aProcessMask & (static_cast<ULONGLONG> (1) << aCpu)) != 0)
+        {
+          aNode.Cpus.push_back (aCpu);
+        }
+      }
+
+      if (!aNode.Cpus.empty())
+      {
+        myNodes.push_back (aNode);
+      }
+    }
+  }
+#else
+  // CPUs outside of the process affinity (e.g. container limits) are skipped
+  cpu_set_t anAllowed;
+  CPU_ZERO (&anAllowed);
+  const bool hasAllowed = sched_getaffinity (0, sizeof (anAllowed), &anAllowed) == 0;
+
+  const std::vector<int> aNodeIds = ParseList (ReadLine ("/sys/devices/system/node/online"));
+  for (size_t anIdx = 0; anIdx < aNodeIds.size(); ++anIdx)
+  {
+    std::stringstream aPath;
+    aPath << "/sys/devices/system/node/node" << aNodeIds[anIdx] << "/cpulist";
+
+    NumaNode aNode;
+    aNode.Id = aNodeIds[anIdx];
+
+    const std::vector<int> aCpus = ParseList (ReadLine (aPath.str()));
+    for (size_t aCpuIdx = 0; aCpuIdx < aCpus.size(); ++aCpuIdx)
+    {
+      if (aCpus[aCpuIdx] < CPU_SETSIZE && (!hasAllowed || CPU_ISSET (aCpus[aCpuIdx], &anAllowed)))
+      {
+        aNode.Cpus.push_back (aCpus[aCpuIdx]);
+      }
+    }
+
+    // Memory-only nodes have no CPUs to pin to
+    if (!aNode.Cpus.empty())
+    {
+      myNodes.push_back (aNode);
+    }
+  }
+#endif
+
+  if (myNodes.empty())
+  {
+    NumaNode aNode;
+    aNode.Id = 0;
+    for (int aCpu = 0; aCpu < std::max (static_cast<int> (std::thread::hardware_concurrency()), 1); ++aCpu)
+    {
+      aNode.Cpus.push_back (aCpu);
+    }
+    myNodes.push_back (aNode);
+  }
+}
+
+//=======================================================================
+//function : NbCpus
+//purpose  :
+//=======================================================================
+int NumaTopology::NbCpus() const
+{
+  int aNbCpus = 0;
+  for (size_t aNodeIdx = 0; aNodeIdx < myNodes.size(); ++aNodeIdx)
+  {
+    aNbCpus += static_cast<int> (myNodes[aNodeIdx].Cpus.size());
+  }
+  return aNbCpus;
+}
+
+//=======================================================================
+//function : NodeOfThread
+//purpose  :
+//=======================================================================
+int NumaTopology::NodeOfThread (int theThreadId, int theNbThreads) const
+{
+  // Thread is mapped to CPU of the same relative position, so that
+  // nodes get numbers of threads in proportion to their CPUs
+  const int aCpu = static_cast<int> (static_cast<int64_t> (theThreadId) * NbCpus() / std::max (theNbThreads, 1));
+
+  int aFirstCpu = 0;
+  for (size_t aNodeIdx = 0; aNodeIdx < myNodes.size(); ++aNodeIdx)
+  {
+    aFirstCpu += static_cast<int> (myNodes[aNodeIdx].Cpus.size());
+    if (aCpu < aFirstCpu)
+    {
+      return static_cast<int> (aNodeIdx);
+    }
+  }
+  return NbNodes() - 1;
+}
+
+//=======================================================================
+//function : PinThread
+//purpose  :
+//=======================================================================
+bool NumaTopology::PinThread (std::thread::native_handle_type theThread, int theNode) const
+{
+#if defined(_WIN32)
+  DWORD_PTR aMask = 0;
+  for (size_t aNodeIdx = 0; aNodeIdx < myNodes.size(); ++aNodeIdx)
+  {
+    if (theNode == -1 || theNode == static_cast<int> (aNodeIdx))
+    {
+      for (size_t aCpuIdx = 0; aCpuIdx < myNodes[aNodeIdx].Cpus.size(); ++aCpuIdx)
+      {
+        aMask |= static_cast<DWORD_PTR> (1) << myNodes[aNodeIdx].Cpus[aCpuIdx];
+      }
+    }
+  }
+  return aMask != 0 && SetThreadAffinityMask (static_cast<HANDLE> (theThread), aMask) != 0;
+#else
+  cpu_set_t aSet;
+  CPU_ZERO (&aSet);
+  for (size_t aNodeIdx = 0; aNodeIdx < myNodes.size(); ++aNodeIdx)
+  {
+    if (theNode == -1 || theNode == static_cast<int> (aNodeIdx))
+    {
+      for (size_t aCpuIdx = 0; aCpuIdx < myNodes[aNodeIdx].Cpus.size(); ++aCpuIdx)
+      {
+        CPU_SET (myNodes[aNodeIdx].Cpus[aCpuIdx], &aSet);
+      }
+    }
+  }
+  return CPU_COUNT (&aSet) > 0 && pthread_setaffinity_np (theThread, sizeof (aSet), &aSet) == 0;
+#endif
+}
+
+//=======================================================================
+//function : PinCurrentThread
+//purpose  :
+//=======================================================================
+bool NumaTopology::PinCurrentThread (int theNode) const
+{
+  SetCurrentNode (theNode);
+#if defined(_WIN32)
+  return PinThread (GetCurrentThread(), theNode);
+#else
+  return PinThread (pthread_self(), theNode);
+#endif
+}
+
+//=======================================================================
+//function : RunOnNode
+//purpose  :
+//=======================================================================
+void NumaTopology::RunOnNode (int theNode, const std::function<void()>& theFunc) const
+{
+  std::thread aThread ([&]()
+  {
+    PinCurrentThread (theNode);
+    theFunc();
+  });
+  aThread.join();
+}
+
+//=======================================================================
+//function : CurrentNode
+//purpose  :
+//=======================================================================
+int NumaTopology::CurrentNode()
+{
+  return THE_CURRENT_NODE;
+}
+
+//=======================================================================
+//function : SetCurrentNode
+//purpose  :
+//=======================================================================
+void NumaTopology::SetCurrentNode (int theNode)
+{
+  THE_CURRENT_NODE = theNode;
+}
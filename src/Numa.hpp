@@ -0,0 +1,63 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+//! NUMA node: CPUs sharing local memory.
+struct NumaNode
+{
+  int              Id;   //!< node number of the OS
+  std::vector<int> Cpus; //!< logical CPUs of the node
+};
+
+//! Topology of NUMA nodes of the machine (detected once) and thread placement helpers.
+//! Memory is placed by the OS on the node of the thread which touches it first, so data
+//! used by pinned threads of one node should be allocated and initialized by them.
+class NumaTopology
+{
+public:
+
+  //! Returns topology of the machine: nodes are read from /sys/devices/system/node (Linux)
+  //! or from GetNumaNodeProcessorMask() (Windows); single node with all CPUs if unknown.
+  static const NumaTopology& Get();
+
+  //! Returns number of nodes.
+  int NbNodes() const { return static_cast<int> (myNodes.size()); }
+
+  //! Returns nodes (indexed from 0, not by OS number).
+  const std::vector<NumaNode>& Nodes() const { return myNodes; }
+
+  //! Returns total number of CPUs.
+  int NbCpus() const;
+
+  //! Returns node of thread theThreadId when theNbThreads threads are spread over nodes
+  //! in proportion to their CPUs (consecutive threads share the node).
+  int NodeOfThread (int theThreadId, int theNbThreads) const;
+
+  //! Restricts thread to CPUs of theNode (all CPUs if theNode is -1). Returns false if not supported.
+  bool PinThread (std::thread::native_handle_type theThread, int theNode) const;
+
+  //! Same as above for the calling thread, which also becomes CurrentNode().
+  bool PinCurrentThread (int theNode) const;
+
+  //! Executes theFunc by temporary thread pinned to theNode, so that memory it
+  //! allocates and writes is placed on that node.
+  void RunOnNode (int theNode, const std::function<void()>& theFunc) const;
+
+  //! Returns node the calling thread is pinned to (-1 if not pinned).
+  static int CurrentNode();
+
+  //! Sets node returned by CurrentNode() for the calling thread (affinity is not changed).
+  static void SetCurrentNode (int theNode);
+
+private:
+
+  //! Detects topology.
+  NumaTopology();
+
+private:
+
+  std::vector<NumaNode> myNodes;
+
+};
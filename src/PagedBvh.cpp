@@ -0,0 +1,442 @@
+#include "PagedBvh.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+  //! Returns size of virtual memory page (queried once), blocks are aligned to it in the file
+  //! so that offsets passed to madvise() and mincore() are page aligned.
+  size_t PageSize()
+  {
+  #if defined(_WIN32)
+    static const size_t THE_PAGE_SIZE = []()
+    {
+      SYSTEM_INFO anInfo;
+      GetSystemInfo (&anInfo);
+      return static_cast<size_t> (anInfo.dwPageSize);
+    }();
+  #else
+    static const size_t THE_PAGE_SIZE = static_cast<size_t> (std::max (sysconf (_SC_PAGESIZE), 4096L));
+  #endif
+    return THE_PAGE_SIZE;
+  }
+
+  //! Number of nearest blocks hinted per ray (farther ones are likely occluded).
+  const int THE_MAX_HINTS_PER_RAY = 4;
+
+  //! Copies subtree of theSrc into block nodes (slot theDst is already allocated)
+  //! keeping children next to each other, leaf triangles are appended in depth-first order.
+  void CopySubtree (const Bvh&                     theBvh,
+                    const std::vector<glm::vec3>&  thePositions,
+                    const std::vector<glm::ivec4>& theTriangles,
+                    int                            theSrc,
+                    int                            theDst,
+                    std::vector<BvhNode>&          theNodes,
+                    std::vector<PagedTriangle>&    theBlockTriangles)
+  {
+    const BvhNode& aSrc = theBvh.Nodes()[theSrc];
+
+    BvhNode& aDst = theNodes[theDst];
+    aDst.Bounds = aSrc.Bounds;
+    aDst.Count  = aSrc.Count;
+
+    if (aSrc.IsLeaf())
+    {
+      aDst.LeftOrFirst = static_cast<int> (theBlockTriangles.size());
+      for (int anIdx = aSrc.LeftOrFirst; anIdx < aSrc.LeftOrFirst + aSrc.Count; ++anIdx)
+      {
+        const int         aTrgIdx   = theBvh.Indices()[anIdx];
+        const glm::ivec4& aTriangle = theTriangles[aTrgIdx];
+
+        const PagedTriangle aPaged = { thePositions[aTriangle.x], thePositions[aTriangle.y], thePositions[aTriangle.z], aTrgIdx };
+        theBlockTriangles.push_back (aPaged);
+      }
+      return;
+    }
+
+    const int aChild = static_cast<int> (theNodes.size());
+    aDst.LeftOrFirst = aChild;
+    theNodes.resize (theNodes.size() + 2);
+
+    CopySubtree (theBvh, thePositions, theTriangles, aSrc.LeftOrFirst,     aChild,     theNodes, theBlockTriangles);
+    CopySubtree (theBvh, thePositions, theTriangles, aSrc.LeftOrFirst + 1, aChild + 1, theNodes, theBlockTriangles);
+  }
+}
+
+//=======================================================================
+//function : PagedBvh
+//purpose  :
+//=======================================================================
+PagedBvh::PagedBvh()
+: myWave (0),
+  myNbPrefetched (0),
+  myFileSize (0),
+  myData (NULL),
+  myFileHandle (NULL),
+  myMapHandle (NULL),
+  myNbNodes (0),
+  myNbReferences (0)
+{
+  //
+}
+
+//=======================================================================
+//function : ~PagedBvh
+//purpose  :
+//=======================================================================
+PagedBvh::~PagedBvh()
+{
+  Clear();
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void PagedBvh::Clear()
+{
+  unmap();
+  if (!myFileName.empty())
+  {
+    std::remove (myFileName.c_str());
+  }
+
+  myTopNodes.clear();
+  myBlocks.clear();
+  myTouched.reset();
+  myHintWave.reset();
+  myFileName.clear();
+  myFileSize     = 0;
+  myNbNodes      = 0;
+  myNbReferences = 0;
+  myNbPrefetched = 0;
+}
+
+//=======================================================================
+//function : Build
+//purpose  :
+//=======================================================================
+bool PagedBvh::Build (const Bvh&                     theBvh,
+                      const std::vector<glm::vec3>&  thePositions,
+                      const std::vector<glm::ivec4>& theTriangles,
+                      const std::string&             theFile,
+                      int                            theBlockSize)
+{
+  Clear();
+  if (theBvh.IsEmpty())
+  {
+    return false;
+  }
+
+  std::ofstream aFile (theFile.c_str(), std::ios::binary | std::ios::trunc);
+  if (!aFile.good())
+  {
+    return false;
+  }
+  myFileName = theFile;
+
+  const size_t aBlockSize = static_cast<size_t> (std::max (theBlockSize, static_cast<int> (sizeof (BvhNode) + sizeof (PagedTriangle))));
+
+  // Top tree is cut where subtree fits into a block; blocks are written in
+  // depth-first order, so that neighbors share file pages
+  std::vector<int> aRoots;
+  theBvh.CutSubtrees (aBlockSize, sizeof (PagedTriangle), myTopNodes, aRoots);
+
+  std::vector<BvhNode>       aBlockNodes;
+  std::vector<PagedTriangle> aBlockTriangles;
+  const size_t               aPageSize = PageSize();
+  const std::vector<char>    aPadding (aPageSize, 0);
+
+  for (size_t aRootIdx = 0; aRootIdx < aRoots.size(); ++aRootIdx)
+  {
+    aBlockNodes.assign (1, BvhNode());
+    aBlockTriangles.clear();
+    CopySubtree (theBvh, thePositions, theTriangles, aRoots[aRootIdx], 0, aBlockNodes, aBlockTriangles);
+
+    PagedBlock aBlock;
+    aBlock.Offset      = myFileSize;
+    aBlock.NbNodes     = static_cast<int> (aBlockNodes.size());
+    aBlock.NbTriangles = static_cast<int> (aBlockTriangles.size());
+    aBlock.Size        = aBlockNodes.size() * sizeof (BvhNode) + aBlockTriangles.size() * sizeof (PagedTriangle);
+
+    aFile.write (reinterpret_cast<const char*> (aBlockNodes.data()), aBlockNodes.size() * sizeof (BvhNode));
+    aFile.write (reinterpret_cast<const char*> (aBlockTriangles.data()), aBlockTriangles.size() * sizeof (PagedTriangle));
+
+    const size_t aPadded = (aBlock.Size + aPageSize - 1) / aPageSize * aPageSize;
+    aFile.write (aPadding.data(), aPadded - aBlock.Size);
+
+    myBlocks.push_back (aBlock);
+    myFileSize     += aPadded;
+    myNbNodes      += aBlock.NbNodes;
+    myNbReferences += aBlock.NbTriangles;
+  }
+
+  aFile.close();
+  if (aFile.fail() || !map())
+  {
+    Clear();
+    return false;
+  }
+
+  myTouched .reset (new std::atomic<uint8_t>[myBlocks.size()]);
+  myHintWave.reset (new std::atomic<uint32_t>[myBlocks.size()]);
+  for (size_t aBlockIdx = 0; aBlockIdx < myBlocks.size(); ++aBlockIdx)
+  {
+    myTouched[aBlockIdx]  = 0;
+    myHintWave[aBlockIdx] = 0;
+  }
+  myWave = 0;
+
+  return true;
+}
+
+//=======================================================================
+//function : map
+//purpose  :
+//=======================================================================
+bool PagedBvh::map()
+{
+#if defined(_WIN32)
+  HANDLE aFile = CreateFileA (myFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+  if (aFile == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  myFileHandle = aFile;
+
+  myMapHandle = CreateFileMappingA (aFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (myMapHandle == NULL)
+  {
+    unmap();
+    return false;
+  }
+
+  myData = static_cast<const uint8_t*> (MapViewOfFile (myMapHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+  const int aFile = open (myFileName.c_str(), O_RDONLY);
+  if (aFile < 0)
+  {
+    return false;
+  }
+  myFileHandle = reinterpret_cast<void*> (static_cast<intptr_t> (aFile) + 1);
+
+  void* aData = mmap (NULL, myFileSize, PROT_READ, MAP_SHARED, aFile, 0);
+  myData = aData != MAP_FAILED ? static_cast<const uint8_t*> (aData) : NULL;
+#endif
+
+  if (myData == NULL)
+  {
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+//=======================================================================
+//function : unmap
+//purpose  :
+//=======================================================================
+void PagedBvh::unmap()
+{
+#if defined(_WIN32)
+  if (myData != NULL)
+  {
+    UnmapViewOfFile (myData);
+  }
+  if (myMapHandle != NULL)
+  {
+    CloseHandle (myMapHandle);
+  }
+  if (myFileHandle != NULL)
+  {
+    CloseHandle (myFileHandle);
+  }
+#else
+  if (myData != NULL)
+  {
+    munmap (const_cast<uint8_t*> (myData), myFileSize);
+  }
+  if (myFileHandle != NULL)
+  {
+    close (static_cast<int> (reinterpret_cast<intptr_t> (myFileHandle) - 1));
+  }
+#endif
+
+  myData       = NULL;
+  myMapHandle  = NULL;
+  myFileHandle = NULL;
+}
+
+//=======================================================================
+//function : PrefetchArenaSize
+//purpose  :
+//=======================================================================
+size_t PagedBvh::PrefetchArenaSize (int theNbRays)
+{
+  return Arena::Footprint<int> (static_cast<size_t> (theNbRays) * THE_MAX_HINTS_PER_RAY);
+}
+
+//=======================================================================
+//function : Prefetch
+//purpose  :
+//=======================================================================
+void PagedBvh::Prefetch (const Ray* theRays, int theNbRays, Arena& theArena) const
+{
+  if (myData == NULL)
+  {
+    return;
+  }
+
+  ArenaScope anArenaScope (theArena);
+
+  int* aHinted   = theArena.Allocate<int> (static_cast<size_t> (theNbRays) * THE_MAX_HINTS_PER_RAY);
+  int  aNbHinted = 0;
+  for (int aRayIdx = 0; aRayIdx < theNbRays; ++aRayIdx)
+  {
+    const Ray& aRay = theRays[aRayIdx];
+    const glm::vec3 anInvDir (1.f / aRay.Direction.x,
+                              1.f / aRay.Direction.y,
+                              1.f / aRay.Direction.z);
+
+    int aNbHints = 0;
+    auto aBlockFunc = [&](int theBlock, int, float&) -> bool
+    {
+      aHinted[aNbHinted++] = theBlock;
+      return ++aNbHints >= THE_MAX_HINTS_PER_RAY;
+    };
+
+    float aTmax = aRay.Tmax;
+    Bvh::TraverseNodes (myTopNodes.data(), 0, aRay, anInvDir, aTmax, aBlockFunc, NULL);
+  }
+
+  std::sort (aHinted, aHinted + aNbHinted);
+  aNbHinted = static_cast<int> (std::unique (aHinted, aHinted + aNbHinted) - aHinted);
+
+  const uint32_t aWave = myWave;
+  for (int anIdx = 0; anIdx < aNbHinted; ++anIdx)
+  {
+    const int aBlockIdx = aHinted[anIdx];
+
+    uint32_t aLast = myHintWave[aBlockIdx].load (std::memory_order_relaxed);
+    if (aLast == aWave || !myHintWave[aBlockIdx].compare_exchange_strong (aLast, aWave))
+    {
+      continue;
+    }
+
+    ++myNbPrefetched;
+  #if !defined(_WIN32)
+    const PagedBlock& aBlock = myBlocks[aBlockIdx];
+    madvise (const_cast<uint8_t*> (myData) + aBlock.Offset, aBlock.Size, MADV_WILLNEED);
+  #endif
+  }
+}
+
+//=======================================================================
+//function : ReleasePages
+//purpose  :
+//=======================================================================
+void PagedBvh::ReleasePages() const
+{
+  if (myData == NULL)
+  {
+    return;
+  }
+
+#if defined(_WIN32)
+  // Unlocking pages which are not locked removes them from the working set
+  VirtualUnlock (const_cast<uint8_t*> (myData), myFileSize);
+#else
+  madvise (const_cast<uint8_t*> (myData), myFileSize, MADV_DONTNEED);
+  #if defined(POSIX_FADV_DONTNEED)
+  posix_fadvise (static_cast<int> (reinterpret_cast<intptr_t> (myFileHandle) - 1), 0, 0, POSIX_FADV_DONTNEED);
+  #endif
+#endif
+}
+
+//=======================================================================
+//function : Stats
+//purpose  :
+//=======================================================================
+PagingStats PagedBvh::Stats() const
+{
+  PagingStats aStats;
+  aStats.NbBlocks     = static_cast<int> (myBlocks.size());
+  aStats.NbPrefetched = myNbPrefetched;
+  for (size_t aBlockIdx = 0; aBlockIdx < myBlocks.size(); ++aBlockIdx)
+  {
+    if (myTouched[aBlockIdx].load (std::memory_order_relaxed) != 0)
+    {
+      ++aStats.NbTouched;
+      aStats.TouchedBytes += myBlocks[aBlockIdx].Size;
+    }
+  }
+
+  aStats.ResidentBytes = ResidentBytes();
+  return aStats;
+}
+
+//=======================================================================
+//function : ResidentBytes
+//purpose  :
+//=======================================================================
+size_t PagedBvh::ResidentBytes() const
+{
+  size_t aBytes = 0;
+#if !defined(_WIN32)
+  if (myData == NULL)
+  {
+    return 0;
+  }
+
+  // The file is queried in spans, so that the page map fits on the stack
+  const size_t aPageSize = PageSize();
+  unsigned char aPages[4096];
+  for (size_t anOffset = 0; anOffset < myFileSize; anOffset += sizeof (aPages) * aPageSize)
+  {
+    const size_t aSpan = std::min (myFileSize - anOffset, sizeof (aPages) * aPageSize);
+  #if defined(__APPLE__)
+    const int aResult = mincore (const_cast<uint8_t*> (myData) + anOffset, aSpan, reinterpret_cast<char*> (aPages));
+  #else
+    const int aResult = mincore (const_cast<uint8_t*> (myData) + anOffset, aSpan, aPages);
+  #endif
+    if (aResult != 0)
+    {
+      return 0;
+    }
+
+    for (size_t aPage = 0; aPage < (aSpan + aPageSize - 1) / aPageSize; ++aPage)
+    {
+      aBytes += (aPages[aPage] & 1) != 0 ? aPageSize : 0;
+    }
+  }
+#endif
+  return aBytes;
+}
+
+//=======================================================================
+//function : ResetStats
+//purpose  :
+//=======================================================================
+void PagedBvh::ResetStats()
+{
+  for (size_t aBlockIdx = 0; aBlockIdx < myBlocks.size(); ++aBlockIdx)
+  {
+    myTouched[aBlockIdx] = 0;
+  }
+  myNbPrefetched = 0;
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Bvh.hpp"
+
+//! Triangle stored in paged block: vertices copied in traversal order and scene index (40 bytes).
+struct PagedTriangle
+{
+  glm::vec3 P0;
+  glm::vec3 P1;
+  glm::vec3 P2;
+  int       Index; //!< triangle index in the scene
+};
+
+//! Subtree of paged BVH stored as single block of the file.
+struct PagedBlock
+{
+  size_t Offset;      //!< offset in the file (page aligned)
+  size_t Size;        //!< size of nodes and triangles in bytes
+  int    NbNodes;     //!< nodes of the subtree (root first), followed by triangles
+  int    NbTriangles; //!< triangle references of the subtree
+};
+
+//! Page access statistics of paged BVH.
+struct PagingStats
+{
+  int      NbBlocks;     //!< number of blocks
+  int      NbTouched;    //!< blocks traversed since the last ResetStats()
+  size_t   TouchedBytes; //!< size of touched blocks
+  size_t   ResidentBytes; //!< mapped bytes currently in RAM (0 if the query is not supported)
+  uint64_t NbPrefetched; //!< prefetch hints issued since the last ResetStats()
+
+  PagingStats() : NbBlocks (0), NbTouched (0), TouchedBytes (0), ResidentBytes (0), NbPrefetched (0) {}
+};
+
+//! Out-of-core BVH. The binary hierarchy is cut into subtrees of limited size, which are
+//! written together with copies of their triangles into a file in depth-first order and
+//! memory-mapped read-only; only the small top tree over the subtree blocks and the block
+//! table stay in RAM. Pages are read by the OS on first access and may be dropped under
+//! memory pressure, so scenes larger than RAM render slower instead of failing.
+//! Ray queues may hint blocks in advance (Prefetch()), so that reads are issued together.
+class PagedBvh
+{
+public:
+
+  //! Default size limit of the block in bytes.
+  static const int DefaultBlockSize = 64 * 1024;
+
+  //! Creates empty hierarchy.
+  PagedBvh();
+
+  //! Unmaps the file.
+  ~PagedBvh();
+
+  //! Cuts theBvh built over theTriangles into blocks of up to theBlockSize bytes, writes
+  //! them into theFile and maps it. Returns false if the file can't be written or mapped
+  //! (the hierarchy stays empty).
+  bool Build (const Bvh&                     theBvh,
+              const std::vector<glm::vec3>&  thePositions,
+              const std::vector<glm::ivec4>& theTriangles,
+              const std::string&             theFile,
+              int                            theBlockSize = DefaultBlockSize);
+
+  //! Unmaps and removes the file.
+  void Clear();
+
+  //! Returns true if hierarchy is empty.
+  bool IsEmpty() const { return myTopNodes.empty(); }
+
+  //! Returns nodes of the top tree (leaves reference single block).
+  const std::vector<BvhNode>& TopNodes() const { return myTopNodes; }
+
+  //! Returns block table.
+  const std::vector<PagedBlock>& Blocks() const { return myBlocks; }
+
+  //! Returns bounds of the whole hierarchy.
+  Box Bounds() const { return myTopNodes.empty() ? Box() : myTopNodes[0].Bounds; }
+
+  //! Returns number of nodes in all blocks.
+  int NbNodes() const { return myNbNodes; }
+
+  //! Returns number of triangle references in all blocks.
+  int NbReferences() const { return myNbReferences; }
+
+  //! Returns size of the top tree and block table kept in RAM.
+  size_t MemorySize() const { return myTopNodes.size() * sizeof (BvhNode) + myBlocks.size() * sizeof (PagedBlock); }
+
+  //! Returns size of the mapped file.
+  size_t FileSize() const { return myFileSize; }
+
+  //! Returns name of the mapped file.
+  const std::string& FileName() const { return myFileName; }
+
+  //! Starts new wave of prefetch hints: each block is hinted at most once per wave.
+  void BeginPrefetch() const { ++myWave; }
+
+  //! Finds blocks crossed by the rays and asks the OS to read them in advance
+  //! (madvise(MADV_WILLNEED); no-op on Windows). Thread-safe, scratch is taken from theArena.
+  void Prefetch (const Ray* theRays, int theNbRays, Arena& theArena) const;
+
+  //! Returns bytes of arena taken by Prefetch() of theNbRays rays.
+  static size_t PrefetchArenaSize (int theNbRays);
+
+  //! Drops resident pages of the file (they are read again on next access).
+  void ReleasePages() const;
+
+  //! Returns mapped bytes currently in RAM (0 if the query is not supported). Doesn't allocate.
+  size_t ResidentBytes() const;
+
+  //! Returns page access statistics.
+  PagingStats Stats() const;
+
+  //! Resets touched blocks and prefetch counter.
+  void ResetStats();
+
+public:
+
+  //! Traverses the hierarchy in front-to-back order. For each reached leaf calls
+  //! theLeaf (theTriangles, theCount, theTmax), which may shorten theTmax on hit and
+  //! returns true to terminate traversal. Visited nodes and blocks are counted into theStats (optional).
+  template<class LeafFunc>
+  void Traverse (const Ray& theRay, float& theTmax, LeafFunc& theLeaf, TraversalStats* theStats = NULL) const
+  {
+    if (myTopNodes.empty())
+    {
+      return;
+    }
+
+    const glm::vec3 anInvDir (1.f / theRay.Direction.x,
+                              1.f / theRay.Direction.y,
+                              1.f / theRay.Direction.z);
+
+    auto aBlockFunc = [&](int theBlock, int, float& theBlockTmax) -> bool
+    {
+      return traverseBlock (theBlock, theRay, anInvDir, theBlockTmax, theLeaf, theStats);
+    };
+
+    Bvh::TraverseNodes (myTopNodes.data(), 0, theRay, anInvDir, theTmax, aBlockFunc, theStats);
+  }
+
+  //! Traverses single block (leaf of the top tree) like Traverse().
+  template<class LeafFunc>
+  void TraverseBlock (int theBlock, const Ray& theRay, float& theTmax, LeafFunc& theLeaf, TraversalStats* theStats = NULL) const
+  {
+    const glm::vec3 anInvDir (1.f / theRay.Direction.x,
+                              1.f / theRay.Direction.y,
+                              1.f / theRay.Direction.z);
+
+    traverseBlock (theBlock, theRay, anInvDir, theTmax, theLeaf, theStats);
+  }
+
+private:
+
+  //! Traverses nodes of theBlock marking it as touched.
+  //! Returns true if traversal was terminated by theLeaf.
+  template<class LeafFunc>
+  bool traverseBlock (int              theBlock,
+                      const Ray&       theRay,
+                      const glm::vec3& theInvDir,
+                      float&           theTmax,
+                      LeafFunc&        theLeaf,
+                      TraversalStats*  theStats) const
+  {
+    const PagedBlock& aBlock = myBlocks[theBlock];
+    if (myTouched[theBlock].load (std::memory_order_relaxed) == 0)
+    {
+      myTouched[theBlock].store (1, std::memory_order_relaxed);
+    }
+    if (theStats != NULL)
+    {
+      ++theStats->NbBlocks;
+    }
+
+    const BvhNode*       aNodes     = reinterpret_cast<const BvhNode*> (myData + aBlock.Offset);
+    const PagedTriangle* aTriangles = reinterpret_cast<const PagedTriangle*> (aNodes + aBlock.NbNodes);
+
+    auto aLeafFunc = [&](int theFirst, int theCount, float& theLeafTmax) -> bool
+    {
+      if (theStats != NULL)
+      {
+        theStats->NbPrimitives += theCount;
+      }
+      return theLeaf (aTriangles + theFirst, theCount, theLeafTmax);
+    };
+
+    return Bvh::TraverseNodes (aNodes, 0, theRay, theInvDir, theTmax, aLeafFunc, theStats);
+  }
+
+  //! Maps the written file, returns false on error.
+  bool map();
+
+  //! Unmaps the file.
+  void unmap();
+
+private:
+
+  PagedBvh (const PagedBvh&);
+  PagedBvh& operator= (const PagedBvh&);
+
+private:
+
+  std::vector<BvhNode>    myTopNodes; //!< top tree, leaf LeftOrFirst is block index
+  std::vector<PagedBlock> myBlocks;
+
+  std::unique_ptr<std::atomic<uint8_t>[]>  myTouched;  //!< blocks traversed since ResetStats()
+  std::unique_ptr<std::atomic<uint32_t>[]> myHintWave; //!< wave of the last prefetch hint of each block
+  mutable std::atomic<uint32_t>            myWave;
+  mutable std::atomic<uint64_t>            myNbPrefetched;
+
+  std::string    myFileName;
+  size_t         myFileSize;
+  const uint8_t* myData;       //!< mapped file
+  void*          myFileHandle; //!< file and mapping handles (Windows)
+  void*          myMapHandle;
+  int            myNbNodes;
+  int            myNbReferences;
+
+};
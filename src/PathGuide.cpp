@@ -0,0 +1,502 @@
+#include "PathGuide.hpp"
+
+#include "Arena.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
+namespace
+{
+  const float THE_PI = 3.14159265358979f;
+
+  //! Depth of spatial tree addressed by Morton code (21 bits per axis).
+  const int THE_MAX_SPATIAL_DEPTH = 63;
+
+  //! Spreads lower 21 bits of value to every third bit.
+  inline uint64_t SpreadBits3 (uint64_t theValue)
+  {
+    theValue &= 0x1fffff;
+    theValue = (theValue | theValue << 32) & 0x1f00000000ffffull;
+    theValue = (theValue | theValue << 16) & 0x1f0000ff0000ffull;
+    theValue = (theValue | theValue << 8)  & 0x100f00f00f00f00full;
+    theValue = (theValue | theValue << 4)  & 0x10c30c30c30c30c3ull;
+    theValue = (theValue | theValue << 2)  & 0x1249249249249249ull;
+    return theValue;
+  }
+
+  //! Atomically adds value to float (compare-and-swap loop over its bits).
+  inline void AtomicAdd (float& theTarget, float theValue)
+  {
+#if defined(_MSC_VER)
+    volatile long* aBits = reinterpret_cast<volatile long*> (&theTarget);
+    long anOld = *aBits;
+    for (;;)
+    {
+      float anOldValue;
+      std::memcpy (&anOldValue, &anOld, sizeof (float));
+
+      const float aNewValue = anOldValue + theValue;
+      long aNew;
+      std::memcpy (&aNew, &aNewValue, sizeof (float));
+
+      const long aPrev = _InterlockedCompareExchange (aBits, aNew, anOld);
+      if (aPrev == anOld)
+      {
+        return;
+      }
+      anOld = aPrev;
+    }
+#else
+    uint32_t* aBits = reinterpret_cast<uint32_t*> (&theTarget);
+    uint32_t anOld = __atomic_load_n (aBits, __ATOMIC_RELAXED);
+    for (;;)
+    {
+      float anOldValue;
+      std::memcpy (&anOldValue, &anOld, sizeof (float));
+
+      const float aNewValue = anOldValue + theValue;
+      uint32_t aNew;
+      std::memcpy (&aNew, &aNewValue, sizeof (float));
+
+      if (__atomic_compare_exchange_n (aBits, &anOld, aNew, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      {
+        return;
+      }
+    }
+#endif
+  }
+
+  //! Atomically increments counter.
+  inline void AtomicIncrement (uint32_t& theCounter)
+  {
+#if defined(_MSC_VER)
+    _InterlockedIncrement (reinterpret_cast<volatile long*> (&theCounter));
+#else
+    __atomic_fetch_add (&theCounter, 1u, __ATOMIC_RELAXED);
+#endif
+  }
+
+  //! Maps unit direction to unit square (cylindrical coordinates).
+  inline glm::vec2 DirectionToSquare (const glm::vec3& theDir)
+  {
+    const float aCosTheta = std::min (std::max (theDir.z, -1.f), 1.f);
+
+    float aPhi = std::atan2 (theDir.y, theDir.x);
+    aPhi = aPhi < 0.f ? aPhi + 2.f * THE_PI : aPhi;
+
+    return glm::vec2 ((aCosTheta + 1.f) * 0.5f, std::min (aPhi / (2.f * THE_PI), 0.99999994f));
+  }
+
+  //! Maps point of unit square to unit direction.
+  inline glm::vec3 SquareToDirection (const glm::vec2& thePoint)
+  {
+    const float aCosTheta = 2.f * thePoint.x - 1.f;
+    const float aSinTheta = std::sqrt (std::max (1.f - aCosTheta * aCosTheta, 0.f));
+    const float aPhi      = 2.f * THE_PI * thePoint.y;
+
+    return glm::vec3 (aSinTheta * std::cos (aPhi), aSinTheta * std::sin (aPhi), aCosTheta);
+  }
+
+  //! Chooses one of two options with the given weights by random number,
+  //! returns 0 or 1 and rescales the number to [0, 1).
+  inline int SelectHalf (float theWeight0, float theWeight1, float& theRnd)
+  {
+    const float aTotal = theWeight0 + theWeight1;
+    const float aProb0 = aTotal > 0.f ? theWeight0 / aTotal : 0.5f;
+    if (theRnd < aProb0)
+    {
+      theRnd = std::min (theRnd / aProb0, 0.99999994f);
+      return 0;
+    }
+
+    theRnd = std::min ((theRnd - aProb0) / (1.f - aProb0), 0.99999994f);
+    return 1;
+  }
+}
+
+//=======================================================================
+//function : GuideQuadtree
+//purpose  :
+//=======================================================================
+GuideQuadtree::GuideQuadtree()
+: myNbSamples (0)
+{
+  const Node aRoot = { { 0.f, 0.f, 0.f, 0.f }, { 0, 0, 0, 0 } };
+  myNodes.push_back (aRoot);
+}
+
+//=======================================================================
+//function : Pdf
+//purpose  :
+//=======================================================================
+float GuideQuadtree::Pdf (glm::vec2 thePoint) const
+{
+  float aPdf = 1.f;
+  for (int aNodeIdx = 0;;)
+  {
+    const Node& aNode = myNodes[aNodeIdx];
+
+    const float aTotal = aNode.Sum[0] + aNode.Sum[1] + aNode.Sum[2] + aNode.Sum[3];
+    if (aTotal <= 0.f)
+    {
+      return 0.f;
+    }
+
+    const int aQx = thePoint.x >= 0.5f ? 1 : 0;
+    const int aQy = thePoint.y >= 0.5f ? 1 : 0;
+    const int aQuadrant = aQx + 2 * aQy;
+
+    aPdf *= 4.f * aNode.Sum[aQuadrant] / aTotal;
+    if (aNode.Child[aQuadrant] == 0 || aPdf <= 0.f)
+    {
+      return aPdf;
+    }
+
+    thePoint = thePoint * 2.f - glm::vec2 (static_cast<float> (aQx), static_cast<float> (aQy));
+    aNodeIdx = aNode.Child[aQuadrant];
+  }
+}
+
+//=======================================================================
+//function : Sample
+//purpose  :
+//=======================================================================
+glm::vec2 GuideQuadtree::Sample (glm::vec2 theRnd, float& thePdf) const
+{
+  glm::vec2 anOrigin (0.f);
+  float     aSize = 1.f;
+  thePdf = 1.f;
+  for (int aNodeIdx = 0;;)
+  {
+    const Node& aNode = myNodes[aNodeIdx];
+
+    // Column by marginal energy, then row within the column
+    const int aQx = SelectHalf (aNode.Sum[0] + aNode.Sum[2], aNode.Sum[1] + aNode.Sum[3], theRnd.x);
+    const int aQy = SelectHalf (aNode.Sum[aQx], aNode.Sum[aQx + 2], theRnd.y);
+    const int aQuadrant = aQx + 2 * aQy;
+
+    thePdf *= 4.f * aNode.Sum[aQuadrant] / (aNode.Sum[0] + aNode.Sum[1] + aNode.Sum[2] + aNode.Sum[3]);
+    aSize  *= 0.5f;
+    anOrigin += glm::vec2 (static_cast<float> (aQx), static_cast<float> (aQy)) * aSize;
+    if (aNode.Child[aQuadrant] == 0)
+    {
+      return anOrigin + theRnd * aSize;
+    }
+
+    aNodeIdx = aNode.Child[aQuadrant];
+  }
+}
+
+//=======================================================================
+//function : Add
+//purpose  :
+//=======================================================================
+void GuideQuadtree::Add (glm::vec2 thePoint, float theValue)
+{
+  for (int aNodeIdx = 0;;)
+  {
+    Node& aNode = myNodes[aNodeIdx];
+
+    const int aQx = thePoint.x >= 0.5f ? 1 : 0;
+    const int aQy = thePoint.y >= 0.5f ? 1 : 0;
+    const int aQuadrant = aQx + 2 * aQy;
+
+    AtomicAdd (aNode.Sum[aQuadrant], theValue);
+    if (aNode.Child[aQuadrant] == 0)
+    {
+      return;
+    }
+
+    thePoint = thePoint * 2.f - glm::vec2 (static_cast<float> (aQx), static_cast<float> (aQy));
+    aNodeIdx = aNode.Child[aQuadrant];
+  }
+}
+
+//=======================================================================
+//function : CountSample
+//purpose  :
+//=======================================================================
+void GuideQuadtree::CountSample()
+{
+  AtomicIncrement (myNbSamples);
+}
+
+//=======================================================================
+//function : Refine
+//purpose  :
+//=======================================================================
+void GuideQuadtree::Refine (const GuideQuadtree& theSource, float theThreshold, int theMaxDepth)
+{
+  myNodes.clear();
+  myNbSamples = 0;
+
+  const Node aRoot = { { 0.f, 0.f, 0.f, 0.f }, { 0, 0, 0, 0 } };
+  myNodes.push_back (aRoot);
+
+  const float aTotal = theSource.Total();
+  if (aTotal > 0.f)
+  {
+    refineNode (theSource, 0, 0.f, 0, aTotal, theThreshold, 1, theMaxDepth);
+  }
+}
+
+//=======================================================================
+//function : refineNode
+//purpose  :
+//=======================================================================
+void GuideQuadtree::refineNode (const GuideQuadtree& theSource, int theSourceNode, float theEnergy, int theTarget,
+                                float theTotal, float theThreshold, int theDepth, int theMaxDepth)
+{
+  if (theDepth >= theMaxDepth)
+  {
+    return;
+  }
+
+  for (int aQuadrant = 0; aQuadrant < 4; ++aQuadrant)
+  {
+    // Quadrants without recorded children are assumed to have uniform energy
+    const Node* aSource = theSourceNode >= 0 ? &theSource.myNodes[theSourceNode] : NULL;
+    const float anEnergy = aSource != NULL ? aSource->Sum[aQuadrant] : theEnergy * 0.25f;
+    if (anEnergy <= theThreshold * theTotal)
+    {
+      continue;
+    }
+
+    const int aChild = static_cast<int> (myNodes.size());
+    const Node aNode = { { 0.f, 0.f, 0.f, 0.f }, { 0, 0, 0, 0 } };
+    myNodes.push_back (aNode);
+    myNodes[theTarget].Child[aQuadrant] = aChild;
+
+    const int aSourceChild = aSource != NULL && aSource->Child[aQuadrant] != 0 ? aSource->Child[aQuadrant] : -1;
+    refineNode (theSource, aSourceChild, anEnergy, aChild, theTotal, theThreshold, theDepth + 1, theMaxDepth);
+  }
+}
+
+//=======================================================================
+//function : PathGuide
+//purpose  :
+//=======================================================================
+PathGuide::PathGuide()
+: myOrigin (0.f),
+  myInvSize (1.f),
+  myIteration (0),
+  myNbPasses (0),
+  myNbSampled (0)
+{
+  //
+}
+
+//=======================================================================
+//function : Reset
+//purpose  :
+//=======================================================================
+void PathGuide::Reset (const Box& theBounds)
+{
+  myNodes.clear();
+  myLeaves.clear();
+
+  myIteration = 0;
+  myNbPasses  = 0;
+  myNbSampled = 0;
+  if (!theBounds.IsValid())
+  {
+    return;
+  }
+
+  // Cube around the scene, slightly enlarged to contain offset points
+  const glm::vec3 aSize = theBounds.Size();
+  const float anEdge = std::max (std::max (aSize.x, aSize.y), std::max (aSize.z, 1.0e-4f)) * 1.01f;
+
+  myOrigin  = theBounds.Center() - glm::vec3 (anEdge * 0.5f);
+  myInvSize = 1.f / anEdge;
+
+  const SpatialNode aRoot = { -1, 0, 0 };
+  myNodes.push_back (aRoot);
+
+  myLeaves.push_back (Leaf());
+}
+
+//=======================================================================
+//function : NbDirectionalNodes
+//purpose  :
+//=======================================================================
+int PathGuide::NbDirectionalNodes() const
+{
+  int aNbNodes = 0;
+  for (size_t aLeaf = 0; aLeaf < myLeaves.size(); ++aLeaf)
+  {
+    for (int anOrient = 0; anOrient < NbOrientations; ++anOrient)
+    {
+      aNbNodes += myLeaves[aLeaf].Sampling[anOrient].NbNodes();
+    }
+  }
+  return aNbNodes;
+}
+
+//=======================================================================
+//function : MemorySize
+//purpose  :
+//=======================================================================
+size_t PathGuide::MemorySize() const
+{
+  size_t aSize = myNodes.size() * sizeof (SpatialNode) + myLeaves.size() * sizeof (Leaf);
+  for (size_t aLeaf = 0; aLeaf < myLeaves.size(); ++aLeaf)
+  {
+    for (int anOrient = 0; anOrient < NbOrientations; ++anOrient)
+    {
+      aSize += myLeaves[aLeaf].Sampling[anOrient].MemorySize() + myLeaves[aLeaf].Recording[anOrient].MemorySize();
+    }
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : FindLeaf
+//purpose  :
+//=======================================================================
+int PathGuide::FindLeaf (const glm::vec3& thePoint) const
+{
+  const glm::vec3 aPoint = glm::clamp ((thePoint - myOrigin) * myInvSize, glm::vec3 (0.f), glm::vec3 (0.99999994f)) * 2097152.f;
+
+  // Split axis cycles with depth, so the path from the root follows bits of the Morton code
+  // (interleaved from the highest) and no coordinate is rescaled along the way
+  const uint64_t aCode = (SpreadBits3 (static_cast<uint64_t> (aPoint.x)) << 2)
+                       | (SpreadBits3 (static_cast<uint64_t> (aPoint.y)) << 1)
+                       |  SpreadBits3 (static_cast<uint64_t> (aPoint.z));
+
+  int aNodeIdx = 0;
+  for (int aBit = THE_MAX_SPATIAL_DEPTH - 1; myNodes[aNodeIdx].Axis >= 0; --aBit)
+  {
+    aNodeIdx = myNodes[aNodeIdx].Index + static_cast<int> ((aCode >> aBit) & 1);
+  }
+
+  return myNodes[aNodeIdx].Index;
+}
+
+//=======================================================================
+//function : Sample
+//purpose  :
+//=======================================================================
+glm::vec3 PathGuide::Sample (int theTree, const glm::vec2& theRnd, float& thePdf) const
+{
+  const GuideQuadtree& aTree = sampling (theTree);
+
+  const glm::vec2 aPoint = aTree.Sample (theRnd, thePdf);
+
+  // Cylindrical mapping has constant Jacobian 4 pi
+  thePdf *= 1.f / (4.f * THE_PI);
+  return SquareToDirection (aPoint);
+}
+
+//=======================================================================
+//function : Pdf
+//purpose  :
+//=======================================================================
+float PathGuide::Pdf (int theTree, const glm::vec3& theDirection) const
+{
+  return sampling (theTree).Pdf (DirectionToSquare (theDirection)) * (1.f / (4.f * THE_PI));
+}
+
+//=======================================================================
+//function : Record
+//purpose  :
+//=======================================================================
+void PathGuide::Record (int theTree, const glm::vec3& theDirection, float theValue)
+{
+  GuideQuadtree& aTree = myLeaves[theTree / NbOrientations].Recording[theTree % NbOrientations];
+
+  aTree.CountSample();
+  if (theValue > 0.f && theValue < FLT_MAX)
+  {
+    aTree.Add (DirectionToSquare (theDirection), theValue);
+  }
+}
+
+//=======================================================================
+//function : FinishPass
+//purpose  :
+//=======================================================================
+bool PathGuide::FinishPass (ThreadPool& thePool)
+{
+  if (!IsLearning()
+   || ++myNbPasses < iterationPasses())
+  {
+    return false;
+  }
+
+  // Distribution changes only if either the old or the new iteration is sampled
+  const bool wasTrained = IsTrained();
+  finishIteration (thePool);
+  return wasTrained || IsTrained();
+}
+
+//=======================================================================
+//function : finishIteration
+//purpose  :
+//=======================================================================
+void PathGuide::finishIteration (ThreadPool& thePool)
+{
+  // Trees are refined by training, their growth is not transient data of the pass
+  AllocationCounter::Ignore anIgnore;
+
+  // Split leaves with many samples, children inherit directional trees
+  // (new nodes are appended, so they are visited and split again if still needed)
+  const float aThreshold = myParams.SpatialThreshold * std::sqrt (static_cast<float> (iterationPasses()));
+  for (size_t aNodeIdx = 0; aNodeIdx < myNodes.size(); ++aNodeIdx)
+  {
+    if (myNodes[aNodeIdx].Axis >= 0
+     || myNodes[aNodeIdx].Depth >= THE_MAX_SPATIAL_DEPTH
+     || myLeaves[myNodes[aNodeIdx].Index].NbSamples() <= aThreshold)
+    {
+      continue;
+    }
+
+    // Each child is assumed to receive half of the samples
+    const int aLeafIdx = myNodes[aNodeIdx].Index;
+    for (int anOrient = 0; anOrient < NbOrientations; ++anOrient)
+    {
+      GuideQuadtree& aTree = myLeaves[aLeafIdx].Recording[anOrient];
+      aTree.SetNbSamples (aTree.NbSamples() / 2);
+    }
+    myLeaves.push_back (myLeaves[aLeafIdx]);
+
+    const int aFirstChild = static_cast<int> (myNodes.size());
+    const int aDepth = myNodes[aNodeIdx].Depth;
+    const SpatialNode aLeft  = { -1, aLeafIdx, aDepth + 1 };
+    const SpatialNode aRight = { -1, static_cast<int> (myLeaves.size()) - 1, aDepth + 1 };
+    myNodes.push_back (aLeft);
+    myNodes.push_back (aRight);
+
+    myNodes[aNodeIdx].Axis  = aDepth % 3;
+    myNodes[aNodeIdx].Index = aFirstChild;
+  }
+
+  // Recorded energy becomes the sampled distribution, recording starts over on refined trees
+  thePool.ParallelFor (static_cast<int> (myLeaves.size()), [&](int theLeaf, int)
+  {
+    AllocationCounter::Ignore anIgnore;
+
+    Leaf& aLeaf = myLeaves[theLeaf];
+    for (int anOrient = 0; anOrient < NbOrientations; ++anOrient)
+    {
+      aLeaf.Sampling[anOrient] = aLeaf.Recording[anOrient];
+      aLeaf.Recording[anOrient].Refine (aLeaf.Sampling[anOrient], myParams.FluxThreshold, myParams.MaxDepth);
+    }
+  });
+
+  myNbSampled = 0;
+  for (int aTree = 0; aTree < static_cast<int> (myLeaves.size()) * NbOrientations; ++aTree)
+  {
+    myNbSampled += CanSample (aTree) ? 1 : 0;
+  }
+
+  ++myIteration;
+  myNbPasses = 0;
+}
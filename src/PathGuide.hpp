@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.hpp"
+
+class ThreadPool;
+
+//! Parameters of path guiding.
+struct GuidingParams
+{
+  float BsdfFraction;     //!< probability of sampling BSDF instead of the learned distribution
+  int   NbIterations;     //!< learning iterations (iteration i > 0 takes 2^(i-1) passes), distribution is fixed afterwards
+  float SpatialThreshold; //!< spatial leaf is split when it receives more than c * sqrt (passes of iteration) samples
+  float FluxThreshold;    //!< directional cell is subdivided when its share of energy exceeds this value
+  int   MaxDepth;         //!< maximum depth of directional quadtrees
+  int   MinSamples;       //!< directional tree is sampled only after learning from this number of samples
+
+  GuidingParams() : BsdfFraction (0.7f), NbIterations (9), SpatialThreshold (1000.f), FluxThreshold (0.02f), MaxDepth (16), MinSamples (1000) {}
+};
+
+//! Vertex of path kept until the path is finished, so that radiance
+//! arriving along the sampled direction can be recorded.
+struct GuideVertex
+{
+  glm::vec3 Direction;  //!< sampled direction
+  glm::vec3 Throughput; //!< path throughput after scattering at the vertex
+  glm::vec3 Incident;   //!< contributions of the path gathered after the vertex
+  float     Pdf;        //!< density of sampling the direction
+  int       Tree;       //!< directional tree of the vertex (PathGuide::FindTree())
+};
+
+//! Quadtree over directions in cylindrical coordinates (cos theta, phi),
+//! an area-preserving mapping of the sphere to the unit square.
+//! Each node keeps energy of its four quadrants; empty child index marks leaf quadrant.
+class GuideQuadtree
+{
+public:
+
+  //! Creates tree with single node of empty quadrants.
+  GuideQuadtree();
+
+  //! Returns total energy.
+  float Total() const { return myNodes[0].Sum[0] + myNodes[0].Sum[1] + myNodes[0].Sum[2] + myNodes[0].Sum[3]; }
+
+  //! Returns number of nodes.
+  int NbNodes() const { return static_cast<int> (myNodes.size()); }
+
+  //! Returns size of nodes in bytes.
+  size_t MemorySize() const { return myNodes.size() * sizeof (Node); }
+
+  //! Returns number of recorded samples (including ones without energy).
+  uint32_t NbSamples() const { return myNbSamples; }
+
+  //! Sets number of recorded samples.
+  void SetNbSamples (uint32_t theNbSamples) { myNbSamples = theNbSamples; }
+
+  //! Counts recorded sample (thread-safe).
+  void CountSample();
+
+  //! Returns density of the point of unit square.
+  float Pdf (glm::vec2 thePoint) const;
+
+  //! Samples point of unit square proportionally to energy, returns it with its density.
+  glm::vec2 Sample (glm::vec2 theRnd, float& thePdf) const;
+
+  //! Adds energy to the cells containing the point (thread-safe).
+  void Add (glm::vec2 thePoint, float theValue);
+
+  //! Rebuilds tree with topology adapted to energy of theSource, zero energy and no samples.
+  void Refine (const GuideQuadtree& theSource, float theThreshold, int theMaxDepth);
+
+private:
+
+  //! Quadrant index (x + 2 y) is given by halves of the node square.
+  struct Node
+  {
+    float Sum[4];
+    int   Child[4]; //!< 0 for leaf quadrant
+  };
+
+  //! Refines node theTarget from node theSource of the source tree (or from uniform energy theEnergy if theSource < 0).
+  void refineNode (const GuideQuadtree& theSource, int theSourceNode, float theEnergy, int theTarget,
+                   float theTotal, float theThreshold, int theDepth, int theMaxDepth);
+
+private:
+
+  std::vector<Node> myNodes;
+  uint32_t          myNbSamples;
+
+};
+
+//! Spatial-directional tree ("SD-tree", Mueller et al., "Practical Path Guiding", 2017)
+//! learning incident radiance across progressive passes. Binary spatial tree over
+//! the scene cube holds pairs of directional quadtrees per leaf: one is sampled
+//! during pass, another accumulates energy of the current iteration. Surfaces of
+//! different orientation (dominant axis of normal) within the leaf have their own
+//! pair, so that directions below one surface are not learned from another. After
+//! iteration (doubling number of passes, so that iterations cover power-of-two blocks
+//! of sample sequence) the recorded tree becomes the sampled one, leaves with many
+//! samples are split and quadtrees are refined in parallel.
+//! Recording is lock-free (atomic updates), so paths of all threads write directly.
+class PathGuide
+{
+public:
+
+  //! Number of surface orientations (signed dominant axis of normal) with own directional trees.
+  static const int NbOrientations = 6;
+
+public:
+
+  //! Creates empty guide.
+  PathGuide();
+
+  //! Returns parameters.
+  const GuidingParams& Params() const { return myParams; }
+
+  //! Returns parameters for modification (applied on reset).
+  GuidingParams& ChangeParams() { return myParams; }
+
+  //! Discards learned data and starts learning in the given bounds.
+  void Reset (const Box& theBounds);
+
+  //! Returns true if distribution for sampling is available (in at least one directional tree).
+  bool IsTrained() const { return myNbSampled > 0; }
+
+  //! Returns true if passes are being recorded.
+  bool IsLearning() const { return !myLeaves.empty() && myIteration < myParams.NbIterations; }
+
+  //! Returns number of finished iterations.
+  int Iteration() const { return myIteration; }
+
+  //! Returns number of spatial leaves.
+  int NbLeaves() const { return static_cast<int> (myLeaves.size()); }
+
+  //! Returns total number of directional nodes of sampled trees.
+  int NbDirectionalNodes() const;
+
+  //! Returns size of spatial tree and directional trees in bytes.
+  size_t MemorySize() const;
+
+  //! Returns spatial leaf containing the point.
+  int FindLeaf (const glm::vec3& thePoint) const;
+
+  //! Returns directional tree of the spatial leaf containing the point for surface with the given normal.
+  int FindTree (const glm::vec3& thePoint, const glm::vec3& theNormal) const
+  {
+    return FindLeaf (thePoint) * NbOrientations + Orientation (theNormal);
+  }
+
+  //! Returns true if the directional tree has learned distribution from enough samples.
+  bool CanSample (int theTree) const
+  {
+    const GuideQuadtree& aTree = sampling (theTree);
+    return aTree.Total() > 0.f && aTree.NbSamples() >= static_cast<uint32_t> (myParams.MinSamples);
+  }
+
+  //! Samples direction of the tree, returns it with solid angle density.
+  glm::vec3 Sample (int theTree, const glm::vec2& theRnd, float& thePdf) const;
+
+  //! Returns solid angle density of sampling the direction in the tree.
+  float Pdf (int theTree, const glm::vec3& theDirection) const;
+
+  //! Records radiance estimate (incident radiance over sampling density) of the direction
+  //! into the directional tree given by FindTree() (thread-safe).
+  void Record (int theTree, const glm::vec3& theDirection, float theValue);
+
+  //! Counts finished pass and rebuilds distributions at the end of iteration.
+  //! Returns true if the sampled distribution has changed.
+  bool FinishPass (ThreadPool& thePool);
+
+private:
+
+  //! Node of spatial tree.
+  struct SpatialNode
+  {
+    int Axis;  //!< split axis or -1 for leaf
+    int Index; //!< first of two consecutive children or leaf index
+    int Depth; //!< depth in tree (split axis cycles with depth)
+  };
+
+  //! Spatial leaf.
+  struct Leaf
+  {
+    GuideQuadtree Sampling[NbOrientations];
+    GuideQuadtree Recording[NbOrientations];
+
+    //! Returns number of samples recorded in the leaf.
+    uint32_t NbSamples() const
+    {
+      uint32_t aNbSamples = 0;
+      for (int anOrient = 0; anOrient < NbOrientations; ++anOrient)
+      {
+        aNbSamples += Recording[anOrient].NbSamples();
+      }
+      return aNbSamples;
+    }
+  };
+
+  //! Returns orientation index of surface with the given normal.
+  static int Orientation (const glm::vec3& theNormal)
+  {
+    const glm::vec3 anAbs = glm::abs (theNormal);
+    const int anAxis = anAbs.x >= anAbs.y ? (anAbs.x >= anAbs.z ? 0 : 2) : (anAbs.y >= anAbs.z ? 1 : 2);
+    return anAxis * 2 + (theNormal[anAxis] < 0.f ? 1 : 0);
+  }
+
+  //! Returns number of passes of the current iteration.
+  int iterationPasses() const { return 1 << std::max (myIteration - 1, 0); }
+
+  //! Returns sampled directional tree.
+  const GuideQuadtree& sampling (int theTree) const { return myLeaves[theTree / NbOrientations].Sampling[theTree % NbOrientations]; }
+
+  //! Finishes iteration: splits spatial leaves and swaps directional trees.
+  void finishIteration (ThreadPool& thePool);
+
+private:
+
+  GuidingParams            myParams;
+  std::vector<SpatialNode> myNodes;
+  std::vector<Leaf>        myLeaves;
+  glm::vec3                myOrigin;   //!< corner of the scene cube
+  float                    myInvSize;  //!< inverse edge length of the scene cube
+  int                      myIteration;
+  int                      myNbPasses;  //!< passes of the current iteration
+  int                      myNbSampled; //!< number of directional trees available for sampling
+
+};
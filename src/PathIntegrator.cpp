@@ -0,0 +1,168 @@
+#include "PathIntegrator.hpp"
+
+#include <vector>
+
+//=======================================================================
+//function : ArenaSize
+//purpose  :
+//=======================================================================
+size_t PathIntegrator::ArenaSize() const
+{
+  // Guide vertices and batched shadow rays are not taken together, but either may be used
+  // depending on the learning state of the guide, so both are reserved
+  const size_t aNbTilePixels = static_cast<size_t> (Framebuffer::TileSize) * Framebuffer::TileSize;
+  const size_t aNbShadows    = aNbTilePixels * myParams.MaxDepth;
+  return Arena::Footprint<GuideVertex> (myParams.MaxDepth)
+       + Arena::Footprint<glm::vec3>   (aNbTilePixels)
+       + Arena::Footprint<ShadowRay>   (aNbShadows)
+       + Arena::Footprint<int>         (aNbShadows);
+}
+
+//=======================================================================
+//function : Render
+//purpose  :
+//=======================================================================
+uint64_t PathIntegrator::Render (const Scene&    theScene,
+                                 const Camera&   theCamera,
+                                 Framebuffer&    theFramebuffer,
+                                 ThreadPool&     thePool)
+{
+  const std::vector<int>& aTiles = theFramebuffer.ActiveTiles();
+
+  ResetStats (thePool.NbThreads());
+
+  thePool.ParallelFor (static_cast<int> (aTiles.size()), [&](int theTileIdx, int theThreadId)
+  {
+    RayStats aTileStats;
+
+    // Scratch of the tile is taken from the thread arena and released after the tile
+    Arena& anArena = thePool.ThreadArena (theThreadId);
+    ArenaScope anArenaScope (anArena);
+
+    const bool isRecording = IsRecordingGuide();
+    GuideVertex* aGuideVertices = isRecording ? anArena.Allocate<GuideVertex> (myParams.MaxDepth) : NULL;
+
+    int aMinX, aMinY, aMaxX, aMaxY;
+    theFramebuffer.TileRect (aTiles[theTileIdx], aMinX, aMinY, aMaxX, aMaxY);
+
+    // Shadow rays are deferred to the end of the tile, unless their
+    // contributions are needed by path guide right after the path
+    const bool toBatch = myParams.BatchShadows && !isRecording;
+    const int  aNbTilePixels = (aMaxX - aMinX) * (aMaxY - aMinY);
+    glm::vec3* aTileRadiance = toBatch ? anArena.Allocate<glm::vec3> (aNbTilePixels) : NULL;
+    ShadowRay* aShadows      = toBatch ? anArena.Allocate<ShadowRay> (aNbTilePixels * myParams.MaxDepth) : NULL;
+    int*       aShadowPixels = toBatch ? anArena.Allocate<int>       (aNbTilePixels * myParams.MaxDepth) : NULL;
+    int        aNbShadows    = 0;
+
+    for (int aY = aMinY; aY < aMaxY; ++aY)
+    {
+      for (int aX = aMinX; aX < aMaxX; ++aX)
+      {
+        const int aPixel = aY * theFramebuffer.SizeX() + aX;
+        const int aTilePixel = (aY - aMinY) * (aMaxX - aMinX) + (aX - aMinX);
+
+        PathState aPath;
+        StartPath (theScene, theCamera, theFramebuffer, aPixel, aPath);
+        aPath.GuideVertices = aGuideVertices;
+
+        AovSample anAov;
+#ifdef RAYLAB_COST_LAYERS
+        PathCost aCost;
+        TraversalStats* aStats = &aCost.Traversal;
+#else
+        TraversalStats  aTraversal;
+        TraversalStats* aStats = &aTraversal;
+#endif
+        for (;;)
+        {
+          SurfaceHit aHit;
+
+          ++(aPath.Depth == 0 ? aTileStats.NbCameraRays : aTileStats.NbBounceRays);
+#ifdef RAYLAB_COST_LAYERS
+          ++aCost.NbRays;
+#endif
+          if (!theScene.Intersect (aPath.Current, aHit, aStats))
+          {
+            AddEscaped (theScene, aPath);
+            break;
+          }
+
+          ++aTileStats.NbShadingCalls;
+
+          ShadowRay aShadow;
+          const bool toContinue = ShadeHit (theScene, aHit, aPath, aShadow, aPath.Depth == 0 ? &anAov : NULL);
+
+          if (aShadow.IsValid)
+          {
+            ++aTileStats.NbShadowRays;
+#ifdef RAYLAB_COST_LAYERS
+            ++aCost.NbShadows;
+#endif
+            if (toBatch)
+            {
+              aShadows     [aNbShadows] = aShadow;
+              aShadowPixels[aNbShadows] = aTilePixel;
+              ++aNbShadows;
+            }
+            else if (!theScene.Occluded (aShadow.Segment))
+            {
+              AddShadow (aShadow, aPath.Radiance, aPath.GuideVertices);
+            }
+          }
+
+          if (!toContinue)
+          {
+            break;
+          }
+        }
+
+        if (isRecording)
+        {
+          RecordPath (aPath);
+        }
+
+        if (toBatch)
+        {
+          aTileRadiance[aTilePixel] = aPath.Radiance;
+        }
+        else
+        {
+          theFramebuffer.AddSample (Layer_Color, aPixel, aPath.Radiance);
+        }
+        theFramebuffer.AddSample (Layer_Albedo, aPixel, anAov.Albedo);
+        theFramebuffer.AddSample (Layer_Normal, aPixel, anAov.Normal);
+        theFramebuffer.AddSample (Layer_Depth,  aPixel, glm::vec3 (anAov.Depth));
+#ifdef RAYLAB_COST_LAYERS
+        aCost.AddSample (theFramebuffer, aPixel);
+#endif
+        aTileStats.AddTraversal (*aStats);
+      }
+    }
+
+    if (toBatch)
+    {
+      int aHint = -1;
+      for (int aShadowIdx = 0; aShadowIdx < aNbShadows; ++aShadowIdx)
+      {
+        if (!theScene.Occluded (aShadows[aShadowIdx].Segment, aHint))
+        {
+          AddShadow (aShadows[aShadowIdx], aTileRadiance[aShadowPixels[aShadowIdx]], NULL);
+        }
+      }
+
+      for (int aY = aMinY; aY < aMaxY; ++aY)
+      {
+        for (int aX = aMinX; aX < aMaxX; ++aX)
+        {
+          theFramebuffer.AddSample (Layer_Color, aY * theFramebuffer.SizeX() + aX,
+                                    aTileRadiance[(aY - aMinY) * (aMaxX - aMinX) + (aX - aMinX)]);
+        }
+      }
+    }
+
+    ThreadStats (theThreadId) += aTileStats;
+  });
+
+  MergeStats();
+  return myStats.NbRays();
+}
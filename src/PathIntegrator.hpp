@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Integrator.hpp"
+
+//! Per-pixel (megakernel style) path tracer.
+//! Each thread renders whole tiles, tracing every path from camera to
+//! termination before moving to the next pixel.
+class PathIntegrator : public Integrator
+{
+public:
+
+  //! Creates integrator.
+  PathIntegrator() {}
+
+  //! Returns name of the integrator.
+  virtual const char* Name() const override { return "Path tracing"; }
+
+  //! Renders one pass (one sample per pixel).
+  virtual uint64_t Render (const Scene&    theScene,
+                           const Camera&   theCamera,
+                           Framebuffer&    theFramebuffer,
+                           ThreadPool&     thePool) override;
+
+  //! Returns bytes of thread arena taken by one tile.
+  virtual size_t ArenaSize() const override;
+
+};
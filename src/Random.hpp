@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+//! PCG32 random number generator (O'Neill, pcg-random.org).
+//! Small state (16 bytes) suitable for per-path storage.
+class Pcg32
+{
+public:
+
+  //! Creates generator with default seed.
+  Pcg32() : myState (0x853c49e6748fea9bULL), myInc (0xda3e39cb94b95bdbULL) {}
+
+  //! Creates generator for the given seed and stream.
+  Pcg32 (uint64_t theSeed, uint64_t theStream = 1) { Seed (theSeed, theStream); }
+
+  //! Reinitializes generator for the given seed and stream.
+  void Seed (uint64_t theSeed, uint64_t theStream = 1)
+  {
+    myState = 0u;
+    myInc   = (theStream << 1u) | 1u;
+    NextUInt();
+    myState += theSeed;
+    NextUInt();
+  }
+
+  //! Returns next 32-bit random number.
+  uint32_t NextUInt()
+  {
+    const uint64_t anOld = myState;
+    myState = anOld * 6364136223846793005ULL + myInc;
+
+    const uint32_t aShifted = static_cast<uint32_t> (((anOld >> 18u) ^ anOld) >> 27u);
+    const uint32_t aRotate  = static_cast<uint32_t> (anOld >> 59u);
+
+    return (aShifted >> aRotate) | (aShifted << ((~aRotate + 1u) & 31u));
+  }
+
+  //! Returns next random number in [0, 1) range.
+  float NextFloat()
+  {
+    // Use upper 24 bits to get exactly representable floats below 1
+    return static_cast<float> (NextUInt() >> 8) * (1.f / 16777216.f);
+  }
+
+  //! Returns raw generator state.
+  uint64_t State() const { return myState; }
+
+  //! Returns raw stream increment.
+  uint64_t Increment() const { return myInc; }
+
+  //! Restores generator from raw state.
+  void SetState (uint64_t theState, uint64_t theInc) { myState = theState; myInc = theInc; }
+
+private:
+
+  uint64_t myState;
+  uint64_t myInc;
+
+};
+
+//! Hashes 32-bit integer (PCG output permutation of one LCG step).
+inline uint32_t HashUInt (uint32_t theValue)
+{
+  const uint32_t aState = theValue * 747796405u + 2891336453u;
+  const uint32_t aWord  = ((aState >> ((aState >> 28u) + 4u)) ^ aState) * 277803737u;
+  return (aWord >> 22u) ^ aWord;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cfloat>
+
+#include "glm/glm.hpp"
+
+//! Ray defined by origin, direction and valid parametric range.
+struct Ray
+{
+  glm::vec3 Origin;
+  glm::vec3 Direction;
+  float     Tmin;
+  float     Tmax;
+  float     Time; //!< time within the shutter interval [0, 1] (motion blur)
+
+  Ray()
+  : Origin (0.f), Direction (0.f, 0.f, 1.f), Tmin (0.f), Tmax (FLT_MAX), Time (0.f) {}
+
+  Ray (const glm::vec3& theOrigin, const glm::vec3& theDirection, float theTmin = 0.f, float theTmax = FLT_MAX, float theTime = 0.f)
+  : Origin (theOrigin), Direction (theDirection), Tmin (theTmin), Tmax (theTmax), Time (theTime) {}
+
+  //! Returns point on the ray at the given distance.
+  glm::vec3 PointAt (float theT) const { return Origin + Direction * theT; }
+};
+
+//! Ray differentials (Igehy, "Tracing Ray Differentials", 1999).
+//! Describe how ray origin and direction change for one pixel step
+//! along screen X and Y, and are used to estimate texture footprint.
+struct RayDifferential
+{
+  glm::vec3 dOdx;
+  glm::vec3 dOdy;
+  glm::vec3 dDdx;
+  glm::vec3 dDdy;
+
+  RayDifferential()
+  : dOdx (0.f), dOdy (0.f), dDdx (0.f), dDdy (0.f) {}
+
+  //! Transfers differentials to the surface hit at distance theT with normal theN.
+  //! After the call dOdx/dOdy hold position differentials of the hit point.
+  void Transfer (const Ray& theRay, float theT, const glm::vec3& theN)
+  {
+    const float aDdotN = glm::dot (theRay.Direction, theN);
+    if (aDdotN == 0.f)
+    {
+      return;
+    }
+
+    const glm::vec3 aPx = dOdx + theT * dDdx;
+    const glm::vec3 aPy = dOdy + theT * dDdy;
+
+    dOdx = aPx - theRay.Direction * (glm::dot (aPx, theN) / aDdotN);
+    dOdy = aPy - theRay.Direction * (glm::dot (aPy, theN) / aDdotN);
+  }
+
+  //! Updates direction differentials for mirror reflection of incident direction theD
+  //! about shading normal theN. Normal differentials may be zero for flat surfaces.
+  void Reflect (const glm::vec3& theD,
+                const glm::vec3& theN,
+                const glm::vec3& theDndx = glm::vec3 (0.f),
+                const glm::vec3& theDndy = glm::vec3 (0.f))
+  {
+    const float aDdotN = glm::dot (theD, theN);
+
+    const float aDDNdx = glm::dot (dDdx, theN) + glm::dot (theD, theDndx);
+    const float aDDNdy = glm::dot (dDdy, theN) + glm::dot (theD, theDndy);
+
+    dDdx -= 2.f * (aDdotN * theDndx + aDDNdx * theN);
+    dDdy -= 2.f * (aDdotN * theDndy + aDDNdy * theN);
+  }
+
+  //! Updates direction differentials for refraction of incident direction theD into theT.
+  //! Normal theN must face the incident side (dot (theD, theN) < 0), theEta = etaI / etaT.
+  void Refract (const glm::vec3& theD,
+                const glm::vec3& theT,
+                const glm::vec3& theN,
+                float            theEta,
+                const glm::vec3& theDndx = glm::vec3 (0.f),
+                const glm::vec3& theDndy = glm::vec3 (0.f))
+  {
+    const float aDdotN = glm::dot (theD, theN);
+    const float aTdotN = glm::dot (theT, theN);
+    if (aTdotN == 0.f)
+    {
+      return;
+    }
+
+    const float aMu = theEta * aDdotN - aTdotN;
+
+    const float aDDNdx = glm::dot (dDdx, theN) + glm::dot (theD, theDndx);
+    const float aDDNdy = glm::dot (dDdy, theN) + glm::dot (theD, theDndy);
+
+    const float aScale = theEta - theEta * theEta * aDdotN / aTdotN;
+
+    dDdx = theEta * dDdx - (aMu * theDndx + aScale * aDDNdx * theN);
+    dDdy = theEta * dDdy - (aMu * theDndy + aScale * aDDNdy * theN);
+  }
+
+  //! Widens direction differentials after a rough (diffuse or glossy) bounce to new direction theWi.
+  //! Specular differentials are meaningless here, so the footprint is treated as a ray cone
+  //! whose spread angle (in radians) is at least theSpread.
+  void Scatter (const glm::vec3& theWi, float theSpread)
+  {
+    const glm::vec3 aT1 = glm::normalize (glm::abs (theWi.x) > 0.9f ? glm::cross (theWi, glm::vec3 (0.f, 1.f, 0.f))
+                                                                      : glm::cross (theWi, glm::vec3 (1.f, 0.f, 0.f)));
+    const glm::vec3 aT2 = glm::cross (theWi, aT1);
+
+    dDdx = aT1 * glm::max (glm::length (dDdx), theSpread);
+    dDdy = aT2 * glm::max (glm::length (dDdy), theSpread);
+  }
+
+  //! Projects position differentials (after Transfer) onto the surface parameterization
+  //! given by theDpdu and theDpdv, returning texture coordinate derivatives.
+  void ComputeUVDerivatives (const glm::vec3& theDpdu,
+                             const glm::vec3& theDpdv,
+                             glm::vec2&       theDuvDx,
+                             glm::vec2&       theDuvDy) const
+  {
+    const float aA00 = glm::dot (theDpdu, theDpdu);
+    const float aA01 = glm::dot (theDpdu, theDpdv);
+    const float aA11 = glm::dot (theDpdv, theDpdv);
+
+    const float aDet = aA00 * aA11 - aA01 * aA01;
+    if (glm::abs (aDet) < 1.0e-20f)
+    {
+      theDuvDx = glm::vec2 (0.f);
+      theDuvDy = glm::vec2 (0.f);
+      return;
+    }
+
+    const float anInvDet = 1.f / aDet;
+
+    const float aB0x = glm::dot (theDpdu, dOdx);
+    const float aB1x = glm::dot (theDpdv, dOdx);
+    const float aB0y = glm::dot (theDpdu, dOdy);
+    const float aB1y = glm::dot (theDpdv, dOdy);
+
+    theDuvDx = glm::vec2 (aA11 * aB0x - aA01 * aB1x, aA00 * aB1x - aA01 * aB0x) * anInvDet;
+    theDuvDy = glm::vec2 (aA11 * aB0y - aA01 * aB1y, aA00 * aB1y - aA01 * aB0y) * anInvDet;
+  }
+};
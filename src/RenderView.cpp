@@ -0,0 +1,188 @@
+#include "RenderView.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+  //! Reads whole text file.
+  bool ReadFile (const std::string& theFileName, std::string& theText)
+  {
+    std::ifstream aFile (theFileName.c_str());
+    if (!aFile.good())
+    {
+      std::cout << "Error: can't read file " << theFileName << std::endl;
+      return false;
+    }
+
+    std::stringstream aStream;
+    aStream << aFile.rdbuf();
+    theText = aStream.str();
+
+    return true;
+  }
+
+  //! Compiles shader of the given type, returns 0 on failure.
+  GLuint CompileShader (GLenum theType, const std::string& theFileName)
+  {
+    std::string aSource;
+    if (!ReadFile (theFileName, aSource))
+    {
+      return 0;
+    }
+
+    const GLuint aShader = glCreateShader (theType);
+
+    const char* aSourcePtr = aSource.c_str();
+    glShaderSource (aShader, 1, &aSourcePtr, NULL);
+    glCompileShader (aShader);
+
+    GLint isCompiled = GL_FALSE;
+    glGetShaderiv (aShader, GL_COMPILE_STATUS, &isCompiled);
+    if (isCompiled == GL_FALSE)
+    {
+      GLint aLength = 0;
+      glGetShaderiv (aShader, GL_INFO_LOG_LENGTH, &aLength);
+
+      std::vector<char> aLog (aLength + 1, '\0');
+      glGetShaderInfoLog (aShader, aLength, NULL, aLog.data());
+      std::cout << "Error: failed to compile " << theFileName << std::endl << aLog.data() << std::endl;
+
+      glDeleteShader (aShader);
+      return 0;
+    }
+
+    return aShader;
+  }
+}
+
+//=======================================================================
+//function : RenderView
+//purpose  :
+//=======================================================================
+RenderView::RenderView()
+: myProgram (0),
+  myVao (0),
+  myTexture (0),
+  myLayer (Layer_Color)
+{
+  //
+}
+
+//=======================================================================
+//function : ~RenderView
+//purpose  :
+//=======================================================================
+RenderView::~RenderView()
+{
+  if (myProgram != 0)
+  {
+    glDeleteProgram (myProgram);
+  }
+  if (myVao != 0)
+  {
+    glDeleteVertexArrays (1, &myVao);
+  }
+  if (myTexture != 0)
+  {
+    glDeleteTextures (1, &myTexture);
+  }
+}
+
+//=======================================================================
+//function : Init
+//purpose  :
+//=======================================================================
+bool RenderView::Init (const std::string& theVertFile, const std::string& theFragFile)
+{
+  const GLuint aVertShader = CompileShader (GL_VERTEX_SHADER,   theVertFile);
+  const GLuint aFragShader = CompileShader (GL_FRAGMENT_SHADER, theFragFile);
+
+  if (aVertShader == 0 || aFragShader == 0)
+  {
+    return false;
+  }
+
+  myProgram = glCreateProgram();
+  glAttachShader (myProgram, aVertShader);
+  glAttachShader (myProgram, aFragShader);
+  glLinkProgram (myProgram);
+
+  glDeleteShader (aVertShader);
+  glDeleteShader (aFragShader);
+
+  GLint isLinked = GL_FALSE;
+  glGetProgramiv (myProgram, GL_LINK_STATUS, &isLinked);
+  if (isLinked == GL_FALSE)
+  {
+    std::cout << "Error: failed to link screen program" << std::endl;
+
+    glDeleteProgram (myProgram);
+    myProgram = 0;
+    return false;
+  }
+
+  // Core profile requires bound VAO even for attribute-less draw
+  glGenVertexArrays (1, &myVao);
+
+  glGenTextures (1, &myTexture);
+  glBindTexture (GL_TEXTURE_2D, myTexture);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture (GL_TEXTURE_2D, 0);
+
+  return true;
+}
+
+//=======================================================================
+//function : Update
+//purpose  :
+//=======================================================================
+void RenderView::Update (const Framebuffer& theFramebuffer, FramebufferLayer theLayer)
+{
+  if (myTexture == 0 || theFramebuffer.SizeX() == 0)
+  {
+    return;
+  }
+
+  myLayer = theLayer;
+
+  theFramebuffer.Resolve (theLayer, myPixels);
+
+  glBindTexture (GL_TEXTURE_2D, myTexture);
+  glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA32F, theFramebuffer.SizeX(), theFramebuffer.SizeY(), 0, GL_RGBA, GL_FLOAT, myPixels.data());
+  glBindTexture (GL_TEXTURE_2D, 0);
+}
+
+//=======================================================================
+//function : Draw
+//purpose  :
+//=======================================================================
+void RenderView::Draw (float theExposure)
+{
+  if (myProgram == 0)
+  {
+    return;
+  }
+
+  // Radiance and albedo are linear, other layers are displayed as is
+  const bool toTonemap = myLayer == Layer_Color || myLayer == Layer_Denoised || myLayer == Layer_Albedo;
+
+  glUseProgram (myProgram);
+  glUniform1i (glGetUniformLocation (myProgram, "image"), 0);
+  glUniform1f (glGetUniformLocation (myProgram, "exposure"), myLayer == Layer_Color || myLayer == Layer_Denoised ? theExposure : 1.f);
+  glUniform1i (glGetUniformLocation (myProgram, "to_tonemap"), toTonemap ? 1 : 0);
+
+  glActiveTexture (GL_TEXTURE0);
+  glBindTexture (GL_TEXTURE_2D, myTexture);
+
+  glBindVertexArray (myVao);
+  glDrawArrays (GL_TRIANGLES, 0, 3);
+  glBindVertexArray (0);
+
+  glBindTexture (GL_TEXTURE_2D, 0);
+  glUseProgram (0);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/gl3w.h>
+
+#include "Framebuffer.hpp"
+
+//! Displays framebuffer layers on screen (fullscreen triangle with exposure
+//! and sRGB encoding of the color layers).
+class RenderView
+{
+public:
+
+  //! Creates empty view (GL resources are created by Init()).
+  RenderView();
+
+  //! Releases GL resources.
+  ~RenderView();
+
+  //! Creates shader program and texture. Requires current GL context.
+  bool Init (const std::string& theVertFile, const std::string& theFragFile);
+
+  //! Uploads resolved layer of the framebuffer into the texture.
+  void Update (const Framebuffer& theFramebuffer, FramebufferLayer theLayer);
+
+  //! Draws the texture into current viewport (exposure is applied to the color layer only).
+  void Draw (float theExposure);
+
+  //! Returns size of the staging buffer and the texture in bytes.
+  size_t MemorySize() const { return 2 * myPixels.size() * sizeof (glm::vec4); }
+
+private:
+
+  GLuint myProgram;
+  GLuint myVao;
+  GLuint myTexture;
+
+  FramebufferLayer myLayer;
+
+  std::vector<glm::vec4> myPixels; //!< staging buffer of resolved layer
+
+};
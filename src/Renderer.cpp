@@ -0,0 +1,625 @@
+#include "Renderer.hpp"
+
+#include "HugePages.hpp"
+#include "PathIntegrator.hpp"
+#include "WavefrontIntegrator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+
+namespace
+{
+  //! Maximum number of samples per pass given to active tiles when other tiles have converged.
+  const int THE_MAX_PASS_REPEATS = 8;
+
+  //! Memory updates between samples of resident pages of paged BVH (scan of the whole mapping).
+  const int THE_RESIDENCY_SAMPLE_INTERVAL = 16;
+
+  //! Fraction of the budget share resident pages must drop below before they can be released again.
+  const double THE_PAGE_REARM_FRACTION = 0.75;
+}
+
+//=======================================================================
+//function : Renderer
+//purpose  :
+//=======================================================================
+Renderer::Renderer (int theNbThreads)
+: myPool (theNbThreads),
+  myPagedResident (0),
+  myNbMemoryUpdates (0),
+  myIsPagedOverShare (false),
+  myMode (IntegratorMode_PathTracing),
+  myDisplayLayer (Layer_Color),
+  myResolutionScale (1.f),
+  myExposure (1.f),
+  mySceneRevision (0),
+  myToReset (true),
+  myIsGuiding (false),
+  myHasCameraMotion (false),
+  myTargetError (0.f),
+  myMinSamples (8),
+  myMaxSamples (0),
+  myIsConverged (false),
+  myDenoiseInterval (8),
+  myDenoisedPasses (-1),
+  myLastPassTime (0.0),
+  myLastPassRays (0),
+  myAccumulatedTime (0.0)
+{
+  myIntegrators[IntegratorMode_PathTracing].reset (new PathIntegrator());
+  myIntegrators[IntegratorMode_Wavefront]  .reset (new WavefrontIntegrator());
+}
+
+//=======================================================================
+//function : ~Renderer
+//purpose  :
+//=======================================================================
+Renderer::~Renderer()
+{
+  //
+}
+
+//=======================================================================
+//function : ModeName
+//purpose  :
+//=======================================================================
+const char* Renderer::ModeName (int theMode)
+{
+  switch (theMode)
+  {
+    case IntegratorMode_PathTracing: return "Path tracing";
+    case IntegratorMode_Wavefront:   return "Wavefront";
+  }
+
+  return "Unknown";
+}
+
+//=======================================================================
+//function : LoadScene
+//purpose  :
+//=======================================================================
+bool Renderer::LoadScene (const std::string& theFileName)
+{
+  if (!myScene.LoadObj (theFileName, myPool))
+  {
+    return false;
+  }
+
+  ++mySceneRevision;
+  myToReset = true;
+
+  myNbMemoryUpdates  = 0;
+  myIsPagedOverShare = false;
+  UpdateMemory();
+  return true;
+}
+
+//=======================================================================
+//function : SetBvhBuildMode
+//purpose  :
+//=======================================================================
+void Renderer::SetBvhBuildMode (BvhBuild theMode)
+{
+  if (myScene.BvhBuildMode() != theMode)
+  {
+    myScene.SetBvhBuildMode (theMode);
+    myScene.Commit (myPool);
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : SetBvhOptimization
+//purpose  :
+//=======================================================================
+void Renderer::SetBvhOptimization (bool theToOptimize)
+{
+  if (myScene.IsBvhOptimized() != theToOptimize)
+  {
+    myScene.SetBvhOptimization (theToOptimize);
+    myScene.Commit (myPool);
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : SetMaxReferenceGrowth
+//purpose  :
+//=======================================================================
+void Renderer::SetMaxReferenceGrowth (float theGrowth)
+{
+  if (myScene.MaxReferenceGrowth() == theGrowth)
+  {
+    return;
+  }
+
+  myScene.SetMaxReferenceGrowth (theGrowth);
+  if (myScene.BvhBuildMode() == BvhBuild_Spatial)
+  {
+    myScene.Commit (myPool);
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : UpdateGeometry
+//purpose  :
+//=======================================================================
+int Renderer::UpdateGeometry()
+{
+  const int aNbRebuilt = myScene.Refit (myPool);
+
+  myToReset = true;
+
+  return aNbRebuilt;
+}
+
+//=======================================================================
+//function : FitCamera
+//purpose  :
+//=======================================================================
+void Renderer::FitCamera (Camera& theCamera) const
+{
+  if (myScene.IsEmpty())
+  {
+    return;
+  }
+
+  const Box aBounds = myScene.Bounds();
+
+  const glm::vec3 aCenter = aBounds.Center();
+  const float     aRadius = glm::length (aBounds.Size()) * 0.5f;
+
+  // Look along -Z from the distance covering bounding sphere (Camera passes FOV to GLM as radians)
+  const float aTanHalfFov = std::max (std::abs (std::tan (static_cast<float> (theCamera.field_of_view) * 0.5f)), 0.1f);
+
+  theCamera.SetPosition (aCenter + glm::vec3 (0.f, 0.f, aRadius * std::sqrt (1.f + 1.f / (aTanHalfFov * aTanHalfFov))));
+  theCamera.SetLookAt (aCenter);
+  theCamera.SetClipping (aRadius * 1.0e-3, aRadius * 1.0e+2);
+
+  theCamera.camera_scale = aRadius * 0.02f;
+}
+
+//=======================================================================
+//function : SetMode
+//purpose  :
+//=======================================================================
+void Renderer::SetMode (IntegratorMode theMode)
+{
+  if (myMode != theMode)
+  {
+    myMode    = theMode;
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : LoadEnvironment
+//purpose  :
+//=======================================================================
+bool Renderer::LoadEnvironment (const std::string& theFileName)
+{
+  if (!myScene.LoadEnvironment (theFileName, myPool))
+  {
+    return false;
+  }
+
+  myToReset = true;
+  return true;
+}
+
+//=======================================================================
+//function : ClearEnvironment
+//purpose  :
+//=======================================================================
+void Renderer::ClearEnvironment()
+{
+  if (!myScene.EnvironmentLight().IsEmpty())
+  {
+    myScene.ChangeEnvironmentLight().Clear();
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : SetEnvironmentIntensity
+//purpose  :
+//=======================================================================
+void Renderer::SetEnvironmentIntensity (float theIntensity)
+{
+  if (myScene.EnvironmentLight().Intensity() != theIntensity)
+  {
+    myScene.ChangeEnvironmentLight().SetIntensity (theIntensity);
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : SetLightSamplingMode
+//purpose  :
+//=======================================================================
+void Renderer::SetLightSamplingMode (LightSampling theMode)
+{
+  if (myScene.LightSamplingMode() != theMode)
+  {
+    myScene.SetLightSamplingMode (theMode);
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : SetMaxDepth
+//purpose  :
+//=======================================================================
+void Renderer::SetMaxDepth (int theDepth)
+{
+  for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+  {
+    myIntegrators[aMode]->ChangeParams().MaxDepth = theDepth;
+  }
+
+  myToReset = true;
+}
+
+//=======================================================================
+//function : SetShadowBatching
+//purpose  :
+//=======================================================================
+void Renderer::SetShadowBatching (bool theToBatch)
+{
+  for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+  {
+    myIntegrators[aMode]->ChangeParams().BatchShadows = theToBatch;
+  }
+}
+
+//=======================================================================
+//function : SetSampler
+//purpose  :
+//=======================================================================
+void Renderer::SetSampler (SamplerType theType)
+{
+  if (theType == SamplerType_BlueNoise)
+  {
+    PathSampler::BlueNoiseTile(); // build the tile outside of rendering passes
+  }
+
+  for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+  {
+    myIntegrators[aMode]->ChangeParams().Sampler = theType;
+  }
+
+  myToReset = true;
+}
+
+//=======================================================================
+//function : SetGuiding
+//purpose  :
+//=======================================================================
+void Renderer::SetGuiding (bool theToGuide)
+{
+  if (myIsGuiding == theToGuide)
+  {
+    return;
+  }
+
+  myIsGuiding = theToGuide;
+  for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+  {
+    myIntegrators[aMode]->SetGuide (theToGuide ? &myGuide : NULL);
+  }
+
+  myToReset = true;
+}
+
+//=======================================================================
+//function : SetMotionInterpolation
+//purpose  :
+//=======================================================================
+void Renderer::SetMotionInterpolation (bool theIsLinear)
+{
+  if (myScene.IsMotionInterpolated() == theIsLinear)
+  {
+    return;
+  }
+
+  myScene.SetMotionInterpolation (theIsLinear, myPool);
+  myToReset = true;
+}
+
+//=======================================================================
+//function : SetTessellationLevel
+//purpose  :
+//=======================================================================
+void Renderer::SetTessellationLevel (int theLevel)
+{
+  if (myScene.TessellationLevel() == theLevel)
+  {
+    return;
+  }
+
+  myScene.SetTessellationLevel (theLevel);
+  myToReset = true;
+}
+
+//=======================================================================
+//function : SetCameraEnd
+//purpose  :
+//=======================================================================
+void Renderer::SetCameraEnd (const Camera& theCamera)
+{
+  myCameraEnd       = theCamera;
+  myHasCameraMotion = true;
+  for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+  {
+    myIntegrators[aMode]->SetCameraEnd (&myCameraEnd);
+  }
+
+  myToReset = true;
+}
+
+//=======================================================================
+//function : ClearCameraEnd
+//purpose  :
+//=======================================================================
+void Renderer::ClearCameraEnd()
+{
+  if (!myHasCameraMotion)
+  {
+    return;
+  }
+
+  myHasCameraMotion = false;
+  for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+  {
+    myIntegrators[aMode]->SetCameraEnd (NULL);
+  }
+
+  myToReset = true;
+}
+
+//=======================================================================
+//function : SetGuideBsdfFraction
+//purpose  :
+//=======================================================================
+void Renderer::SetGuideBsdfFraction (float theFraction)
+{
+  theFraction = std::max (0.f, std::min (theFraction, 1.f));
+  if (myGuide.Params().BsdfFraction != theFraction)
+  {
+    myGuide.ChangeParams().BsdfFraction = theFraction;
+    myToReset = true;
+  }
+}
+
+//=======================================================================
+//function : BsdfIsa
+//purpose  :
+//=======================================================================
+SimdIsa Renderer::BsdfIsa() const
+{
+  return static_cast<const WavefrontIntegrator&> (*myIntegrators[IntegratorMode_Wavefront]).Isa();
+}
+
+//=======================================================================
+//function : SetBsdfIsa
+//purpose  :
+//=======================================================================
+void Renderer::SetBsdfIsa (SimdIsa theIsa)
+{
+  static_cast<WavefrontIntegrator&> (*myIntegrators[IntegratorMode_Wavefront]).SetIsa (theIsa);
+}
+
+//=======================================================================
+//function : IsRayReordering
+//purpose  :
+//=======================================================================
+bool Renderer::IsRayReordering() const
+{
+  return static_cast<const WavefrontIntegrator&> (*myIntegrators[IntegratorMode_Wavefront]).IsRayReordering();
+}
+
+//=======================================================================
+//function : SetRayReordering
+//purpose  :
+//=======================================================================
+void Renderer::SetRayReordering (bool theToUse)
+{
+  static_cast<WavefrontIntegrator&> (*myIntegrators[IntegratorMode_Wavefront]).SetRayReordering (theToUse);
+}
+
+//=======================================================================
+//function : IsHugePages
+//purpose  :
+//=======================================================================
+bool Renderer::IsHugePages() const
+{
+  return HugePages::IsEnabled();
+}
+
+//=======================================================================
+//function : SetHugePages
+//purpose  :
+//=======================================================================
+void Renderer::SetHugePages (bool theToUse)
+{
+  HugePages::SetEnabled (theToUse);
+  myScene.AdoptHugePages();
+  myFramebuffer.AdoptHugePages (myPool);
+}
+
+//=======================================================================
+//function : SetResolutionScale
+//purpose  :
+//=======================================================================
+void Renderer::SetResolutionScale (float theScale)
+{
+  myResolutionScale = std::max (0.05f, std::min (theScale, 1.f));
+}
+
+//=======================================================================
+//function : RenderPass
+//purpose  :
+//=======================================================================
+bool Renderer::RenderPass (const Camera& theCamera)
+{
+  if (myScene.IsEmpty() || theCamera.window_width <= 0 || theCamera.window_height <= 0)
+  {
+    return false;
+  }
+
+  const int aSizeX = std::max (1, static_cast<int> (theCamera.window_width  * myResolutionScale));
+  const int aSizeY = std::max (1, static_cast<int> (theCamera.window_height * myResolutionScale));
+
+  const glm::mat4 aViewProj = theCamera.projection * theCamera.view;
+
+  if (myToReset || aViewProj != myLastViewProj || aSizeX != myFramebuffer.SizeX() || aSizeY != myFramebuffer.SizeY())
+  {
+    myFramebuffer.Resize (aSizeX, aSizeY, myPool);
+    myFramebuffer.Clear (myPool);
+
+    myLastViewProj    = aViewProj;
+    myAccumulatedTime = 0.0;
+    myDenoisedPasses  = -1;
+    myToReset         = false;
+
+    if (myIsGuiding)
+    {
+      myGuide.Reset (myScene.Bounds());
+    }
+  }
+
+  const auto aStart = std::chrono::steady_clock::now();
+
+  myFramebuffer.UpdateActiveTiles (myTargetError, myMinSamples, myPool);
+
+  const int aNbActive = static_cast<int> (myFramebuffer.ActiveTiles().size());
+  const int aNbLeft   = myMaxSamples > 0 ? myMaxSamples - myFramebuffer.NbPasses() : INT_MAX;
+
+  myIsConverged = aNbActive == 0 || aNbLeft <= 0;
+  if (myIsConverged)
+  {
+    myLastPassTime  = 0.0;
+    myLastPassRays  = 0;
+    myLastPassStats = RayStats();
+
+    denoise();
+    UpdateMemory();
+    return true;
+  }
+
+  // Give cores released by converged tiles to the noisy ones
+  int aNbRepeats = 1;
+  if (myTargetError > 0.f)
+  {
+    aNbRepeats = std::min (std::min (myFramebuffer.NbTiles() / aNbActive, THE_MAX_PASS_REPEATS), aNbLeft);
+  }
+
+  myLastPassRays  = 0;
+  myLastPassStats = RayStats();
+  for (int aRepeat = 0; aRepeat < aNbRepeats; ++aRepeat)
+  {
+    myPool.ResetArenas (myIntegrators[myMode]->ArenaSize());
+    myLastPassRays  += myIntegrators[myMode]->Render (myScene, theCamera, myFramebuffer, myPool);
+    myLastPassStats += myIntegrators[myMode]->Stats();
+
+    myFramebuffer.FinishPass();
+    if (myIsGuiding)
+    {
+      // Passes sampling the same guide distribution form a round combined
+      // with the others by inverse variance (early ones are noisier)
+      if (myGuide.FinishPass (myPool))
+      {
+        myFramebuffer.FinishRound (myPool);
+      }
+    }
+  }
+
+  myLastPassTime = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now() - aStart).count();
+  myAccumulatedTime += myLastPassTime;
+
+  denoise();
+  UpdateMemory();
+  return true;
+}
+
+//=======================================================================
+//function : UpdateMemory
+//purpose  :
+//=======================================================================
+void Renderer::UpdateMemory()
+{
+  myMemory.Set (MemoryTag_Geometry,     myScene.GeometrySize());
+  myMemory.Set (MemoryTag_Bvh,          myScene.HierarchySize());
+  myMemory.Set (MemoryTag_Textures,     myScene.TextureSize());
+  myMemory.Set (MemoryTag_Framebuffers, myFramebuffer.MemorySize() + myDenoiser.MemorySize());
+
+  size_t aStateSize = myPool.ArenaCapacity();
+  for (int aMode = 0; aMode < IntegratorMode_NB; ++aMode)
+  {
+    aStateSize += myIntegrators[aMode]->MemorySize();
+  }
+  myMemory.Set (MemoryTag_RenderState, aStateSize);
+
+  // Path guide can't be trimmed without losing learned data, so the other caches get the rest;
+  // it is split between them, so that trimming one cache doesn't evict the other
+  const PagedBvh& aPaged     = myScene.PagedHierarchy();
+  const size_t    aBudget    = myMemory.Budget (MemoryTag_Caches);
+  const size_t    aGuideSize = myGuide.MemorySize();
+  const size_t    aRest      = aBudget > aGuideSize ? aBudget - aGuideSize : 0;
+  const size_t    aTessShare = aPaged.IsEmpty() ? aRest : aRest / 2;
+  const size_t    aPageShare = aRest - aTessShare;
+
+  TessellationCache& aTessCache = myScene.ChangeTessellation();
+  aTessCache.SetLimit (aBudget != 0 ? std::max (aTessShare, static_cast<size_t> (1)) : 0);
+
+  if (aPaged.IsEmpty())
+  {
+    // The first update after paging is enabled samples residency
+    myPagedResident    = 0;
+    myIsPagedOverShare = false;
+    myNbMemoryUpdates  = -1;
+  }
+  else if (myNbMemoryUpdates % THE_RESIDENCY_SAMPLE_INTERVAL == 0)
+  {
+    // Traversal faults released pages right back, so releasing is re-armed only after residency
+    // drops below a fraction of the share (not on every update while above it)
+    myPagedResident = aPaged.ResidentBytes();
+
+    const size_t aRearmLevel = static_cast<size_t> (aPageShare * THE_PAGE_REARM_FRACTION);
+    if (aBudget != 0 && myPagedResident > aPageShare && !myIsPagedOverShare)
+    {
+      aPaged.ReleasePages();
+      myPagedResident    = aPaged.ResidentBytes();
+      myIsPagedOverShare = myPagedResident > aRearmLevel;
+    }
+    else if (myIsPagedOverShare)
+    {
+      myIsPagedOverShare = aBudget != 0 && myPagedResident > aRearmLevel;
+    }
+  }
+  ++myNbMemoryUpdates;
+
+  myMemory.Set (MemoryTag_Caches, aGuideSize + aTessCache.MemoryUsed() + myPagedResident);
+}
+
+//=======================================================================
+//function : denoise
+//purpose  :
+//=======================================================================
+void Renderer::denoise()
+{
+  const int aNbPasses = myFramebuffer.NbPasses();
+  if (myDenoiseInterval <= 0 || aNbPasses == 0 || aNbPasses == myDenoisedPasses)
+  {
+    return;
+  }
+
+  if (myDenoisedPasses < 0 || aNbPasses - myDenoisedPasses >= myDenoiseInterval || myIsConverged)
+  {
+    myDenoiser.Run (myFramebuffer, myPool);
+    myDenoisedPasses = aNbPasses;
+  }
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "BsdfBatch.hpp"
+#include "Camera.h"
+#include "Denoiser.hpp"
+#include "Framebuffer.hpp"
+#include "Integrator.hpp"
+#include "Memory.hpp"
+#include "PathGuide.hpp"
+#include "Scene.hpp"
+#include "ThreadPool.hpp"
+
+//! Available rendering algorithms.
+enum IntegratorMode
+{
+  IntegratorMode_PathTracing, //!< per-pixel path tracing
+  IntegratorMode_Wavefront,   //!< wavefront path tracing with material sorting
+  IntegratorMode_NB
+};
+
+//! Progressive renderer (owns scene, worker threads and accumulation buffer).
+//! Accumulation restarts automatically when camera, resolution or any
+//! rendering parameter changes.
+class Renderer
+{
+public:
+
+  //! Creates renderer with the given number of threads (0 - hardware concurrency).
+  explicit Renderer (int theNbThreads = 0);
+
+  //! Releases resources.
+  ~Renderer();
+
+  //! Loads scene from OBJ file.
+  bool LoadScene (const std::string& theFileName);
+
+  //! Returns current scene.
+  const Scene& CurrentScene() const { return myScene; }
+
+  //! Returns scene for moving vertices (UpdateGeometry() should be called afterwards).
+  Scene& ChangeScene() { return myScene; }
+
+  //! Updates acceleration structure after vertices were moved and restarts accumulation.
+  //! Returns number of rebuilt BVH subtrees.
+  int UpdateGeometry();
+
+  //! Returns revision of the scene (incremented on each load).
+  int SceneRevision() const { return mySceneRevision; }
+
+  //! Loads HDR environment light.
+  bool LoadEnvironment (const std::string& theFileName);
+
+  //! Removes environment light.
+  void ClearEnvironment();
+
+  //! Returns radiance scale of environment light.
+  float EnvironmentIntensity() const { return myScene.EnvironmentLight().Intensity(); }
+
+  //! Sets radiance scale of environment light.
+  void SetEnvironmentIntensity (float theIntensity);
+
+  //! Returns strategy of emitter selection.
+  LightSampling LightSamplingMode() const { return myScene.LightSamplingMode(); }
+
+  //! Sets strategy of emitter selection.
+  void SetLightSamplingMode (LightSampling theMode);
+
+  //! Returns algorithm of building BVH.
+  BvhBuild BvhBuildMode() const { return myScene.BvhBuildMode(); }
+
+  //! Sets algorithm of building BVH and rebuilds it.
+  void SetBvhBuildMode (BvhBuild theMode);
+
+  //! Returns limit of BVH references per triangle for spatial splits.
+  float MaxReferenceGrowth() const { return myScene.MaxReferenceGrowth(); }
+
+  //! Sets limit of BVH references per triangle for spatial splits and rebuilds BVH.
+  void SetMaxReferenceGrowth (float theGrowth);
+
+  //! Returns true if BVH is optimized by treelet restructuring.
+  bool IsBvhOptimized() const { return myScene.IsBvhOptimized(); }
+
+  //! Enables treelet restructuring of BVH and rebuilds it.
+  void SetBvhOptimization (bool theToOptimize);
+
+  //! Returns true if built BVH is cached next to the scene file.
+  bool IsUsingBvhCache() const { return myScene.IsUsingBvhCache(); }
+
+  //! Enables BVH cache file (applied on the next build).
+  void SetBvhCache (bool theToUse) { myScene.SetBvhCache (theToUse); }
+
+  //! Returns true if rays traverse compressed 8-wide BVH.
+  bool IsWideBvh() const { return myScene.IsWideBvh(); }
+
+  //! Enables compressed 8-wide BVH (does not change the image).
+  void SetWideBvh (bool theToUse) { myScene.SetWideBvh (theToUse, myPool); }
+
+  //! Returns true if BVH is paged out of core from memory-mapped file.
+  bool IsPaging() const { return myScene.IsPaging(); }
+
+  //! Enables out-of-core BVH (does not change the image).
+  void SetPaging (bool theToUse) { myScene.SetPaging (theToUse, myPool); }
+
+  //! Returns true if wavefront ray queues hint paged blocks in advance.
+  bool IsPrefetching() const { return myScene.IsPrefetching(); }
+
+  //! Enables prefetch hints of paged blocks.
+  void SetPrefetch (bool theToUse) { myScene.SetPrefetch (theToUse); }
+
+  //! Returns true if worker threads are pinned to NUMA nodes.
+  bool IsNumaPinning() const { return myPool.IsPinned(); }
+
+  //! Pins worker threads to NUMA nodes (or releases them).
+  void SetNumaPinning (bool theToPin) { myPool.SetPinning (theToPin); }
+
+  //! Returns true if BVH and triangles are replicated per NUMA node.
+  bool IsReplicating() const { return myScene.IsReplicating(); }
+
+  //! Enables replicas of BVH and triangles per NUMA node (read by pinned threads).
+  void SetReplication (bool theToUse) { myScene.SetReplication (theToUse); }
+
+  //! Returns true if large scene and framebuffer arrays are advised for huge pages.
+  bool IsHugePages() const;
+
+  //! Moves BVH, geometry and framebuffer layers into huge-page backed storage (or back).
+  void SetHugePages (bool theToUse);
+
+  //! Returns true if node bounds of motion BVH are interpolated in time.
+  bool IsMotionInterpolated() const { return myScene.IsMotionInterpolated(); }
+
+  //! Switches motion BVH between interpolated bounds and unions over time segments.
+  void SetMotionInterpolation (bool theIsLinear);
+
+  //! Returns subdivision level of displaced patches.
+  int TessellationLevel() const { return myScene.TessellationLevel(); }
+
+  //! Sets subdivision level of displaced patches (tessellated micro-meshes are dropped).
+  void SetTessellationLevel (int theLevel);
+
+  //! Returns true if camera moves during the shutter interval.
+  bool HasCameraMotion() const { return myHasCameraMotion; }
+
+  //! Sets camera at the end of the shutter interval (camera passed
+  //! to RenderPass() is taken as the one at its start).
+  void SetCameraEnd (const Camera& theCamera);
+
+  //! Disables camera motion blur.
+  void ClearCameraEnd();
+
+  //! Places camera so that the whole scene is visible.
+  void FitCamera (Camera& theCamera) const;
+
+  //! Returns active integrator.
+  IntegratorMode Mode() const { return myMode; }
+
+  //! Sets active integrator.
+  void SetMode (IntegratorMode theMode);
+
+  //! Returns integrator of the given mode.
+  Integrator& IntegratorOf (IntegratorMode theMode) { return *myIntegrators[theMode]; }
+
+  //! Returns name of the integrator mode.
+  static const char* ModeName (int theMode);
+
+  //! Returns maximum path depth.
+  int MaxDepth() const { return myIntegrators[0]->Params().MaxDepth; }
+
+  //! Sets maximum path depth.
+  void SetMaxDepth (int theDepth);
+
+  //! Returns generator of sample values.
+  SamplerType Sampler() const { return myIntegrators[0]->Params().Sampler; }
+
+  //! Sets generator of sample values.
+  void SetSampler (SamplerType theType);
+
+  //! Returns true if per-pixel integrator traces shadow rays of the whole tile at once.
+  bool IsBatchingShadows() const { return myIntegrators[0]->Params().BatchShadows; }
+
+  //! Enables batching of shadow rays per tile (does not change the image).
+  void SetShadowBatching (bool theToBatch);
+
+  //! Returns true if paths are guided by learned incident radiance.
+  bool IsGuiding() const { return myIsGuiding; }
+
+  //! Enables path guiding (learning restarts with accumulation).
+  void SetGuiding (bool theToGuide);
+
+  //! Returns path guide.
+  const PathGuide& Guide() const { return myGuide; }
+
+  //! Sets probability of sampling BSDF instead of the learned distribution.
+  void SetGuideBsdfFraction (float theFraction);
+
+  //! Returns instruction set of BSDF kernels of the wavefront integrator.
+  SimdIsa BsdfIsa() const;
+
+  //! Sets instruction set of BSDF kernels of the wavefront integrator.
+  void SetBsdfIsa (SimdIsa theIsa);
+
+  //! Returns true if the wavefront integrator bins rays by BVH subtree.
+  bool IsRayReordering() const;
+
+  //! Enables binning of rays by BVH subtree in the wavefront integrator.
+  void SetRayReordering (bool theToUse);
+
+  //! Returns ratio of framebuffer resolution to the viewport resolution.
+  float ResolutionScale() const { return myResolutionScale; }
+
+  //! Sets ratio of framebuffer resolution to the viewport resolution.
+  void SetResolutionScale (float theScale);
+
+  //! Returns target error of adaptive sampling (0 - disabled).
+  float TargetError() const { return myTargetError; }
+
+  //! Sets target error of adaptive sampling; tiles with lower estimated
+  //! error stop receiving samples (0 disables adaptive sampling).
+  void SetTargetError (float theError) { myTargetError = std::max (theError, 0.f); }
+
+  //! Returns number of samples taken in every tile before its error is tested.
+  int MinSamples() const { return myMinSamples; }
+
+  //! Sets number of samples taken in every tile before its error is tested.
+  void SetMinSamples (int theNbSamples) { myMinSamples = std::max (theNbSamples, 2); }
+
+  //! Returns maximum number of samples per pixel (0 - unlimited).
+  int MaxSamples() const { return myMaxSamples; }
+
+  //! Sets maximum number of samples per pixel (0 - unlimited).
+  void SetMaxSamples (int theNbSamples) { myMaxSamples = std::max (theNbSamples, 0); }
+
+  //! Returns true if all tiles have reached the target error or sample limit.
+  bool IsConverged() const { return myIsConverged; }
+
+  //! Returns number of samples between denoiser runs (0 - denoiser disabled).
+  int DenoiseInterval() const { return myDenoiseInterval; }
+
+  //! Sets number of samples between denoiser runs (0 disables denoiser).
+  void SetDenoiseInterval (int theNbSamples) { myDenoiseInterval = std::max (theNbSamples, 0); }
+
+  //! Returns denoiser filling Layer_Denoised.
+  Denoiser& ImageDenoiser() { return myDenoiser; }
+
+  //! Requests denoiser run after the next pass (e.g. after parameters change).
+  void InvalidateDenoised() { myDenoisedPasses = -1; }
+
+  //! Returns layer selected for display.
+  FramebufferLayer DisplayLayer() const { return myDisplayLayer; }
+
+  //! Sets layer selected for display.
+  void SetDisplayLayer (FramebufferLayer theLayer) { myDisplayLayer = theLayer; }
+
+  //! Returns exposure multiplier for display.
+  float Exposure() const { return myExposure; }
+
+  //! Sets exposure multiplier for display.
+  void SetExposure (float theExposure) { myExposure = theExposure; }
+
+  //! Discards accumulated samples.
+  void Reset() { myToReset = true; }
+
+  //! Renders one more pass from the given camera. With adaptive sampling the
+  //! pass covers only active tiles, which get several samples when most tiles
+  //! have converged. Denoiser runs after the first pass, then every
+  //! DenoiseInterval() samples and once more on convergence.
+  //! Returns false if there is nothing to render.
+  bool RenderPass (const Camera& theCamera);
+
+  //! Returns accumulation buffer.
+  const Framebuffer& Accumulator() const { return myFramebuffer; }
+
+  //! Returns thread pool.
+  ThreadPool& Pool() { return myPool; }
+
+  //! Returns time of the last pass (in milliseconds).
+  double LastPassTime() const { return myLastPassTime; }
+
+  //! Returns number of rays traced in the last pass.
+  uint64_t LastPassRays() const { return myLastPassRays; }
+
+  //! Returns ray and traversal statistics of the last pass (all repeats together).
+  const RayStats& LastPassStats() const { return myLastPassStats; }
+
+  //! Returns time spent since accumulation restart (in milliseconds).
+  double AccumulatedTime() const { return myAccumulatedTime; }
+
+  //! Returns memory accounted by category (updated after each pass and scene load).
+  const MemoryStats& Memory() const { return myMemory; }
+
+  //! Returns memory statistics for modification (budgets, memory of the viewer).
+  MemoryStats& ChangeMemory() { return myMemory; }
+
+  //! Gathers current sizes of all categories and keeps caches within their budget. The budget
+  //! left by path guide is split between tessellation cache (limited to its share) and resident
+  //! pages of out-of-core BVH (released when they cross their share). Residency of pages is
+  //! sampled every few updates. Doesn't allocate.
+  void UpdateMemory();
+
+private:
+
+  //! Runs denoiser if enough samples were added since the last run.
+  void denoise();
+
+private:
+
+  ThreadPool   myPool;
+  Scene        myScene;
+  Framebuffer  myFramebuffer;
+  Denoiser     myDenoiser;
+  PathGuide    myGuide;
+  Camera       myCameraEnd; //!< camera at the end of the shutter interval
+  MemoryStats  myMemory;
+  size_t       myPagedResident;    //!< last sampled resident bytes of paged BVH
+  int          myNbMemoryUpdates;  //!< number of UpdateMemory() calls since scene load
+  bool         myIsPagedOverShare; //!< pages were released and residency hasn't dropped below the re-arm level since
+
+  std::unique_ptr<Integrator> myIntegrators[IntegratorMode_NB];
+
+  IntegratorMode   myMode;
+  FramebufferLayer myDisplayLayer;
+  float            myResolutionScale;
+  float            myExposure;
+  int              mySceneRevision;
+  bool             myToReset;
+  bool             myIsGuiding;
+  bool             myHasCameraMotion;
+  float            myTargetError;
+  int              myMinSamples;
+  int              myMaxSamples;
+  bool             myIsConverged;
+  int              myDenoiseInterval;
+  int              myDenoisedPasses; //!< number of passes at the last denoiser run (-1 - none)
+
+  glm::mat4 myLastViewProj; //!< camera of accumulated passes
+
+  double   myLastPassTime;
+  uint64_t myLastPassRays;
+  RayStats myLastPassStats;
+  double   myAccumulatedTime;
+
+};
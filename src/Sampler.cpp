@@ -0,0 +1,318 @@
+#include "Sampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  //! Direction numbers of the second Sobol dimension
+  //! (the first one is radical inverse in base 2, i.e. reversed bits).
+  const uint32_t THE_SOBOL_DIRECTIONS[32] =
+  {
+    0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000,
+    0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000,
+    0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00,
+    0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff
+  };
+
+  //! Seed shared by all pixels of blue-noise sampler.
+  const uint32_t THE_BLUE_NOISE_SEED = 0x2545f491u;
+
+  //! Reverses order of bits.
+  inline uint32_t ReverseBits (uint32_t theValue)
+  {
+    theValue = ((theValue >> 1) & 0x55555555u) | ((theValue & 0x55555555u) << 1);
+    theValue = ((theValue >> 2) & 0x33333333u) | ((theValue & 0x33333333u) << 2);
+    theValue = ((theValue >> 4) & 0x0f0f0f0fu) | ((theValue & 0x0f0f0f0fu) << 4);
+    theValue = ((theValue >> 8) & 0x00ff00ffu) | ((theValue & 0x00ff00ffu) << 8);
+    return (theValue >> 16) | (theValue << 16);
+  }
+
+  //! Laine-Karras permutation of bit-reversed value: nested uniform (Owen) scrambling
+  //! of the value when applied between two bit reversals (Burley 2020).
+  inline uint32_t LaineKarras (uint32_t theValue, uint32_t theSeed)
+  {
+    theValue += theSeed;
+    theValue ^= theValue * 0x6c50b47cu;
+    theValue ^= theValue * 0xb82f1e52u;
+    theValue ^= theValue * 0xc7afe638u;
+    theValue ^= theValue * 0x8d22f6e6u;
+    return theValue;
+  }
+
+  //! Owen scrambling of the value by hash-based permutation (Laine and Karras 2011, Burley 2020).
+  inline uint32_t OwenScramble (uint32_t theValue, uint32_t theSeed)
+  {
+    return ReverseBits (LaineKarras (ReverseBits (theValue), theSeed));
+  }
+
+  //! Returns scrambled point of the first Sobol dimension. Sobol point is the
+  //! reversed index, so two of the bit reversals cancel out.
+  inline uint32_t ScrambledSobol0 (uint32_t theIndex, uint32_t theSeed)
+  {
+    return ReverseBits (LaineKarras (theIndex, theSeed));
+  }
+
+  //! Generator matrix of the second Sobol dimension split into per-byte tables,
+  //! so that a point takes four lookups instead of a loop over index bits.
+  struct SobolTables
+  {
+    uint32_t Bytes[4][256];
+
+    SobolTables()
+    {
+      for (int aByte = 0; aByte < 4; ++aByte)
+      {
+        for (int aValue = 0; aValue < 256; ++aValue)
+        {
+          uint32_t aResult = 0;
+          for (int aBit = 0; aBit < 8; ++aBit)
+          {
+            aResult ^= (aValue & (1 << aBit)) != 0 ? THE_SOBOL_DIRECTIONS[aByte * 8 + aBit] : 0u;
+          }
+          Bytes[aByte][aValue] = aResult;
+        }
+      }
+    }
+  };
+
+  const SobolTables THE_SOBOL_TABLES;
+
+  //! Returns scrambled point of the second Sobol dimension.
+  inline uint32_t ScrambledSobol1 (uint32_t theIndex, uint32_t theSeed)
+  {
+    const uint32_t aResult = THE_SOBOL_TABLES.Bytes[0][theIndex & 0xff]
+                           ^ THE_SOBOL_TABLES.Bytes[1][(theIndex >> 8) & 0xff]
+                           ^ THE_SOBOL_TABLES.Bytes[2][(theIndex >> 16) & 0xff]
+                           ^ THE_SOBOL_TABLES.Bytes[3][theIndex >> 24];
+    return OwenScramble (aResult, theSeed);
+  }
+
+  //! Combines two hashes.
+  inline uint32_t HashCombine (uint32_t theSeed, uint32_t theValue)
+  {
+    return theSeed ^ (HashUInt (theValue) + 0x9e3779b9u + (theSeed << 6) + (theSeed >> 2));
+  }
+
+  //! Converts 32-bit value to float in [0, 1).
+  inline float ToFloat (uint32_t theValue)
+  {
+    return static_cast<float> (theValue >> 8) * (1.f / 16777216.f);
+  }
+
+  //! Returns fractional part of the sum of two values in [0, 1).
+  inline float AddWrapped (float theA, float theB)
+  {
+    const float aSum = theA + theB;
+    return aSum >= 1.f ? aSum - 1.f : aSum;
+  }
+
+  //! Builds blue-noise dither tile by void-and-cluster method (Ulichney 1993).
+  //! Energy of each pixel is sum of toroidal Gaussian kernels of set pixels,
+  //! clusters and voids are pixels with maximum and minimum energy.
+  std::vector<float> BuildBlueNoise (int theSize)
+  {
+    const int aNbPixels = theSize * theSize;
+    const float aSigma  = 1.5f;
+
+    // Kernel indexed by toroidal offset
+    std::vector<float> aKernel (aNbPixels);
+    for (int aY = 0; aY < theSize; ++aY)
+    {
+      for (int aX = 0; aX < theSize; ++aX)
+      {
+        const int aDx = std::min (aX, theSize - aX);
+        const int aDy = std::min (aY, theSize - aY);
+        aKernel[aY * theSize + aX] = std::exp (-static_cast<float> (aDx * aDx + aDy * aDy) / (2.f * aSigma * aSigma));
+      }
+    }
+
+    std::vector<uint8_t> aPattern (aNbPixels, 0);
+    std::vector<float>   anEnergy (aNbPixels, 0.f);
+
+    auto aSplat = [&](int thePixel, float theSign)
+    {
+      const int aPx = thePixel % theSize;
+      const int aPy = thePixel / theSize;
+      for (int aY = 0; aY < theSize; ++aY)
+      {
+        const int aRow = ((aY - aPy + theSize) % theSize) * theSize;
+        for (int aX = 0; aX < theSize; ++aX)
+        {
+          anEnergy[aY * theSize + aX] += theSign * aKernel[aRow + (aX - aPx + theSize) % theSize];
+        }
+      }
+    };
+
+    auto aFind = [&](uint8_t theValue, bool isCluster) -> int
+    {
+      int aBest = -1;
+      for (int aPixel = 0; aPixel < aNbPixels; ++aPixel)
+      {
+        if (aPattern[aPixel] == theValue
+         && (aBest < 0 || (isCluster ? anEnergy[aPixel] > anEnergy[aBest] : anEnergy[aPixel] < anEnergy[aBest])))
+        {
+          aBest = aPixel;
+        }
+      }
+      return aBest;
+    };
+
+    // Initial random pattern with 10% of pixels set
+    Pcg32 aRng (7u, 3u);
+    const int aNbInitial = aNbPixels / 10;
+    for (int aCount = 0; aCount < aNbInitial;)
+    {
+      const int aPixel = static_cast<int> (aRng.NextUInt() % static_cast<uint32_t> (aNbPixels));
+      if (aPattern[aPixel] == 0)
+      {
+        aPattern[aPixel] = 1;
+        aSplat (aPixel, 1.f);
+        ++aCount;
+      }
+    }
+
+    // Move pixels from the tightest clusters into the largest voids until stable
+    for (;;)
+    {
+      const int aCluster = aFind (1, true);
+      aPattern[aCluster] = 0;
+      aSplat (aCluster, -1.f);
+
+      const int aVoid = aFind (0, false);
+      aPattern[aVoid] = 1;
+      aSplat (aVoid, 1.f);
+
+      if (aVoid == aCluster)
+      {
+        break;
+      }
+    }
+
+    std::vector<int> aRanks (aNbPixels, 0);
+
+    // Ranks of the initial pattern by removing clusters
+    {
+      std::vector<uint8_t> aSavedPattern = aPattern;
+      std::vector<float>   aSavedEnergy  = anEnergy;
+      for (int aRank = aNbInitial - 1; aRank >= 0; --aRank)
+      {
+        const int aCluster = aFind (1, true);
+        aPattern[aCluster] = 0;
+        aSplat (aCluster, -1.f);
+        aRanks[aCluster] = aRank;
+      }
+      aPattern = aSavedPattern;
+      anEnergy = aSavedEnergy;
+    }
+
+    // Remaining ranks by filling the largest voids
+    for (int aRank = aNbInitial; aRank < aNbPixels; ++aRank)
+    {
+      const int aVoid = aFind (0, false);
+      aPattern[aVoid] = 1;
+      aSplat (aVoid, 1.f);
+      aRanks[aVoid] = aRank;
+    }
+
+    std::vector<float> aTile (aNbPixels);
+    for (int aPixel = 0; aPixel < aNbPixels; ++aPixel)
+    {
+      aTile[aPixel] = (aRanks[aPixel] + 0.5f) / aNbPixels;
+    }
+    return aTile;
+  }
+}
+
+//=======================================================================
+//function : Start
+//purpose  :
+//=======================================================================
+void PathSampler::Start (SamplerType theType, int thePixelX, int thePixelY, int thePixel, uint32_t theIndex)
+{
+  myType      = static_cast<uint8_t> (theType);
+  myIndex     = theIndex;
+  myDimension = 0;
+  mySeed      = theType == SamplerType_BlueNoise ? THE_BLUE_NOISE_SEED : HashUInt (static_cast<uint32_t> (thePixel) ^ 0x68bc21ebu);
+  myTilePixel = static_cast<uint16_t> ((thePixelY % BlueNoiseSize) * BlueNoiseSize + thePixelX % BlueNoiseSize);
+
+  myRng.Seed (static_cast<uint64_t> (theIndex), static_cast<uint64_t> (thePixel));
+}
+
+//=======================================================================
+//function : nextSobol1D
+//purpose  :
+//=======================================================================
+float PathSampler::nextSobol1D()
+{
+  const uint32_t aSeed  = HashCombine (mySeed, myDimension++);
+  const uint32_t anIdx  = OwenScramble (myIndex, aSeed);
+  const float    aValue = ToFloat (ScrambledSobol0 (anIdx, HashUInt (aSeed)));
+  if (myType != SamplerType_BlueNoise)
+  {
+    return aValue;
+  }
+
+  return AddWrapped (aValue, blueNoise (HashUInt (aSeed)));
+}
+
+//=======================================================================
+//function : nextSobol2D
+//purpose  :
+//=======================================================================
+glm::vec2 PathSampler::nextSobol2D()
+{
+  const uint32_t aSeed = HashCombine (mySeed, myDimension++);
+  const uint32_t anIdx = OwenScramble (myIndex, aSeed);
+
+  glm::vec2 aValue (ToFloat (ScrambledSobol0 (anIdx, HashUInt (aSeed))),
+                    ToFloat (ScrambledSobol1 (anIdx, HashUInt (aSeed + 1u))));
+  if (myType != SamplerType_BlueNoise)
+  {
+    return aValue;
+  }
+
+  aValue.x = AddWrapped (aValue.x, blueNoise (HashUInt (aSeed)));
+  aValue.y = AddWrapped (aValue.y, blueNoise (HashUInt (aSeed + 1u)));
+  return aValue;
+}
+
+//=======================================================================
+//function : blueNoise
+//purpose  :
+//=======================================================================
+float PathSampler::blueNoise (uint32_t theShift) const
+{
+  // Toroidal shift of the tile decorrelates dimensions
+  const int aX = (myTilePixel + theShift) % BlueNoiseSize;
+  const int aY = (myTilePixel / BlueNoiseSize + (theShift >> 8)) % BlueNoiseSize;
+
+  return BlueNoiseTile()[aY * BlueNoiseSize + aX];
+}
+
+//=======================================================================
+//function : BlueNoiseTile
+//purpose  :
+//=======================================================================
+const float* PathSampler::BlueNoiseTile()
+{
+  static const std::vector<float> THE_TILE = BuildBlueNoise (BlueNoiseSize);
+  return THE_TILE.data();
+}
+
+//=======================================================================
+//function : TypeName
+//purpose  :
+//=======================================================================
+const char* PathSampler::TypeName (int theType)
+{
+  switch (theType)
+  {
+    case SamplerType_Random:    return "Random";
+    case SamplerType_Sobol:     return "Sobol";
+    case SamplerType_BlueNoise: return "Blue noise";
+  }
+
+  return "Unknown";
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+#include "Random.hpp"
+
+//! Generators of sample values used by integrators.
+enum SamplerType
+{
+  SamplerType_Random,    //!< independent PCG32 numbers
+  SamplerType_Sobol,     //!< Owen-scrambled Sobol points hashed per pixel
+  SamplerType_BlueNoise, //!< Sobol points shifted by blue-noise tile (screen-space error distribution)
+  SamplerType_NB
+};
+
+//! Stream of sample values of one path (pixel and sample index).
+//! Low-discrepancy samplers are padded (Burley 2020): each requested 1D or 2D
+//! value takes the first dimensions of Sobol sequence scrambled with its own
+//! seed, so that the values stay well distributed regardless of path depth.
+//! State is small and copyable, so that wavefront integrator can store it per path.
+class PathSampler
+{
+public:
+
+  //! Size of square blue-noise tile in pixels.
+  static const int BlueNoiseSize = 64;
+
+  //! Creates random sampler with default seed.
+  PathSampler() : myIndex (0), myDimension (0), mySeed (0), myTilePixel (0), myType (SamplerType_Random) {}
+
+  //! Starts sequence of the given sample of the pixel.
+  void Start (SamplerType theType, int thePixelX, int thePixelY, int thePixel, uint32_t theIndex);
+
+  //! Returns next value in [0, 1).
+  float Next1D()
+  {
+    return myType == SamplerType_Random ? myRng.NextFloat() : nextSobol1D();
+  }
+
+  //! Returns next pair of values in [0, 1)^2.
+  glm::vec2 Next2D()
+  {
+    if (myType == SamplerType_Random)
+    {
+      const float anX = myRng.NextFloat();
+      return glm::vec2 (anX, myRng.NextFloat());
+    }
+
+    return nextSobol2D();
+  }
+
+  //! Returns sampler type.
+  SamplerType Type() const { return static_cast<SamplerType> (myType); }
+
+  //! Returns name of the sampler type.
+  static const char* TypeName (int theType);
+
+  //! Returns blue-noise tile of BlueNoiseSize^2 values in [0, 1) (built on the first call).
+  static const float* BlueNoiseTile();
+
+private:
+
+  //! Returns next value of padded Sobol sequence.
+  float nextSobol1D();
+
+  //! Returns next pair of values of padded Sobol sequence.
+  glm::vec2 nextSobol2D();
+
+  //! Returns value of blue-noise tile at the pixel shifted by theShift.
+  float blueNoise (uint32_t theShift) const;
+
+private:
+
+  Pcg32    myRng;       //!< generator of random sampler
+  uint32_t myIndex;     //!< sample index within the pixel
+  uint32_t myDimension; //!< number of consumed values
+  uint32_t mySeed;      //!< hash of the pixel (per-pixel scrambling)
+  uint16_t myTilePixel; //!< pixel position within blue-noise tile
+  uint8_t  myType;
+
+};
@@ -0,0 +1,2308 @@
+#include "Scene.hpp"
+
+#include "HugePages.hpp"
+#include "ImageIO.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+
+#define TINYOBJLOADER_USE_DOUBLE
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+namespace
+{
+  //! Key of unique OBJ vertex (position, normal and texture coordinate indices).
+  struct VertexKey
+  {
+    int Position;
+    int Normal;
+    int TexCoord;
+
+    bool operator== (const VertexKey& theOther) const
+    {
+      return Position == theOther.Position && Normal == theOther.Normal && TexCoord == theOther.TexCoord;
+    }
+  };
+
+  //! Hasher of OBJ vertex key.
+  struct VertexKeyHasher
+  {
+    size_t operator() (const VertexKey& theKey) const
+    {
+      size_t aHash = static_cast<size_t> (theKey.Position) * 73856093u;
+      aHash ^= static_cast<size_t> (theKey.Normal)   * 19349663u;
+      aHash ^= static_cast<size_t> (theKey.TexCoord) * 83492791u;
+      return aHash;
+    }
+  };
+
+  //! Converts OBJ color to vector.
+  inline glm::vec3 ToVec3 (const double* theColor)
+  {
+    return glm::vec3 (static_cast<float> (theColor[0]),
+                      static_cast<float> (theColor[1]),
+                      static_cast<float> (theColor[2]));
+  }
+
+  //! Returns maximum component of the vector.
+  inline float MaxComponent (const glm::vec3& theVec)
+  {
+    return std::max (theVec.x, std::max (theVec.y, theVec.z));
+  }
+
+  //! Moller-Trumbore ray-triangle test; returns true for hit in (Tmin, theTmax) range.
+  inline bool IntersectTriangle (const Ray&       theRay,
+                                 const glm::vec3& theP0,
+                                 const glm::vec3& theP1,
+                                 const glm::vec3& theP2,
+                                 float            theTmax,
+                                 float&           theT,
+                                 float&           theU,
+                                 float&           theV)
+  {
+    const glm::vec3 anEdge1 = theP1 - theP0;
+    const glm::vec3 anEdge2 = theP2 - theP0;
+
+    const glm::vec3 aPvec = glm::cross (theRay.Direction, anEdge2);
+    const float aDet = glm::dot (anEdge1, aPvec);
+    if (aDet == 0.f)
+    {
+      return false;
+    }
+
+    const float anInvDet = 1.f / aDet;
+
+    const glm::vec3 aTvec = theRay.Origin - theP0;
+    theU = glm::dot (aTvec, aPvec) * anInvDet;
+    if (theU < 0.f || theU > 1.f)
+    {
+      return false;
+    }
+
+    const glm::vec3 aQvec = glm::cross (aTvec, anEdge1);
+    theV = glm::dot (theRay.Direction, aQvec) * anInvDet;
+    if (theV < 0.f || theU + theV > 1.f)
+    {
+      return false;
+    }
+
+    theT = glm::dot (anEdge2, aQvec) * anInvDet;
+    return theT > theRay.Tmin && theT < theTmax;
+  }
+
+  //! Returns bounds of the part of triangle inside the box (Sutherland-Hodgman clipping).
+  Box ClipTriangle (const glm::vec3& theP0, const glm::vec3& theP1, const glm::vec3& theP2, const Box& theBox)
+  {
+    glm::vec3 aPoly[9] = { theP0, theP1, theP2 };
+    glm::vec3 aNext[9];
+    int aNbPoints = 3;
+
+    for (int aPlane = 0; aPlane < 6 && aNbPoints > 0; ++aPlane)
+    {
+      const int   anAxis = aPlane / 2;
+      const bool  isMax  = (aPlane % 2) != 0;
+      const float aValue = isMax ? theBox.Max[anAxis] : theBox.Min[anAxis];
+
+      int aNbNext = 0;
+      for (int aPnt = 0; aPnt < aNbPoints; ++aPnt)
+      {
+        const glm::vec3& aCur = aPoly[aPnt];
+        const glm::vec3& aNxt = aPoly[(aPnt + 1) % aNbPoints];
+
+        const float aDistCur = isMax ? aValue - aCur[anAxis] : aCur[anAxis] - aValue;
+        const float aDistNxt = isMax ? aValue - aNxt[anAxis] : aNxt[anAxis] - aValue;
+
+        if (aDistCur >= 0.f)
+        {
+          aNext[aNbNext++] = aCur;
+        }
+        if ((aDistCur >= 0.f) != (aDistNxt >= 0.f))
+        {
+          glm::vec3 aPoint = aCur + (aNxt - aCur) * (aDistCur / (aDistCur - aDistNxt));
+          aPoint[anAxis] = aValue;
+          aNext[aNbNext++] = aPoint;
+        }
+      }
+
+      std::copy (aNext, aNext + aNbNext, aPoly);
+      aNbPoints = aNbNext;
+    }
+
+    Box aBounds;
+    for (int aPnt = 0; aPnt < aNbPoints; ++aPnt)
+    {
+      aBounds.Add (aPoly[aPnt]);
+    }
+
+    return aBounds;
+  }
+
+  const float THE_PI = 3.14159265358979f;
+
+  //! Minimum number of emitters for building light hierarchy (alias table is used for fewer).
+  const int THE_MIN_BVH_EMITTERS = 16;
+
+  //! Signature and version of BVH cache file.
+  const uint32_t THE_CACHE_MAGIC   = 0x48564252; // "RBVH"
+  const int      THE_CACHE_VERSION = 1;
+
+  //! Number of triangles per task of computing bounds on refit.
+  const size_t THE_REFIT_CHUNK = 4096;
+
+  //! Maximum subdivision level of displaced patches (65536 micro triangles).
+  const int THE_MAX_TESS_LEVEL = 8;
+
+  //! Computes parametric derivatives of triangle (needed to map ray differentials into texture space).
+  void TriangleDerivatives (const glm::vec3& theP0, const glm::vec3& theP1, const glm::vec3& theP2,
+                            const glm::vec2& theUV0, const glm::vec2& theUV1, const glm::vec2& theUV2,
+                            const glm::vec3& theNormal, glm::vec3& theDpdu, glm::vec3& theDpdv)
+  {
+    const glm::vec2 aDuv02 = theUV0 - theUV2;
+    const glm::vec2 aDuv12 = theUV1 - theUV2;
+    const glm::vec3 aDp02  = theP0 - theP2;
+    const glm::vec3 aDp12  = theP1 - theP2;
+
+    const float aDet = aDuv02.x * aDuv12.y - aDuv02.y * aDuv12.x;
+    if (std::abs (aDet) > 1.0e-12f)
+    {
+      const float anInvDet = 1.f / aDet;
+
+      theDpdu = ( aDuv12.y * aDp02 - aDuv02.y * aDp12) * anInvDet;
+      theDpdv = (-aDuv12.x * aDp02 + aDuv02.x * aDp12) * anInvDet;
+    }
+    else
+    {
+      theDpdu = glm::normalize (std::abs (theNormal.x) > 0.9f ? glm::cross (theNormal, glm::vec3 (0.f, 1.f, 0.f))
+                                                              : glm::cross (theNormal, glm::vec3 (1.f, 0.f, 0.f)));
+      theDpdv = glm::cross (theNormal, theDpdu);
+    }
+  }
+}
+
+//=======================================================================
+//function : Scene
+//purpose  :
+//=======================================================================
+Scene::Scene()
+: myTessLevel (5),
+  myLightSampling (LightSampling_Bvh),
+  myBvhBuild (BvhBuild_Binned),
+  myMaxRefGrowth (1.5f),
+  myToOptimizeBvh (false),
+  myToUseCache (false),
+  myToUseWide (false),
+  myToUsePaging (false),
+  myToPrefetch (true),
+  myPageBlockSize (PagedBvh::DefaultBlockSize),
+  myToReplicate (false),
+  myReplicaBudget (static_cast<size_t> (1) << 30),
+  myIsMotionLinear (true),
+  myIsCached (false),
+  myEpsilon (1.0e-4f)
+{
+  //
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void Scene::Clear()
+{
+  Positions.clear();
+  MotionPositions.clear();
+  Normals.clear();
+  MotionNormals.clear();
+  TexCoords.clear();
+  Triangles.clear();
+  Spheres.clear();
+  Discs.clear();
+  Curves.clear();
+  Patches.clear();
+  Materials.clear();
+  Textures.clear();
+
+  myBvh.Clear();
+  myWideBvh.Clear();
+  myMotionBvh.Clear();
+  myPagedBvh.Clear();
+  myReplicas.clear();
+  mySubtreeTop.clear();
+  mySubtreeRoots.clear();
+  mySubtreeLeaves.clear();
+  myShapeBvh.Clear();
+  myCurveBounds.clear();
+  myTessCache.Reset (0, TessellationCache::BuildFunc());
+  myIsCached = false;
+  myCacheFile.clear();
+  myPageFile.clear();
+  myEmitters.clear();
+  myEmitterOfTriangle.clear();
+  myEmitterPower.Clear();
+  myLightBvh.Clear();
+
+  AdoptHugePages();
+}
+
+//=======================================================================
+//function : LoadObj
+//purpose  :
+//=======================================================================
+bool Scene::LoadObj (const std::string& theFileName, ThreadPool& thePool)
+{
+  Clear();
+
+  const size_t aSlash = theFileName.find_last_of ("/\\");
+  const std::string aBaseDir = aSlash == std::string::npos ? std::string() : theFileName.substr (0, aSlash + 1);
+
+  tinyobj::attrib_t                aAttrib;
+  std::vector<tinyobj::shape_t>    aShapes;
+  std::vector<tinyobj::material_t> aMaterials;
+  std::string                      anError;
+
+  if (!tinyobj::LoadObj (&aAttrib, &aShapes, &aMaterials, &anError, theFileName.c_str(), aBaseDir.empty() ? NULL : aBaseDir.c_str()))
+  {
+    std::cout << "Error: failed to load " << theFileName << ": " << anError << std::endl;
+    return false;
+  }
+
+  // Convert materials
+  std::map<std::string, int> aTextureMap;
+
+  auto aLoadTexture = [&](const std::string& theName) -> int
+  {
+    std::map<std::string, int>::iterator aTexIter = aTextureMap.find (theName);
+    if (aTexIter != aTextureMap.end())
+    {
+      return aTexIter->second;
+    }
+
+    int aTexture = -1;
+    int aSizeX   = 0;
+    int aSizeY   = 0;
+
+    std::vector<glm::vec4> aPixels;
+    if (ImageIO::Load (aBaseDir + theName, aSizeX, aSizeY, aPixels))
+    {
+      Textures.push_back (Texture());
+      Textures.back().Init (aSizeX, aSizeY, aPixels.data());
+
+      aTexture = static_cast<int> (Textures.size()) - 1;
+    }
+    else
+    {
+      std::cout << "Warning: failed to load texture " << theName << std::endl;
+    }
+
+    aTextureMap[theName] = aTexture;
+    return aTexture;
+  };
+
+  for (size_t aMatIdx = 0; aMatIdx < aMaterials.size(); ++aMatIdx)
+  {
+    const tinyobj::material_t& aSrc = aMaterials[aMatIdx];
+
+    Material aMaterial;
+    aMaterial.Diffuse  = ToVec3 (aSrc.diffuse);
+    aMaterial.Specular = ToVec3 (aSrc.specular);
+    aMaterial.Emission = ToVec3 (aSrc.emission);
+    aMaterial.Ior      = aSrc.ior > 1.0 ? static_cast<float> (aSrc.ior) : 1.5f;
+
+    const bool isTransparent = aSrc.dissolve < 1.0 || aSrc.illum == 4 || aSrc.illum == 6 || aSrc.illum == 7 || aSrc.illum == 9;
+
+    if (isTransparent)
+    {
+      aMaterial.Type = MaterialType_Dielectric;
+    }
+    else if (MaxComponent (aMaterial.Specular) > MaxComponent (aMaterial.Diffuse))
+    {
+      aMaterial.Type = MaterialType_Glossy;
+
+      // Use PBR roughness if present, otherwise convert Phong exponent to GGX alpha
+      aMaterial.Roughness = aSrc.roughness > 0.0 ? static_cast<float> (aSrc.roughness * aSrc.roughness)
+                                                 : std::sqrt (2.f / (static_cast<float> (aSrc.shininess) + 2.f));
+
+      aMaterial.Roughness = std::max (aMaterial.Roughness, 1.0e-3f);
+    }
+
+    if (!aSrc.diffuse_texname.empty())
+    {
+      aMaterial.DiffuseTexture = aLoadTexture (aSrc.diffuse_texname);
+    }
+
+    // Height map (disp) with scale given by -bm option
+    if (!aSrc.displacement_texname.empty())
+    {
+      aMaterial.DisplacementTexture = aLoadTexture (aSrc.displacement_texname);
+      aMaterial.DisplacementScale   = static_cast<float> (aSrc.displacement_texopt.bump_multiplier);
+    }
+
+    Materials.push_back (aMaterial);
+  }
+
+  // Default material for faces without one
+  const int aDefaultMaterial = static_cast<int> (Materials.size());
+  Materials.push_back (Material());
+
+  // Convert geometry (OBJ indexes attributes separately, so unique combinations become vertices)
+  std::unordered_map<VertexKey, int, VertexKeyHasher> aVertexMap;
+
+  const bool hasNormals   = !aAttrib.normals.empty();
+  const bool hasTexCoords = !aAttrib.texcoords.empty();
+
+  for (size_t aShapeIdx = 0; aShapeIdx < aShapes.size(); ++aShapeIdx)
+  {
+    const tinyobj::mesh_t& aMesh = aShapes[aShapeIdx].mesh;
+
+    size_t anOffset = 0;
+    for (size_t aFaceIdx = 0; aFaceIdx < aMesh.num_face_vertices.size(); anOffset += aMesh.num_face_vertices[aFaceIdx++])
+    {
+      if (aMesh.num_face_vertices[aFaceIdx] != 3)
+      {
+        continue;
+      }
+
+      glm::ivec4 aTriangle;
+      for (int aCorner = 0; aCorner < 3; ++aCorner)
+      {
+        const tinyobj::index_t& anIndex = aMesh.indices[anOffset + aCorner];
+
+        VertexKey aKey = { anIndex.vertex_index,
+                           hasNormals   ? anIndex.normal_index   : -1,
+                           hasTexCoords ? anIndex.texcoord_index : -1 };
+
+        std::unordered_map<VertexKey, int, VertexKeyHasher>::iterator aVertIter = aVertexMap.find (aKey);
+        if (aVertIter == aVertexMap.end())
+        {
+          const int aVertex = static_cast<int> (Positions.size());
+
+          Positions.push_back (glm::vec3 (static_cast<float> (aAttrib.vertices[aKey.Position * 3 + 0]),
+                                          static_cast<float> (aAttrib.vertices[aKey.Position * 3 + 1]),
+                                          static_cast<float> (aAttrib.vertices[aKey.Position * 3 + 2])));
+          if (hasNormals)
+          {
+            Normals.push_back (aKey.Normal < 0 ? glm::vec3 (0.f)
+                                               : glm::vec3 (static_cast<float> (aAttrib.normals[aKey.Normal * 3 + 0]),
+                                                            static_cast<float> (aAttrib.normals[aKey.Normal * 3 + 1]),
+                                                            static_cast<float> (aAttrib.normals[aKey.Normal * 3 + 2])));
+          }
+          if (hasTexCoords)
+          {
+            TexCoords.push_back (aKey.TexCoord < 0 ? glm::vec2 (0.f)
+                                                   : glm::vec2 (static_cast<float> (aAttrib.texcoords[aKey.TexCoord * 2 + 0]),
+                                                                static_cast<float> (aAttrib.texcoords[aKey.TexCoord * 2 + 1])));
+          }
+
+          aVertIter = aVertexMap.insert (std::make_pair (aKey, aVertex)).first;
+        }
+
+        aTriangle[aCorner] = aVertIter->second;
+      }
+
+      const int aMaterial = aFaceIdx < aMesh.material_ids.size() ? aMesh.material_ids[aFaceIdx] : -1;
+      aTriangle.w = aMaterial >= 0 && aMaterial < aDefaultMaterial ? aMaterial : aDefaultMaterial;
+
+      if (Materials[aTriangle.w].IsDisplaced())
+      {
+        Patches.push_back (aTriangle);
+      }
+      else
+      {
+        Triangles.push_back (aTriangle);
+      }
+    }
+  }
+
+  myCacheFile = theFileName + ".bvh";
+  myPageFile  = theFileName + ".pages";
+
+  Commit (thePool);
+
+  std::cout << "Info: loaded " << theFileName << ": " << Triangles.size() << " triangles, "
+            << Patches.size() << " displaced patches, " << Materials.size() << " materials, "
+            << myEmitters.size() << " emitters" << std::endl;
+
+  return !IsEmpty();
+}
+
+//=======================================================================
+//function : Commit
+//purpose  :
+//=======================================================================
+void Scene::Commit (ThreadPool& thePool)
+{
+  std::vector<Box> aBoxes (Triangles.size());
+
+  myEmitters.clear();
+  myEmitterOfTriangle.assign (Triangles.size(), -1);
+
+  for (size_t aTrgIdx = 0; aTrgIdx < Triangles.size(); ++aTrgIdx)
+  {
+    const glm::ivec4& aTriangle = Triangles[aTrgIdx];
+
+    aBoxes[aTrgIdx].Add (Positions[aTriangle.x]);
+    aBoxes[aTrgIdx].Add (Positions[aTriangle.y]);
+    aBoxes[aTrgIdx].Add (Positions[aTriangle.z]);
+
+    if (Materials[aTriangle.w].IsEmissive() && TriangleArea (static_cast<int> (aTrgIdx)) > 0.f)
+    {
+      myEmitterOfTriangle[aTrgIdx] = static_cast<int> (myEmitters.size());
+      myEmitters.push_back (static_cast<int> (aTrgIdx));
+    }
+  }
+
+  const uint64_t aKey = myToUseCache && !myCacheFile.empty() ? cacheKey() : 0;
+
+  myIsCached = aKey != 0 && readCache (aKey);
+  if (!myIsCached)
+  {
+    buildHierarchy (aBoxes, thePool);
+
+    if (aKey != 0)
+    {
+      writeCache (aKey);
+    }
+  }
+
+  myWideBvh.Clear();
+  if (myToUseWide)
+  {
+    myWideBvh.Build (myBvh, aBoxes);
+  }
+
+  buildMotionBvh (thePool);
+
+  buildPagedBvh();
+
+  AdoptHugePages();
+
+  buildSubtrees();
+
+  buildReplicas();
+
+  buildShapeBvh();
+
+  updateLights (aBoxes);
+}
+
+//=======================================================================
+//function : buildHierarchy
+//purpose  :
+//=======================================================================
+void Scene::buildHierarchy (const std::vector<Box>& theBoxes, ThreadPool& thePool)
+{
+  if (myBvhBuild == BvhBuild_Spatial)
+  {
+    myBvh.BuildSpatial (theBoxes, [this](int theTriangle, const Box& theClip)
+    {
+      const glm::ivec4& aTriangle = Triangles[theTriangle];
+      return ClipTriangle (Positions[aTriangle.x], Positions[aTriangle.y], Positions[aTriangle.z], theClip);
+    }, myMaxRefGrowth);
+  }
+  else
+  {
+    myBvh.Build (theBoxes);
+  }
+
+  if (myToOptimizeBvh)
+  {
+    myBvh.Optimize (thePool);
+  }
+}
+
+//=======================================================================
+//function : buildShapeBvh
+//purpose  :
+//=======================================================================
+void Scene::buildShapeBvh()
+{
+  std::vector<Box> aBoxes;
+  aBoxes.reserve (NbShapes());
+
+  for (size_t anIdx = 0; anIdx < Spheres.size(); ++anIdx)
+  {
+    const Sphere& aSphere = Spheres[anIdx];
+    aBoxes.push_back (Box (aSphere.Center - glm::vec3 (aSphere.Radius), aSphere.Center + glm::vec3 (aSphere.Radius)));
+  }
+
+  // Disc extent along each axis is radius scaled by sine of the angle between axis and normal
+  for (size_t anIdx = 0; anIdx < Discs.size(); ++anIdx)
+  {
+    const Disc& aDisc = Discs[anIdx];
+    const glm::vec3 anExtent = aDisc.Radius * glm::sqrt (glm::max (1.f - aDisc.Normal * aDisc.Normal, glm::vec3 (0.f)));
+    aBoxes.push_back (Box (aDisc.Center - anExtent, aDisc.Center + anExtent));
+  }
+
+  myCurveBounds.resize (Curves.size());
+  for (size_t anIdx = 0; anIdx < Curves.size(); ++anIdx)
+  {
+    myCurveBounds[anIdx] = ComputeCurveBounds (Curves[anIdx]);
+    aBoxes.push_back (Curves[anIdx].Bounds());
+  }
+
+  // Patch bounds are enlarged by the largest displacement of its material in any direction
+  for (size_t anIdx = 0; anIdx < Patches.size(); ++anIdx)
+  {
+    const glm::ivec4& aPatch    = Patches[anIdx];
+    const Material&   aMaterial = Materials[aPatch.w];
+
+    const float aHeight = aMaterial.IsDisplaced() ? std::abs (aMaterial.DisplacementScale) * Textures[aMaterial.DisplacementTexture].MaxMagnitude().x : 0.f;
+
+    Box aBox;
+    aBox.Add (Positions[aPatch.x]);
+    aBox.Add (Positions[aPatch.y]);
+    aBox.Add (Positions[aPatch.z]);
+    aBoxes.push_back (Box (aBox.Min - glm::vec3 (aHeight), aBox.Max + glm::vec3 (aHeight)));
+  }
+
+  myShapeBvh.Build (aBoxes);
+
+  myTessCache.Reset (static_cast<int> (Patches.size()), [this](int thePatch, MicroMesh& theMesh)
+  {
+    tessellatePatch (thePatch, theMesh);
+  });
+}
+
+//=======================================================================
+//function : shapeMaterial
+//purpose  :
+//=======================================================================
+int Scene::shapeMaterial (int theShape) const
+{
+  const int aNbSpheres = static_cast<int> (Spheres.size());
+  const int aNbDiscs   = static_cast<int> (Discs.size());
+  const int aNbCurves  = static_cast<int> (Curves.size());
+
+  return theShape < aNbSpheres                        ? Spheres[theShape].Material
+       : theShape < aNbSpheres + aNbDiscs             ? Discs[theShape - aNbSpheres].Material
+       : theShape < aNbSpheres + aNbDiscs + aNbCurves ? Curves[theShape - aNbSpheres - aNbDiscs].Material
+                                                      : Patches[theShape - aNbSpheres - aNbDiscs - aNbCurves].w;
+}
+
+//=======================================================================
+//function : GeometrySize
+//purpose  :
+//=======================================================================
+size_t Scene::GeometrySize() const
+{
+  return (Positions.size() + MotionPositions.size() + Normals.size() + MotionNormals.size()) * sizeof (glm::vec3)
+       + TexCoords.size() * sizeof (glm::vec2)
+       + (Triangles.size() + Patches.size()) * sizeof (glm::ivec4)
+       + Spheres.size()   * sizeof (Sphere)
+       + Discs.size()     * sizeof (Disc)
+       + Curves.size()    * (sizeof (Curve) + sizeof (CurveBounds));
+}
+
+//=======================================================================
+//function : HierarchySize
+//purpose  :
+//=======================================================================
+size_t Scene::HierarchySize() const
+{
+  return myBvh.MemorySize() + myWideBvh.MemorySize() + myMotionBvh.MemorySize() + myPagedBvh.MemorySize()
+       + myShapeBvh.MemorySize() + ReplicaSize()
+       + mySubtreeTop.size() * sizeof (BvhNode)
+       + (mySubtreeRoots.size() + mySubtreeLeaves.size()) * sizeof (int)
+       + (myEmitters.size() + myEmitterOfTriangle.size()) * sizeof (int)
+       + myEmitterPower.MemorySize() + myLightBvh.MemorySize();
+}
+
+//=======================================================================
+//function : TextureSize
+//purpose  :
+//=======================================================================
+size_t Scene::TextureSize() const
+{
+  size_t aSize = myEnvironment.MemorySize();
+  for (size_t aTexture = 0; aTexture < Textures.size(); ++aTexture)
+  {
+    aSize += Textures[aTexture].MemorySize();
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : buildMotionBvh
+//purpose  :
+//=======================================================================
+void Scene::buildMotionBvh (ThreadPool& thePool)
+{
+  myMotionBvh.Clear();
+  if (!HasMotion())
+  {
+    return;
+  }
+
+  if (MotionPositions.size() % Positions.size() != 0
+   || (!MotionNormals.empty() && MotionNormals.size() != MotionPositions.size()))
+  {
+    std::cout << "Warning: motion keys do not match vertices, motion is ignored" << std::endl;
+    MotionPositions.clear();
+    MotionNormals.clear();
+    return;
+  }
+
+  const int    aNbKeys = NbMotionKeys();
+  const size_t aNbTrgs = Triangles.size();
+
+  std::vector<Box> aBoxes (aNbTrgs * aNbKeys);
+
+  const int aNbChunks = static_cast<int> ((aNbTrgs + THE_REFIT_CHUNK - 1) / THE_REFIT_CHUNK);
+  thePool.ParallelFor (aNbChunks * aNbKeys, [&](int theTask, int)
+  {
+    const int        aKey       = theTask / aNbChunks;
+    const size_t     aFirst     = static_cast<size_t> (theTask % aNbChunks) * THE_REFIT_CHUNK;
+    const size_t     aLast      = std::min (aFirst + THE_REFIT_CHUNK, aNbTrgs);
+    const glm::vec3* aPositions = keyPositions (aKey);
+
+    for (size_t aTrgIdx = aFirst; aTrgIdx < aLast; ++aTrgIdx)
+    {
+      const glm::ivec4& aTriangle = Triangles[aTrgIdx];
+
+      Box& aBox = aBoxes[aNbTrgs * aKey + aTrgIdx];
+      aBox.Add (aPositions[aTriangle.x]);
+      aBox.Add (aPositions[aTriangle.y]);
+      aBox.Add (aPositions[aTriangle.z]);
+    }
+  });
+
+  myMotionBvh.Build (aBoxes, aNbKeys, myIsMotionLinear, thePool);
+}
+
+//=======================================================================
+//function : SetTransformMotion
+//purpose  :
+//=======================================================================
+void Scene::SetTransformMotion (const std::vector<glm::mat4>& theKeys, int theFirstTriangle, int theNbTriangles)
+{
+  const int    aNbKeys  = static_cast<int> (theKeys.size());
+  const size_t aNbVerts = Positions.size();
+  if (aNbKeys == 0 || aNbVerts == 0)
+  {
+    return;
+  }
+
+  // Other vertices keep their motion only if it has the same keys
+  if (NbMotionKeys() != aNbKeys)
+  {
+    MotionPositions.clear();
+    MotionNormals.clear();
+    for (int aKey = 1; aKey < aNbKeys; ++aKey)
+    {
+      MotionPositions.insert (MotionPositions.end(), Positions.begin(), Positions.end());
+      MotionNormals.insert (MotionNormals.end(), Normals.begin(), Normals.end());
+    }
+  }
+  else if (MotionNormals.empty() && !Normals.empty())
+  {
+    for (int aKey = 1; aKey < aNbKeys; ++aKey)
+    {
+      MotionNormals.insert (MotionNormals.end(), Normals.begin(), Normals.end());
+    }
+  }
+
+  const int aFirst = std::max (theFirstTriangle, 0);
+  const int aLast  = theNbTriangles < 0 ? static_cast<int> (Triangles.size())
+                                        : std::min (aFirst + theNbTriangles, static_cast<int> (Triangles.size()));
+
+  std::vector<bool> isMoved (aNbVerts, false);
+  for (int aTrgIdx = aFirst; aTrgIdx < aLast; ++aTrgIdx)
+  {
+    isMoved[Triangles[aTrgIdx].x] = true;
+    isMoved[Triangles[aTrgIdx].y] = true;
+    isMoved[Triangles[aTrgIdx].z] = true;
+  }
+
+  for (int aKey = 0; aKey < aNbKeys; ++aKey)
+  {
+    glm::vec3* aPositions = aKey == 0 ? Positions.data() : MotionPositions.data() + (aKey - 1) * aNbVerts;
+    glm::vec3* aNormals   = Normals.empty() ? NULL : (aKey == 0 ? Normals.data() : MotionNormals.data() + (aKey - 1) * aNbVerts);
+
+    const glm::mat3 aNormalMatrix = glm::transpose (glm::inverse (glm::mat3 (theKeys[aKey])));
+    for (size_t aVertex = 0; aVertex < aNbVerts; ++aVertex)
+    {
+      if (!isMoved[aVertex])
+      {
+        continue;
+      }
+
+      aPositions[aVertex] = glm::vec3 (theKeys[aKey] * glm::vec4 (aPositions[aVertex], 1.f));
+      if (aNormals != NULL)
+      {
+        aNormals[aVertex] = aNormalMatrix * aNormals[aVertex];
+      }
+    }
+  }
+}
+
+//=======================================================================
+//function : triangleAt
+//purpose  :
+//=======================================================================
+void Scene::triangleAt (int theTriangle, float theTime, glm::vec3& theP0, glm::vec3& theP1, glm::vec3& theP2) const
+{
+  const glm::ivec4& aTriangle = Triangles[theTriangle];
+  if (!HasMotion())
+  {
+    theP0 = Positions[aTriangle.x];
+    theP1 = Positions[aTriangle.y];
+    theP2 = Positions[aTriangle.z];
+    return;
+  }
+
+  float aTau = 0.f;
+  const int aSegment = MotionBvh::Segment (theTime, NbMotionKeys() - 1, aTau);
+
+  const glm::vec3* aKey0 = keyPositions (aSegment);
+  const glm::vec3* aKey1 = keyPositions (aSegment + 1);
+
+  theP0 = glm::mix (aKey0[aTriangle.x], aKey1[aTriangle.x], aTau);
+  theP1 = glm::mix (aKey0[aTriangle.y], aKey1[aTriangle.y], aTau);
+  theP2 = glm::mix (aKey0[aTriangle.z], aKey1[aTriangle.z], aTau);
+}
+
+//=======================================================================
+//function : SetWideBvh
+//purpose  :
+//=======================================================================
+void Scene::SetWideBvh (bool theToUse, ThreadPool& thePool)
+{
+  myToUseWide = theToUse;
+
+  myWideBvh.Clear();
+  if (myToUseWide && !myBvh.IsEmpty())
+  {
+    myWideBvh.Build (myBvh, triangleBoxes (thePool));
+  }
+
+  // Only binary hierarchy is replicated
+  buildReplicas();
+}
+
+//=======================================================================
+//function : SetPaging
+//purpose  :
+//=======================================================================
+void Scene::SetPaging (bool theToUse, ThreadPool& thePool)
+{
+  if (myToUsePaging == theToUse)
+  {
+    return;
+  }
+
+  myToUsePaging = theToUse;
+  if (myToUsePaging)
+  {
+    buildPagedBvh();
+    AdoptHugePages();
+    buildSubtrees();
+    buildReplicas();
+  }
+  else if (!myPagedBvh.IsEmpty())
+  {
+    // Released binary hierarchy is built again
+    myPagedBvh.Clear();
+    Commit (thePool);
+  }
+}
+
+//=======================================================================
+//function : buildPagedBvh
+//purpose  :
+//=======================================================================
+void Scene::buildPagedBvh()
+{
+  myPagedBvh.Clear();
+  if (!myToUsePaging || HasMotion() || myBvh.IsEmpty())
+  {
+    return;
+  }
+
+  const std::string aFile = !myPageFile.empty() ? myPageFile : std::string ("scene.pages");
+  if (!myPagedBvh.Build (myBvh, Positions, Triangles, aFile, myPageBlockSize))
+  {
+    std::cout << "Warning: can't map paged BVH " << aFile << ", BVH is kept in memory" << std::endl;
+    return;
+  }
+
+  // Assignment releases memory kept by Clear(), traversal reads only the mapped copy
+  myBvh = Bvh();
+  myWideBvh.Clear();
+}
+
+//=======================================================================
+//function : buildSubtrees
+//purpose  :
+//=======================================================================
+void Scene::buildSubtrees()
+{
+  mySubtreeTop.clear();
+  mySubtreeRoots.clear();
+  mySubtreeLeaves.clear();
+  if (!myMotionBvh.IsEmpty())
+  {
+    return;
+  }
+
+  // In-memory hierarchy is cut like the paged one, so that both bin rays alike
+  if (myPagedBvh.IsEmpty())
+  {
+    myBvh.CutSubtrees (static_cast<size_t> (myPageBlockSize), sizeof (PagedTriangle), mySubtreeTop, mySubtreeRoots);
+  }
+
+  const std::vector<BvhNode>& aTop = subtreeTop();
+  for (size_t aNodeIdx = 0; aNodeIdx < aTop.size(); ++aNodeIdx)
+  {
+    if (aTop[aNodeIdx].IsLeaf())
+    {
+      mySubtreeLeaves.resize (std::max (mySubtreeLeaves.size(), static_cast<size_t> (aTop[aNodeIdx].LeftOrFirst + 1)));
+      mySubtreeLeaves[aTop[aNodeIdx].LeftOrFirst] = static_cast<int> (aNodeIdx);
+    }
+  }
+}
+
+//=======================================================================
+//function : SetReplication
+//purpose  :
+//=======================================================================
+void Scene::SetReplication (bool theToUse)
+{
+  myToReplicate = theToUse;
+  buildReplicas();
+}
+
+//=======================================================================
+//function : ReplicaSize
+//purpose  :
+//=======================================================================
+size_t Scene::ReplicaSize() const
+{
+  size_t aSize = 0;
+  for (size_t aNodeIdx = 0; aNodeIdx < myReplicas.size(); ++aNodeIdx)
+  {
+    const NodeReplica& aReplica = *myReplicas[aNodeIdx];
+    aSize += aReplica.Hierarchy.MemorySize()
+           + aReplica.Positions.size() * sizeof (glm::vec3)
+           + aReplica.Triangles.size() * sizeof (glm::ivec4);
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : AdoptHugePages
+//purpose  :
+//=======================================================================
+void Scene::AdoptHugePages()
+{
+  // Arrays are copied only when enabled or disabled, refitted nodes stay in place
+  myBvh.AdoptHugePages ("bvh");
+  HugePages::Adopt (Positions, "positions");
+  HugePages::Adopt (Normals,   "normals");
+  HugePages::Adopt (Triangles, "triangles");
+}
+
+//=======================================================================
+//function : buildReplicas
+//purpose  :
+//=======================================================================
+void Scene::buildReplicas()
+{
+  myReplicas.clear();
+
+  const NumaTopology& aTopology = NumaTopology::Get();
+  if (!myToReplicate || aTopology.NbNodes() < 2 || myBvh.IsEmpty() || myToUseWide || !myMotionBvh.IsEmpty())
+  {
+    return;
+  }
+
+  const size_t aSize = myBvh.MemorySize() + Positions.size() * sizeof (glm::vec3) + Triangles.size() * sizeof (glm::ivec4);
+  if (aSize * aTopology.NbNodes() > myReplicaBudget)
+  {
+    std::cout << "Warning: NUMA replicas need " << (aSize * aTopology.NbNodes() >> 20) << " MB, budget is "
+              << (myReplicaBudget >> 20) << " MB, scene is not replicated" << std::endl;
+    return;
+  }
+
+  // Copies are written by thread of the node, so their pages are placed there on first touch
+  for (int aNode = 0; aNode < aTopology.NbNodes(); ++aNode)
+  {
+    aTopology.RunOnNode (aNode, [&]()
+    {
+      myReplicas.push_back (std::unique_ptr<NodeReplica> (new NodeReplica()));
+      myReplicas.back()->Hierarchy = myBvh;
+      myReplicas.back()->Positions = Positions;
+      myReplicas.back()->Triangles = Triangles;
+    });
+  }
+}
+
+//=======================================================================
+//function : SetMotionInterpolation
+//purpose  :
+//=======================================================================
+void Scene::SetMotionInterpolation (bool theIsLinear, ThreadPool& thePool)
+{
+  myIsMotionLinear = theIsLinear;
+  if (!myBvh.IsEmpty())
+  {
+    buildMotionBvh (thePool);
+  }
+}
+
+//=======================================================================
+//function : SetTessellationLevel
+//purpose  :
+//=======================================================================
+void Scene::SetTessellationLevel (int theLevel)
+{
+  myTessLevel = glm::clamp (theLevel, 0, THE_MAX_TESS_LEVEL);
+  myTessCache.Clear();
+}
+
+//=======================================================================
+//function : TessellatePatches
+//purpose  :
+//=======================================================================
+void Scene::TessellatePatches()
+{
+  const int aNbSegs = 1 << myTessLevel;
+
+  for (size_t aPatchIdx = 0; aPatchIdx < Patches.size(); ++aPatchIdx)
+  {
+    const glm::ivec4& aPatch = Patches[aPatchIdx];
+    const int aFirst = static_cast<int> (Positions.size());
+
+    // Zero normals make shading follow micro triangles as with the cache
+    for (int aJ = 0; aJ <= aNbSegs; ++aJ)
+    {
+      for (int anI = 0; anI <= aNbSegs - aJ; ++anI)
+      {
+        glm::vec2 aUV;
+        Positions.push_back (displacedVertex (aPatch, aNbSegs, anI, aJ, aUV));
+        if (!Normals.empty())
+        {
+          Normals.push_back (glm::vec3 (0.f));
+        }
+        if (!TexCoords.empty())
+        {
+          TexCoords.push_back (aUV);
+        }
+      }
+    }
+
+    for (int aJ = 0; aJ < aNbSegs; ++aJ)
+    {
+      for (int anI = 0; anI < aNbSegs - aJ; ++anI)
+      {
+        for (int aHalf = 0; aHalf < (anI + aJ < aNbSegs - 1 ? 2 : 1); ++aHalf)
+        {
+          glm::ivec2 aV0, aV1, aV2;
+          MicroMesh::CellVertices (MicroMesh::PackCell (anI, aJ, aHalf != 0), aV0, aV1, aV2);
+
+          Triangles.push_back (glm::ivec4 (aFirst + MicroMesh::Vertex (aNbSegs, aV0.x, aV0.y),
+                                           aFirst + MicroMesh::Vertex (aNbSegs, aV1.x, aV1.y),
+                                           aFirst + MicroMesh::Vertex (aNbSegs, aV2.x, aV2.y), aPatch.w));
+        }
+      }
+    }
+  }
+
+  Patches.clear();
+}
+
+//=======================================================================
+//function : cacheKey
+//purpose  :
+//=======================================================================
+uint64_t Scene::cacheKey() const
+{
+  // FNV-1a over geometry and everything affecting the hierarchy
+  uint64_t aHash = 14695981039346656037ULL;
+  auto aHashBytes = [&aHash](const void* theData, size_t theSize)
+  {
+    const unsigned char* aBytes = static_cast<const unsigned char*> (theData);
+    for (size_t anIdx = 0; anIdx < theSize; ++anIdx)
+    {
+      aHash = (aHash ^ aBytes[anIdx]) * 1099511628211ULL;
+    }
+  };
+
+  const int aSettings[5] = { THE_CACHE_VERSION, static_cast<int> (myBvhBuild), myToOptimizeBvh ? 1 : 0, myBvh.NbBins(), myBvh.MaxLeafSize() };
+  aHashBytes (aSettings, sizeof (aSettings));
+  aHashBytes (&myMaxRefGrowth, sizeof (myMaxRefGrowth));
+  aHashBytes (Positions.data(), Positions.size() * sizeof (glm::vec3));
+  aHashBytes (Triangles.data(), Triangles.size() * sizeof (glm::ivec4));
+
+  return aHash;
+}
+
+//=======================================================================
+//function : readCache
+//purpose  :
+//=======================================================================
+bool Scene::readCache (uint64_t theKey)
+{
+  std::ifstream aFile (myCacheFile.c_str(), std::ios::binary);
+  if (!aFile.good())
+  {
+    return false;
+  }
+
+  uint32_t aMagic = 0;
+  uint64_t aKey   = 0;
+  if (!aFile.read (reinterpret_cast<char*> (&aMagic), sizeof (aMagic))
+   || !aFile.read (reinterpret_cast<char*> (&aKey),   sizeof (aKey))
+   || aMagic != THE_CACHE_MAGIC
+   || aKey   != theKey)
+  {
+    return false;
+  }
+
+  if (!myBvh.Read (aFile) || myBvh.NbPrimitives() != static_cast<int> (Triangles.size()))
+  {
+    std::cout << "Warning: invalid BVH cache " << myCacheFile << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//=======================================================================
+//function : writeCache
+//purpose  :
+//=======================================================================
+void Scene::writeCache (uint64_t theKey) const
+{
+  std::ofstream aFile (myCacheFile.c_str(), std::ios::binary);
+
+  const uint32_t aMagic = THE_CACHE_MAGIC;
+  aFile.write (reinterpret_cast<const char*> (&aMagic), sizeof (aMagic));
+  aFile.write (reinterpret_cast<const char*> (&theKey), sizeof (theKey));
+  myBvh.Write (aFile);
+
+  if (!aFile.good())
+  {
+    std::cout << "Warning: can't write BVH cache " << myCacheFile << std::endl;
+  }
+}
+
+//=======================================================================
+//function : Refit
+//purpose  :
+//=======================================================================
+int Scene::Refit (ThreadPool& thePool)
+{
+  const std::vector<Box> aBoxes = triangleBoxes (thePool);
+
+  // Binary hierarchy is released after paging, so blocks are cut from a new build
+  const bool isPaged = !myPagedBvh.IsEmpty();
+
+  int aNbRebuilt = isPaged ? -1 : myBvh.Refit (aBoxes, thePool);
+  if (aNbRebuilt < 0)
+  {
+    buildHierarchy (aBoxes, thePool);
+    aNbRebuilt = 0;
+  }
+
+  // Quantization grids depend on node bounds, so the wide hierarchy is collapsed again
+  if (myToUseWide)
+  {
+    myWideBvh.Build (myBvh, aBoxes);
+  }
+
+  buildMotionBvh (thePool);
+
+  if (isPaged)
+  {
+    buildPagedBvh();
+  }
+
+  AdoptHugePages();
+
+  buildSubtrees();
+
+  buildReplicas();
+
+  updateLights (aBoxes);
+
+  return aNbRebuilt;
+}
+
+//=======================================================================
+//function : triangleBoxes
+//purpose  :
+//=======================================================================
+std::vector<Box> Scene::triangleBoxes (ThreadPool& thePool) const
+{
+  std::vector<Box> aBoxes (Triangles.size());
+
+  const int aNbChunks = static_cast<int> ((Triangles.size() + THE_REFIT_CHUNK - 1) / THE_REFIT_CHUNK);
+  thePool.ParallelFor (aNbChunks, [&](int theChunk, int)
+  {
+    const size_t aLast = std::min (static_cast<size_t> (theChunk + 1) * THE_REFIT_CHUNK, Triangles.size());
+    for (size_t aTrgIdx = static_cast<size_t> (theChunk) * THE_REFIT_CHUNK; aTrgIdx < aLast; ++aTrgIdx)
+    {
+      const glm::ivec4& aTriangle = Triangles[aTrgIdx];
+
+      aBoxes[aTrgIdx].Add (Positions[aTriangle.x]);
+      aBoxes[aTrgIdx].Add (Positions[aTriangle.y]);
+      aBoxes[aTrgIdx].Add (Positions[aTriangle.z]);
+    }
+  });
+
+  return aBoxes;
+}
+
+//=======================================================================
+//function : updateLights
+//purpose  :
+//=======================================================================
+void Scene::updateLights (const std::vector<Box>& theBoxes)
+{
+  // Emitted power of one-sided triangle is pi * area * radiance
+  std::vector<LightBounds> aLights (myEmitters.size());
+  std::vector<float>       aPowers (myEmitters.size());
+
+  for (size_t anIdx = 0; anIdx < myEmitters.size(); ++anIdx)
+  {
+    const glm::ivec4& aTriangle = Triangles[myEmitters[anIdx]];
+    const glm::vec3&  anEmission = Materials[aTriangle.w].Emission;
+
+    const glm::vec3 aCross = glm::cross (Positions[aTriangle.y] - Positions[aTriangle.x],
+                                         Positions[aTriangle.z] - Positions[aTriangle.x]);
+
+    LightBounds& aLight = aLights[anIdx];
+    aLight.Bounds    = theBoxes[myEmitters[anIdx]];
+    aLight.Axis      = glm::normalize (aCross);
+    aLight.CosThetaO = 1.f;
+    aLight.CosThetaE = 0.f;
+    aLight.Power     = THE_PI * 0.5f * glm::length (aCross) * (0.2126f * anEmission.x + 0.7152f * anEmission.y + 0.0722f * anEmission.z);
+
+    aPowers[anIdx] = aLight.Power;
+  }
+
+  myEmitterPower.Build (aPowers);
+
+  myLightBvh.Clear();
+  if (static_cast<int> (myEmitters.size()) >= THE_MIN_BVH_EMITTERS)
+  {
+    myLightBvh.Build (aLights);
+  }
+
+  const Box aBounds = Bounds();
+  myEpsilon = aBounds.IsValid() ? std::max (glm::length (aBounds.Size()) * 1.0e-5f, 1.0e-6f) : 1.0e-4f;
+}
+
+//=======================================================================
+//function : Intersect
+//purpose  :
+//=======================================================================
+bool Scene::Intersect (const Ray& theRay, SurfaceHit& theHit, TraversalStats* theStats) const
+{
+  float aTmax = theRay.Tmax;
+
+  theHit.Triangle = -1;
+  theHit.Time     = theRay.Time;
+  if (!myMotionBvh.IsEmpty())
+  {
+    intersectMotion (theRay, aTmax, theHit, theStats);
+    intersectShapes (theRay, aTmax, theHit, theStats);
+    return theHit.Triangle != -1;
+  }
+
+  if (!myPagedBvh.IsEmpty())
+  {
+    intersectPaged (theRay, aTmax, theHit, theStats);
+    intersectShapes (theRay, aTmax, theHit, theStats);
+    return theHit.Triangle != -1;
+  }
+
+  const NodeReplica*       aReplica   = localReplica();
+  const Bvh&               aBvh       = aReplica != NULL ? aReplica->Hierarchy : myBvh;
+  const glm::vec3*         aPositions = aReplica != NULL ? aReplica->Positions.data() : Positions.data();
+  const glm::ivec4*        aTriangles = aReplica != NULL ? aReplica->Triangles.data() : Triangles.data();
+  const std::vector<int>&  anIndices  = myToUseWide ? myWideBvh.Indices() : aBvh.Indices();
+
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      const int aTrgIdx = anIndices[anIdx];
+      const glm::ivec4& aTriangle = aTriangles[aTrgIdx];
+
+      float aT, aU, aV;
+      if (IntersectTriangle (theRay, aPositions[aTriangle.x], aPositions[aTriangle.y], aPositions[aTriangle.z], theTmax, aT, aU, aV))
+      {
+        theTmax = aT;
+
+        theHit.T        = aT;
+        theHit.Triangle = aTrgIdx;
+        theHit.U        = aU;
+        theHit.V        = aV;
+      }
+    }
+
+    return false;
+  };
+
+  if (myToUseWide)
+  {
+    myWideBvh.Traverse (theRay, aTmax, aLeafFunc, theStats);
+  }
+  else
+  {
+    aBvh.Traverse (theRay, aTmax, aLeafFunc, theStats);
+  }
+
+  intersectShapes (theRay, aTmax, theHit, theStats);
+
+  return theHit.Triangle != -1;
+}
+
+//=======================================================================
+//function : Occluded
+//purpose  :
+//=======================================================================
+bool Scene::Occluded (const Ray& theRay, int& theHint) const
+{
+  if (!myShapeBvh.IsEmpty() && occludedShapes (theRay, theHint))
+  {
+    return true;
+  }
+
+  if (!myMotionBvh.IsEmpty())
+  {
+    return occludedMotion (theRay, theHint);
+  }
+
+  if (!myPagedBvh.IsEmpty())
+  {
+    return occludedPaged (theRay, theHint);
+  }
+
+  const NodeReplica* aReplica   = localReplica();
+  const Bvh&         aBvh       = aReplica != NULL ? aReplica->Hierarchy : myBvh;
+  const glm::vec3*   aPositions = aReplica != NULL ? aReplica->Positions.data() : Positions.data();
+  const glm::ivec4*  aTriangles = aReplica != NULL ? aReplica->Triangles.data() : Triangles.data();
+
+  float aT, aU, aV;
+  if (theHint != -1 && theHint < static_cast<int> (Triangles.size()))
+  {
+    const glm::ivec4& aTriangle = aTriangles[theHint];
+    if (IntersectTriangle (theRay, aPositions[aTriangle.x], aPositions[aTriangle.y], aPositions[aTriangle.z], theRay.Tmax, aT, aU, aV))
+    {
+      return true;
+    }
+  }
+
+  const std::vector<int>& anIndices = myToUseWide ? myWideBvh.Indices() : aBvh.Indices();
+
+  float aTmax = theRay.Tmax;
+  int anOccluder = -1;
+
+  // Any hit terminates traversal, hit attributes are not needed
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      const int aTrgIdx = anIndices[anIdx];
+      if (aTrgIdx == theHint)
+      {
+        continue;
+      }
+
+      const glm::ivec4& aTriangle = aTriangles[aTrgIdx];
+      if (IntersectTriangle (theRay, aPositions[aTriangle.x], aPositions[aTriangle.y], aPositions[aTriangle.z], theTmax, aT, aU, aV))
+      {
+        anOccluder = aTrgIdx;
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  if (myToUseWide)
+  {
+    myWideBvh.Traverse (theRay, aTmax, aLeafFunc);
+  }
+  else
+  {
+    aBvh.Traverse (theRay, aTmax, aLeafFunc);
+  }
+
+  if (anOccluder != -1)
+  {
+    theHint = anOccluder;
+  }
+  return anOccluder != -1;
+}
+
+//=======================================================================
+//function : intersectMotion
+//purpose  :
+//=======================================================================
+void Scene::intersectMotion (const Ray& theRay, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats) const
+{
+  float aTau = 0.f;
+  const int aSegment = MotionBvh::Segment (theRay.Time, myMotionBvh.NbSegments(), aTau);
+
+  const std::vector<int>& anIndices = myMotionBvh.Indices (aSegment);
+  const glm::vec3*        aKey0     = keyPositions (aSegment);
+  const glm::vec3*        aKey1     = keyPositions (aSegment + 1);
+
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      const int aTrgIdx = anIndices[anIdx];
+      const glm::ivec4& aTriangle = Triangles[aTrgIdx];
+
+      float aT, aU, aV;
+      if (IntersectTriangle (theRay,
+                             glm::mix (aKey0[aTriangle.x], aKey1[aTriangle.x], aTau),
+                             glm::mix (aKey0[aTriangle.y], aKey1[aTriangle.y], aTau),
+                             glm::mix (aKey0[aTriangle.z], aKey1[aTriangle.z], aTau), theTmax, aT, aU, aV))
+      {
+        theTmax = aT;
+
+        theHit.T        = aT;
+        theHit.Triangle = aTrgIdx;
+        theHit.U        = aU;
+        theHit.V        = aV;
+      }
+    }
+
+    return false;
+  };
+
+  myMotionBvh.Traverse (theRay, theTmax, aLeafFunc, theStats);
+}
+
+//=======================================================================
+//function : occludedMotion
+//purpose  :
+//=======================================================================
+bool Scene::occludedMotion (const Ray& theRay, int& theHint) const
+{
+  float aTau = 0.f;
+  const int aSegment = MotionBvh::Segment (theRay.Time, myMotionBvh.NbSegments(), aTau);
+
+  const std::vector<int>& anIndices = myMotionBvh.Indices (aSegment);
+  const glm::vec3*        aKey0     = keyPositions (aSegment);
+  const glm::vec3*        aKey1     = keyPositions (aSegment + 1);
+
+  auto anIntersect = [&](int theTriangle, float theTmax) -> bool
+  {
+    const glm::ivec4& aTriangle = Triangles[theTriangle];
+
+    float aT, aU, aV;
+    return IntersectTriangle (theRay,
+                              glm::mix (aKey0[aTriangle.x], aKey1[aTriangle.x], aTau),
+                              glm::mix (aKey0[aTriangle.y], aKey1[aTriangle.y], aTau),
+                              glm::mix (aKey0[aTriangle.z], aKey1[aTriangle.z], aTau), theTmax, aT, aU, aV);
+  };
+
+  if (theHint != -1 && theHint < static_cast<int> (Triangles.size()) && anIntersect (theHint, theRay.Tmax))
+  {
+    return true;
+  }
+
+  float aTmax = theRay.Tmax;
+  int anOccluder = -1;
+
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      const int aTrgIdx = anIndices[anIdx];
+      if (aTrgIdx != theHint && anIntersect (aTrgIdx, theTmax))
+      {
+        anOccluder = aTrgIdx;
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  myMotionBvh.Traverse (theRay, aTmax, aLeafFunc);
+
+  if (anOccluder != -1)
+  {
+    theHint = anOccluder;
+  }
+  return anOccluder != -1;
+}
+
+//=======================================================================
+//function : intersectPaged
+//purpose  :
+//=======================================================================
+void Scene::intersectPaged (const Ray& theRay, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats) const
+{
+  auto aLeafFunc = [&](const PagedTriangle* theTriangles, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = 0; anIdx < theCount; ++anIdx)
+    {
+      const PagedTriangle& aTriangle = theTriangles[anIdx];
+
+      float aT, aU, aV;
+      if (IntersectTriangle (theRay, aTriangle.P0, aTriangle.P1, aTriangle.P2, theTmax, aT, aU, aV))
+      {
+        theTmax = aT;
+
+        theHit.T        = aT;
+        theHit.Triangle = aTriangle.Index;
+        theHit.U        = aU;
+        theHit.V        = aV;
+      }
+    }
+
+    return false;
+  };
+
+  myPagedBvh.Traverse (theRay, theTmax, aLeafFunc, theStats);
+}
+
+//=======================================================================
+//function : occludedPaged
+//purpose  :
+//=======================================================================
+bool Scene::occludedPaged (const Ray& theRay, int& theHint) const
+{
+  float aT, aU, aV;
+  if (theHint != -1 && theHint < static_cast<int> (Triangles.size()))
+  {
+    const glm::ivec4& aTriangle = Triangles[theHint];
+    if (IntersectTriangle (theRay, Positions[aTriangle.x], Positions[aTriangle.y], Positions[aTriangle.z], theRay.Tmax, aT, aU, aV))
+    {
+      return true;
+    }
+  }
+
+  float aTmax = theRay.Tmax;
+  int anOccluder = -1;
+
+  auto aLeafFunc = [&](const PagedTriangle* theTriangles, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = 0; anIdx < theCount; ++anIdx)
+    {
+      const PagedTriangle& aTriangle = theTriangles[anIdx];
+      if (aTriangle.Index != theHint && IntersectTriangle (theRay, aTriangle.P0, aTriangle.P1, aTriangle.P2, theTmax, aT, aU, aV))
+      {
+        anOccluder = aTriangle.Index;
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  myPagedBvh.Traverse (theRay, aTmax, aLeafFunc);
+
+  if (anOccluder != -1)
+  {
+    theHint = anOccluder;
+  }
+  return anOccluder != -1;
+}
+
+//=======================================================================
+//function : EnteredSubtrees
+//purpose  :
+//=======================================================================
+int Scene::EnteredSubtrees (const Ray& theRay, int* theSubtrees, float* theEntries, int theMaxSubtrees) const
+{
+  const std::vector<BvhNode>& aTop = subtreeTop();
+  if (aTop.empty())
+  {
+    return 0;
+  }
+
+  const glm::vec3 anInvDir (1.f / theRay.Direction.x,
+                            1.f / theRay.Direction.y,
+                            1.f / theRay.Direction.z);
+
+  // Tmax is not shortened, so subtrees come in the same order as in full traversal
+  int aNbSubtrees = 0;
+  auto aLeafFunc = [&](int theSubtree, int, float& theTmax) -> bool
+  {
+    if (aNbSubtrees < theMaxSubtrees)
+    {
+      theSubtrees[aNbSubtrees] = theSubtree;
+      theEntries [aNbSubtrees] = Bvh::IntersectBox (aTop[mySubtreeLeaves[theSubtree]].Bounds,
+                                                    theRay.Origin, anInvDir, theRay.Tmin, theTmax);
+    }
+    ++aNbSubtrees;
+    return false;
+  };
+
+  float aTmax = theRay.Tmax;
+  Bvh::TraverseNodes (aTop.data(), 0, theRay, anInvDir, aTmax, aLeafFunc, NULL);
+
+  return aNbSubtrees;
+}
+
+//=======================================================================
+//function : IntersectSubtree
+//purpose  :
+//=======================================================================
+void Scene::IntersectSubtree (const Ray& theRay, int theSubtree, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats) const
+{
+  if (!myPagedBvh.IsEmpty())
+  {
+    auto aLeafFunc = [&](const PagedTriangle* theTriangles, int theCount, float& theTmax) -> bool
+    {
+      for (int anIdx = 0; anIdx < theCount; ++anIdx)
+      {
+        const PagedTriangle& aTriangle = theTriangles[anIdx];
+
+        float aT, aU, aV;
+        if (IntersectTriangle (theRay, aTriangle.P0, aTriangle.P1, aTriangle.P2, theTmax, aT, aU, aV))
+        {
+          theTmax = aT;
+
+          theHit.T        = aT;
+          theHit.Triangle = aTriangle.Index;
+          theHit.U        = aU;
+          theHit.V        = aV;
+        }
+      }
+
+      return false;
+    };
+
+    myPagedBvh.TraverseBlock (theSubtree, theRay, theTmax, aLeafFunc, theStats);
+    return;
+  }
+
+  const NodeReplica* aReplica   = localReplica();
+  const Bvh&         aBvh       = aReplica != NULL ? aReplica->Hierarchy : myBvh;
+  const glm::vec3*   aPositions = aReplica != NULL ? aReplica->Positions.data() : Positions.data();
+  const glm::ivec4*  aTriangles = aReplica != NULL ? aReplica->Triangles.data() : Triangles.data();
+  const std::vector<int>& anIndices = aBvh.Indices();
+
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      const int aTrgIdx = anIndices[anIdx];
+      const glm::ivec4& aTriangle = aTriangles[aTrgIdx];
+
+      float aT, aU, aV;
+      if (IntersectTriangle (theRay, aPositions[aTriangle.x], aPositions[aTriangle.y], aPositions[aTriangle.z], theTmax, aT, aU, aV))
+      {
+        theTmax = aT;
+
+        theHit.T        = aT;
+        theHit.Triangle = aTrgIdx;
+        theHit.U        = aU;
+        theHit.V        = aV;
+      }
+    }
+
+    return false;
+  };
+
+  aBvh.TraverseSubtree (mySubtreeRoots[theSubtree], theRay, theTmax, aLeafFunc, theStats);
+}
+
+//=======================================================================
+//function : OccludedSubtree
+//purpose  :
+//=======================================================================
+bool Scene::OccludedSubtree (const Ray& theRay, int theSubtree) const
+{
+  float aTmax = theRay.Tmax;
+  bool isOccluded = false;
+
+  if (!myPagedBvh.IsEmpty())
+  {
+    auto aLeafFunc = [&](const PagedTriangle* theTriangles, int theCount, float& theTmax) -> bool
+    {
+      for (int anIdx = 0; anIdx < theCount; ++anIdx)
+      {
+        const PagedTriangle& aTriangle = theTriangles[anIdx];
+
+        float aT, aU, aV;
+        if (IntersectTriangle (theRay, aTriangle.P0, aTriangle.P1, aTriangle.P2, theTmax, aT, aU, aV))
+        {
+          isOccluded = true;
+          return true;
+        }
+      }
+
+      return false;
+    };
+
+    myPagedBvh.TraverseBlock (theSubtree, theRay, aTmax, aLeafFunc);
+    return isOccluded;
+  }
+
+  const NodeReplica* aReplica   = localReplica();
+  const Bvh&         aBvh       = aReplica != NULL ? aReplica->Hierarchy : myBvh;
+  const glm::vec3*   aPositions = aReplica != NULL ? aReplica->Positions.data() : Positions.data();
+  const glm::ivec4*  aTriangles = aReplica != NULL ? aReplica->Triangles.data() : Triangles.data();
+  const std::vector<int>& anIndices = aBvh.Indices();
+
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      const glm::ivec4& aTriangle = aTriangles[anIndices[anIdx]];
+
+      float aT, aU, aV;
+      if (IntersectTriangle (theRay, aPositions[aTriangle.x], aPositions[aTriangle.y], aPositions[aTriangle.z], theTmax, aT, aU, aV))
+      {
+        isOccluded = true;
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  aBvh.TraverseSubtree (mySubtreeRoots[theSubtree], theRay, aTmax, aLeafFunc);
+  return isOccluded;
+}
+
+//=======================================================================
+//function : intersectShape
+//purpose  :
+//=======================================================================
+bool Scene::intersectShape (const Ray& theRay, int theShape, float theTmax, float& theT, float& theU, float& theV) const
+{
+  const int aNbSpheres = static_cast<int> (Spheres.size());
+  const int aNbDiscs   = static_cast<int> (Discs.size());
+
+  if (theShape < aNbSpheres)
+  {
+    return IntersectSphere (theRay, Spheres[theShape], theTmax, theT, theU, theV);
+  }
+  if (theShape < aNbSpheres + aNbDiscs)
+  {
+    return IntersectDisc (theRay, Discs[theShape - aNbSpheres], theTmax, theT, theU, theV);
+  }
+
+  const int aCurve = theShape - aNbSpheres - aNbDiscs;
+  if (aCurve < static_cast<int> (Curves.size()))
+  {
+    return IntersectCurve (theRay, Curves[aCurve], myCurveBounds[aCurve], theTmax, theT, theU, theV);
+  }
+
+  return intersectPatch (theRay, aCurve - static_cast<int> (Curves.size()), theTmax, theT, theU, theV);
+}
+
+//=======================================================================
+//function : intersectShapes
+//purpose  :
+//=======================================================================
+void Scene::intersectShapes (const Ray& theRay, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats) const
+{
+  if (myShapeBvh.IsEmpty())
+  {
+    return;
+  }
+
+  const std::vector<int>& anIndices = myShapeBvh.Indices();
+  const int aFirstShape = static_cast<int> (Triangles.size());
+
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theLeafTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      float aT, aU, aV;
+      if (intersectShape (theRay, anIndices[anIdx], theLeafTmax, aT, aU, aV))
+      {
+        theLeafTmax = aT;
+
+        theHit.T        = aT;
+        theHit.Triangle = aFirstShape + anIndices[anIdx];
+        theHit.U        = aU;
+        theHit.V        = aV;
+      }
+    }
+
+    return false;
+  };
+
+  myShapeBvh.Traverse (theRay, theTmax, aLeafFunc, theStats);
+}
+
+//=======================================================================
+//function : occludedShapes
+//purpose  :
+//=======================================================================
+bool Scene::occludedShapes (const Ray& theRay, int& theHint) const
+{
+  const int aFirstShape = static_cast<int> (Triangles.size());
+  const int aHintShape  = theHint >= aFirstShape ? theHint - aFirstShape : -1;
+
+  float aT, aU, aV;
+  if (aHintShape != -1 && intersectShape (theRay, aHintShape, theRay.Tmax, aT, aU, aV))
+  {
+    return true;
+  }
+
+  const std::vector<int>& anIndices = myShapeBvh.Indices();
+
+  float aTmax = theRay.Tmax;
+  int anOccluder = -1;
+
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      if (anIndices[anIdx] != aHintShape && intersectShape (theRay, anIndices[anIdx], theTmax, aT, aU, aV))
+      {
+        anOccluder = anIndices[anIdx];
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  myShapeBvh.Traverse (theRay, aTmax, aLeafFunc);
+
+  if (anOccluder != -1)
+  {
+    theHint = aFirstShape + anOccluder;
+  }
+  return anOccluder != -1;
+}
+
+//=======================================================================
+//function : interpolateShape
+//purpose  :
+//=======================================================================
+void Scene::interpolateShape (const SurfaceHit& theHit, int theShape, SurfacePoint& thePoint) const
+{
+  const int aNbSpheres = static_cast<int> (Spheres.size());
+  const int aNbDiscs   = static_cast<int> (Discs.size());
+
+  // Positions are restored from shape parameters, so hits do not depend on the ray
+  if (theShape < aNbSpheres)
+  {
+    const Sphere&   aSphere = Spheres[theShape];
+    const glm::vec3 aNormal = UnpackUnitVector (theHit.V);
+
+    const float aPhi   = std::atan2 (aNormal.z, aNormal.x);
+    const float aTheta = std::acos (glm::clamp (aNormal.y, -1.f, 1.f));
+
+    thePoint.Position = aSphere.Center + aNormal * aSphere.Radius;
+    thePoint.Normal   = aNormal;
+    thePoint.Material = aSphere.Material;
+    thePoint.TexCoord = glm::vec2 (aPhi / (2.f * THE_PI) + 0.5f, aTheta / THE_PI);
+    thePoint.Dpdu     = glm::vec3 (-aNormal.z, 0.f, aNormal.x) * (2.f * THE_PI * aSphere.Radius);
+    thePoint.Dpdv     = glm::vec3 (aNormal.y * std::cos (aPhi), -std::sin (aTheta), aNormal.y * std::sin (aPhi)) * (THE_PI * aSphere.Radius);
+  }
+  else if (theShape < aNbSpheres + aNbDiscs)
+  {
+    const Disc& aDisc = Discs[theShape - aNbSpheres];
+
+    glm::vec3 aX, aY;
+    ShapeBasis (aDisc.Normal, aX, aY);
+
+    thePoint.Position = aDisc.Center + (aX * theHit.U + aY * theHit.V) * aDisc.Radius;
+    thePoint.Normal   = aDisc.Normal;
+    thePoint.Material = aDisc.Material;
+    thePoint.TexCoord = glm::vec2 (theHit.U, theHit.V) * 0.5f + 0.5f;
+    thePoint.Dpdu     = aX * (2.f * aDisc.Radius);
+    thePoint.Dpdv     = aY * (2.f * aDisc.Radius);
+  }
+  else if (theShape >= aNbSpheres + aNbDiscs + static_cast<int> (Curves.size()))
+  {
+    interpolatePatch (theHit, theShape - aNbSpheres - aNbDiscs - static_cast<int> (Curves.size()), thePoint);
+    return;
+  }
+  else
+  {
+    const int          aCurveIdx = theShape - aNbSpheres - aNbDiscs;
+    const Curve&       aCurve    = Curves[aCurveIdx];
+    const CurveBounds& aBounds   = myCurveBounds[aCurveIdx];
+
+    // Round segment containing the hit is restored to offset the point from its axis
+    const float aNbSegments = static_cast<float> (1 << aBounds.Depth);
+    const int   aSegment    = glm::clamp (static_cast<int> (theHit.U * aNbSegments), 0, (1 << aBounds.Depth) - 1);
+    const float aS          = glm::clamp (theHit.U * aNbSegments - aSegment, 0.f, 1.f);
+
+    glm::vec3 anA, aB;
+    float aRadius = 0.f;
+    CurveSegment (aCurve, aBounds.Depth, aSegment, anA, aB, aRadius);
+
+    const glm::vec3 aNormal  = UnpackUnitVector (theHit.V);
+    const glm::vec3 aTangent = aCurve.Derivative (theHit.U);
+
+    thePoint.Position = anA + (aB - anA) * aS + aNormal * aRadius;
+    thePoint.Normal   = aNormal;
+    thePoint.Material = aCurve.Material;
+    thePoint.TexCoord = glm::vec2 (theHit.U, 0.5f);
+    thePoint.Dpdu     = aTangent;
+    thePoint.Dpdv     = glm::cross (aNormal, aTangent) * (2.f * THE_PI * aRadius / glm::max (glm::length (aTangent), FLT_MIN));
+  }
+
+  thePoint.GeomNormal = thePoint.Normal;
+}
+
+//=======================================================================
+//function : displacedVertex
+//purpose  :
+//=======================================================================
+glm::vec3 Scene::displacedVertex (const glm::ivec4& thePatch, int theNbSegments, int theI, int theJ, glm::vec2& theUV) const
+{
+  // Weights are exact multiples of 1/N and zero weights drop out of the sums,
+  // so vertices on edges shared by patches are bitwise equal
+  const float aStep = 1.f / static_cast<float> (theNbSegments);
+  const float aW0   = static_cast<float> (theNbSegments - theI - theJ) * aStep;
+  const float aW1   = static_cast<float> (theI) * aStep;
+  const float aW2   = static_cast<float> (theJ) * aStep;
+
+  const glm::vec3& aP0 = Positions[thePatch.x];
+  const glm::vec3& aP1 = Positions[thePatch.y];
+  const glm::vec3& aP2 = Positions[thePatch.z];
+
+  glm::vec3 aNormal (0.f);
+  if (!Normals.empty())
+  {
+    aNormal = Normals[thePatch.x] * aW0 + Normals[thePatch.y] * aW1 + Normals[thePatch.z] * aW2;
+  }
+  aNormal = glm::dot (aNormal, aNormal) > 0.f ? glm::normalize (aNormal)
+                                              : glm::normalize (glm::cross (aP1 - aP0, aP2 - aP0));
+
+  theUV = !TexCoords.empty() ? TexCoords[thePatch.x] * aW0 + TexCoords[thePatch.y] * aW1 + TexCoords[thePatch.z] * aW2
+                             : glm::vec2 (aW1, aW2);
+
+  const Material& aMaterial = Materials[thePatch.w];
+  const float aHeight = aMaterial.IsDisplaced() ? aMaterial.DisplacementScale * Textures[aMaterial.DisplacementTexture].Bilinear (theUV, 0).x : 0.f;
+
+  return aP0 * aW0 + aP1 * aW1 + aP2 * aW2 + aNormal * aHeight;
+}
+
+//=======================================================================
+//function : tessellatePatch
+//purpose  :
+//=======================================================================
+void Scene::tessellatePatch (int thePatch, MicroMesh& theMesh) const
+{
+  const glm::ivec4& aPatch = Patches[thePatch];
+
+  theMesh.Level = myTessLevel;
+  const int aNbSegs = theMesh.NbSegments();
+
+  theMesh.Positions.resize ((aNbSegs + 1) * (aNbSegs + 2) / 2);
+  for (int aJ = 0; aJ <= aNbSegs; ++aJ)
+  {
+    for (int anI = 0; anI <= aNbSegs - aJ; ++anI)
+    {
+      glm::vec2 aUV;
+      theMesh.Positions[MicroMesh::Vertex (aNbSegs, anI, aJ)] = displacedVertex (aPatch, aNbSegs, anI, aJ, aUV);
+    }
+  }
+
+  theMesh.Cells.clear();
+  theMesh.Cells.reserve (aNbSegs * aNbSegs);
+  for (int aJ = 0; aJ < aNbSegs; ++aJ)
+  {
+    for (int anI = 0; anI < aNbSegs - aJ; ++anI)
+    {
+      theMesh.Cells.push_back (MicroMesh::PackCell (anI, aJ, false));
+      if (anI + aJ < aNbSegs - 1)
+      {
+        theMesh.Cells.push_back (MicroMesh::PackCell (anI, aJ, true));
+      }
+    }
+  }
+
+  std::vector<Box> aBoxes (theMesh.Cells.size());
+  for (size_t aTrgIdx = 0; aTrgIdx < theMesh.Cells.size(); ++aTrgIdx)
+  {
+    glm::ivec2 aV0, aV1, aV2;
+    MicroMesh::CellVertices (theMesh.Cells[aTrgIdx], aV0, aV1, aV2);
+
+    aBoxes[aTrgIdx].Add (theMesh.Positions[MicroMesh::Vertex (aNbSegs, aV0.x, aV0.y)]);
+    aBoxes[aTrgIdx].Add (theMesh.Positions[MicroMesh::Vertex (aNbSegs, aV1.x, aV1.y)]);
+    aBoxes[aTrgIdx].Add (theMesh.Positions[MicroMesh::Vertex (aNbSegs, aV2.x, aV2.y)]);
+  }
+
+  theMesh.Hierarchy.Build (aBoxes);
+}
+
+//=======================================================================
+//function : intersectPatch
+//purpose  :
+//=======================================================================
+bool Scene::intersectPatch (const Ray& theRay, int thePatch, float theTmax, float& theT, float& theU, float& theV) const
+{
+  // Mesh is held for the duration of traversal even if other threads evict it
+  const std::shared_ptr<const MicroMesh> aMesh = myTessCache.Acquire (thePatch);
+
+  const MicroMesh&        aMicro   = *aMesh;
+  const std::vector<int>& anIndices = aMicro.Hierarchy.Indices();
+  const int               aNbSegs  = aMicro.NbSegments();
+  const float             aStep    = 1.f / static_cast<float> (aNbSegs);
+
+  bool isHit = false;
+  auto aLeafFunc = [&](int theFirst, int theCount, float& theLeafTmax) -> bool
+  {
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      glm::ivec2 aV0, aV1, aV2;
+      MicroMesh::CellVertices (aMicro.Cells[anIndices[anIdx]], aV0, aV1, aV2);
+
+      float aT, aU, aV;
+      if (IntersectTriangle (theRay,
+                             aMicro.Positions[MicroMesh::Vertex (aNbSegs, aV0.x, aV0.y)],
+                             aMicro.Positions[MicroMesh::Vertex (aNbSegs, aV1.x, aV1.y)],
+                             aMicro.Positions[MicroMesh::Vertex (aNbSegs, aV2.x, aV2.y)], theLeafTmax, aT, aU, aV))
+      {
+        // Barycentric coordinates of the micro triangle are converted into the patch ones
+        const glm::vec2 aGrid = glm::vec2 (aV0) + glm::vec2 (aV1 - aV0) * aU + glm::vec2 (aV2 - aV0) * aV;
+
+        theLeafTmax = aT;
+        theT  = aT;
+        theU  = aGrid.x * aStep;
+        theV  = aGrid.y * aStep;
+        isHit = true;
+      }
+    }
+
+    return false;
+  };
+
+  float aTmax = theTmax;
+  aMicro.Hierarchy.Traverse (theRay, aTmax, aLeafFunc);
+  return isHit;
+}
+
+//=======================================================================
+//function : interpolatePatch
+//purpose  :
+//=======================================================================
+void Scene::interpolatePatch (const SurfaceHit& theHit, int thePatch, SurfacePoint& thePoint) const
+{
+  const glm::ivec4& aPatch  = Patches[thePatch];
+  const int         aNbSegs = 1 << myTessLevel;
+
+  // Micro triangle is restored from its displaced vertices without the cache
+  float aB1 = 0.f;
+  float aB2 = 0.f;
+  glm::ivec2 aV0, aV1, aV2;
+  MicroMesh::CellVertices (MicroMesh::LocateCell (aNbSegs, theHit.U, theHit.V, aB1, aB2), aV0, aV1, aV2);
+
+  glm::vec2 aUV0, aUV1, aUV2;
+  const glm::vec3 aP0 = displacedVertex (aPatch, aNbSegs, aV0.x, aV0.y, aUV0);
+  const glm::vec3 aP1 = displacedVertex (aPatch, aNbSegs, aV1.x, aV1.y, aUV1);
+  const glm::vec3 aP2 = displacedVertex (aPatch, aNbSegs, aV2.x, aV2.y, aUV2);
+
+  const float aB0 = 1.f - aB1 - aB2;
+
+  thePoint.Position   = aP0 * aB0 + aP1 * aB1 + aP2 * aB2;
+  thePoint.GeomNormal = glm::normalize (glm::cross (aP1 - aP0, aP2 - aP0));
+  thePoint.Normal     = thePoint.GeomNormal;
+  thePoint.Material   = aPatch.w;
+  thePoint.TexCoord   = aUV0 * aB0 + aUV1 * aB1 + aUV2 * aB2;
+
+  TriangleDerivatives (aP0, aP1, aP2, aUV0, aUV1, aUV2, thePoint.GeomNormal, thePoint.Dpdu, thePoint.Dpdv);
+}
+
+//=======================================================================
+//function : Interpolate
+//purpose  :
+//=======================================================================
+void Scene::Interpolate (const SurfaceHit& theHit, SurfacePoint& thePoint) const
+{
+  if (theHit.Triangle >= static_cast<int> (Triangles.size()))
+  {
+    interpolateShape (theHit, theHit.Triangle - static_cast<int> (Triangles.size()), thePoint);
+    return;
+  }
+
+  const glm::ivec4& aTriangle = Triangles[theHit.Triangle];
+
+  const float aW = 1.f - theHit.U - theHit.V;
+
+  glm::vec3 aP0, aP1, aP2;
+  triangleAt (theHit.Triangle, theHit.Time, aP0, aP1, aP2);
+
+  thePoint.Position   = aP0 * aW + aP1 * theHit.U + aP2 * theHit.V;
+  thePoint.GeomNormal = glm::normalize (glm::cross (aP1 - aP0, aP2 - aP0));
+  thePoint.Material   = aTriangle.w;
+
+  thePoint.Normal = thePoint.GeomNormal;
+  if (!Normals.empty())
+  {
+    glm::vec3 aNormal = Normals[aTriangle.x] * aW + Normals[aTriangle.y] * theHit.U + Normals[aTriangle.z] * theHit.V;
+    if (!MotionNormals.empty())
+    {
+      float aTau = 0.f;
+      const int aSegment = MotionBvh::Segment (theHit.Time, NbMotionKeys() - 1, aTau);
+
+      const glm::vec3* aKey0 = aSegment == 0 ? Normals.data() : MotionNormals.data() + (aSegment - 1) * Normals.size();
+      const glm::vec3* aKey1 = MotionNormals.data() + aSegment * Normals.size();
+
+      aNormal = glm::mix (aKey0[aTriangle.x], aKey1[aTriangle.x], aTau) * aW
+              + glm::mix (aKey0[aTriangle.y], aKey1[aTriangle.y], aTau) * theHit.U
+              + glm::mix (aKey0[aTriangle.z], aKey1[aTriangle.z], aTau) * theHit.V;
+    }
+
+    if (glm::dot (aNormal, aNormal) > 0.f)
+    {
+      thePoint.Normal = glm::normalize (aNormal);
+    }
+  }
+
+  glm::vec2 aUV0 (0.f, 0.f);
+  glm::vec2 aUV1 (1.f, 0.f);
+  glm::vec2 aUV2 (0.f, 1.f);
+
+  if (!TexCoords.empty())
+  {
+    aUV0 = TexCoords[aTriangle.x];
+    aUV1 = TexCoords[aTriangle.y];
+    aUV2 = TexCoords[aTriangle.z];
+  }
+
+  thePoint.TexCoord = aUV0 * aW + aUV1 * theHit.U + aUV2 * theHit.V;
+
+  TriangleDerivatives (aP0, aP1, aP2, aUV0, aUV1, aUV2, thePoint.GeomNormal, thePoint.Dpdu, thePoint.Dpdv);
+}
+
+//=======================================================================
+//function : TriangleArea
+//purpose  :
+//=======================================================================
+float Scene::TriangleArea (int theTriangle) const
+{
+  const glm::ivec4& aTriangle = Triangles[theTriangle];
+
+  return 0.5f * glm::length (glm::cross (Positions[aTriangle.y] - Positions[aTriangle.x],
+                                         Positions[aTriangle.z] - Positions[aTriangle.x]));
+}
+
+//=======================================================================
+//function : SampleEmitter
+//purpose  :
+//=======================================================================
+bool Scene::SampleEmitter (const glm::vec3& thePoint, float theU, const glm::vec2& theUV, EmitterSample& theSample, float theTime) const
+{
+  const float anEnvProb = environmentProb();
+  if (theU < anEnvProb)
+  {
+    if (!myEnvironment.Sample (theUV, theSample.Direction, theSample.Radiance, theSample.Pdf))
+    {
+      return false;
+    }
+
+    theSample.Pdf     *= anEnvProb;
+    theSample.MisPdf   = anEnvProb * myEnvironment.MisPdf (theSample.Direction);
+    theSample.Distance = FLT_MAX;
+    theSample.Position = thePoint;
+    theSample.Normal   = -theSample.Direction;
+
+    return theSample.Pdf > 0.f;
+  }
+
+  if (myEmitters.empty())
+  {
+    return false;
+  }
+
+  // Reuse the selection number for triangles
+  theU = std::min ((theU - anEnvProb) / (1.f - anEnvProb), 0.99999994f);
+
+  float aProb = 0.f;
+  const int anEmitter = selectEmitter (thePoint, theU, aProb);
+  if (anEmitter < 0 || aProb <= 0.f)
+  {
+    return false;
+  }
+
+  const glm::ivec4& aTriangle = Triangles[myEmitters[anEmitter]];
+
+  glm::vec3 aP0, aP1, aP2;
+  triangleAt (myEmitters[anEmitter], theTime, aP0, aP1, aP2);
+
+  // Uniform sampling of triangle area
+  const float aSqrtU = std::sqrt (theUV.x);
+  const float aB0 = 1.f - aSqrtU;
+  const float aB1 = theUV.y * aSqrtU;
+
+  theSample.Position = aP0 * aB0 + aP1 * aB1 + aP2 * (1.f - aB0 - aB1);
+
+  const glm::vec3 aCross = glm::cross (aP1 - aP0, aP2 - aP0);
+  const float anArea = 0.5f * glm::length (aCross);
+
+  theSample.Normal = aCross / (2.f * anArea);
+
+  glm::vec3 aToLight = theSample.Position - thePoint;
+
+  theSample.Distance = glm::length (aToLight);
+  if (theSample.Distance <= 0.f)
+  {
+    return false;
+  }
+
+  aToLight /= theSample.Distance;
+
+  // Emitters are one-sided (front face follows triangle winding)
+  const float aCosLight = -glm::dot (aToLight, theSample.Normal);
+  if (aCosLight <= 0.f)
+  {
+    return false;
+  }
+
+  theSample.Direction = aToLight;
+  theSample.Radiance  = Materials[aTriangle.w].Emission;
+  theSample.Pdf       = theSample.Distance * theSample.Distance * aProb * (1.f - anEnvProb) / (aCosLight * anArea);
+  theSample.MisPdf    = theSample.Pdf;
+
+  return true;
+}
+
+//=======================================================================
+//function : EmitterPdf
+//purpose  :
+//=======================================================================
+float Scene::EmitterPdf (const glm::vec3& thePoint, int theTriangle, const glm::vec3& theDirection, float theDistance, float theTime) const
+{
+  // Emissive shapes are reached only by BSDF sampling
+  const int anEmitter = theTriangle < static_cast<int> (Triangles.size()) ? myEmitterOfTriangle[theTriangle] : -1;
+  if (anEmitter < 0)
+  {
+    return 0.f;
+  }
+
+  glm::vec3 aP0, aP1, aP2;
+  triangleAt (theTriangle, theTime, aP0, aP1, aP2);
+
+  const glm::vec3 aCross = glm::cross (aP1 - aP0, aP2 - aP0);
+
+  const float anArea = 0.5f * glm::length (aCross);
+  const float aCosLight = -glm::dot (theDirection, aCross) / (2.f * anArea);
+  if (aCosLight <= 0.f)
+  {
+    return 0.f;
+  }
+
+  return theDistance * theDistance * emitterProb (thePoint, anEmitter) * (1.f - environmentProb()) / (aCosLight * anArea);
+}
+
+//=======================================================================
+//function : LoadEnvironment
+//purpose  :
+//=======================================================================
+bool Scene::LoadEnvironment (const std::string& theFileName, ThreadPool& thePool)
+{
+  if (!myEnvironment.Load (theFileName, thePool))
+  {
+    std::cout << "Error: failed to load environment " << theFileName << std::endl;
+    return false;
+  }
+
+  std::cout << "Info: loaded environment " << theFileName << ": " << myEnvironment.SizeX() << "x" << myEnvironment.SizeY() << std::endl;
+  return true;
+}
+
+//=======================================================================
+//function : EnvironmentPdf
+//purpose  :
+//=======================================================================
+float Scene::EnvironmentPdf (const glm::vec3& theDirection) const
+{
+  const float anEnvProb = environmentProb();
+
+  return anEnvProb > 0.f ? anEnvProb * myEnvironment.MisPdf (theDirection) : 0.f;
+}
+
+//=======================================================================
+//function : environmentProb
+//purpose  :
+//=======================================================================
+float Scene::environmentProb() const
+{
+  if (myEnvironment.IsEmpty())
+  {
+    return 0.f;
+  }
+
+  return myEmitters.empty() ? 1.f : 0.5f;
+}
+
+//=======================================================================
+//function : selectEmitter
+//purpose  :
+//=======================================================================
+int Scene::selectEmitter (const glm::vec3& thePoint, float theU, float& theProb) const
+{
+  if (myLightSampling == LightSampling_Bvh && !myLightBvh.IsEmpty())
+  {
+    return myLightBvh.Sample (thePoint, theU, theProb);
+  }
+
+  if (myLightSampling != LightSampling_Uniform && !myEmitterPower.IsEmpty())
+  {
+    return myEmitterPower.Sample (theU, theProb);
+  }
+
+  const int aNbEmitters = static_cast<int> (myEmitters.size());
+
+  theProb = 1.f / static_cast<float> (aNbEmitters);
+  return std::min (static_cast<int> (theU * aNbEmitters), aNbEmitters - 1);
+}
+
+//=======================================================================
+//function : emitterProb
+//purpose  :
+//=======================================================================
+float Scene::emitterProb (const glm::vec3& thePoint, int theEmitter) const
+{
+  if (myLightSampling == LightSampling_Bvh && !myLightBvh.IsEmpty())
+  {
+    return myLightBvh.Prob (thePoint, theEmitter);
+  }
+
+  if (myLightSampling != LightSampling_Uniform && !myEmitterPower.IsEmpty())
+  {
+    return myEmitterPower.Prob (theEmitter);
+  }
+
+  return 1.f / static_cast<float> (myEmitters.size());
+}
+
+//=======================================================================
+//function : BvhBuildName
+//purpose  :
+//=======================================================================
+const char* Scene::BvhBuildName (int theMode)
+{
+  switch (theMode)
+  {
+    case BvhBuild_Binned:  return "Binned SAH";
+    case BvhBuild_Spatial: return "Spatial splits";
+  }
+
+  return "Unknown";
+}
+
+//=======================================================================
+//function : LightSamplingName
+//purpose  :
+//=======================================================================
+const char* Scene::LightSamplingName (int theMode)
+{
+  switch (theMode)
+  {
+    case LightSampling_Uniform: return "Uniform";
+    case LightSampling_Power:   return "Power";
+    case LightSampling_Bvh:     return "Light BVH";
+  }
+
+  return "Unknown";
+}
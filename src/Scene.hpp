@@ -0,0 +1,578 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AliasTable.hpp"
+#include "Bvh.hpp"
+#include "Environment.hpp"
+#include "LightBvh.hpp"
+#include "MotionBvh.hpp"
+#include "Numa.hpp"
+#include "PagedBvh.hpp"
+#include "Shape.hpp"
+#include "Tessellation.hpp"
+#include "Texture.hpp"
+#include "WideBvh.hpp"
+
+//! Type of material scattering model.
+enum MaterialType
+{
+  MaterialType_Diffuse,    //!< Lambertian reflector
+  MaterialType_Glossy,     //!< GGX microfacet reflector
+  MaterialType_Dielectric, //!< smooth glass
+  MaterialType_NB
+};
+
+//! Strategies of selecting emitter for next event estimation.
+enum LightSampling
+{
+  LightSampling_Uniform, //!< all emitters are equally likely
+  LightSampling_Power,   //!< proportional to emitted power (alias table)
+  LightSampling_Bvh,     //!< proportional to estimated contribution (light BVH, power for few emitters)
+  LightSampling_NB
+};
+
+//! Algorithms of building triangle BVH.
+enum BvhBuild
+{
+  BvhBuild_Binned,  //!< object splits with binned SAH (fast build)
+  BvhBuild_Spatial, //!< object and spatial splits (SBVH), for large overlapping triangles
+  BvhBuild_NB
+};
+
+//! Surface material.
+struct Material
+{
+  MaterialType Type;
+  glm::vec3    Diffuse;        //!< diffuse albedo (Kd)
+  glm::vec3    Specular;       //!< specular reflectance (Ks)
+  glm::vec3    Emission;       //!< emitted radiance (Ke)
+  float        Roughness;      //!< GGX alpha
+  float        Ior;            //!< index of refraction
+  int          DiffuseTexture; //!< index of albedo texture or -1
+  int          DisplacementTexture; //!< index of height texture (red channel) or -1
+  float        DisplacementScale;   //!< displacement along normal for height 1
+
+  Material()
+  : Type (MaterialType_Diffuse),
+    Diffuse (0.8f),
+    Specular (0.f),
+    Emission (0.f),
+    Roughness (1.f),
+    Ior (1.5f),
+    DiffuseTexture (-1),
+    DisplacementTexture (-1),
+    DisplacementScale (0.f) {}
+
+  //! Returns true if material emits light.
+  bool IsEmissive() const { return Emission.x > 0.f || Emission.y > 0.f || Emission.z > 0.f; }
+
+  //! Returns true if surfaces of the material are displaced.
+  bool IsDisplaced() const { return DisplacementTexture >= 0 && DisplacementScale != 0.f; }
+};
+
+//! Closest hit found by ray traversal.
+struct SurfaceHit
+{
+  float T;        //!< ray distance
+  int   Triangle; //!< primitive index (triangles first, then analytic shapes) or -1 if missed
+  float U;        //!< barycentric coordinate of the second vertex (shape parameter for analytic shapes)
+  float V;        //!< barycentric coordinate of the third vertex (shape parameter for analytic shapes)
+  float Time;     //!< ray time within the shutter interval
+
+  SurfaceHit() : T (FLT_MAX), Triangle (-1), U (0.f), V (0.f), Time (0.f) {}
+};
+
+//! Interpolated surface attributes at hit point.
+struct SurfacePoint
+{
+  glm::vec3 Position;
+  glm::vec3 Normal;     //!< interpolated shading normal
+  glm::vec3 GeomNormal; //!< geometric normal (follows triangle winding)
+  glm::vec2 TexCoord;
+  glm::vec3 Dpdu;
+  glm::vec3 Dpdv;
+  int       Material;
+};
+
+//! Sampled point on emitter.
+struct EmitterSample
+{
+  glm::vec3 Position;
+  glm::vec3 Normal;
+  glm::vec3 Direction; //!< unit direction from the shading point
+  glm::vec3 Radiance;
+  float     Pdf;       //!< solid angle density with respect to the shading point
+  float     MisPdf;    //!< density used in MIS weights (approximate for environment)
+  float     Distance;  //!< distance to the emitter (FLT_MAX for environment)
+};
+
+//! Scene of triangles and analytic shapes with materials and acceleration structures.
+//! Analytic shapes (spheres, discs and curves) have their own hierarchy and are indexed
+//! after triangles in SurfaceHit::Triangle. Triangles of displaced materials are kept as
+//! coarse patches in the same hierarchy, their micro-geometry is generated on first hit
+//! into bounded tessellation cache.
+class Scene
+{
+public:
+
+  //! Creates empty scene.
+  Scene();
+
+  //! Loads scene from Wavefront OBJ file (with MTL materials) and commits it.
+  bool LoadObj (const std::string& theFileName, ThreadPool& thePool);
+
+  //! Removes all data.
+  void Clear();
+
+  //! Builds acceleration structure and emitter list (called by loaders). With BVH cache
+  //! enabled, the hierarchy is taken from the cache file of the loaded OBJ if it matches
+  //! the geometry and build settings, otherwise it is built and saved there.
+  void Commit (ThreadPool& thePool);
+
+  //! Updates acceleration structure and emitters after vertex positions were moved
+  //! (topology and materials must stay the same). Degraded parts of BVH are rebuilt,
+  //! returns number of rebuilt subtrees.
+  int Refit (ThreadPool& thePool);
+
+  //! Returns true if scene has no geometry.
+  bool IsEmpty() const { return Triangles.empty() && NbShapes() == 0; }
+
+  //! Returns bounding box of the scene (over the whole shutter interval).
+  Box Bounds() const
+  {
+    Box aBounds = !myMotionBvh.IsEmpty() ? myMotionBvh.Bounds()
+                : !myPagedBvh.IsEmpty()  ? myPagedBvh.Bounds()
+                                         : myBvh.Bounds();
+    if (!myShapeBvh.IsEmpty())
+    {
+      aBounds.Add (myShapeBvh.Bounds());
+    }
+    return aBounds;
+  }
+
+  //! Returns acceleration structure (empty when paged out of core).
+  const Bvh& Hierarchy() const { return myBvh; }
+
+  //! Returns hierarchy of moving geometry (empty for static scene).
+  const MotionBvh& MotionHierarchy() const { return myMotionBvh; }
+
+  //! Returns hierarchy of analytic shapes.
+  const Bvh& ShapeHierarchy() const { return myShapeBvh; }
+
+  //! Returns number of analytic shapes.
+  int NbShapes() const { return static_cast<int> (Spheres.size() + Discs.size() + Curves.size() + Patches.size()); }
+
+  //! Returns type of analytic shape (index in the common list of spheres, discs, curves and patches).
+  ShapeType ShapeTypeOf (int theShape) const
+  {
+    return theShape < static_cast<int> (Spheres.size())                                ? ShapeType_Sphere
+         : theShape < static_cast<int> (Spheres.size() + Discs.size())                 ? ShapeType_Disc
+         : theShape < static_cast<int> (Spheres.size() + Discs.size() + Curves.size()) ? ShapeType_Curve
+                                                                                        : ShapeType_Patch;
+  }
+
+  //! Returns subdivision level of displaced patches (each is split into 4^Level micro triangles).
+  int TessellationLevel() const { return myTessLevel; }
+
+  //! Sets subdivision level of displaced patches and drops tessellated micro-meshes.
+  //! The level is the same for all patches, so that shared edges stay watertight.
+  void SetTessellationLevel (int theLevel);
+
+  //! Returns cache of tessellated patches.
+  const TessellationCache& Tessellation() const { return myTessCache; }
+
+  //! Returns cache of tessellated patches for modification (budget, statistics).
+  TessellationCache& ChangeTessellation() { return myTessCache; }
+
+  //! Replaces displaced patches by triangles of their micro-meshes (full pre-tessellation
+  //! for comparison with the cache). Scene must be committed afterwards.
+  void TessellatePatches();
+
+  //! Returns size of geometry (vertices, triangles and shapes) in bytes.
+  size_t GeometrySize() const;
+
+  //! Returns size of hierarchies kept in RAM in bytes: triangle and shape BVHs with their
+  //! compressed, motion and paged copies, NUMA replicas, subtree tables and light structures.
+  size_t HierarchySize() const;
+
+  //! Returns size of textures and environment light in bytes.
+  size_t TextureSize() const;
+
+  //! Returns compressed 8-wide hierarchy (empty if disabled).
+  const WideBvh& WideHierarchy() const { return myWideBvh; }
+
+  //! Returns offset used to move secondary ray origins off the surface.
+  float Epsilon() const { return myEpsilon; }
+
+  //! Returns algorithm of building BVH.
+  BvhBuild BvhBuildMode() const { return myBvhBuild; }
+
+  //! Sets algorithm of building BVH (applied by Commit()).
+  void SetBvhBuildMode (BvhBuild theMode) { myBvhBuild = theMode; }
+
+  //! Returns name of the BVH build algorithm.
+  static const char* BvhBuildName (int theMode);
+
+  //! Returns limit of BVH references per triangle for spatial splits.
+  float MaxReferenceGrowth() const { return myMaxRefGrowth; }
+
+  //! Sets limit of BVH references per triangle for spatial splits (applied by Commit()).
+  void SetMaxReferenceGrowth (float theGrowth) { myMaxRefGrowth = std::max (theGrowth, 1.f); }
+
+  //! Returns true if BVH is optimized by treelet restructuring after build.
+  bool IsBvhOptimized() const { return myToOptimizeBvh; }
+
+  //! Enables treelet restructuring of BVH after build (applied by Commit()).
+  void SetBvhOptimization (bool theToOptimize) { myToOptimizeBvh = theToOptimize; }
+
+  //! Returns true if built BVH is stored next to the OBJ file and reused on next load.
+  bool IsUsingBvhCache() const { return myToUseCache; }
+
+  //! Enables BVH cache file (<scene>.obj.bvh).
+  void SetBvhCache (bool theToUse) { myToUseCache = theToUse; }
+
+  //! Returns true if rays traverse compressed 8-wide BVH collapsed from the binary one.
+  bool IsWideBvh() const { return myToUseWide; }
+
+  //! Enables traversal of compressed 8-wide BVH (built on demand, binary BVH is kept for updates).
+  void SetWideBvh (bool theToUse, ThreadPool& thePool);
+
+  //! Returns true if BVH and triangles for traversal are paged from memory-mapped file.
+  bool IsPaging() const { return myToUsePaging; }
+
+  //! Enables out-of-core BVH: after build, the hierarchy is cut into blocks stored in
+  //! <scene>.obj.pages and the in-memory one is released (static scenes only, wide BVH
+  //! is not used). Falls back to in-memory BVH if the file can't be mapped. Disabling
+  //! paging commits the scene again.
+  void SetPaging (bool theToUse, ThreadPool& thePool);
+
+  //! Returns size limit of paged block in bytes.
+  int PageBlockSize() const { return myPageBlockSize; }
+
+  //! Sets size limit of paged block in bytes (applied by Commit()).
+  void SetPageBlockSize (int theBytes) { myPageBlockSize = std::max (theBytes, 1024); }
+
+  //! Returns out-of-core hierarchy (empty if paging is disabled).
+  const PagedBvh& PagedHierarchy() const { return myPagedBvh; }
+
+  //! Returns out-of-core hierarchy for modification (statistics).
+  PagedBvh& ChangePagedHierarchy() { return myPagedBvh; }
+
+  //! Returns true if ray queues hint paged blocks via Prefetch().
+  bool IsPrefetching() const { return myToPrefetch; }
+
+  //! Enables prefetch hints of paged blocks.
+  void SetPrefetch (bool theToUse) { myToPrefetch = theToUse; }
+
+  //! Starts new wave of prefetch hints (each block is hinted once per wave).
+  void BeginPrefetch() const { myPagedBvh.BeginPrefetch(); }
+
+  //! Asks the OS to read paged blocks crossed by the rays in advance. Thread-safe, scratch is taken from theArena.
+  void Prefetch (const Ray* theRays, int theNbRays, Arena& theArena) const { myPagedBvh.Prefetch (theRays, theNbRays, theArena); }
+
+  //! Returns true if traversal data is replicated per NUMA node.
+  bool IsReplicating() const { return myToReplicate; }
+
+  //! Enables copies of binary BVH, positions and triangles placed in memory of each NUMA node
+  //! (machines with several nodes, static in-memory BVH, within the budget). Copies are read
+  //! by threads pinned to the node (ThreadPool::SetPinning()), others use the original data.
+  void SetReplication (bool theToUse);
+
+  //! Returns limit of memory of all replicas in bytes.
+  size_t ReplicaBudget() const { return myReplicaBudget; }
+
+  //! Sets limit of memory of all replicas in bytes (applied by Commit()).
+  void SetReplicaBudget (size_t theBytes) { myReplicaBudget = theBytes; }
+
+  //! Returns number of replicas (0 if replication is disabled or doesn't fit the budget).
+  int NbReplicas() const { return static_cast<int> (myReplicas.size()); }
+
+  //! Returns memory of all replicas in bytes.
+  size_t ReplicaSize() const;
+
+  //! Moves binary BVH, positions, normals and triangles into storage advised for huge pages
+  //! if HugePages::IsEnabled() (back to regular pages otherwise). Called by Commit() and Refit().
+  void AdoptHugePages();
+
+  //! Returns number of motion keys evenly spaced over the shutter interval (1 for static scene).
+  int NbMotionKeys() const { return Positions.empty() ? 1 : 1 + static_cast<int> (MotionPositions.size() / Positions.size()); }
+
+  //! Returns true if vertices move during the shutter interval.
+  bool HasMotion() const { return !MotionPositions.empty(); }
+
+  //! Moves triangles [theFirstTriangle, theFirstTriangle + theNbTriangles) by transformations
+  //! at evenly spaced motion keys (theNbTriangles = -1 - up to the last triangle). Transformed
+  //! vertices are interpolated linearly between keys. Motion of other vertices is kept if the
+  //! number of keys is the same. Applied by Commit().
+  void SetTransformMotion (const std::vector<glm::mat4>& theKeys, int theFirstTriangle = 0, int theNbTriangles = -1);
+
+  //! Returns true if motion BVH interpolates node bounds in time (otherwise unions over segment are used).
+  bool IsMotionInterpolated() const { return myIsMotionLinear; }
+
+  //! Sets interpolation of motion BVH bounds and rebuilds motion BVH (does not change the image).
+  void SetMotionInterpolation (bool theIsLinear, ThreadPool& thePool);
+
+  //! Returns true if BVH was taken from the cache by the last Commit().
+  bool IsBvhFromCache() const { return myIsCached; }
+
+  //! Finds closest intersection in [Tmin, Tmax] range of the ray.
+  //! Traversal work is counted into theStats (optional).
+  bool Intersect (const Ray& theRay, SurfaceHit& theHit, TraversalStats* theStats = NULL) const;
+
+  //! Returns true if any surface blocks the ray in (Tmin, Tmax) range.
+  //! Traversal stops at the first found hit; no hit attributes are computed.
+  bool Occluded (const Ray& theRay) const
+  {
+    int aHint = -1;
+    return Occluded (theRay, aHint);
+  }
+
+  //! Same as above, but tests triangle theHint first (if not -1) and stores found occluder into it.
+  //! Coherent shadow rays are often blocked by the same triangle.
+  bool Occluded (const Ray& theRay, int& theHint) const;
+
+  //! Returns number of subtrees of the triangle BVH cut by page block size (0 for moving geometry).
+  //! Subtrees are blocks of paged hierarchy or same-size parts of in-memory one, so that ray
+  //! queues may be binned by subtree and each subtree traced by coherent batch of rays.
+  int NbSubtrees() const { return static_cast<int> (mySubtreeLeaves.size()); }
+
+  //! Finds subtrees entered by the ray in traversal order (front-to-back) with their entry
+  //! distances. Stores up to theMaxSubtrees of them and returns their total number.
+  int EnteredSubtrees (const Ray& theRay, int* theSubtrees, float* theEntries, int theMaxSubtrees) const;
+
+  //! Intersects triangles of single subtree. theTmax and theHit must be initialized for the
+  //! ray (Tmax and missed hit) and are updated if closer hit is found.
+  void IntersectSubtree (const Ray& theRay, int theSubtree, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats = NULL) const;
+
+  //! Returns true if any triangle of the subtree blocks the ray.
+  bool OccludedSubtree (const Ray& theRay, int theSubtree) const;
+
+  //! Intersects analytic shapes and displaced patches only (see IntersectSubtree()).
+  void IntersectShapes (const Ray& theRay, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats = NULL) const
+  {
+    intersectShapes (theRay, theTmax, theHit, theStats);
+  }
+
+  //! Returns true if any analytic shape or displaced patch blocks the ray (theHint as in Occluded()).
+  bool OccludedShapes (const Ray& theRay, int& theHint) const
+  {
+    return !myShapeBvh.IsEmpty() && occludedShapes (theRay, theHint);
+  }
+
+  //! Computes surface attributes of the hit.
+  void Interpolate (const SurfaceHit& theHit, SurfacePoint& thePoint) const;
+
+  //! Returns material index of the primitive (triangle or shape).
+  int MaterialOf (int thePrimitive) const
+  {
+    return thePrimitive < static_cast<int> (Triangles.size()) ? Triangles[thePrimitive].w
+                                                              : shapeMaterial (thePrimitive - static_cast<int> (Triangles.size()));
+  }
+
+  //! Returns indices of emissive triangles.
+  const std::vector<int>& Emitters() const { return myEmitters; }
+
+  //! Returns strategy of emitter selection.
+  LightSampling LightSamplingMode() const { return myLightSampling; }
+
+  //! Sets strategy of emitter selection.
+  void SetLightSamplingMode (LightSampling theMode) { myLightSampling = theMode; }
+
+  //! Returns name of the emitter selection strategy.
+  static const char* LightSamplingName (int theMode);
+
+  //! Returns light hierarchy (empty if the scene has few emitters).
+  const LightBvh& LightHierarchy() const { return myLightBvh; }
+
+  //! Loads environment light (kept by Clear()). Returns false on error.
+  bool LoadEnvironment (const std::string& theFileName, ThreadPool& thePool);
+
+  //! Returns environment light (may be empty).
+  const Environment& EnvironmentLight() const { return myEnvironment; }
+
+  //! Returns environment light for modification.
+  Environment& ChangeEnvironmentLight() { return myEnvironment; }
+
+  //! Returns density of sampling direction of escaped ray by SampleEmitter()
+  //! for MIS weights (uses coarse environment distribution).
+  float EnvironmentPdf (const glm::vec3& theDirection) const;
+
+  //! Samples emitter (selection by theU, position by theUV at time theTime) as seen from thePoint.
+  //! Environment is chosen with the same probability as all emissive triangles together.
+  bool SampleEmitter (const glm::vec3& thePoint, float theU, const glm::vec2& theUV, EmitterSample& theSample, float theTime = 0.f) const;
+
+  //! Returns solid angle density of sampling emitter triangle theTriangle via SampleEmitter()
+  //! from thePoint for the direction theDirection hitting it at distance theDistance at time theTime.
+  float EmitterPdf (const glm::vec3& thePoint, int theTriangle, const glm::vec3& theDirection, float theDistance, float theTime = 0.f) const;
+
+  //! Returns area of the triangle.
+  float TriangleArea (int theTriangle) const;
+
+public:
+
+  std::vector<glm::vec3>  Positions;       //!< vertex positions (at the first motion key)
+  std::vector<glm::vec3>  MotionPositions; //!< positions at the next motion keys, Positions.size() per key (empty for static scene)
+  std::vector<glm::vec3>  Normals;         //!< per-vertex normals (may be empty)
+  std::vector<glm::vec3>  MotionNormals;   //!< normals at the next motion keys (empty - Normals are used at all times)
+  std::vector<glm::vec2>  TexCoords; //!< per-vertex texture coordinates (may be empty)
+  std::vector<glm::ivec4> Triangles; //!< vertex indices and material index
+  std::vector<Sphere>     Spheres;   //!< analytic spheres
+  std::vector<Disc>       Discs;     //!< analytic discs
+  std::vector<Curve>      Curves;    //!< round curves
+  std::vector<glm::ivec4> Patches;   //!< displaced triangles (vertex indices and material)
+  std::vector<Material>   Materials;
+  std::vector<Texture>    Textures;
+
+private:
+
+  //! Returns hash of geometry and BVH build settings identifying the cache.
+  uint64_t cacheKey() const;
+
+  //! Reads BVH from the cache file, returns false if it is missing or outdated.
+  bool readCache (uint64_t theKey);
+
+  //! Writes BVH into the cache file.
+  void writeCache (uint64_t theKey) const;
+
+  //! Returns bounding boxes of triangles.
+  std::vector<Box> triangleBoxes (ThreadPool& thePool) const;
+
+  //! Builds triangle BVH with the selected builder (and treelet optimization).
+  void buildHierarchy (const std::vector<Box>& theBoxes, ThreadPool& thePool);
+
+  //! Cuts built BVH into out-of-core blocks and releases it (if paging is enabled).
+  void buildPagedBvh();
+
+  //! Traversal data copied into memory of single NUMA node.
+  struct NodeReplica
+  {
+    Bvh                     Hierarchy;
+    std::vector<glm::vec3>  Positions;
+    std::vector<glm::ivec4> Triangles;
+  };
+
+  //! Copies traversal data for each NUMA node (cleared if replication is not applicable).
+  void buildReplicas();
+
+  //! Returns replica of NUMA node of the calling thread (NULL if there is none).
+  const NodeReplica* localReplica() const
+  {
+    const int aNode = NumaTopology::CurrentNode();
+    return aNode >= 0 && aNode < static_cast<int> (myReplicas.size()) ? myReplicas[aNode].get() : NULL;
+  }
+
+  //! Cuts triangle BVH into subtrees for binning of rays (after BVH or paged BVH is built).
+  void buildSubtrees();
+
+  //! Returns nodes above subtrees (leaf LeftOrFirst is subtree index).
+  const std::vector<BvhNode>& subtreeTop() const { return !myPagedBvh.IsEmpty() ? myPagedBvh.TopNodes() : mySubtreeTop; }
+
+  //! Intersect() for out-of-core hierarchy.
+  void intersectPaged (const Ray& theRay, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats) const;
+
+  //! Occluded() for out-of-core hierarchy.
+  bool occludedPaged (const Ray& theRay, int& theHint) const;
+
+  //! Builds hierarchy of moving geometry (cleared for static scene).
+  void buildMotionBvh (ThreadPool& thePool);
+
+  //! Returns vertex positions at motion key theKey.
+  const glm::vec3* keyPositions (int theKey) const
+  {
+    return theKey == 0 ? Positions.data() : MotionPositions.data() + (theKey - 1) * Positions.size();
+  }
+
+  //! Returns vertices of the triangle at time theTime.
+  void triangleAt (int theTriangle, float theTime, glm::vec3& theP0, glm::vec3& theP1, glm::vec3& theP2) const;
+
+  //! Intersect() for moving geometry.
+  void intersectMotion (const Ray& theRay, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats) const;
+
+  //! Occluded() for moving geometry.
+  bool occludedMotion (const Ray& theRay, int& theHint) const;
+
+  //! Builds hierarchy of analytic shapes and oriented bounds of curves.
+  void buildShapeBvh();
+
+  //! Returns material of analytic shape.
+  int shapeMaterial (int theShape) const;
+
+  //! Tests ray against analytic shape; returns true for hit in (Tmin, theTmax).
+  bool intersectShape (const Ray& theRay, int theShape, float theTmax, float& theT, float& theU, float& theV) const;
+
+  //! Finds closest hit with analytic shapes closer than theTmax (updated on hit).
+  void intersectShapes (const Ray& theRay, float& theTmax, SurfaceHit& theHit, TraversalStats* theStats) const;
+
+  //! Returns true if any analytic shape blocks the ray (theHint as in Occluded(), in primitive indices).
+  bool occludedShapes (const Ray& theRay, int& theHint) const;
+
+  //! Computes surface attributes of the hit with analytic shape.
+  void interpolateShape (const SurfaceHit& theHit, int theShape, SurfacePoint& thePoint) const;
+
+  //! Returns displaced vertex (theI, theJ) of the patch split into theNbSegments per edge
+  //! and its texture coordinates.
+  glm::vec3 displacedVertex (const glm::ivec4& thePatch, int theNbSegments, int theI, int theJ, glm::vec2& theUV) const;
+
+  //! Generates micro-mesh of the patch (called by tessellation cache).
+  void tessellatePatch (int thePatch, MicroMesh& theMesh) const;
+
+  //! Tests ray against micro-mesh of the patch; theU and theV are barycentric coordinates in the patch.
+  bool intersectPatch (const Ray& theRay, int thePatch, float theTmax, float& theT, float& theU, float& theV) const;
+
+  //! Computes surface attributes of the hit with displaced patch.
+  void interpolatePatch (const SurfaceHit& theHit, int thePatch, SurfacePoint& thePoint) const;
+
+  //! Builds emitter distributions and updates ray offset for the given triangle bounds.
+  void updateLights (const std::vector<Box>& theBoxes);
+
+  //! Returns probability of choosing environment instead of emissive triangles.
+  float environmentProb() const;
+
+  //! Selects emitter for the point, returns its index in myEmitters (or -1) and probability.
+  int selectEmitter (const glm::vec3& thePoint, float theU, float& theProb) const;
+
+  //! Returns probability of selecting emitter theEmitter (index in myEmitters) for the point.
+  float emitterProb (const glm::vec3& thePoint, int theEmitter) const;
+
+private:
+
+  Bvh              myBvh;
+  WideBvh          myWideBvh;       //!< compressed copy of myBvh used for traversal
+  MotionBvh        myMotionBvh;     //!< hierarchy of moving geometry used instead of myBvh
+  PagedBvh         myPagedBvh;      //!< out-of-core copy of myBvh used for traversal
+  std::vector<std::unique_ptr<NodeReplica> > myReplicas; //!< traversal data of each NUMA node
+  std::vector<BvhNode> mySubtreeTop;    //!< nodes of myBvh above subtrees (empty if paged)
+  std::vector<int>     mySubtreeRoots;  //!< roots of subtrees in myBvh (empty if paged)
+  std::vector<int>     mySubtreeLeaves; //!< leaf of subtreeTop() of each subtree
+  Bvh              myShapeBvh;      //!< hierarchy of analytic shapes
+  std::vector<CurveBounds> myCurveBounds; //!< oriented bounds of curves
+  mutable TessellationCache myTessCache;  //!< micro-meshes of displaced patches
+  int              myTessLevel;     //!< subdivision level of displaced patches
+  std::vector<int> myEmitters;
+  std::vector<int> myEmitterOfTriangle; //!< index in myEmitters or -1
+  AliasTable       myEmitterPower;      //!< emitters by power
+  LightBvh         myLightBvh;          //!< emitters by estimated contribution
+  Environment      myEnvironment;
+  LightSampling    myLightSampling;
+  BvhBuild         myBvhBuild;
+  float            myMaxRefGrowth;  //!< limit of BVH references per triangle
+  bool             myToOptimizeBvh; //!< restructure BVH treelets after build
+  bool             myToUseCache;    //!< read and write BVH cache file
+  bool             myToUseWide;     //!< traverse compressed 8-wide BVH
+  bool             myToUsePaging;   //!< page BVH and triangles from file
+  bool             myToPrefetch;    //!< hint paged blocks from ray queues
+  int              myPageBlockSize; //!< size limit of paged block in bytes
+  bool             myToReplicate;   //!< copy traversal data per NUMA node
+  size_t           myReplicaBudget; //!< limit of memory of all replicas
+  bool             myIsMotionLinear; //!< interpolate motion BVH bounds in time
+  bool             myIsCached;      //!< BVH of the last commit was read from cache
+  std::string      myCacheFile;     //!< BVH cache file of the loaded OBJ
+  std::string      myPageFile;      //!< file of paged BVH
+  float            myEpsilon;
+
+};
@@ -0,0 +1,26 @@
+#version 330 core
+
+layout(location = 0) out vec4 out_color;
+
+uniform sampler2D image;
+uniform float exposure;
+uniform int to_tonemap;
+
+in vec2 tex_coord;
+
+vec3 linear_to_srgb(vec3 color)
+{
+	return mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, color));
+}
+
+void main()
+{
+	vec3 color = texture(image, tex_coord).rgb;
+
+	if (to_tonemap != 0)
+	{
+		color = linear_to_srgb(clamp(color * exposure, 0.0, 1.0));
+	}
+
+	out_color = vec4(color, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+out vec2 tex_coord;
+
+void main()
+{
+	// Fullscreen triangle generated from vertex index
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+
+	tex_coord = position;
+
+	gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
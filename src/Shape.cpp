@@ -0,0 +1,284 @@
+#include "Shape.hpp"
+
+#include <algorithm>
+
+namespace
+{
+  //! Maximum subdivision depth of curves.
+  const int THE_MAX_CURVE_DEPTH = 10;
+
+  //! Largest position along segment axis stored in hit (exact in float with segment index).
+  const float THE_MAX_AXIS_POS = 1.f - 1.f / 4096.f;
+
+  //! Ray-capsule test (cylinder of theRadius between theA and theB with spherical caps).
+  //! Returns nearest hit in (Tmin, theTmax) and its projection theS onto the axis in [0, 1].
+  bool IntersectCapsule (const Ray&       theRay,
+                         const glm::vec3& theA,
+                         const glm::vec3& theB,
+                         float            theRadius,
+                         float            theTmax,
+                         float&           theT,
+                         float&           theS)
+  {
+    const glm::vec3 anAxis = theB - theA;
+    const glm::vec3 anOA   = theRay.Origin - theA;
+
+    const float aDD   = glm::dot (theRay.Direction, theRay.Direction);
+    const float anAA  = glm::dot (anAxis, anAxis);
+    const float anAD  = glm::dot (anAxis, theRay.Direction);
+    const float anAO  = glm::dot (anAxis, anOA);
+    const float aDO   = glm::dot (theRay.Direction, anOA);
+    const float anOO  = glm::dot (anOA, anOA);
+    const float aRR   = theRadius * theRadius;
+
+    float aBest = theTmax;
+    auto aTry = [&](float theRoot)
+    {
+      if (theRoot > theRay.Tmin && theRoot < aBest)
+      {
+        aBest = theRoot;
+      }
+    };
+
+    // Lateral surface (projection onto the axis within the segment)
+    const float aQA = anAA * aDD - anAD * anAD;
+    if (aQA > 0.f)
+    {
+      const float aQB = anAA * aDO - anAO * anAD;
+      const float aQC = anAA * anOO - anAO * anAO - aRR * anAA;
+
+      const float aDisc = aQB * aQB - aQA * aQC;
+      if (aDisc >= 0.f)
+      {
+        const float aSqrt = std::sqrt (aDisc);
+        for (int aSign = -1; aSign <= 1; aSign += 2)
+        {
+          const float aRoot = (-aQB + aSign * aSqrt) / aQA;
+          const float aY = anAO + aRoot * anAD;
+          if (aY >= 0.f && aY <= anAA)
+          {
+            aTry (aRoot);
+          }
+        }
+      }
+    }
+
+    // Caps (parts of end spheres beyond the segment)
+    for (int anEnd = 0; anEnd < 2; ++anEnd)
+    {
+      const glm::vec3 anOC = anEnd == 0 ? anOA : theRay.Origin - theB;
+
+      const float aB = glm::dot (theRay.Direction, anOC);
+      const float aDisc = aB * aB - aDD * (glm::dot (anOC, anOC) - aRR);
+      if (aDisc < 0.f)
+      {
+        continue;
+      }
+
+      const float aSqrt = std::sqrt (aDisc);
+      for (int aSign = -1; aSign <= 1; aSign += 2)
+      {
+        const float aRoot = (-aB + aSign * aSqrt) / aDD;
+        const float aY = anAO + aRoot * anAD;
+        if (anEnd == 0 ? aY <= 0.f : aY >= anAA)
+        {
+          aTry (aRoot);
+        }
+      }
+    }
+
+    if (aBest >= theTmax)
+    {
+      return false;
+    }
+
+    theT = aBest;
+    theS = anAA > 0.f ? glm::clamp ((anAO + aBest * anAD) / anAA, 0.f, 1.f) : 0.f;
+    return true;
+  }
+
+  //! Splits Bezier control points in halves (de Casteljau).
+  void SplitBezier (const glm::vec3* thePoints, glm::vec3* theLeft, glm::vec3* theRight)
+  {
+    const glm::vec3 aP01  = (thePoints[0] + thePoints[1]) * 0.5f;
+    const glm::vec3 aP12  = (thePoints[1] + thePoints[2]) * 0.5f;
+    const glm::vec3 aP23  = (thePoints[2] + thePoints[3]) * 0.5f;
+    const glm::vec3 aP012 = (aP01 + aP12) * 0.5f;
+    const glm::vec3 aP123 = (aP12 + aP23) * 0.5f;
+    const glm::vec3 aMid  = (aP012 + aP123) * 0.5f;
+
+    theLeft[0] = thePoints[0];
+    theLeft[1] = aP01;
+    theLeft[2] = aP012;
+    theLeft[3] = aMid;
+
+    theRight[0] = aMid;
+    theRight[1] = aP123;
+    theRight[2] = aP23;
+    theRight[3] = thePoints[3];
+  }
+
+  //! Sub-curve pending in subdivision.
+  struct CurvePiece
+  {
+    glm::vec3 Points[4];
+    int       Level;   //!< subdivision level
+    int       Segment; //!< index of the piece at its level
+  };
+}
+
+//=======================================================================
+//function : ComputeCurveBounds
+//purpose  :
+//=======================================================================
+CurveBounds ComputeCurveBounds (const Curve& theCurve)
+{
+  CurveBounds aBounds;
+
+  // Box axes follow the chord and the bend of control polygon
+  glm::vec3 aX = theCurve.Points[3] - theCurve.Points[0];
+  aX = glm::dot (aX, aX) > 0.f ? glm::normalize (aX) : glm::vec3 (1.f, 0.f, 0.f);
+
+  glm::vec3 aY = theCurve.Points[1] + theCurve.Points[2] - theCurve.Points[0] * 2.f;
+  aY -= aX * glm::dot (aY, aX);
+
+  glm::vec3 aZ;
+  if (glm::dot (aY, aY) > 1.0e-12f * glm::dot (theCurve.Points[3] - theCurve.Points[0], theCurve.Points[3] - theCurve.Points[0]))
+  {
+    aY = glm::normalize (aY);
+    aZ = glm::cross (aX, aY);
+  }
+  else
+  {
+    ShapeBasis (aX, aY, aZ);
+  }
+
+  aBounds.ToLocal = glm::transpose (glm::mat3 (aX, aY, aZ));
+
+  const float aRadius = glm::max (theCurve.Radius0, theCurve.Radius1);
+  for (int aPnt = 0; aPnt < 4; ++aPnt)
+  {
+    aBounds.Local.Add (aBounds.ToLocal * theCurve.Points[aPnt]);
+  }
+  aBounds.Local.Min -= glm::vec3 (aRadius);
+  aBounds.Local.Max += glm::vec3 (aRadius);
+
+  // Segments approximate the curve within 5% of radius (Pharr et al., PBRT 3rd ed., 9.3)
+  float aL0 = 0.f;
+  for (int aPnt = 0; aPnt < 2; ++aPnt)
+  {
+    const glm::vec3 aSecond = glm::abs (theCurve.Points[aPnt] - theCurve.Points[aPnt + 1] * 2.f + theCurve.Points[aPnt + 2]);
+    aL0 = glm::max (aL0, glm::max (aSecond.x, glm::max (aSecond.y, aSecond.z)));
+  }
+
+  const float anEps = 0.05f * aRadius;
+  aBounds.Depth = 0;
+  if (aL0 > 0.f && anEps > 0.f)
+  {
+    const float aLevel = std::log2 (1.41421356f * 6.f * aL0 / (8.f * anEps)) * 0.5f;
+    aBounds.Depth = glm::clamp (static_cast<int> (aLevel), 0, THE_MAX_CURVE_DEPTH);
+  }
+
+  return aBounds;
+}
+
+//=======================================================================
+//function : CurveSegment
+//purpose  :
+//=======================================================================
+void CurveSegment (const Curve& theCurve, int theDepth, int theSegment, glm::vec3& theA, glm::vec3& theB, float& theRadius)
+{
+  const float aScale = 1.f / static_cast<float> (1 << theDepth);
+
+  theA      = theCurve.Evaluate (theSegment * aScale);
+  theB      = theCurve.Evaluate ((theSegment + 1) * aScale);
+  theRadius = theCurve.RadiusAt ((theSegment + 0.5f) * aScale);
+}
+
+//=======================================================================
+//function : IntersectCurve
+//purpose  :
+//=======================================================================
+bool IntersectCurve (const Ray&         theRay,
+                     const Curve&       theCurve,
+                     const CurveBounds& theBounds,
+                     float              theTmax,
+                     float&             theT,
+                     float&             theU,
+                     float&             theV)
+{
+  {
+    const glm::vec3 anOrigin = theBounds.ToLocal * theRay.Origin;
+    const glm::vec3 aDir     = theBounds.ToLocal * theRay.Direction;
+    if (Bvh::IntersectBox (theBounds.Local, anOrigin, 1.f / aDir, theRay.Tmin, theTmax) == FLT_MAX)
+    {
+      return false;
+    }
+  }
+
+  const glm::vec3 anInvDir = 1.f / theRay.Direction;
+
+  CurvePiece aStack[THE_MAX_CURVE_DEPTH + 1];
+  int aHead = 0;
+
+  CurvePiece& aRoot = aStack[aHead++];
+  std::copy (theCurve.Points, theCurve.Points + 4, aRoot.Points);
+  aRoot.Level   = 0;
+  aRoot.Segment = 0;
+
+  float aTmax = theTmax;
+  bool isHit = false;
+  while (aHead > 0)
+  {
+    const CurvePiece aPiece = aStack[--aHead];
+
+    const float aScale  = 1.f / static_cast<float> (1 << aPiece.Level);
+    const float aRadius = glm::max (theCurve.RadiusAt (aPiece.Segment * aScale), theCurve.RadiusAt ((aPiece.Segment + 1) * aScale));
+
+    Box aBox;
+    for (int aPnt = 0; aPnt < 4; ++aPnt)
+    {
+      aBox.Add (aPiece.Points[aPnt]);
+    }
+    aBox.Min -= glm::vec3 (aRadius);
+    aBox.Max += glm::vec3 (aRadius);
+
+    if (Bvh::IntersectBox (aBox, theRay.Origin, anInvDir, theRay.Tmin, aTmax) == FLT_MAX)
+    {
+      continue;
+    }
+
+    if (aPiece.Level < theBounds.Depth)
+    {
+      CurvePiece& aLeft  = aStack[aHead++];
+      CurvePiece& aRight = aStack[aHead++];
+      SplitBezier (aPiece.Points, aLeft.Points, aRight.Points);
+
+      aLeft.Level    = aPiece.Level + 1;
+      aLeft.Segment  = aPiece.Segment * 2;
+      aRight.Level   = aPiece.Level + 1;
+      aRight.Segment = aPiece.Segment * 2 + 1;
+      continue;
+    }
+
+    // Ends are evaluated as in CurveSegment(), so that hit position can be restored exactly
+    glm::vec3 anA, aB;
+    float aSegRadius = 0.f;
+    CurveSegment (theCurve, theBounds.Depth, aPiece.Segment, anA, aB, aSegRadius);
+
+    float aT = 0.f;
+    float aS = 0.f;
+    if (IntersectCapsule (theRay, anA, aB, aSegRadius, aTmax, aT, aS))
+    {
+      aTmax = aT;
+      isHit = true;
+
+      // Axis position is kept below 1, so that the hit is restored within the same segment
+      theT = aT;
+      theU = (aPiece.Segment + glm::min (aS, THE_MAX_AXIS_POS)) * aScale;
+      theV = PackUnitVector (glm::normalize (theRay.PointAt (aT) - (anA + (aB - anA) * aS)));
+    }
+  }
+
+  return isHit;
+}
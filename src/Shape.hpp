@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "Bvh.hpp"
+
+//! Types of analytic primitives.
+enum ShapeType
+{
+  ShapeType_Sphere, //!< sphere given by center and radius
+  ShapeType_Disc,   //!< flat disc given by center, normal and radius
+  ShapeType_Curve,  //!< round curve (cubic Bezier swept by sphere of varying radius)
+  ShapeType_Patch,  //!< displaced triangle tessellated on demand
+  ShapeType_NB
+};
+
+//! Sphere primitive (20 bytes instead of hundreds of triangles).
+struct Sphere
+{
+  glm::vec3 Center;
+  float     Radius;
+  int       Material;
+
+  Sphere() : Center (0.f), Radius (1.f), Material (0) {}
+
+  Sphere (const glm::vec3& theCenter, float theRadius, int theMaterial)
+  : Center (theCenter), Radius (theRadius), Material (theMaterial) {}
+};
+
+//! Two-sided disc primitive.
+struct Disc
+{
+  glm::vec3 Center;
+  glm::vec3 Normal; //!< unit normal
+  float     Radius;
+  int       Material;
+
+  Disc() : Center (0.f), Normal (0.f, 0.f, 1.f), Radius (1.f), Material (0) {}
+
+  Disc (const glm::vec3& theCenter, const glm::vec3& theNormal, float theRadius, int theMaterial)
+  : Center (theCenter), Normal (theNormal), Radius (theRadius), Material (theMaterial) {}
+};
+
+//! Round curve: cubic Bezier swept by sphere with radius varying linearly along the curve
+//! (hair and fur strands).
+struct Curve
+{
+  glm::vec3 Points[4]; //!< Bezier control points
+  float     Radius0;   //!< radius at the first point
+  float     Radius1;   //!< radius at the last point
+  int       Material;
+
+  Curve() : Radius0 (1.f), Radius1 (1.f), Material (0) {}
+
+  //! Returns point of the curve at parameter theT.
+  glm::vec3 Evaluate (float theT) const
+  {
+    const float aS = 1.f - theT;
+    return Points[0] * (aS * aS * aS) + Points[1] * (3.f * aS * aS * theT)
+         + Points[2] * (3.f * aS * theT * theT) + Points[3] * (theT * theT * theT);
+  }
+
+  //! Returns tangent of the curve at parameter theT (not normalized).
+  glm::vec3 Derivative (float theT) const
+  {
+    const float aS = 1.f - theT;
+    return (Points[1] - Points[0]) * (3.f * aS * aS) + (Points[2] - Points[1]) * (6.f * aS * theT)
+         + (Points[3] - Points[2]) * (3.f * theT * theT);
+  }
+
+  //! Returns radius at parameter theT.
+  float RadiusAt (float theT) const { return Radius0 + (Radius1 - Radius0) * theT; }
+
+  //! Returns axis-aligned bounds of the swept volume.
+  Box Bounds() const
+  {
+    Box aBox;
+    for (int aPnt = 0; aPnt < 4; ++aPnt)
+    {
+      aBox.Add (Points[aPnt]);
+    }
+
+    const float aRadius = glm::max (Radius0, Radius1);
+    return Box (aBox.Min - glm::vec3 (aRadius), aBox.Max + glm::vec3 (aRadius));
+  }
+};
+
+//! Oriented bounds of curve with subdivision depth of its intersector. Long thin strands
+//! are diagonal to world axes, so rays are tested against box aligned with the chord first.
+struct CurveBounds
+{
+  glm::mat3 ToLocal; //!< rows are box axes (the first one follows the chord)
+  Box       Local;   //!< bounds in the box frame
+  int       Depth;   //!< curve is split into 2^Depth round segments
+
+  CurveBounds() : ToLocal (1.f), Depth (0) {}
+};
+
+//! Encodes unit vector into float (12-bit octahedral coordinates, exactly representable).
+inline float PackUnitVector (const glm::vec3& theDir)
+{
+  glm::vec2 anOct = glm::vec2 (theDir.x, theDir.y) / (std::abs (theDir.x) + std::abs (theDir.y) + std::abs (theDir.z));
+  if (theDir.z < 0.f)
+  {
+    anOct = (1.f - glm::abs (glm::vec2 (anOct.y, anOct.x))) * glm::vec2 (anOct.x >= 0.f ? 1.f : -1.f, anOct.y >= 0.f ? 1.f : -1.f);
+  }
+
+  const int aX = glm::clamp (static_cast<int> ((anOct.x * 0.5f + 0.5f) * 4095.f + 0.5f), 0, 4095);
+  const int aY = glm::clamp (static_cast<int> ((anOct.y * 0.5f + 0.5f) * 4095.f + 0.5f), 0, 4095);
+  return static_cast<float> (aX * 4096 + aY);
+}
+
+//! Decodes unit vector packed by PackUnitVector().
+inline glm::vec3 UnpackUnitVector (float thePacked)
+{
+  const int aCode = static_cast<int> (thePacked);
+  const glm::vec2 anOct = glm::vec2 (static_cast<float> (aCode / 4096), static_cast<float> (aCode % 4096)) * (2.f / 4095.f) - 1.f;
+
+  glm::vec3 aDir (anOct.x, anOct.y, 1.f - std::abs (anOct.x) - std::abs (anOct.y));
+  if (aDir.z < 0.f)
+  {
+    const glm::vec2 aFold = (1.f - glm::abs (glm::vec2 (aDir.y, aDir.x))) * glm::vec2 (aDir.x >= 0.f ? 1.f : -1.f, aDir.y >= 0.f ? 1.f : -1.f);
+    aDir.x = aFold.x;
+    aDir.y = aFold.y;
+  }
+  return glm::normalize (aDir);
+}
+
+//! Builds tangents of the unit normal (Duff et al., "Building an Orthonormal Basis, Revisited").
+inline void ShapeBasis (const glm::vec3& theNormal, glm::vec3& theX, glm::vec3& theY)
+{
+  const float aSign = theNormal.z >= 0.f ? 1.f : -1.f;
+  const float aA = -1.f / (aSign + theNormal.z);
+  const float aB = theNormal.x * theNormal.y * aA;
+
+  theX = glm::vec3 (1.f + aSign * theNormal.x * theNormal.x * aA, aSign * aB, -aSign * theNormal.x);
+  theY = glm::vec3 (aB, aSign + theNormal.y * theNormal.y * aA, -theNormal.y);
+}
+
+//! Ray-sphere test with reduced cancellation (Haines et al., "Precision Improvements for Ray/Sphere
+//! Intersection", 2019). Returns true for hit in (Tmin, theTmax), the unit normal is packed into theV.
+inline bool IntersectSphere (const Ray& theRay, const Sphere& theSphere, float theTmax, float& theT, float& theU, float& theV)
+{
+  const glm::vec3 aF = theRay.Origin - theSphere.Center;
+  const float aA = glm::dot (theRay.Direction, theRay.Direction);
+  const float aB = -glm::dot (aF, theRay.Direction);
+
+  const glm::vec3 aL = aF + theRay.Direction * (aB / aA);
+  const float aDisc = aA * (theSphere.Radius * theSphere.Radius - glm::dot (aL, aL));
+  if (aDisc < 0.f)
+  {
+    return false;
+  }
+
+  const float aQ = aB + (aB >= 0.f ? std::sqrt (aDisc) : -std::sqrt (aDisc));
+  if (aQ == 0.f)
+  {
+    return false;
+  }
+
+  const float aC = glm::dot (aF, aF) - theSphere.Radius * theSphere.Radius;
+  const float aT0 = glm::min (aC / aQ, aQ / aA);
+  const float aT1 = glm::max (aC / aQ, aQ / aA);
+
+  theT = aT0 > theRay.Tmin ? aT0 : aT1;
+  if (theT <= theRay.Tmin || theT >= theTmax)
+  {
+    return false;
+  }
+
+  theU = 0.f;
+  theV = PackUnitVector (glm::normalize (aF + theRay.Direction * theT));
+  return true;
+}
+
+//! Ray-disc test; returns true for hit in (Tmin, theTmax) with position
+//! in the disc plane (in units of radius) written into theU and theV.
+inline bool IntersectDisc (const Ray& theRay, const Disc& theDisc, float theTmax, float& theT, float& theU, float& theV)
+{
+  const float aDenom = glm::dot (theRay.Direction, theDisc.Normal);
+  if (aDenom == 0.f)
+  {
+    return false;
+  }
+
+  theT = glm::dot (theDisc.Center - theRay.Origin, theDisc.Normal) / aDenom;
+  if (theT <= theRay.Tmin || theT >= theTmax)
+  {
+    return false;
+  }
+
+  const glm::vec3 anOffset = theRay.PointAt (theT) - theDisc.Center;
+  if (glm::dot (anOffset, anOffset) > theDisc.Radius * theDisc.Radius)
+  {
+    return false;
+  }
+
+  glm::vec3 aX, aY;
+  ShapeBasis (theDisc.Normal, aX, aY);
+
+  theU = glm::dot (anOffset, aX) / theDisc.Radius;
+  theV = glm::dot (anOffset, aY) / theDisc.Radius;
+  return true;
+}
+
+//! Computes oriented bounds and subdivision depth of the curve.
+CurveBounds ComputeCurveBounds (const Curve& theCurve);
+
+//! Returns ends of round segment theSegment of the curve split into 2^theDepth segments
+//! and its radius (the segment is a capsule approximating the curve within 5% of radius).
+void CurveSegment (const Curve& theCurve, int theDepth, int theSegment, glm::vec3& theA, glm::vec3& theB, float& theRadius);
+
+//! Ray-curve test. The curve is subdivided recursively (Nakamaru and Ohno, "Ray tracing for curves
+//! primitive", 2002), sub-curves missed by bounds of their control points are culled and the rest
+//! are intersected as capsules. Returns true for hit in (Tmin, theTmax), curve parameter of the hit
+//! is written into theU and the packed unit normal into theV.
+bool IntersectCurve (const Ray&         theRay,
+                     const Curve&       theCurve,
+                     const CurveBounds& theBounds,
+                     float              theTmax,
+                     float&             theT,
+                     float&             theU,
+                     float&             theV);
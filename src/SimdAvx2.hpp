@@ -0,0 +1,54 @@
+#pragma once
+
+// AVX2 vector type for generic SIMD kernels (see BsdfKernels.hpp).
+// Include only from translation units compiled with AVX2 enabled, after the
+// target pragma; definitions are file-local to each including translation unit.
+
+#include <cstdint>
+
+#include <immintrin.h>
+
+namespace
+{
+  //! 8-wide AVX float vector (also used as lane mask).
+  struct AvxFloat
+  {
+    static const int Width = 8;
+
+    __m256 Data;
+
+    AvxFloat() {}
+    AvxFloat (__m256 theData) : Data (theData) {}
+    AvxFloat (float theValue) : Data (_mm256_set1_ps (theValue)) {}
+
+    static AvxFloat Load (const float* thePtr) { return _mm256_loadu_ps (thePtr); }
+
+    static void Store (float* thePtr, const AvxFloat& theVec) { _mm256_storeu_ps (thePtr, theVec.Data); }
+
+    static void StoreMask (int32_t* thePtr, const AvxFloat& theMask)
+    {
+      _mm256_storeu_si256 (reinterpret_cast<__m256i*> (thePtr), _mm256_castps_si256 (theMask.Data));
+    }
+  };
+
+  inline AvxFloat operator+ (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_add_ps (theA.Data, theB.Data); }
+  inline AvxFloat operator- (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_sub_ps (theA.Data, theB.Data); }
+  inline AvxFloat operator* (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_mul_ps (theA.Data, theB.Data); }
+  inline AvxFloat operator/ (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_div_ps (theA.Data, theB.Data); }
+  inline AvxFloat operator- (const AvxFloat& theA) { return _mm256_xor_ps (theA.Data, _mm256_set1_ps (-0.f)); }
+
+  inline AvxFloat Less    (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_cmp_ps (theA.Data, theB.Data, _CMP_LT_OQ); }
+  inline AvxFloat Greater (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_cmp_ps (theA.Data, theB.Data, _CMP_GT_OQ); }
+  inline AvxFloat Equal   (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_cmp_ps (theA.Data, theB.Data, _CMP_EQ_OQ); }
+  inline AvxFloat And     (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_and_ps (theA.Data, theB.Data); }
+  inline AvxFloat Or      (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_or_ps  (theA.Data, theB.Data); }
+  inline AvxFloat Min     (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_min_ps (theA.Data, theB.Data); }
+  inline AvxFloat Max     (const AvxFloat& theA, const AvxFloat& theB) { return _mm256_max_ps (theA.Data, theB.Data); }
+  inline AvxFloat Sqrt    (const AvxFloat& theA) { return _mm256_sqrt_ps (theA.Data); }
+  inline AvxFloat Abs     (const AvxFloat& theA) { return _mm256_andnot_ps (_mm256_set1_ps (-0.f), theA.Data); }
+
+  inline AvxFloat Select (const AvxFloat& theMask, const AvxFloat& theA, const AvxFloat& theB)
+  {
+    return _mm256_blendv_ps (theB.Data, theA.Data, theMask.Data);
+  }
+}
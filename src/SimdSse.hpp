@@ -0,0 +1,61 @@
+#pragma once
+
+// SSE2 vector type for generic SIMD kernels (see BsdfKernels.hpp).
+// Definitions are file-local to each including translation unit.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  #define RAYLAB_HAS_X86
+#endif
+
+#ifdef RAYLAB_HAS_X86
+
+#include <cstdint>
+
+#include <emmintrin.h>
+
+namespace
+{
+  //! 4-wide SSE2 float vector (also used as lane mask).
+  struct SseFloat
+  {
+    static const int Width = 4;
+
+    __m128 Data;
+
+    SseFloat() {}
+    SseFloat (__m128 theData) : Data (theData) {}
+    SseFloat (float theValue) : Data (_mm_set1_ps (theValue)) {}
+
+    static SseFloat Load (const float* thePtr) { return _mm_loadu_ps (thePtr); }
+
+    static void Store (float* thePtr, const SseFloat& theVec) { _mm_storeu_ps (thePtr, theVec.Data); }
+
+    static void StoreMask (int32_t* thePtr, const SseFloat& theMask)
+    {
+      _mm_storeu_si128 (reinterpret_cast<__m128i*> (thePtr), _mm_castps_si128 (theMask.Data));
+    }
+  };
+
+  inline SseFloat operator+ (const SseFloat& theA, const SseFloat& theB) { return _mm_add_ps (theA.Data, theB.Data); }
+  inline SseFloat operator- (const SseFloat& theA, const SseFloat& theB) { return _mm_sub_ps (theA.Data, theB.Data); }
+  inline SseFloat operator* (const SseFloat& theA, const SseFloat& theB) { return _mm_mul_ps (theA.Data, theB.Data); }
+  inline SseFloat operator/ (const SseFloat& theA, const SseFloat& theB) { return _mm_div_ps (theA.Data, theB.Data); }
+  inline SseFloat operator- (const SseFloat& theA) { return _mm_xor_ps (theA.Data, _mm_set1_ps (-0.f)); }
+
+  inline SseFloat Less    (const SseFloat& theA, const SseFloat& theB) { return _mm_cmplt_ps (theA.Data, theB.Data); }
+  inline SseFloat Greater (const SseFloat& theA, const SseFloat& theB) { return _mm_cmpgt_ps (theA.Data, theB.Data); }
+  inline SseFloat Equal   (const SseFloat& theA, const SseFloat& theB) { return _mm_cmpeq_ps (theA.Data, theB.Data); }
+  inline SseFloat And     (const SseFloat& theA, const SseFloat& theB) { return _mm_and_ps (theA.Data, theB.Data); }
+  inline SseFloat Or      (const SseFloat& theA, const SseFloat& theB) { return _mm_or_ps  (theA.Data, theB.Data); }
+  inline SseFloat Min     (const SseFloat& theA, const SseFloat& theB) { return _mm_min_ps (theA.Data, theB.Data); }
+  inline SseFloat Max     (const SseFloat& theA, const SseFloat& theB) { return _mm_max_ps (theA.Data, theB.Data); }
+  inline SseFloat Sqrt    (const SseFloat& theA) { return _mm_sqrt_ps (theA.Data); }
+  inline SseFloat Abs     (const SseFloat& theA) { return _mm_andnot_ps (_mm_set1_ps (-0.f), theA.Data); }
+
+  inline SseFloat Select (const SseFloat& theMask, const SseFloat& theA, const SseFloat& theB)
+  {
+    return _mm_or_ps (_mm_and_ps (theMask.Data, theA.Data), _mm_andnot_ps (theMask.Data, theB.Data));
+  }
+}
+
+#endif // RAYLAB_HAS_X86
@@ -0,0 +1,124 @@
+#include "Tessellation.hpp"
+
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+//=======================================================================
+//function : TessellationCache
+//purpose  :
+//=======================================================================
+TessellationCache::TessellationCache()
+: myBudget (256u << 20),
+  myLimit (0),
+  myUsed (0),
+  myNbHits (0),
+  myNbMisses (0),
+  myNbEvictions (0),
+  myTessTimeNs (0)
+{
+  //
+}
+
+//=======================================================================
+//function : Reset
+//purpose  :
+//=======================================================================
+void TessellationCache::Reset (int theNbPatches, const BuildFunc& theBuilder)
+{
+  for (int aShardIdx = 0; aShardIdx < NbShards; ++aShardIdx)
+  {
+    myShards[aShardIdx].Lru.clear();
+  }
+  myUsed = 0;
+
+  myEntries.clear();
+  myEntries.resize (theNbPatches);
+  myBuilder = theBuilder;
+
+  ResetStats();
+}
+
+//=======================================================================
+//function : ResetStats
+//purpose  :
+//=======================================================================
+void TessellationCache::ResetStats()
+{
+  myNbHits      = 0;
+  myNbMisses    = 0;
+  myNbEvictions = 0;
+  myTessTimeNs  = 0;
+}
+
+//=======================================================================
+//function : Acquire
+//purpose  :
+//=======================================================================
+std::shared_ptr<const MicroMesh> TessellationCache::Acquire (int thePatch)
+{
+  Entry& anEntry = myEntries[thePatch];
+  Shard& aShard  = myShards[thePatch % NbShards];
+
+  {
+    std::lock_guard<std::mutex> aLock (aShard.Mutex);
+    if (anEntry.Mesh)
+    {
+      aShard.Lru.splice (aShard.Lru.begin(), aShard.Lru, anEntry.Position);
+      ++myNbHits;
+      return anEntry.Mesh;
+    }
+  }
+
+  // Tessellation runs unlocked, so other patches of the shard are served meanwhile;
+  // meshes are bounded by the budget and aren't counted as transient allocations
+  AllocationCounter::Ignore anIgnore;
+
+  const auto aStart = std::chrono::steady_clock::now();
+
+  std::shared_ptr<MicroMesh> aMesh = std::make_shared<MicroMesh>();
+  myBuilder (thePatch, *aMesh);
+
+  myTessTimeNs += static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - aStart).count());
+  ++myNbMisses;
+
+  std::lock_guard<std::mutex> aLock (aShard.Mutex);
+  if (anEntry.Mesh)
+  {
+    // Another thread has tessellated the same patch first
+    aShard.Lru.splice (aShard.Lru.begin(), aShard.Lru, anEntry.Position);
+    return anEntry.Mesh;
+  }
+
+  anEntry.Mesh     = aMesh;
+  anEntry.Position = aShard.Lru.insert (aShard.Lru.begin(), thePatch);
+  myUsed          += aMesh->MemorySize();
+
+  // The newest mesh is kept even if the budget is still exceeded
+  const size_t aBudget = myLimit != 0 ? std::min (myBudget, myLimit) : myBudget;
+  while (myUsed > aBudget && aShard.Lru.size() > 1)
+  {
+    Entry& anOldest = myEntries[aShard.Lru.back()];
+    myUsed -= anOldest.Mesh->MemorySize();
+    anOldest.Mesh.reset();
+    aShard.Lru.pop_back();
+    ++myNbEvictions;
+  }
+
+  return anEntry.Mesh;
+}
+
+//=======================================================================
+//function : NbResident
+//purpose  :
+//=======================================================================
+int TessellationCache::NbResident() const
+{
+  size_t aNbMeshes = 0;
+  for (int aShardIdx = 0; aShardIdx < NbShards; ++aShardIdx)
+  {
+    aNbMeshes += myShards[aShardIdx].Lru.size();
+  }
+  return static_cast<int> (aNbMeshes);
+}
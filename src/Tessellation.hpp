@@ -0,0 +1,188 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Bvh.hpp"
+
+//! Micro-geometry of displaced patch: coarse triangle uniformly split into 4^Level triangles
+//! on triangular grid with N = 2^Level segments per edge. Grid vertex (I, J) has barycentric
+//! weights (N - I - J, I, J) / N of the patch corners, cell (I, J) holds the lower triangle
+//! (I, J), (I + 1, J), (I, J + 1) and (if I + J < N - 1) the upper one (I + 1, J + 1), (I, J + 1), (I + 1, J).
+struct MicroMesh
+{
+  std::vector<glm::vec3> Positions; //!< displaced grid vertices, row J holds N + 1 - J vertices
+  std::vector<int>       Cells;     //!< packed cell of each micro triangle (see PackCell())
+  Bvh                    Hierarchy; //!< sub-BVH over micro triangles
+  int                    Level;     //!< subdivision level
+
+  MicroMesh() : Level (0) {}
+
+  //! Returns number of segments per edge.
+  int NbSegments() const { return 1 << Level; }
+
+  //! Returns size of vertices, cells and sub-BVH in bytes.
+  size_t MemorySize() const
+  {
+    return Positions.size() * sizeof (glm::vec3) + Cells.size() * sizeof (int) + Hierarchy.MemorySize();
+  }
+
+  //! Returns index of grid vertex (I, J).
+  static int Vertex (int theNbSegments, int theI, int theJ)
+  {
+    return theJ * (theNbSegments + 1) - theJ * (theJ - 1) / 2 + theI;
+  }
+
+  //! Packs grid cell and triangle half into single integer.
+  static int PackCell (int theI, int theJ, bool theIsUpper)
+  {
+    return theI | (theJ << 12) | (theIsUpper ? 1 << 24 : 0);
+  }
+
+  //! Returns grid vertices of micro triangle (in the winding of the patch).
+  static void CellVertices (int theCell, glm::ivec2& theV0, glm::ivec2& theV1, glm::ivec2& theV2)
+  {
+    const int anI = theCell & 0xFFF;
+    const int aJ  = (theCell >> 12) & 0xFFF;
+    if ((theCell >> 24) != 0)
+    {
+      theV0 = glm::ivec2 (anI + 1, aJ + 1);
+      theV1 = glm::ivec2 (anI,     aJ + 1);
+      theV2 = glm::ivec2 (anI + 1, aJ);
+    }
+    else
+    {
+      theV0 = glm::ivec2 (anI,     aJ);
+      theV1 = glm::ivec2 (anI + 1, aJ);
+      theV2 = glm::ivec2 (anI,     aJ + 1);
+    }
+  }
+
+  //! Finds micro triangle containing point of the patch with barycentric coordinates
+  //! (theU, theV) and returns its cell with barycentric coordinates of the point in it.
+  static int LocateCell (int theNbSegments, float theU, float theV, float& theB1, float& theB2)
+  {
+    const float aX = theU * theNbSegments;
+    const float aY = theV * theNbSegments;
+
+    const int aJ = glm::clamp (static_cast<int> (aY), 0, theNbSegments - 1);
+    const int anI = glm::clamp (static_cast<int> (aX), 0, theNbSegments - 1 - aJ);
+
+    const float aFx = aX - anI;
+    const float aFy = aY - aJ;
+    if (aFx + aFy > 1.f && anI + aJ < theNbSegments - 1)
+    {
+      theB1 = anI + 1 - aX;
+      theB2 = aJ + 1 - aY;
+      return PackCell (anI, aJ, true);
+    }
+
+    theB1 = aFx;
+    theB2 = aFy;
+    return PackCell (anI, aJ, false);
+  }
+};
+
+//! Bounded cache of micro-meshes of displaced patches generated on first ray hit.
+//! Patches are distributed over shards with own lock and LRU list, so threads hitting
+//! different patches rarely contend. When the cache exceeds its memory budget, inserting
+//! thread evicts least recently used meshes of its shard (the budget may be exceeded by
+//! the last inserted mesh of each shard). Evicted mesh stays alive while any thread holds it.
+class TessellationCache
+{
+public:
+
+  //! Fills micro-mesh of the given patch.
+  typedef std::function<void (int thePatch, MicroMesh& theMesh)> BuildFunc;
+
+  //! Number of independently locked shards.
+  static const int NbShards = 16;
+
+  //! Creates empty cache with default budget.
+  TessellationCache();
+
+  //! Drops all meshes and prepares the cache for theNbPatches patches tessellated by theBuilder.
+  //! Statistics are reset. Must not be called while rays are traced.
+  void Reset (int theNbPatches, const BuildFunc& theBuilder);
+
+  //! Drops all meshes keeping the builder (e.g. after change of subdivision level).
+  void Clear() { Reset (static_cast<int> (myEntries.size()), myBuilder); }
+
+  //! Returns micro-mesh of the patch, tessellating it on miss. Thread-safe.
+  std::shared_ptr<const MicroMesh> Acquire (int thePatch);
+
+  //! Returns memory budget in bytes.
+  size_t Budget() const { return myBudget; }
+
+  //! Sets memory budget in bytes (applied on next insertion).
+  void SetBudget (size_t theBytes) { myBudget = theBytes; }
+
+  //! Returns limit in bytes imposed by memory budget of caches (0 - none).
+  size_t Limit() const { return myLimit; }
+
+  //! Sets limit in bytes imposed by memory budget of caches (0 - none); meshes are
+  //! kept within the smaller of budget and limit (applied on next insertion).
+  void SetLimit (size_t theBytes) { myLimit = theBytes; }
+
+  //! Returns size of resident meshes in bytes.
+  size_t MemoryUsed() const { return myUsed; }
+
+  //! Returns number of resident meshes.
+  int NbResident() const;
+
+  //! Returns number of lookups that found resident mesh.
+  uint64_t NbHits() const { return myNbHits; }
+
+  //! Returns number of lookups that tessellated the patch.
+  uint64_t NbMisses() const { return myNbMisses; }
+
+  //! Returns number of evicted meshes.
+  uint64_t NbEvictions() const { return myNbEvictions; }
+
+  //! Returns fraction of lookups served from the cache.
+  double HitRate() const
+  {
+    const uint64_t aNbLookups = myNbHits + myNbMisses;
+    return aNbLookups != 0 ? static_cast<double> (myNbHits) / aNbLookups : 0.0;
+  }
+
+  //! Returns time spent in tessellation summed over threads (ms).
+  double TessellationTime() const { return myTessTimeNs * 1.0e-6; }
+
+  //! Resets hit, miss and eviction counters and tessellation time.
+  void ResetStats();
+
+private:
+
+  //! Cache slot of single patch (guarded by the lock of its shard).
+  struct Entry
+  {
+    std::shared_ptr<const MicroMesh> Mesh;
+    std::list<int>::iterator         Position; //!< position in LRU list of the shard
+  };
+
+  //! Part of the cache with own lock and LRU list (most recent first).
+  struct Shard
+  {
+    std::mutex     Mutex;
+    std::list<int> Lru;
+  };
+
+private:
+
+  std::vector<Entry>    myEntries;
+  Shard                 myShards[NbShards];
+  BuildFunc             myBuilder;
+  size_t                myBudget;
+  size_t                myLimit;
+  std::atomic<size_t>   myUsed;
+  std::atomic<uint64_t> myNbHits;
+  std::atomic<uint64_t> myNbMisses;
+  std::atomic<uint64_t> myNbEvictions;
+  std::atomic<uint64_t> myTessTimeNs;
+
+};
@@ -0,0 +1,275 @@
+#include "Texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  //! Wraps integer texel coordinate into [0, theSize) range.
+  inline int WrapCoord (int theCoord, int theSize)
+  {
+    const int aCoord = theCoord % theSize;
+    return aCoord < 0 ? aCoord + theSize : aCoord;
+  }
+
+  //! Source taps of one destination texel along one axis of the mip reduction.
+  struct MipTaps
+  {
+    int   Index[3];
+    float Weight[3];
+    int   Count;
+  };
+
+  //! Computes taps covering the footprint of destination texel theDst when
+  //! reducing theSrcSize texels to theDstSize (2-tap box for even sizes,
+  //! polyphase 3-tap box for odd ones, so that every source texel contributes).
+  inline MipTaps ComputeMipTaps (int theDst, int theSrcSize, int theDstSize)
+  {
+    MipTaps aTaps;
+    if (theSrcSize == 1)
+    {
+      aTaps.Index[0] = 0; aTaps.Weight[0] = 1.f; aTaps.Count = 1;
+    }
+    else if (theSrcSize % 2 == 0)
+    {
+      aTaps.Index[0] = theDst * 2;     aTaps.Weight[0] = 0.5f;
+      aTaps.Index[1] = theDst * 2 + 1; aTaps.Weight[1] = 0.5f;
+      aTaps.Count = 2;
+    }
+    else
+    {
+      const float aNorm = 1.f / theSrcSize;
+      aTaps.Index[0] = theDst * 2;     aTaps.Weight[0] = (theDstSize - theDst) * aNorm;
+      aTaps.Index[1] = theDst * 2 + 1; aTaps.Weight[1] = theDstSize * aNorm;
+      aTaps.Index[2] = theDst * 2 + 2; aTaps.Weight[2] = (theDst + 1) * aNorm;
+      aTaps.Count = 3;
+    }
+    return aTaps;
+  }
+}
+
+//=======================================================================
+//function : Texture
+//purpose  :
+//=======================================================================
+Texture::Texture()
+: myMaxAnisotropy (8)
+{
+  //
+}
+
+//=======================================================================
+//function : Init
+//purpose  :
+//=======================================================================
+void Texture::Init (int theSizeX, int theSizeY, const glm::vec4* theTexels)
+{
+  myLevels.clear();
+
+  if (theSizeX <= 0 || theSizeY <= 0 || theTexels == NULL)
+  {
+    return;
+  }
+
+  myLevels.push_back (Level());
+  myLevels.back().SizeX = theSizeX;
+  myLevels.back().SizeY = theSizeY;
+  myLevels.back().Texels.assign (theTexels, theTexels + theSizeX * theSizeY);
+
+  // Box-filter each level into the next one until 1x1 is reached (odd sizes use 3-tap footprints)
+  while (myLevels.back().SizeX > 1 || myLevels.back().SizeY > 1)
+  {
+    const Level& aSrc = myLevels.back();
+
+    Level aDst;
+    aDst.SizeX = std::max (aSrc.SizeX / 2, 1);
+    aDst.SizeY = std::max (aSrc.SizeY / 2, 1);
+    aDst.Texels.resize (aDst.SizeX * aDst.SizeY);
+
+    for (int aY = 0; aY < aDst.SizeY; ++aY)
+    {
+      const MipTaps aTapsY = ComputeMipTaps (aY, aSrc.SizeY, aDst.SizeY);
+
+      for (int aX = 0; aX < aDst.SizeX; ++aX)
+      {
+        const MipTaps aTapsX = ComputeMipTaps (aX, aSrc.SizeX, aDst.SizeX);
+
+        glm::vec4 aSum (0.f);
+        for (int aTapY = 0; aTapY < aTapsY.Count; ++aTapY)
+        {
+          for (int aTapX = 0; aTapX < aTapsX.Count; ++aTapX)
+          {
+            aSum += aTapsX.Weight[aTapX] * aTapsY.Weight[aTapY]
+                  * aSrc.Texel (aTapsX.Index[aTapX], aTapsY.Index[aTapY]);
+          }
+        }
+        aDst.Texels[aY * aDst.SizeX + aX] = aSum;
+      }
+    }
+
+    myLevels.push_back (std::move (aDst));
+  }
+}
+
+//=======================================================================
+//function : Bilinear
+//purpose  :
+//=======================================================================
+glm::vec4 Texture::Bilinear (const glm::vec2& theUV, int theLevel) const
+{
+  if (myLevels.empty())
+  {
+    return glm::vec4 (1.f);
+  }
+
+  const Level& aLevel = myLevels[std::min (std::max (theLevel, 0), Levels() - 1)];
+
+  const float aX = theUV.x * aLevel.SizeX - 0.5f;
+  const float aY = theUV.y * aLevel.SizeY - 0.5f;
+
+  const float aFloorX = std::floor (aX);
+  const float aFloorY = std::floor (aY);
+
+  const float aFracX = aX - aFloorX;
+  const float aFracY = aY - aFloorY;
+
+  const int aX0 = WrapCoord (static_cast<int> (aFloorX),     aLevel.SizeX);
+  const int aX1 = WrapCoord (static_cast<int> (aFloorX) + 1, aLevel.SizeX);
+  const int aY0 = WrapCoord (static_cast<int> (aFloorY),     aLevel.SizeY);
+  const int aY1 = WrapCoord (static_cast<int> (aFloorY) + 1, aLevel.SizeY);
+
+  return glm::mix (glm::mix (aLevel.Texel (aX0, aY0), aLevel.Texel (aX1, aY0), aFracX),
+                   glm::mix (aLevel.Texel (aX0, aY1), aLevel.Texel (aX1, aY1), aFracX), aFracY);
+}
+
+//=======================================================================
+//function : MaxMagnitude
+//purpose  :
+//=======================================================================
+glm::vec4 Texture::MaxMagnitude() const
+{
+  if (myLevels.empty())
+  {
+    return glm::vec4 (1.f);
+  }
+
+  glm::vec4 aMax (0.f);
+  for (size_t anIdx = 0; anIdx < myLevels[0].Texels.size(); ++anIdx)
+  {
+    aMax = glm::max (aMax, glm::abs (myLevels[0].Texels[anIdx]));
+  }
+  return aMax;
+}
+
+//=======================================================================
+//function : Trilinear
+//purpose  :
+//=======================================================================
+glm::vec4 Texture::Trilinear (const glm::vec2& theUV, float theLod) const
+{
+  if (theLod <= 0.f)
+  {
+    return Bilinear (theUV, 0);
+  }
+
+  if (theLod >= static_cast<float> (Levels() - 1))
+  {
+    return Bilinear (theUV, Levels() - 1);
+  }
+
+  const int   aLevel = static_cast<int> (theLod);
+  const float aDelta = theLod - aLevel;
+
+  return glm::mix (Bilinear (theUV, aLevel), Bilinear (theUV, aLevel + 1), aDelta);
+}
+
+//=======================================================================
+//function : ComputeLod
+//purpose  :
+//=======================================================================
+float Texture::ComputeLod (const glm::vec2& theDuvDx, const glm::vec2& theDuvDy) const
+{
+  if (myLevels.empty())
+  {
+    return 0.f;
+  }
+
+  const glm::vec2 aScale (static_cast<float> (myLevels[0].SizeX),
+                          static_cast<float> (myLevels[0].SizeY));
+
+  const float aWidth = std::max (glm::length (theDuvDx * aScale),
+                                 glm::length (theDuvDy * aScale));
+
+  return aWidth > 1.f ? std::log2 (aWidth) : 0.f;
+}
+
+//=======================================================================
+//function : Sample
+//purpose  :
+//=======================================================================
+glm::vec4 Texture::Sample (const glm::vec2& theUV, const glm::vec2& theDuvDx, const glm::vec2& theDuvDy) const
+{
+  if (myLevels.empty())
+  {
+    return glm::vec4 (1.f);
+  }
+
+  const glm::vec2 aScale (static_cast<float> (myLevels[0].SizeX),
+                          static_cast<float> (myLevels[0].SizeY));
+
+  glm::vec2 aMajor = theDuvDx;
+  glm::vec2 aMinor = theDuvDy;
+
+  float aMajorLen = glm::length (aMajor * aScale);
+  float aMinorLen = glm::length (aMinor * aScale);
+
+  if (aMajorLen < aMinorLen)
+  {
+    std::swap (aMajor,    aMinor);
+    std::swap (aMajorLen, aMinorLen);
+  }
+
+  if (aMajorLen <= 1.f)
+  {
+    return Bilinear (theUV, 0);
+  }
+
+  // Clamp eccentricity, so that the number of probes stays bounded
+  if (aMinorLen * myMaxAnisotropy < aMajorLen)
+  {
+    aMinorLen = aMajorLen / myMaxAnisotropy;
+  }
+
+  const float aLod = aMinorLen > 1.f ? std::log2 (aMinorLen) : 0.f;
+
+  const int aNbProbes = std::min (static_cast<int> (std::ceil (aMajorLen / std::max (aMinorLen, 1.f))), myMaxAnisotropy);
+  if (aNbProbes <= 1)
+  {
+    return Trilinear (theUV, aLod);
+  }
+
+  // Distribute probes along the major axis of the footprint
+  glm::vec4 aResult (0.f);
+  for (int aProbe = 0; aProbe < aNbProbes; ++aProbe)
+  {
+    const float aOffset = (aProbe + 0.5f) / aNbProbes - 0.5f;
+
+    aResult += Trilinear (theUV + aMajor * aOffset, aLod);
+  }
+
+  return aResult * (1.f / aNbProbes);
+}
+
+//=======================================================================
+//function : MemorySize
+//purpose  :
+//=======================================================================
+size_t Texture::MemorySize() const
+{
+  size_t aSize = 0;
+  for (size_t aLevel = 0; aLevel < myLevels.size(); ++aLevel)
+  {
+    aSize += myLevels[aLevel].Texels.size() * sizeof (glm::vec4);
+  }
+  return aSize;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+//! Mip-mapped RGBA texture with footprint-based filtering.
+//! Level of detail is selected from texture coordinate derivatives
+//! (see RayDifferential::ComputeUVDerivatives), so distant or grazing
+//! hits fetch coarse levels instead of thrashing the finest one.
+class Texture
+{
+public:
+
+  //! Creates empty texture.
+  Texture();
+
+  //! Initializes texture from theSizeX * theSizeY texels (rows from bottom to top)
+  //! and builds the full mip-map chain.
+  void Init (int theSizeX, int theSizeY, const glm::vec4* theTexels);
+
+  //! Returns true if texture has no data.
+  bool IsEmpty() const { return myLevels.empty(); }
+
+  //! Returns number of mip-map levels.
+  int Levels() const { return static_cast<int> (myLevels.size()); }
+
+  //! Returns width of the given level.
+  int SizeX (int theLevel = 0) const { return myLevels[theLevel].SizeX; }
+
+  //! Returns height of the given level.
+  int SizeY (int theLevel = 0) const { return myLevels[theLevel].SizeY; }
+
+  //! Sets maximum number of probes along the major axis of anisotropic footprint.
+  void SetMaxAnisotropy (int theValue) { myMaxAnisotropy = theValue < 1 ? 1 : theValue; }
+
+  //! Returns bilinearly filtered value of the given level (repeat wrap mode).
+  glm::vec4 Bilinear (const glm::vec2& theUV, int theLevel) const;
+
+  //! Returns trilinearly filtered value for (fractional) level of detail.
+  glm::vec4 Trilinear (const glm::vec2& theUV, float theLod) const;
+
+  //! Returns value filtered over the footprint given by texture coordinate derivatives.
+  glm::vec4 Sample (const glm::vec2& theUV, const glm::vec2& theDuvDx, const glm::vec2& theDuvDy) const;
+
+  //! Returns value of the finest level (no footprint available).
+  glm::vec4 Sample (const glm::vec2& theUV) const { return Bilinear (theUV, 0); }
+
+  //! Returns per-component maximum magnitude over the finest level (bounds any filtered value).
+  glm::vec4 MaxMagnitude() const;
+
+  //! Returns level of detail for the given texture coordinate derivatives.
+  float ComputeLod (const glm::vec2& theDuvDx, const glm::vec2& theDuvDy) const;
+
+  //! Returns size of all mip levels in bytes.
+  size_t MemorySize() const;
+
+private:
+
+  //! Single level of mip-map chain.
+  struct Level
+  {
+    int SizeX;
+    int SizeY;
+
+    std::vector<glm::vec4> Texels;
+
+    const glm::vec4& Texel (int theX, int theY) const { return Texels[theY * SizeX + theX]; }
+  };
+
+  std::vector<Level> myLevels;
+  int                myMaxAnisotropy;
+
+};
@@ -0,0 +1,196 @@
+#include "ThreadPool.hpp"
+
+#include "Numa.hpp"
+
+#include <algorithm>
+
+//=======================================================================
+//function : ThreadPool
+//purpose  :
+//=======================================================================
+ThreadPool::ThreadPool (int theNbThreads)
+: myFuncData (NULL),
+  myFuncCall (NULL),
+  myCount (0),
+  myNext (0),
+  myNbBusy (0),
+  myGeneration (0),
+  myToStop (false)
+{
+  if (theNbThreads <= 0)
+  {
+    theNbThreads = std::max (static_cast<int> (std::thread::hardware_concurrency()), 1);
+  }
+
+  for (int aThreadId = 0; aThreadId < theNbThreads; ++aThreadId)
+  {
+    myArenas.push_back (std::unique_ptr<Arena> (new Arena()));
+  }
+
+  for (int aThreadId = 1; aThreadId < theNbThreads; ++aThreadId)
+  {
+    myWorkers.push_back (std::thread (&ThreadPool::workerLoop, this, aThreadId));
+  }
+}
+
+//=======================================================================
+//function : ~ThreadPool
+//purpose  :
+//=======================================================================
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> aLock (myMutex);
+    myToStop = true;
+  }
+
+  myStartCond.notify_all();
+
+  for (size_t anIdx = 0; anIdx < myWorkers.size(); ++anIdx)
+  {
+    myWorkers[anIdx].join();
+  }
+}
+
+//=======================================================================
+//function : SetPinning
+//purpose  :
+//=======================================================================
+void ThreadPool::SetPinning (bool theToPin)
+{
+  const NumaTopology& aTopology = NumaTopology::Get();
+
+  myThreadNodes.clear();
+  if (theToPin)
+  {
+    for (int aThreadId = 0; aThreadId < NbThreads(); ++aThreadId)
+    {
+      myThreadNodes.push_back (aTopology.NodeOfThread (aThreadId, NbThreads()));
+    }
+  }
+
+  // Workers are idle between loops, so their affinity may be changed from here
+  aTopology.PinCurrentThread (NodeOfThread (0));
+  for (size_t anIdx = 0; anIdx < myWorkers.size(); ++anIdx)
+  {
+    aTopology.PinThread (myWorkers[anIdx].native_handle(), NodeOfThread (static_cast<int> (anIdx) + 1));
+  }
+}
+
+//=======================================================================
+//function : ResetArenas
+//purpose  :
+//=======================================================================
+void ThreadPool::ResetArenas (size_t theReserve)
+{
+  for (size_t anIdx = 0; anIdx < myArenas.size(); ++anIdx)
+  {
+    myArenas[anIdx]->Reserve (theReserve);
+  }
+}
+
+//=======================================================================
+//function : ArenaCapacity
+//purpose  :
+//=======================================================================
+size_t ThreadPool::ArenaCapacity() const
+{
+  size_t aSize = 0;
+  for (size_t anIdx = 0; anIdx < myArenas.size(); ++anIdx)
+  {
+    aSize += myArenas[anIdx]->Capacity();
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : parallelFor
+//purpose  :
+//=======================================================================
+void ThreadPool::parallelFor (int theCount, const void* theData, LoopCall theCall)
+{
+  if (theCount <= 0)
+  {
+    return;
+  }
+
+  if (myWorkers.empty() || theCount == 1)
+  {
+    // The calling thread runs as thread 0, like in runIterations()
+    NumaTopology::SetCurrentNode (NodeOfThread (0));
+    for (int anIdx = 0; anIdx < theCount; ++anIdx)
+    {
+      theCall (theData, anIdx, 0);
+    }
+
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> aLock (myMutex);
+
+    myFuncData = theData;
+    myFuncCall = theCall;
+    myCount    = theCount;
+    myNbBusy = static_cast<int> (myWorkers.size());
+    myNext.store (0);
+
+    ++myGeneration;
+  }
+
+  myStartCond.notify_all();
+
+  runIterations (0);
+
+  std::unique_lock<std::mutex> aLock (myMutex);
+  myDoneCond.wait (aLock, [this]() { return myNbBusy == 0; });
+
+  myFuncData = NULL;
+  myFuncCall = NULL;
+}
+
+//=======================================================================
+//function : runIterations
+//purpose  :
+//=======================================================================
+void ThreadPool::runIterations (int theThreadId)
+{
+  NumaTopology::SetCurrentNode (NodeOfThread (theThreadId));
+
+  for (int anIdx = myNext.fetch_add (1); anIdx < myCount; anIdx = myNext.fetch_add (1))
+  {
+    myFuncCall (myFuncData, anIdx, theThreadId);
+  }
+}
+
+//=======================================================================
+//function : workerLoop
+//purpose  :
+//=======================================================================
+void ThreadPool::workerLoop (int theThreadId)
+{
+  unsigned int aGeneration = 0;
+
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> aLock (myMutex);
+      myStartCond.wait (aLock, [&]() { return myToStop || myGeneration != aGeneration; });
+
+      if (myToStop)
+      {
+        return;
+      }
+
+      aGeneration = myGeneration;
+    }
+
+    runIterations (theThreadId);
+
+    std::lock_guard<std::mutex> aLock (myMutex);
+    if (--myNbBusy == 0)
+    {
+      myDoneCond.notify_one();
+    }
+  }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Arena.hpp"
+
+//! Pool of persistent worker threads executing parallel loops.
+//! The calling thread participates in the loop as thread 0.
+//! Nested calls of ParallelFor() from loop bodies are not supported.
+class ThreadPool
+{
+public:
+
+  //! Creates pool with the given total number of threads (0 means hardware concurrency).
+  explicit ThreadPool (int theNbThreads = 0);
+
+  //! Stops and joins worker threads.
+  ~ThreadPool();
+
+  //! Returns total number of threads (including the calling one).
+  int NbThreads() const { return static_cast<int> (myWorkers.size()) + 1; }
+
+  //! Returns true if threads are pinned to NUMA nodes.
+  bool IsPinned() const { return !myThreadNodes.empty(); }
+
+  //! Pins threads to NUMA nodes (spread in proportion to node CPUs, the calling thread is thread 0)
+  //! or releases them to all CPUs. Loop bodies see node of their thread in NumaTopology::CurrentNode().
+  void SetPinning (bool theToPin);
+
+  //! Returns NUMA node of the thread (-1 if threads are not pinned).
+  int NodeOfThread (int theThreadId) const { return myThreadNodes.empty() ? -1 : myThreadNodes[theThreadId]; }
+
+  //! Executes theFunc (theIndex, theThreadId) for all indices in [0, theCount)
+  //! and blocks until all iterations are complete. The functor is called by
+  //! reference (not wrapped into std::function), so the call doesn't allocate.
+  template<class Func>
+  void ParallelFor (int theCount, const Func& theFunc)
+  {
+    parallelFor (theCount, &theFunc, [](const void* theData, int theIndex, int theThreadId)
+    {
+      (*static_cast<const Func*> (theData)) (theIndex, theThreadId);
+    });
+  }
+
+  //! Returns arena for transient data of the thread (used only by loop bodies of this thread).
+  Arena& ThreadArena (int theThreadId) { return *myArenas[theThreadId]; }
+
+  //! Releases transient data of all threads and makes each arena hold theReserve bytes in one
+  //! block (called between passes, not from loop bodies). Reserving the scratch of one loop
+  //! iteration keeps threads which first get work in later passes from allocating then.
+  void ResetArenas (size_t theReserve = 0);
+
+  //! Returns capacity of arenas of all threads in bytes.
+  size_t ArenaCapacity() const;
+
+private:
+
+  //! Calls functor theData for iteration theIndex by thread theThreadId.
+  typedef void (*LoopCall) (const void* theData, int theIndex, int theThreadId);
+
+  //! Executes loop of type-erased functor.
+  void parallelFor (int theCount, const void* theData, LoopCall theCall);
+
+  //! Main loop of worker thread.
+  void workerLoop (int theThreadId);
+
+  //! Processes iterations of the current loop.
+  void runIterations (int theThreadId);
+
+private:
+
+  std::vector<std::thread> myWorkers;
+  std::vector<int>         myThreadNodes; //!< NUMA node of each thread (empty if not pinned)
+  std::vector<std::unique_ptr<Arena> > myArenas; //!< transient data of each thread
+
+  std::mutex              myMutex;
+  std::condition_variable myStartCond;
+  std::condition_variable myDoneCond;
+
+  const void* myFuncData;
+  LoopCall    myFuncCall;
+
+  int              myCount;
+  std::atomic<int> myNext;
+  int              myNbBusy;
+  unsigned int     myGeneration;
+  bool             myToStop;
+
+};
@@ -0,0 +1,870 @@
+#include "WavefrontIntegrator.hpp"
+
+#include <algorithm>
+
+namespace
+{
+  //! Number of work items processed by single parallel task.
+  const int THE_CHUNK_SIZE = 1024;
+
+  //! Number of subtrees entered by ray, which are binned (rays entering more are traversed as usual).
+  const int THE_MAX_SUBTREES_PER_RAY = 8;
+
+  //! Returns number of chunks covering the given number of items.
+  inline int NbChunks (int theCount)
+  {
+    return (theCount + THE_CHUNK_SIZE - 1) / THE_CHUNK_SIZE;
+  }
+
+  //! Returns size of the vector elements in bytes.
+  template<class T>
+  inline size_t BytesOf (const std::vector<T>& theVector)
+  {
+    return theVector.size() * sizeof (T);
+  }
+}
+
+//=======================================================================
+//function : WavefrontIntegrator
+//purpose  :
+//=======================================================================
+WavefrontIntegrator::WavefrontIntegrator (int theBatchSize)
+: myBatchSize (std::max (theBatchSize, 1024)),
+  myAllocatedSize (0),
+  myIsa (BsdfBatch::SupportedIsa()),
+  myToReorder (false),
+  myGuideStride (0),
+  myNbActive (0),
+  myNbQueued (0),
+  myPixelOrderSizeX (0),
+  myPixelOrderSizeY (0)
+{
+  //
+}
+
+//=======================================================================
+//function : allocate
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::allocate (int theNbThreads)
+{
+  if (static_cast<int> (myScratch.size()) != theNbThreads)
+  {
+    myScratch.resize (theNbThreads);
+    for (size_t aThread = 0; aThread < myScratch.size(); ++aThread)
+    {
+      myScratch[aThread].Records.Resize (THE_CHUNK_SIZE);
+      myScratch[aThread].Paths   .resize (THE_CHUNK_SIZE);
+      myScratch[aThread].Points  .resize (THE_CHUNK_SIZE);
+      myScratch[aThread].IsActive.resize (THE_CHUNK_SIZE);
+    }
+  }
+
+  // Guide vertices depend on path depth, which may change between passes
+  myGuideStride = IsRecordingGuide() ? myParams.MaxDepth : 0;
+  if (myGuideStride > 0)
+  {
+    myGuideVertices.resize (static_cast<size_t> (myBatchSize) * myGuideStride);
+  }
+
+  // Subtree queues are kept only while reordering is enabled
+  const size_t aNbBinned = myToReorder ? static_cast<size_t> (myBatchSize) : 0;
+  if (myNbRaySubtrees.size() != aNbBinned)
+  {
+    myRaySubtrees.resize (aNbBinned * THE_MAX_SUBTREES_PER_RAY);
+    myRayEntries.resize (aNbBinned * THE_MAX_SUBTREES_PER_RAY);
+    myNbRaySubtrees.resize (aNbBinned);
+    myRayTmax.resize (aNbBinned);
+    myIsOccluded.resize (aNbBinned);
+    mySubtreeQueue.resize (aNbBinned);
+  }
+
+  if (myAllocatedSize == myBatchSize)
+  {
+    return;
+  }
+
+  myAllocatedSize = myBatchSize;
+
+  const size_t aSize = static_cast<size_t> (myBatchSize);
+
+  myRayOrigin.Resize (aSize);
+  myRayDirection.Resize (aSize);
+  myRayTime.resize (aSize);
+  myDiffOdx.Resize (aSize);
+  myDiffOdy.Resize (aSize);
+  myDiffDdx.Resize (aSize);
+  myDiffDdy.Resize (aSize);
+  myThroughput.Resize (aSize);
+  myRadiance.Resize (aSize);
+  myPrevPdf.resize (aSize);
+  myDepth.resize (aSize);
+  myPixel.resize (aSize);
+  myIsSpecular.resize (aSize);
+  myIsAlive.resize (aSize);
+  mySamplers.resize (aSize);
+  myNbGuideVertices.resize (aSize);
+
+  myAlbedo.Resize (aSize);
+  myNormal.Resize (aSize);
+  myHitDepth.resize (aSize);
+#ifdef RAYLAB_COST_LAYERS
+  myCosts.resize (aSize);
+#endif
+
+  myHitT.resize (aSize);
+  myHitU.resize (aSize);
+  myHitV.resize (aSize);
+  myHitTriangle.resize (aSize);
+
+  myShadowOrigin.Resize (aSize);
+  myShadowDirection.Resize (aSize);
+  myShadowContribution.Resize (aSize);
+  myShadowTmax.resize (aSize);
+  myShadowNbGuideVertices.resize (aSize);
+  myIsShadowValid.resize (aSize);
+
+  myActive.resize (aSize);
+  myQueue.resize (aSize);
+}
+
+//=======================================================================
+//function : ArenaSize
+//purpose  :
+//=======================================================================
+size_t WavefrontIntegrator::ArenaSize() const
+{
+  return Arena::Footprint<Ray> (THE_CHUNK_SIZE) + PagedBvh::PrefetchArenaSize (THE_CHUNK_SIZE);
+}
+
+//=======================================================================
+//function : MemorySize
+//purpose  :
+//=======================================================================
+size_t WavefrontIntegrator::MemorySize() const
+{
+  size_t aSize = myRayOrigin.MemorySize() + myRayDirection.MemorySize() + BytesOf (myRayTime)
+               + myDiffOdx.MemorySize() + myDiffOdy.MemorySize() + myDiffDdx.MemorySize() + myDiffDdy.MemorySize()
+               + myThroughput.MemorySize() + myRadiance.MemorySize() + BytesOf (myPrevPdf)
+               + BytesOf (myDepth) + BytesOf (myPixel) + BytesOf (myIsSpecular) + BytesOf (myIsAlive) + BytesOf (mySamplers)
+               + BytesOf (myGuideVertices) + BytesOf (myNbGuideVertices)
+               + myAlbedo.MemorySize() + myNormal.MemorySize() + BytesOf (myHitDepth)
+               + BytesOf (myHitT) + BytesOf (myHitU) + BytesOf (myHitV) + BytesOf (myHitTriangle)
+               + myShadowOrigin.MemorySize() + myShadowDirection.MemorySize() + myShadowContribution.MemorySize()
+               + BytesOf (myShadowTmax) + BytesOf (myShadowNbGuideVertices) + BytesOf (myIsShadowValid)
+               + BytesOf (myActive) + BytesOf (myQueue) + BytesOf (myQueueOffsets) + BytesOf (myQueueHeads) + BytesOf (myPixelOrder)
+               + BytesOf (myRaySubtrees) + BytesOf (myRayEntries) + BytesOf (myNbRaySubtrees) + BytesOf (myRayTmax)
+               + BytesOf (myIsOccluded) + BytesOf (mySubtreeQueue) + BytesOf (mySubtreeOffsets) + BytesOf (myTraceChunks)
+               + BytesOf (myShadeChunks) + BytesOf (myPixelOrderTiles);
+#ifdef RAYLAB_COST_LAYERS
+  aSize += BytesOf (myCosts);
+#endif
+  for (size_t aThread = 0; aThread < myScratch.size(); ++aThread)
+  {
+    const ShadeScratch& aScratch = myScratch[aThread];
+    aSize += aScratch.Records.MemorySize() + BytesOf (aScratch.Paths) + BytesOf (aScratch.Points) + BytesOf (aScratch.IsActive);
+  }
+  return aSize;
+}
+
+//=======================================================================
+//function : updatePixelOrder
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::updatePixelOrder (const Framebuffer& theFramebuffer)
+{
+  if (myPixelOrderSizeX == theFramebuffer.SizeX()
+   && myPixelOrderSizeY == theFramebuffer.SizeY()
+   && myPixelOrderTiles == theFramebuffer.ActiveTiles())
+  {
+    return;
+  }
+
+  myPixelOrderSizeX = theFramebuffer.SizeX();
+  myPixelOrderSizeY = theFramebuffer.SizeY();
+  myPixelOrderTiles = theFramebuffer.ActiveTiles();
+
+  // Enumerate pixels of active tiles tile by tile to keep primary rays of a batch coherent
+  myPixelOrder.clear();
+  myPixelOrder.reserve (myPixelOrderSizeX * myPixelOrderSizeY);
+
+  for (size_t aTileIdx = 0; aTileIdx < myPixelOrderTiles.size(); ++aTileIdx)
+  {
+    int aMinX, aMinY, aMaxX, aMaxY;
+    theFramebuffer.TileRect (myPixelOrderTiles[aTileIdx], aMinX, aMinY, aMaxX, aMaxY);
+
+    for (int aY = aMinY; aY < aMaxY; ++aY)
+    {
+      for (int aX = aMinX; aX < aMaxX; ++aX)
+      {
+        myPixelOrder.push_back (aY * myPixelOrderSizeX + aX);
+      }
+    }
+  }
+}
+
+//=======================================================================
+//function : loadPath
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::loadPath (int thePath, PathState& theState)
+{
+  theState.Current = Ray (myRayOrigin.Get (thePath), myRayDirection.Get (thePath), 0.f, FLT_MAX, myRayTime[thePath]);
+
+  theState.Diff.dOdx = myDiffOdx.Get (thePath);
+  theState.Diff.dOdy = myDiffOdy.Get (thePath);
+  theState.Diff.dDdx = myDiffDdx.Get (thePath);
+  theState.Diff.dDdy = myDiffDdy.Get (thePath);
+
+  theState.Throughput = myThroughput.Get (thePath);
+  theState.Radiance   = myRadiance.Get (thePath);
+  theState.PrevPdf    = myPrevPdf[thePath];
+  theState.IsSpecular = myIsSpecular[thePath] != 0;
+  theState.Depth      = myDepth[thePath];
+  theState.Pixel      = myPixel[thePath];
+
+  theState.Sampler    = mySamplers[thePath];
+
+  theState.GuideVertices   = guideVertices (thePath);
+  theState.NbGuideVertices = myNbGuideVertices[thePath];
+}
+
+//=======================================================================
+//function : storePath
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::storePath (int thePath, const PathState& theState)
+{
+  myRayOrigin.Set    (thePath, theState.Current.Origin);
+  myRayDirection.Set (thePath, theState.Current.Direction);
+  myRayTime[thePath] = theState.Current.Time;
+
+  myDiffOdx.Set (thePath, theState.Diff.dOdx);
+  myDiffOdy.Set (thePath, theState.Diff.dOdy);
+  myDiffDdx.Set (thePath, theState.Diff.dDdx);
+  myDiffDdy.Set (thePath, theState.Diff.dDdy);
+
+  myThroughput.Set (thePath, theState.Throughput);
+  myRadiance.Set   (thePath, theState.Radiance);
+
+  myPrevPdf[thePath]    = theState.PrevPdf;
+  myIsSpecular[thePath] = theState.IsSpecular ? 1 : 0;
+  myDepth[thePath]      = theState.Depth;
+  myPixel[thePath]      = theState.Pixel;
+  mySamplers[thePath]   = theState.Sampler;
+
+  myNbGuideVertices[thePath] = theState.NbGuideVertices;
+}
+
+//=======================================================================
+//function : generate
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::generate (const Scene& theScene, const Camera& theCamera, const Framebuffer& theFramebuffer, int theFirst, int theCount, ThreadPool& thePool)
+{
+  thePool.ParallelFor (NbChunks (theCount), [&](int theChunk, int)
+  {
+    const int aLast = std::min ((theChunk + 1) * THE_CHUNK_SIZE, theCount);
+
+    for (int aPath = theChunk * THE_CHUNK_SIZE; aPath < aLast; ++aPath)
+    {
+      PathState aState;
+      StartPath (theScene, theCamera, theFramebuffer, myPixelOrder[theFirst + aPath], aState);
+      aState.GuideVertices = guideVertices (aPath);
+      storePath (aPath, aState);
+
+      myActive[aPath] = aPath;
+
+      myAlbedo.Set (aPath, glm::vec3 (0.f));
+      myNormal.Set (aPath, glm::vec3 (0.f));
+      myHitDepth[aPath] = 0.f;
+#ifdef RAYLAB_COST_LAYERS
+      myCosts[aPath] = PathCost();
+#endif
+    }
+  });
+
+  myNbActive = theCount;
+}
+
+//=======================================================================
+//function : prefetch
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::prefetch (const Scene& theScene, const std::vector<int>& theQueue, int theCount, bool theIsShadow, ThreadPool& thePool)
+{
+  // Blocks needed by the whole queue are requested before tracing,
+  // so that their reads overlap instead of faulting one by one
+  theScene.BeginPrefetch();
+  thePool.ParallelFor (NbChunks (theCount), [&](int theChunk, int theThreadId)
+  {
+    const int aLast = std::min ((theChunk + 1) * THE_CHUNK_SIZE, theCount);
+
+    Arena& anArena = thePool.ThreadArena (theThreadId);
+    ArenaScope anArenaScope (anArena);
+
+    Ray* aRays   = anArena.Allocate<Ray> (aLast - theChunk * THE_CHUNK_SIZE);
+    int  aNbRays = 0;
+    for (int anIdx = theChunk * THE_CHUNK_SIZE; anIdx < aLast; ++anIdx)
+    {
+      const int aPath = theQueue[anIdx];
+      if (!theIsShadow || myIsShadowValid[aPath])
+      {
+        aRays[aNbRays++] = pathRay (aPath, theIsShadow);
+      }
+    }
+
+    theScene.Prefetch (aRays, aNbRays, anArena);
+  });
+}
+
+//=======================================================================
+//function : traceBySubtree
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::traceBySubtree (const Scene& theScene, const std::vector<int>& theQueue, int theCount, bool theIsShadow, ThreadPool& thePool)
+{
+  const int aNbSubtrees = theScene.NbSubtrees();
+
+  // Subtrees entered by each ray are found by traversal of the small top tree
+  thePool.ParallelFor (NbChunks (theCount), [&](int theChunk, int)
+  {
+    const int aLast = std::min ((theChunk + 1) * THE_CHUNK_SIZE, theCount);
+
+    for (int anIdx = theChunk * THE_CHUNK_SIZE; anIdx < aLast; ++anIdx)
+    {
+      const int aPath = theQueue[anIdx];
+
+      myNbRaySubtrees[anIdx] = 0;
+      myIsOccluded[anIdx]    = 0;
+      if (theIsShadow && !myIsShadowValid[aPath])
+      {
+        continue;
+      }
+
+      const Ray aRay = pathRay (aPath, theIsShadow);
+      myRayTmax[anIdx] = aRay.Tmax;
+
+      int aHint = -1;
+      if (theIsShadow && theScene.OccludedShapes (aRay, aHint))
+      {
+        myIsOccluded[anIdx] = 1;
+        continue;
+      }
+      else if (!theIsShadow)
+      {
+        myHitT[aPath]        = FLT_MAX;
+        myHitU[aPath]        = 0.f;
+        myHitV[aPath]        = 0.f;
+        myHitTriangle[aPath] = -1;
+      }
+
+      const int aNbEntered = theScene.EnteredSubtrees (aRay,
+                                                       &myRaySubtrees[anIdx * THE_MAX_SUBTREES_PER_RAY],
+                                                       &myRayEntries [anIdx * THE_MAX_SUBTREES_PER_RAY],
+                                                       THE_MAX_SUBTREES_PER_RAY);
+      myNbRaySubtrees[anIdx] = aNbEntered <= THE_MAX_SUBTREES_PER_RAY ? aNbEntered : -1;
+    }
+  });
+
+  // In round N each ray traces its N-th subtree (front-to-back), unless the hit found
+  // so far is closer. Rays of the same subtree are traced together by few tasks.
+  for (int aRound = 0; aRound < THE_MAX_SUBTREES_PER_RAY; ++aRound)
+  {
+    auto isPending = [&](int theIdx) -> bool
+    {
+      return aRound < myNbRaySubtrees[theIdx]
+          && myIsOccluded[theIdx] == 0
+          && myRayEntries[theIdx * THE_MAX_SUBTREES_PER_RAY + aRound] < myRayTmax[theIdx];
+    };
+
+    // Counting sort of pending rays by subtree
+    mySubtreeOffsets.assign (aNbSubtrees + 1, 0);
+    for (int anIdx = 0; anIdx < theCount; ++anIdx)
+    {
+      if (isPending (anIdx))
+      {
+        ++mySubtreeOffsets[myRaySubtrees[anIdx * THE_MAX_SUBTREES_PER_RAY + aRound] + 1];
+      }
+    }
+
+    for (int aSubtree = 0; aSubtree < aNbSubtrees; ++aSubtree)
+    {
+      mySubtreeOffsets[aSubtree + 1] += mySubtreeOffsets[aSubtree];
+    }
+
+    if (mySubtreeOffsets[aNbSubtrees] == 0)
+    {
+      break;
+    }
+
+    myTraceChunks.clear();
+    for (int aSubtree = 0; aSubtree < aNbSubtrees; ++aSubtree)
+    {
+      for (int aFirst = mySubtreeOffsets[aSubtree]; aFirst < mySubtreeOffsets[aSubtree + 1]; aFirst += THE_CHUNK_SIZE)
+      {
+        const TraceChunk aChunk = { aSubtree, aFirst, std::min (aFirst + THE_CHUNK_SIZE, mySubtreeOffsets[aSubtree + 1]) };
+        myTraceChunks.push_back (aChunk);
+      }
+    }
+
+    for (int anIdx = 0; anIdx < theCount; ++anIdx)
+    {
+      if (isPending (anIdx))
+      {
+        mySubtreeQueue[mySubtreeOffsets[myRaySubtrees[anIdx * THE_MAX_SUBTREES_PER_RAY + aRound]]++] = anIdx;
+      }
+    }
+
+    // Each ray is binned at most once per round, so tasks don't share rays
+    thePool.ParallelFor (static_cast<int> (myTraceChunks.size()), [&](int theChunk, int theThreadId)
+    {
+      const TraceChunk& aChunk = myTraceChunks[theChunk];
+
+      TraversalStats aTraversal;
+
+      for (int aQueueIdx = aChunk.First; aQueueIdx < aChunk.Last; ++aQueueIdx)
+      {
+        const int anIdx = mySubtreeQueue[aQueueIdx];
+        const int aPath = theQueue[anIdx];
+        const Ray aRay  = pathRay (aPath, theIsShadow);
+
+        if (theIsShadow)
+        {
+          myIsOccluded[anIdx] = theScene.OccludedSubtree (aRay, aChunk.Subtree) ? 1 : 0;
+          continue;
+        }
+
+        SurfaceHit     aHit;
+        TraversalStats aRayTraversal;
+        theScene.IntersectSubtree (aRay, aChunk.Subtree, myRayTmax[anIdx], aHit, &aRayTraversal);
+        aTraversal += aRayTraversal;
+#ifdef RAYLAB_COST_LAYERS
+        myCosts[aPath].Traversal += aRayTraversal;
+#endif
+        if (aHit.Triangle != -1)
+        {
+          myHitT[aPath]        = aHit.T;
+          myHitU[aPath]        = aHit.U;
+          myHitV[aPath]        = aHit.V;
+          myHitTriangle[aPath] = aHit.Triangle;
+        }
+      }
+
+      ThreadStats (theThreadId).AddTraversal (aTraversal);
+    });
+  }
+}
+
+//=======================================================================
+//function : extend
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::extend (const Scene& theScene, ThreadPool& thePool)
+{
+  if (theScene.IsPrefetching() && !theScene.PagedHierarchy().IsEmpty())
+  {
+    prefetch (theScene, myActive, myNbActive, false, thePool);
+  }
+
+  const bool isReordered = myToReorder && theScene.NbSubtrees() > 0;
+  if (isReordered)
+  {
+    traceBySubtree (theScene, myActive, myNbActive, false, thePool);
+  }
+
+  const bool hasEnvironment = !theScene.EnvironmentLight().IsEmpty();
+
+  thePool.ParallelFor (NbChunks (myNbActive), [&](int theChunk, int theThreadId)
+  {
+    RayStats aChunkStats;
+
+    const int aLast = std::min ((theChunk + 1) * THE_CHUNK_SIZE, myNbActive);
+
+    for (int anIdx = theChunk * THE_CHUNK_SIZE; anIdx < aLast; ++anIdx)
+    {
+      const int aPath = myActive[anIdx];
+
+      const Ray aRay = pathRay (aPath, false);
+
+      ++(myDepth[aPath] == 0 ? aChunkStats.NbCameraRays : aChunkStats.NbBounceRays);
+
+      SurfaceHit     aHit;
+      TraversalStats aRayTraversal;
+      if (isReordered && myNbRaySubtrees[anIdx] != -1)
+      {
+        // Triangles were traced by subtree queues, only shapes are left
+        aHit.T        = myHitT[aPath];
+        aHit.Triangle = myHitTriangle[aPath];
+        aHit.U        = myHitU[aPath];
+        aHit.V        = myHitV[aPath];
+        aHit.Time     = aRay.Time;
+        theScene.IntersectShapes (aRay, myRayTmax[anIdx], aHit, &aRayTraversal);
+      }
+      else
+      {
+        theScene.Intersect (aRay, aHit, &aRayTraversal);
+      }
+
+      aChunkStats.AddTraversal (aRayTraversal);
+#ifdef RAYLAB_COST_LAYERS
+      ++myCosts[aPath].NbRays;
+      myCosts[aPath].Traversal += aRayTraversal;
+#endif
+
+      myHitT[aPath]        = aHit.T;
+      myHitU[aPath]        = aHit.U;
+      myHitV[aPath]        = aHit.V;
+      myHitTriangle[aPath] = aHit.Triangle;
+
+      // Escaped paths are terminated by sortByMaterial()
+      if (aHit.Triangle == -1 && hasEnvironment)
+      {
+        PathState aState;
+        loadPath (aPath, aState);
+        AddEscaped (theScene, aState);
+        myRadiance.Set (aPath, aState.Radiance);
+      }
+    }
+
+    ThreadStats (theThreadId) += aChunkStats;
+  });
+}
+
+//=======================================================================
+//function : sortByMaterial
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::sortByMaterial (const Scene& theScene)
+{
+  const int aNbMaterials = static_cast<int> (theScene.Materials.size());
+
+  // Counting sort of paths with hits by material index
+  myQueueOffsets.assign (aNbMaterials + 1, 0);
+
+  for (int anIdx = 0; anIdx < myNbActive; ++anIdx)
+  {
+    const int aTriangle = myHitTriangle[myActive[anIdx]];
+    if (aTriangle != -1)
+    {
+      ++myQueueOffsets[theScene.MaterialOf (aTriangle) + 1];
+    }
+  }
+
+  for (int aMaterial = 0; aMaterial < aNbMaterials; ++aMaterial)
+  {
+    myQueueOffsets[aMaterial + 1] += myQueueOffsets[aMaterial];
+  }
+
+  myNbQueued = myQueueOffsets[aNbMaterials];
+
+  // Split queues into chunks shaded by single task
+  myShadeChunks.clear();
+  for (int aMaterial = 0; aMaterial < aNbMaterials; ++aMaterial)
+  {
+    for (int aFirst = myQueueOffsets[aMaterial]; aFirst < myQueueOffsets[aMaterial + 1]; aFirst += THE_CHUNK_SIZE)
+    {
+      const ShadeChunk aChunk = { aMaterial, aFirst, std::min (aFirst + THE_CHUNK_SIZE, myQueueOffsets[aMaterial + 1]) };
+      myShadeChunks.push_back (aChunk);
+    }
+  }
+
+  myQueueHeads.assign (myQueueOffsets.begin(), myQueueOffsets.end() - 1);
+  for (int anIdx = 0; anIdx < myNbActive; ++anIdx)
+  {
+    const int aPath     = myActive[anIdx];
+    const int aTriangle = myHitTriangle[aPath];
+
+    if (aTriangle != -1)
+    {
+      myQueue[myQueueHeads[theScene.MaterialOf (aTriangle)]++] = aPath;
+    }
+    else
+    {
+      myIsAlive[aPath] = 0;
+    }
+  }
+}
+
+//=======================================================================
+//function : shade
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::shade (const Scene& theScene, ThreadPool& thePool)
+{
+  thePool.ParallelFor (static_cast<int> (myShadeChunks.size()), [&](int theChunk, int theThreadId)
+  {
+    const ShadeChunk& aChunk    = myShadeChunks[theChunk];
+    const Material&   aMaterial = theScene.Materials[aChunk.Material];
+
+    ShadeScratch& aScratch = myScratch[theThreadId];
+    HitRecords&   aRecords = aScratch.Records;
+
+    const int aCount = aChunk.Last - aChunk.First;
+
+    ThreadStats (theThreadId).NbShadingCalls += static_cast<uint64_t> (aCount);
+
+    // Surface setup and emitter sampling
+    for (int aLane = 0; aLane < aCount; ++aLane)
+    {
+      const int aPath = myQueue[aChunk.First + aLane];
+
+      PathState&    aState = aScratch.Paths[aLane];
+      ShadingPoint& aPoint = aScratch.Points[aLane];
+
+      loadPath (aPath, aState);
+
+      SurfaceHit aHit;
+      aHit.T        = myHitT[aPath];
+      aHit.U        = myHitU[aPath];
+      aHit.V        = myHitV[aPath];
+      aHit.Triangle = myHitTriangle[aPath];
+      aHit.Time     = myRayTime[aPath];
+
+      AovSample anAov;
+
+      const bool isFirstHit = aState.Depth == 0;
+      const bool isActive   = PrepareShading (theScene, aHit, aState, aPoint, isFirstHit ? &anAov : NULL);
+
+      if (isFirstHit)
+      {
+        myAlbedo.Set (aPath, anAov.Albedo);
+        myNormal.Set (aPath, anAov.Normal);
+        myHitDepth[aPath] = anAov.Depth;
+      }
+
+      aScratch.IsActive[aLane] = isActive ? 1 : 0;
+      if (!isActive)
+      {
+        aRecords.SetEmpty (aLane);
+        continue;
+      }
+
+      const SurfacePoint& aSurface = aPoint.Surface;
+
+      aRecords.PositionX[aLane] = aSurface.Position.x;
+      aRecords.PositionY[aLane] = aSurface.Position.y;
+      aRecords.PositionZ[aLane] = aSurface.Position.z;
+      aRecords.NormalX[aLane]   = aSurface.Normal.x;
+      aRecords.NormalY[aLane]   = aSurface.Normal.y;
+      aRecords.NormalZ[aLane]   = aSurface.Normal.z;
+      aRecords.U[aLane]         = aSurface.TexCoord.x;
+      aRecords.V[aLane]         = aSurface.TexCoord.y;
+      aRecords.WoX[aLane]       = aPoint.Wo.x;
+      aRecords.WoY[aLane]       = aPoint.Wo.y;
+      aRecords.WoZ[aLane]       = aPoint.Wo.z;
+      aRecords.AlbedoR[aLane]   = aPoint.Albedo.x;
+      aRecords.AlbedoG[aLane]   = aPoint.Albedo.y;
+      aRecords.AlbedoB[aLane]   = aPoint.Albedo.z;
+      aRecords.LightX[aLane]    = aPoint.LightDir.x;
+      aRecords.LightY[aLane]    = aPoint.LightDir.y;
+      aRecords.LightZ[aLane]    = aPoint.LightDir.z;
+      aRecords.Rnd0[aLane]      = aPoint.BsdfRnd.x;
+      aRecords.Rnd1[aLane]      = aPoint.BsdfRnd.y;
+      aRecords.Rnd2[aLane]      = aPoint.BsdfRnd.z;
+    }
+
+    // Evaluate and sample BSDFs of the whole chunk at once
+    const int aNbPadded = (aCount + HitRecords::Width - 1) / HitRecords::Width * HitRecords::Width;
+    for (int aLane = aCount; aLane < aNbPadded; ++aLane)
+    {
+      aRecords.SetEmpty (aLane);
+    }
+
+    BsdfBatch::Shade (aMaterial, aRecords, 0, aNbPadded, myIsa);
+
+    // Shadow rays and path continuation
+    for (int aLane = 0; aLane < aCount; ++aLane)
+    {
+      const int aPath = myQueue[aChunk.First + aLane];
+
+      PathState& aState = aScratch.Paths[aLane];
+
+      ShadowRay aShadow;
+      aShadow.IsValid = false;
+
+      bool toContinue = false;
+      if (aScratch.IsActive[aLane])
+      {
+        BsdfSample aSample;
+        aSample.Wi         = glm::vec3 (aRecords.WiX[aLane],     aRecords.WiY[aLane],     aRecords.WiZ[aLane]);
+        aSample.Weight     = glm::vec3 (aRecords.WeightR[aLane], aRecords.WeightG[aLane], aRecords.WeightB[aLane]);
+        aSample.Pdf        = aRecords.Pdf[aLane];
+        aSample.IsSpecular = Bsdf::IsDelta (aMaterial);
+
+        const glm::vec3 aLightBsdf (aRecords.LightBsdfR[aLane], aRecords.LightBsdfG[aLane], aRecords.LightBsdfB[aLane]);
+
+        toContinue = FinishShading (theScene, aScratch.Points[aLane], aLightBsdf, aRecords.LightPdf[aLane],
+                                    aSample, aRecords.IsSampled[aLane] != 0, aState, aShadow);
+      }
+
+      myIsShadowValid[aPath] = aShadow.IsValid ? 1 : 0;
+      if (aShadow.IsValid)
+      {
+        myShadowOrigin.Set       (aPath, aShadow.Segment.Origin);
+        myShadowDirection.Set    (aPath, aShadow.Segment.Direction);
+        myShadowContribution.Set (aPath, aShadow.Contribution);
+        myShadowTmax[aPath] = aShadow.Segment.Tmax;
+
+        myShadowNbGuideVertices[aPath] = aShadow.NbGuideVertices;
+      }
+
+      myIsAlive[aPath] = toContinue ? 1 : 0;
+
+      storePath (aPath, aState);
+    }
+  });
+}
+
+//=======================================================================
+//function : shadow
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::shadow (const Scene& theScene, ThreadPool& thePool)
+{
+  if (theScene.IsPrefetching() && !theScene.PagedHierarchy().IsEmpty())
+  {
+    prefetch (theScene, myQueue, myNbQueued, true, thePool);
+  }
+
+  const bool isReordered = myToReorder && theScene.NbSubtrees() > 0;
+  if (isReordered)
+  {
+    traceBySubtree (theScene, myQueue, myNbQueued, true, thePool);
+  }
+
+  thePool.ParallelFor (NbChunks (myNbQueued), [&](int theChunk, int theThreadId)
+  {
+    uint64_t aNbChunkRays = 0;
+
+    // Queued paths are sorted by material, neighbors often share the occluder
+    int aHint = -1;
+
+    const int aLast = std::min ((theChunk + 1) * THE_CHUNK_SIZE, myNbQueued);
+
+    for (int anIdx = theChunk * THE_CHUNK_SIZE; anIdx < aLast; ++anIdx)
+    {
+      const int aPath = myQueue[anIdx];
+      if (!myIsShadowValid[aPath])
+      {
+        continue;
+      }
+
+      ++aNbChunkRays;
+#ifdef RAYLAB_COST_LAYERS
+      ++myCosts[aPath].NbShadows;
+#endif
+
+      ShadowRay aShadow;
+      aShadow.Segment         = pathRay (aPath, true);
+      aShadow.Contribution    = myShadowContribution.Get (aPath);
+      aShadow.NbGuideVertices = myShadowNbGuideVertices[aPath];
+
+      const bool isOccluded = isReordered && myNbRaySubtrees[anIdx] != -1
+                            ? myIsOccluded[anIdx] != 0
+                            : theScene.Occluded (aShadow.Segment, aHint);
+      if (!isOccluded)
+      {
+        glm::vec3 aRadiance = myRadiance.Get (aPath);
+        AddShadow (aShadow, aRadiance, guideVertices (aPath));
+        myRadiance.Set (aPath, aRadiance);
+      }
+    }
+
+    ThreadStats (theThreadId).NbShadowRays += aNbChunkRays;
+  });
+}
+
+//=======================================================================
+//function : compact
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::compact()
+{
+  // Keep original (tile-major) order, so that next bounce rays stay coherent
+  int aNbAlive = 0;
+  for (int anIdx = 0; anIdx < myNbActive; ++anIdx)
+  {
+    const int aPath = myActive[anIdx];
+    if (myIsAlive[aPath])
+    {
+      myActive[aNbAlive++] = aPath;
+    }
+  }
+
+  myNbActive = aNbAlive;
+}
+
+//=======================================================================
+//function : accumulate
+//purpose  :
+//=======================================================================
+void WavefrontIntegrator::accumulate (Framebuffer& theFramebuffer, int theCount, ThreadPool& thePool)
+{
+  thePool.ParallelFor (NbChunks (theCount), [&](int theChunk, int)
+  {
+    const int aLast = std::min ((theChunk + 1) * THE_CHUNK_SIZE, theCount);
+
+    for (int aPath = theChunk * THE_CHUNK_SIZE; aPath < aLast; ++aPath)
+    {
+      const int aPixel = myPixel[aPath];
+
+      if (myGuideStride > 0)
+      {
+        PathState aState;
+        loadPath (aPath, aState);
+        RecordPath (aState);
+      }
+
+      theFramebuffer.AddSample (Layer_Color,  aPixel, myRadiance.Get (aPath));
+      theFramebuffer.AddSample (Layer_Albedo, aPixel, myAlbedo.Get (aPath));
+      theFramebuffer.AddSample (Layer_Normal, aPixel, myNormal.Get (aPath));
+      theFramebuffer.AddSample (Layer_Depth,  aPixel, glm::vec3 (myHitDepth[aPath]));
+#ifdef RAYLAB_COST_LAYERS
+      myCosts[aPath].AddSample (theFramebuffer, aPixel);
+#endif
+    }
+  });
+}
+
+//=======================================================================
+//function : Render
+//purpose  :
+//=======================================================================
+uint64_t WavefrontIntegrator::Render (const Scene&    theScene,
+                                      const Camera&   theCamera,
+                                      Framebuffer&    theFramebuffer,
+                                      ThreadPool&     thePool)
+{
+  allocate (thePool.NbThreads());
+  updatePixelOrder (theFramebuffer);
+
+  ResetStats (thePool.NbThreads());
+
+  const int aNbPixels = static_cast<int> (myPixelOrder.size());
+
+  for (int aFirst = 0; aFirst < aNbPixels; aFirst += myBatchSize)
+  {
+    const int aCount = std::min (myBatchSize, aNbPixels - aFirst);
+
+    generate (theScene, theCamera, theFramebuffer, aFirst, aCount, thePool);
+
+    while (myNbActive > 0)
+    {
+      extend (theScene, thePool);
+
+      sortByMaterial (theScene);
+
+      shade (theScene, thePool);
+
+      shadow (theScene, thePool);
+
+      compact();
+    }
+
+    accumulate (theFramebuffer, aCount, thePool);
+  }
+
+  MergeStats();
+  return myStats.NbRays();
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <vector>
+
+#include "BsdfBatch.hpp"
+#include "Integrator.hpp"
+
+//! Wavefront path tracer (Laine et al., "Megakernels Considered Harmful", 2013).
+//! Large batches of paths are advanced in stages (generate, extend, shade,
+//! shadow, accumulate). Between extend and shade the hits are sorted into
+//! per-material queues, so that shading of each material runs over
+//! consecutive work items. Path state lives in preallocated SoA buffers.
+//! Each material queue is shaded in chunks: surface setup and emitter
+//! sampling fill SoA hit records, then BSDFs of the whole chunk are
+//! evaluated and sampled by SIMD kernels (BsdfBatch).
+//! Optionally, extension and shadow rays are binned by BVH subtree they enter
+//! next and each subtree queue is traced at once, so that nodes and triangles
+//! (pages of out-of-core BVH) are loaded once per round instead of per ray.
+class WavefrontIntegrator : public Integrator
+{
+public:
+
+  //! Creates integrator with the given number of paths in flight.
+  explicit WavefrontIntegrator (int theBatchSize = 1 << 16);
+
+  //! Returns name of the integrator.
+  virtual const char* Name() const override { return "Wavefront"; }
+
+  //! Renders one pass (one sample per pixel).
+  virtual uint64_t Render (const Scene&    theScene,
+                           const Camera&   theCamera,
+                           Framebuffer&    theFramebuffer,
+                           ThreadPool&     thePool) override;
+
+  //! Returns number of paths in flight.
+  int BatchSize() const { return myBatchSize; }
+
+  //! Sets number of paths in flight.
+  void SetBatchSize (int theSize) { myBatchSize = theSize < 1024 ? 1024 : theSize; }
+
+  //! Returns instruction set of BSDF kernels.
+  SimdIsa Isa() const { return myIsa; }
+
+  //! Sets instruction set of BSDF kernels (falls back to supported one).
+  void SetIsa (SimdIsa theIsa) { myIsa = theIsa; }
+
+  //! Returns true if rays are binned by BVH subtree before tracing.
+  bool IsRayReordering() const { return myToReorder; }
+
+  //! Enables binning of rays by BVH subtree (ignored for moving geometry).
+  void SetRayReordering (bool theToUse) { myToReorder = theToUse; }
+
+  //! Returns size of path state, queues and shading scratch in bytes.
+  virtual size_t MemorySize() const override;
+
+  //! Returns bytes of thread arena taken by one chunk of prefetched rays.
+  virtual size_t ArenaSize() const override;
+
+private:
+
+  //! Three-component vector stored as separate arrays.
+  struct SoaVec3
+  {
+    std::vector<float> X;
+    std::vector<float> Y;
+    std::vector<float> Z;
+
+    void Resize (size_t theSize) { X.resize (theSize); Y.resize (theSize); Z.resize (theSize); }
+
+    glm::vec3 Get (int theIdx) const { return glm::vec3 (X[theIdx], Y[theIdx], Z[theIdx]); }
+
+    void Set (int theIdx, const glm::vec3& theVec) { X[theIdx] = theVec.x; Y[theIdx] = theVec.y; Z[theIdx] = theVec.z; }
+
+    size_t MemorySize() const { return (X.size() + Y.size() + Z.size()) * sizeof (float); }
+  };
+
+  //! Range of sorted queue with hits of single material.
+  struct ShadeChunk
+  {
+    int Material;
+    int First;
+    int Last;
+  };
+
+  //! Range of subtree queue traced by single task.
+  struct TraceChunk
+  {
+    int Subtree;
+    int First;
+    int Last;
+  };
+
+  //! Per-thread buffers of the shade stage.
+  struct ShadeScratch
+  {
+    HitRecords                Records;
+    std::vector<PathState>    Paths;
+    std::vector<ShadingPoint> Points;
+    std::vector<uint8_t>      IsActive;
+  };
+
+  //! Returns recorded guide vertices of the path (NULL if not recording).
+  GuideVertex* guideVertices (int thePath) { return myGuideStride > 0 ? &myGuideVertices[thePath * myGuideStride] : NULL; }
+
+  //! Allocates buffers for current batch size and number of threads.
+  void allocate (int theNbThreads);
+
+  //! Builds tile-major order of pixels of active tiles of the framebuffer.
+  void updatePixelOrder (const Framebuffer& theFramebuffer);
+
+  //! Loads path from SoA buffers.
+  void loadPath (int thePath, PathState& theState);
+
+  //! Stores path into SoA buffers.
+  void storePath (int thePath, const PathState& theState);
+
+  //! Generates camera rays for batch of pixels.
+  void generate (const Scene& theScene, const Camera& theCamera, const Framebuffer& theFramebuffer, int theFirst, int theCount, ThreadPool& thePool);
+
+  //! Returns extension or shadow ray of the path.
+  Ray pathRay (int thePath, bool theIsShadow) const
+  {
+    return theIsShadow ? Ray (myShadowOrigin.Get (thePath), myShadowDirection.Get (thePath), 0.f, myShadowTmax[thePath], myRayTime[thePath])
+                       : Ray (myRayOrigin.Get (thePath), myRayDirection.Get (thePath), 0.f, FLT_MAX, myRayTime[thePath]);
+  }
+
+  //! Traces triangles for rays of the queued paths binned by BVH subtree. Closest hits are
+  //! stored into hit records (extension rays) or myIsOccluded (shadow rays); rays entering
+  //! too many subtrees are marked in myNbRaySubtrees (-1) and left for regular traversal.
+  void traceBySubtree (const Scene& theScene, const std::vector<int>& theQueue, int theCount, bool theIsShadow, ThreadPool& thePool);
+
+  //! Hints blocks of out-of-core BVH crossed by rays of the queued paths (shadow or extension rays).
+  void prefetch (const Scene& theScene, const std::vector<int>& theQueue, int theCount, bool theIsShadow, ThreadPool& thePool);
+
+  //! Traces active rays and stores closest hits.
+  void extend (const Scene& theScene, ThreadPool& thePool);
+
+  //! Sorts paths with hits into per-material queues and splits them into chunks.
+  void sortByMaterial (const Scene& theScene);
+
+  //! Shades queued hits and produces shadow and continuation rays.
+  void shade (const Scene& theScene, ThreadPool& thePool);
+
+  //! Traces shadow rays of the queued paths.
+  void shadow (const Scene& theScene, ThreadPool& thePool);
+
+  //! Compacts the list of active paths.
+  void compact();
+
+  //! Adds batch results to the framebuffer.
+  void accumulate (Framebuffer& theFramebuffer, int theCount, ThreadPool& thePool);
+
+private:
+
+  int     myBatchSize;
+  int     myAllocatedSize;
+  SimdIsa myIsa;
+  bool    myToReorder;
+
+  // Path state
+  SoaVec3                  myRayOrigin;
+  SoaVec3                  myRayDirection;
+  std::vector<float>       myRayTime;
+  SoaVec3                  myDiffOdx;
+  SoaVec3                  myDiffOdy;
+  SoaVec3                  myDiffDdx;
+  SoaVec3                  myDiffDdy;
+  SoaVec3                  myThroughput;
+  SoaVec3                  myRadiance;
+  std::vector<float>       myPrevPdf;
+  std::vector<int>         myDepth;
+  std::vector<int>         myPixel;
+  std::vector<uint8_t>     myIsSpecular;
+  std::vector<uint8_t>     myIsAlive;
+  std::vector<PathSampler> mySamplers;
+
+  // Vertices recorded for path guiding (MaxDepth per path)
+  std::vector<GuideVertex> myGuideVertices;
+  std::vector<int>         myNbGuideVertices;
+  int                      myGuideStride; //!< vertices per path (0 if not recording)
+
+  // First-hit AOVs
+  SoaVec3               myAlbedo;
+  SoaVec3               myNormal;
+  std::vector<float>    myHitDepth;
+#ifdef RAYLAB_COST_LAYERS
+  std::vector<PathCost> myCosts;
+#endif
+
+  // Hit records
+  std::vector<float>    myHitT;
+  std::vector<float>    myHitU;
+  std::vector<float>    myHitV;
+  std::vector<int>      myHitTriangle;
+
+  // Shadow rays
+  SoaVec3               myShadowOrigin;
+  SoaVec3               myShadowDirection;
+  SoaVec3               myShadowContribution;
+  std::vector<float>    myShadowTmax;
+  std::vector<int>      myShadowNbGuideVertices;
+  std::vector<uint8_t>  myIsShadowValid;
+
+  // Queues
+  std::vector<int>      myActive;       //!< paths to be extended
+  int                   myNbActive;
+  std::vector<int>      myQueue;        //!< paths with hits sorted by material
+  int                   myNbQueued;
+  std::vector<int>      myQueueOffsets; //!< start of each material queue
+  std::vector<int>      myQueueHeads;   //!< next free slot of each material queue while sorting
+  std::vector<int>      myPixelOrder;   //!< tile-major order of pixels
+
+  // Subtree queues (indexed by position in the traced queue)
+  std::vector<int>        myRaySubtrees;    //!< subtrees entered by each ray in traversal order
+  std::vector<float>      myRayEntries;     //!< entry distances of the subtrees
+  std::vector<int>        myNbRaySubtrees;  //!< number of entered subtrees (-1 - too many)
+  std::vector<float>      myRayTmax;        //!< distance of the closest hit found so far
+  std::vector<uint8_t>    myIsOccluded;     //!< shadow ray is blocked by triangle or shape
+  std::vector<int>        mySubtreeQueue;   //!< rays sorted by subtree of the current round
+  std::vector<int>        mySubtreeOffsets; //!< start of each subtree queue
+  std::vector<TraceChunk> myTraceChunks;
+
+  std::vector<ShadeChunk>   myShadeChunks;
+  std::vector<ShadeScratch> myScratch;
+
+  int              myPixelOrderSizeX;
+  int              myPixelOrderSizeY;
+  std::vector<int> myPixelOrderTiles; //!< active tiles of the pixel order
+
+};
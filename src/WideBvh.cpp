@@ -0,0 +1,259 @@
+#include "WideBvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+  //! Candidate child of wide node: subtree of binary hierarchy or range of primitive indices of its leaf.
+  struct WideItem
+  {
+    Box Bounds;
+    int Node;  //!< root of binary subtree or -1 for primitive range
+    int First; //!< first index of primitive range
+    int Count; //!< number of primitive references in subtree or range
+
+    //! Returns true if the item fits into leaf child (small subtrees are merged).
+    bool IsLeaf() const { return Count <= WideBvh::MaxLeafSize; }
+  };
+
+  //! Returns grid position of the coordinate rounded down (theIsMin) or up.
+  //! Rounding is checked with the same arithmetic as dequantization.
+  inline uint8_t Quantize (float theValue, float theOrigin, float theStep, bool theIsMin)
+  {
+    const float aGrid = (theValue - theOrigin) / theStep;
+
+    int aQuant = static_cast<int> (theIsMin ? std::floor (aGrid) : std::ceil (aGrid));
+    aQuant = std::min (std::max (aQuant, 0), 255);
+
+    if (theIsMin)
+    {
+      for (; aQuant > 0 && theOrigin + aQuant * theStep > theValue; --aQuant) {}
+    }
+    else
+    {
+      for (; aQuant < 255 && theOrigin + aQuant * theStep < theValue; ++aQuant) {}
+    }
+    return static_cast<uint8_t> (aQuant);
+  }
+}
+
+//=======================================================================
+//function : Clear
+//purpose  :
+//=======================================================================
+void WideBvh::Clear()
+{
+  myNodes.clear();
+  myIndices.clear();
+}
+
+//=======================================================================
+//function : Build
+//purpose  :
+//=======================================================================
+void WideBvh::Build (const Bvh& theBvh, const std::vector<Box>& theBoxes)
+{
+  Clear();
+
+  if (theBvh.IsEmpty())
+  {
+    return;
+  }
+
+  const std::vector<BvhNode>& aBinNodes   = theBvh.Nodes();
+  const std::vector<int>&     aBinIndices = theBvh.Indices();
+
+  // Small subtrees are merged into single leaf, so reference counts are accumulated bottom-up
+  std::vector<int> aCounts (aBinNodes.size(), 0);
+  {
+    std::vector<int> anOrder (1, 0);
+    for (size_t anIdx = 0; anIdx < anOrder.size(); ++anIdx)
+    {
+      const BvhNode& aNode = aBinNodes[anOrder[anIdx]];
+      if (!aNode.IsLeaf())
+      {
+        anOrder.push_back (aNode.LeftOrFirst);
+        anOrder.push_back (aNode.LeftOrFirst + 1);
+      }
+    }
+
+    for (size_t anIdx = anOrder.size(); anIdx-- > 0;)
+    {
+      const BvhNode& aNode = aBinNodes[anOrder[anIdx]];
+      aCounts[anOrder[anIdx]] = aNode.IsLeaf() ? aNode.Count : aCounts[aNode.LeftOrFirst] + aCounts[aNode.LeftOrFirst + 1];
+    }
+  }
+
+  auto aMakeItem = [&](int theNode)
+  {
+    WideItem anItem;
+    anItem.Bounds = aBinNodes[theNode].Bounds;
+    anItem.Node   = theNode;
+    anItem.First  = 0;
+    anItem.Count  = aCounts[theNode];
+    return anItem;
+  };
+
+  // Primitive ranges are split in halves bounded by primitive boxes
+  // clipped to the range (leaves of spatial splits hold clipped references)
+  auto aMakeRange = [&](const Box& theClip, int theFirst, int theCount)
+  {
+    WideItem anItem;
+    anItem.Node  = -1;
+    anItem.First = theFirst;
+    anItem.Count = theCount;
+    for (int anIdx = theFirst; anIdx < theFirst + theCount; ++anIdx)
+    {
+      anItem.Bounds.Add (theBoxes[aBinIndices[anIdx]]);
+    }
+
+    anItem.Bounds.Min = glm::max (anItem.Bounds.Min, theClip.Min);
+    anItem.Bounds.Max = glm::min (anItem.Bounds.Max, theClip.Max);
+    if (!anItem.Bounds.IsValid())
+    {
+      anItem.Bounds = theClip;
+    }
+    return anItem;
+  };
+
+  myNodes.reserve (aBinNodes.size() / 4 + 1);
+  myIndices.reserve (aBinIndices.size());
+
+  // Nodes are filled in breadth-first order, so that inner children
+  // of each node are allocated next to each other
+  std::vector<std::pair<int, WideItem> > aQueue (1, std::make_pair (0, aMakeItem (0)));
+  myNodes.resize (1);
+
+  for (size_t aTaskIdx = 0; aTaskIdx < aQueue.size(); ++aTaskIdx)
+  {
+    const int aNodeIdx = aQueue[aTaskIdx].first;
+
+    WideItem aChildren[8];
+    aChildren[0] = aQueue[aTaskIdx].second;
+    int aNbChildren = 1;
+
+    // Child with the largest area is opened until all slots are used
+    while (aNbChildren < 8)
+    {
+      int   aBest     = -1;
+      float aBestArea = -1.f;
+      for (int aChild = 0; aChild < aNbChildren; ++aChild)
+      {
+        if (!aChildren[aChild].IsLeaf() && aChildren[aChild].Bounds.Area() > aBestArea)
+        {
+          aBest     = aChild;
+          aBestArea = aChildren[aChild].Bounds.Area();
+        }
+      }
+
+      if (aBest == -1)
+      {
+        break;
+      }
+
+      const WideItem anOpened = aChildren[aBest];
+      if (anOpened.Node >= 0 && !aBinNodes[anOpened.Node].IsLeaf())
+      {
+        aChildren[aBest]         = aMakeItem (aBinNodes[anOpened.Node].LeftOrFirst);
+        aChildren[aNbChildren++] = aMakeItem (aBinNodes[anOpened.Node].LeftOrFirst + 1);
+      }
+      else
+      {
+        const int aFirst = anOpened.Node >= 0 ? aBinNodes[anOpened.Node].LeftOrFirst : anOpened.First;
+        const int aHalf  = anOpened.Count / 2;
+        aChildren[aBest]         = aMakeRange (anOpened.Bounds, aFirst, aHalf);
+        aChildren[aNbChildren++] = aMakeRange (anOpened.Bounds, aFirst + aHalf, anOpened.Count - aHalf);
+      }
+    }
+
+    const int aChildBase = static_cast<int> (myNodes.size());
+
+    int aNbInner = 0;
+    Box aBounds;
+    for (int aChild = 0; aChild < aNbChildren; ++aChild)
+    {
+      aNbInner += aChildren[aChild].IsLeaf() ? 0 : 1;
+      aBounds.Add (aChildren[aChild].Bounds);
+    }
+    myNodes.resize (myNodes.size() + aNbInner);
+
+    WideBvhNode& aNode = myNodes[aNodeIdx];
+    aNode = WideBvhNode();
+
+    aNode.Origin    = aBounds.Min;
+    aNode.ChildBase = aChildBase;
+    aNode.PrimBase  = static_cast<int> (myIndices.size());
+
+    // Smallest power of two step covering the node extent with 255 cells
+    for (int anAxis = 0; anAxis < 3; ++anAxis)
+    {
+      int anExp = -126;
+      const float anExtent = aBounds.Max[anAxis] - aBounds.Min[anAxis];
+      if (anExtent > 0.f)
+      {
+        std::frexp (anExtent / 255.f, &anExp);
+        anExp = std::max (anExp, -126);
+      }
+
+      aNode.Exponent[anAxis] = static_cast<int8_t> (anExp);
+      while (anExp < 127 && aNode.Origin[anAxis] + 255.f * aNode.Step (anAxis) < aBounds.Max[anAxis])
+      {
+        aNode.Exponent[anAxis] = static_cast<int8_t> (++anExp);
+      }
+    }
+
+    int aNbLeafPrims = 0;
+    int aRank = 0;
+    for (int aSlot = 0; aSlot < aNbChildren; ++aSlot)
+    {
+      const WideItem& aChild = aChildren[aSlot];
+      for (int anAxis = 0; anAxis < 3; ++anAxis)
+      {
+        aNode.QMin[anAxis][aSlot] = Quantize (aChild.Bounds.Min[anAxis], aNode.Origin[anAxis], aNode.Step (anAxis), true);
+        aNode.QMax[anAxis][aSlot] = Quantize (aChild.Bounds.Max[anAxis], aNode.Origin[anAxis], aNode.Step (anAxis), false);
+      }
+
+      if (aChild.IsLeaf())
+      {
+        aNode.Meta[aSlot] = static_cast<uint8_t> ((aChild.Count << 5) | aNbLeafPrims);
+        aNbLeafPrims += aChild.Count;
+
+        if (aChild.Node < 0)
+        {
+          myIndices.insert (myIndices.end(), aBinIndices.begin() + aChild.First, aBinIndices.begin() + aChild.First + aChild.Count);
+          continue;
+        }
+
+        // Gather references of binary leaves under the merged subtree
+        int aStack[Bvh::MaxDepth];
+        int aHead = 0;
+        for (int aBinNode = aChild.Node;;)
+        {
+          const BvhNode& aLeaf = aBinNodes[aBinNode];
+          if (!aLeaf.IsLeaf())
+          {
+            aStack[aHead++] = aLeaf.LeftOrFirst + 1;
+            aBinNode = aLeaf.LeftOrFirst;
+            continue;
+          }
+
+          myIndices.insert (myIndices.end(), aBinIndices.begin() + aLeaf.LeftOrFirst, aBinIndices.begin() + aLeaf.LeftOrFirst + aLeaf.Count);
+          if (aHead == 0)
+          {
+            break;
+          }
+          aBinNode = aStack[--aHead];
+        }
+      }
+      else
+      {
+        aNode.Meta[aSlot] = static_cast<uint8_t> (1 + aRank);
+        aNode.InnerMask |= static_cast<uint8_t> (1 << aSlot);
+        aQueue.push_back (std::make_pair (aChildBase + aRank, aChild));
+        ++aRank;
+      }
+    }
+  }
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Bvh.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  #include <emmintrin.h>
+  #define RAYLAB_WIDE_BVH_SSE
+#endif
+
+//! Compressed node of 8-wide BVH (80 bytes, Ylitie et al., "Efficient incoherent
+//! ray traversal on GPUs through compressed wide BVHs", 2017). Child boxes are
+//! stored as 8-bit offsets on the grid spanned by the node bounds. Inner children
+//! are stored next to each other, primitives of leaf children too.
+struct WideBvhNode
+{
+  glm::vec3 Origin;      //!< minimum corner of the quantization grid
+  int8_t    Exponent[3]; //!< grid step along each axis is 2^Exponent
+  uint8_t   InnerMask;   //!< bit of each child slot holding inner node
+  int       ChildBase;   //!< index of the first inner child
+  int       PrimBase;    //!< first primitive index of leaf children
+  uint8_t   Meta[8];     //!< 0 - empty slot, inner: 1 + offset from ChildBase, leaf: count << 5 | offset from PrimBase (below 32)
+  uint8_t   QMin[3][8];  //!< quantized minimum corners of child boxes per axis
+  uint8_t   QMax[3][8];  //!< quantized maximum corners of child boxes per axis
+
+  //! Returns grid step along the axis.
+  float Step (int theAxis) const
+  {
+    const uint32_t aBits = static_cast<uint32_t> (Exponent[theAxis] + 127) << 23;
+    float aStep;
+    std::memcpy (&aStep, &aBits, sizeof (aStep));
+    return aStep;
+  }
+
+  //! Returns conservative box of the child slot.
+  Box ChildBounds (int theSlot) const
+  {
+    const glm::vec3 aStep (Step (0), Step (1), Step (2));
+    return Box (Origin + glm::vec3 (QMin[0][theSlot], QMin[1][theSlot], QMin[2][theSlot]) * aStep,
+                Origin + glm::vec3 (QMax[0][theSlot], QMax[1][theSlot], QMax[2][theSlot]) * aStep);
+  }
+};
+
+//! Compressed 8-wide BVH collapsed from binary hierarchy. Takes about 3 bytes per
+//! primitive reference instead of about 16 for binary nodes, leaves hold up to 4 primitives.
+//! Boxes of all children are dequantized and tested at once with SSE.
+class WideBvh
+{
+public:
+
+  //! Size of traversal stack (up to 7 entries are left per level,
+  //! splitting of large binary leaves adds up to 32 levels).
+  static const int MaxStack = 8 * (Bvh::MaxDepth + 32);
+
+  //! Maximum number of primitives in leaf child.
+  static const int MaxLeafSize = 4;
+
+  //! Creates empty hierarchy.
+  WideBvh() {}
+
+  //! Collapses binary hierarchy built over theBoxes. Children are chosen greedily
+  //! by opening the largest node, subtrees with up to MaxLeafSize references are merged
+  //! into leaves and larger binary leaves are split.
+  void Build (const Bvh& theBvh, const std::vector<Box>& theBoxes);
+
+  //! Releases all data.
+  void Clear();
+
+  //! Returns true if hierarchy is empty.
+  bool IsEmpty() const { return myNodes.empty(); }
+
+  //! Returns hierarchy nodes (root is the first one).
+  const std::vector<WideBvhNode>& Nodes() const { return myNodes; }
+
+  //! Returns primitive indices referenced by leaves.
+  const std::vector<int>& Indices() const { return myIndices; }
+
+  //! Returns size of nodes and indices in bytes.
+  size_t MemorySize() const { return myNodes.size() * sizeof (WideBvhNode) + myIndices.size() * sizeof (int); }
+
+public:
+
+  //! Intersects ray with all child boxes of the node. Returns mask of hit slots,
+  //! entry distances are written into theTimes.
+  static int IntersectChildren (const WideBvhNode& theNode,
+                                const glm::vec3&   theOrigin,
+                                const glm::vec3&   theInvDir,
+                                float              theTmin,
+                                float              theTmax,
+                                float*             theTimes)
+  {
+    // Near plane of the child slab is the minimum corner for positive direction
+    const uint8_t* aNear[3];
+    const uint8_t* aFar[3];
+    for (int anAxis = 0; anAxis < 3; ++anAxis)
+    {
+      aNear[anAxis] = theInvDir[anAxis] >= 0.f ? theNode.QMin[anAxis] : theNode.QMax[anAxis];
+      aFar[anAxis]  = theInvDir[anAxis] >= 0.f ? theNode.QMax[anAxis] : theNode.QMin[anAxis];
+    }
+
+  #ifdef RAYLAB_WIDE_BVH_SSE
+    const __m128i aZero = _mm_setzero_si128();
+
+    __m128 aNearLo = _mm_set1_ps (theTmin), aNearHi = aNearLo;
+    __m128 aFarLo  = _mm_set1_ps (theTmax), aFarHi  = aFarLo;
+
+    for (int anAxis = 0; anAxis < 3; ++anAxis)
+    {
+      const __m128 aStep = _mm_set1_ps (theNode.Step (anAxis) * theInvDir[anAxis]);
+      const __m128 aBase = _mm_set1_ps ((theNode.Origin[anAxis] - theOrigin[anAxis]) * theInvDir[anAxis]);
+
+      const __m128i aNearQ = _mm_unpacklo_epi8 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (aNear[anAxis])), aZero);
+      const __m128i aFarQ  = _mm_unpacklo_epi8 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (aFar[anAxis])),  aZero);
+
+      // Zero direction component gives 0 * inf = NaN for planes at the ray origin; min/max
+      // return the second operand if any is NaN, so the accumulator is passed second
+      aNearLo = _mm_max_ps (_mm_add_ps (aBase, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (aNearQ, aZero)), aStep)), aNearLo);
+      aNearHi = _mm_max_ps (_mm_add_ps (aBase, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (aNearQ, aZero)), aStep)), aNearHi);
+      aFarLo  = _mm_min_ps (_mm_add_ps (aBase, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (aFarQ,  aZero)), aStep)), aFarLo);
+      aFarHi  = _mm_min_ps (_mm_add_ps (aBase, _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (aFarQ,  aZero)), aStep)), aFarHi);
+    }
+
+    _mm_storeu_ps (theTimes,     aNearLo);
+    _mm_storeu_ps (theTimes + 4, aNearHi);
+
+    const int aHits = _mm_movemask_ps (_mm_cmple_ps (aNearLo, aFarLo))
+                   | (_mm_movemask_ps (_mm_cmple_ps (aNearHi, aFarHi)) << 4);
+    const int anEmpty = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (theNode.Meta)), aZero));
+
+    return aHits & ~anEmpty & 0xFF;
+  #else
+    int aHits = 0;
+    for (int aSlot = 0; aSlot < 8; ++aSlot)
+    {
+      float aTnear = theTmin;
+      float aTfar  = theTmax;
+      for (int anAxis = 0; anAxis < 3; ++anAxis)
+      {
+        const float aStep = theNode.Step (anAxis) * theInvDir[anAxis];
+        const float aBase = (theNode.Origin[anAxis] - theOrigin[anAxis]) * theInvDir[anAxis];
+
+        aTnear = glm::max (aTnear, aBase + aNear[anAxis][aSlot] * aStep);
+        aTfar  = glm::min (aTfar,  aBase + aFar [anAxis][aSlot] * aStep);
+      }
+
+      theTimes[aSlot] = aTnear;
+      if (aTnear <= aTfar && theNode.Meta[aSlot] != 0)
+      {
+        aHits |= 1 << aSlot;
+      }
+    }
+    return aHits;
+  #endif
+  }
+
+  //! Traverses the hierarchy in front-to-back order with the same leaf callback as
+  //! Bvh::Traverse(). Visited wide nodes and primitives of reached leaves are counted
+  //! into theStats (optional).
+  template<class LeafFunc>
+  void Traverse (const Ray& theRay, float& theTmax, LeafFunc& theLeaf, TraversalStats* theStats = NULL) const
+  {
+    if (myNodes.empty())
+    {
+      return;
+    }
+
+    const glm::vec3 anInvDir (1.f / theRay.Direction.x,
+                              1.f / theRay.Direction.y,
+                              1.f / theRay.Direction.z);
+
+    StackItem aStack[MaxStack];
+    int aHead = 0;
+
+    for (int aNode = 0;;)
+    {
+      const WideBvhNode& aCurrent = myNodes[aNode];
+
+      if (theStats != NULL)
+      {
+        ++theStats->NbNodes;
+      }
+
+      float aTimes[8];
+      const int aHits = IntersectChildren (aCurrent, theRay.Origin, anInvDir, theRay.Tmin, theTmax, aTimes);
+
+      // Hit children are pushed from far to near, so the nearest one is popped first
+      int aSlots[8];
+      int aNbHits = 0;
+      for (int aSlot = 0; aSlot < 8; ++aSlot)
+      {
+        if ((aHits & (1 << aSlot)) == 0)
+        {
+          continue;
+        }
+
+        int aPos = aNbHits++;
+        for (; aPos > 0 && aTimes[aSlots[aPos - 1]] < aTimes[aSlot]; --aPos)
+        {
+          aSlots[aPos] = aSlots[aPos - 1];
+        }
+        aSlots[aPos] = aSlot;
+      }
+
+      for (int aHitIdx = 0; aHitIdx < aNbHits; ++aHitIdx)
+      {
+        const int     aSlot = aSlots[aHitIdx];
+        const uint8_t aMeta = aCurrent.Meta[aSlot];
+
+        StackItem& anItem = aStack[aHead++];
+        anItem.T = aTimes[aSlot];
+        if (aCurrent.InnerMask & (1 << aSlot))
+        {
+          anItem.Index = aCurrent.ChildBase + aMeta - 1;
+          anItem.Count = 0;
+        }
+        else
+        {
+          anItem.Index = aCurrent.PrimBase + (aMeta & 31);
+          anItem.Count = aMeta >> 5;
+        }
+      }
+
+      aNode = -1;
+      while (aHead > 0)
+      {
+        const StackItem& anItem = aStack[--aHead];
+        if (anItem.T > theTmax)
+        {
+          continue;
+        }
+
+        if (anItem.Count == 0)
+        {
+          aNode = anItem.Index;
+          break;
+        }
+
+        if (theStats != NULL)
+        {
+          theStats->NbPrimitives += anItem.Count;
+        }
+
+        if (theLeaf (anItem.Index, anItem.Count, theTmax))
+        {
+          return;
+        }
+      }
+
+      if (aNode == -1)
+      {
+        return;
+      }
+    }
+  }
+
+private:
+
+  //! Entry of traversal stack.
+  struct StackItem
+  {
+    int   Index; //!< node index or first primitive index of leaf
+    int   Count; //!< number of leaf primitives (0 for inner node)
+    float T;     //!< entry distance of child box
+  };
+
+private:
+
+  std::vector<WideBvhNode> myNodes;
+  std::vector<int>         myIndices;
+
+};
@@ -6,10 +6,14 @@
 #include <imgui.h>
 #include "imgui_impl_glfw_gl3.h"
 #include <stdio.h>
+#include <algorithm>
 #include <GL/gl3w.h>    // This example is using gl3w to access OpenGL functions (because it is small). You may use glew/glad/glLoadGen/etc. whatever already works for you.
 #include <GLFW/glfw3.h>
 
 #include "AppGui.hpp"
+#include "Benchmark.hpp"
+#include "Renderer.hpp"
+#include "RenderView.hpp"
 
 #include "TestCube.h"
 
@@ -81,8 +85,20 @@ void handleMouseKeypress (GLFWwindow* window, int theButton, int theAction, int
   }
 }
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    // Headless benchmark mode
+    if (Benchmark::IsRequested (argc, argv))
+    {
+        Benchmark benchmark;
+        if (!benchmark.Parse (argc, argv))
+        {
+            Benchmark::PrintUsage ();
+            return 1;
+        }
+        return benchmark.Run ();
+    }
+
     // Setup window
     glfwSetErrorCallback(error_callback);
     if (!glfwInit())
@@ -126,6 +142,16 @@ int main(int, char**)
 
     AppGui gui;
 
+    // Create renderer and view displaying its framebuffer
+
+    Renderer renderer;
+    gui.SetRenderer (&renderer);
+
+    RenderView* render_view = new RenderView();
+    render_view->Init ("Screen_Vert.glsl", "Screen_Frag.glsl");
+
+    int scene_revision = renderer.SceneRevision ();
+
     // Create test cube
 
     TestCube* cube = new TestCube();
@@ -167,6 +193,29 @@ int main(int, char**)
 
             ImGui::Spacing();
             ImGui::Text("%.3f ms/frame\n%.1f FPS", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+            if (!renderer.CurrentScene ().IsEmpty ())
+            {
+                ImGui::Text("%d spp, %.1f ms/pass\n%.2f Mrays/s", renderer.Accumulator ().NbPasses (), renderer.LastPassTime (),
+                            renderer.LastPassRays () / (std::max (renderer.LastPassTime (), 1.0e-3) * 1.0e3));
+
+                // Traversal is measured for camera and bounce rays only
+                const RayStats& ray_stats = renderer.LastPassStats ();
+                const double traced = static_cast<double> (std::max<uint64_t> (ray_stats.NbCameraRays + ray_stats.NbBounceRays, 1));
+                ImGui::Text("%.2f / %.2f / %.2f M camera/bounce/shadow\n%.1f nodes, %.1f tris per ray\n%.2f M shading calls\n%.2f Msamples/s",
+                            ray_stats.NbCameraRays * 1.0e-6, ray_stats.NbBounceRays * 1.0e-6, ray_stats.NbShadowRays * 1.0e-6,
+                            ray_stats.NbNodes / traced, ray_stats.NbTriangles / traced, ray_stats.NbShadingCalls * 1.0e-6,
+                            ray_stats.NbSamples () / (std::max (renderer.LastPassTime (), 1.0e-3) * 1.0e3));
+
+                // Current camera becomes the shutter close pose, moving it afterwards blurs the motion
+                bool camera_motion = renderer.HasCameraMotion ();
+                if (ImGui::Checkbox("Camera motion blur", &camera_motion))
+                {
+                    if (camera_motion)
+                        renderer.SetCameraEnd (camera);
+                    else
+                        renderer.ClearCameraEnd ();
+                }
+            }
             ImGui::End();
         }
 
@@ -183,12 +232,31 @@ int main(int, char**)
         glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // Frame newly loaded scene
+        if (scene_revision != renderer.SceneRevision ())
+        {
+            scene_revision = renderer.SceneRevision ();
+            renderer.FitCamera (camera);
+        }
+
         glm::mat4 model, view, projection;
         camera.SetViewport (0, 0, display_w, display_h);
         camera.Update();
         camera.GetMatricies (projection, view, model);
 
-        cube->Draw (projection, view);
+        if (renderer.RenderPass (camera))
+        {
+            render_view->Update (renderer.Accumulator (), renderer.DisplayLayer ());
+            render_view->Draw (renderer.Exposure ());
+        }
+        else
+        {
+            cube->Draw (projection, view);
+        }
+
+        // Viewer memory: displayed layer and font atlas (RGBA32)
+        renderer.ChangeMemory ().Set (MemoryTag_Ui, render_view->MemorySize ()
+                                    + static_cast<size_t> (ImGui::GetIO ().Fonts->TexWidth) * ImGui::GetIO ().Fonts->TexHeight * 4);
 
         //
 
@@ -199,6 +267,8 @@ int main(int, char**)
     }
 
     // Cleanup
+    delete render_view;
+
     ImGui_ImplGlfwGL3_Shutdown();
     glfwTerminate();
 